@@ -21,7 +21,6 @@
 #include <libdigiapix/gpio.h>
 #include <stdio.h>
 #include <stdint.h>
-#include <time.h>
 
 #include "data_points.h"
 
@@ -36,6 +35,8 @@
 
 #define DATA_STREAM_BUTTON_UNITS	"state"
 
+#define CSV_BUFFER_SIZE				1024
+
 #define MONITOR_TAG					"MON:"
 
 /*------------------------------------------------------------------------------
@@ -44,14 +45,21 @@
 /**
  * button_cb_data_t - Data for button interrupt
  *
- * @button:			GPIO button.
- * @dp_collection:	Collection of data points to store the button value.
+ * @button:				GPIO button.
+ * @dp_collection:		Collection of data points to store the button value.
+ * @value:				Last button value.
+ * @num_samples_upload:	Number of samples to collect before uploading them.
+ * @csv:				Samples of the collection in CSV format, to store them
+ *						in the data spool if they cannot be uploaded.
+ * @csv_len:			Length of the CSV samples.
  */
 typedef struct {
 	gpio_t *button;
 	ccapi_dp_collection_handle_t dp_collection;
 	gpio_value_t value;
 	uint32_t num_samples_upload;
+	char csv[CSV_BUFFER_SIZE];
+	size_t csv_len;
 } button_cb_data_t;
 
 /*------------------------------------------------------------------------------
@@ -61,8 +69,8 @@ static ccapi_dp_error_t init_monitor(ccapi_dp_collection_handle_t *dp_collection
 static gpio_t *get_user_button(void);
 static int button_interrupt_cb(void *arg);
 static void add_button_sample(button_cb_data_t *data);
-static ccapi_timestamp_t *get_timestamp(void);
-static void free_timestamp(ccapi_timestamp_t *timestamp);
+static void add_button_sample_csv(button_cb_data_t *data, uint64_t timestamp_ms);
+static void send_button_samples(button_cb_data_t *data);
 
 /*------------------------------------------------------------------------------
                                   M A C R O S
@@ -125,6 +133,7 @@ int start_monitoring(void)
 
 	cb_data.value = GPIO_HIGH;
 	cb_data.num_samples_upload = 2;
+	cb_data.csv_len = 0;
 
 	if (ldx_gpio_start_wait_interrupt(cb_data.button, &button_interrupt_cb, &cb_data) != EXIT_SUCCESS) {
 		log_mon_error("Error initalizing app monitor: Unable to capture %s interrupts", USER_BUTTON_ALIAS);
@@ -189,7 +198,7 @@ static ccapi_dp_error_t init_monitor(ccapi_dp_collection_handle_t *dp_collection
 	}
 
 	dp_error = ccapi_dp_add_data_stream_to_collection_extra(*dp_collection,
-			DATA_STREAM_USER_BUTTON, "int32 ts_iso", DATA_STREAM_BUTTON_UNITS, NULL);
+			DATA_STREAM_USER_BUTTON, "int32 ts_epoch_ms", DATA_STREAM_BUTTON_UNITS, NULL);
 	if (dp_error != CCAPI_DP_ERROR_NONE) {
 		log_mon_error("Cannot add '%s' stream to data point collection, error %d",
 					DATA_STREAM_USER_BUTTON, dp_error);
@@ -246,13 +255,14 @@ static void add_button_sample(button_cb_data_t *data)
 {
 	ccapi_dp_error_t dp_error;
 	uint32_t count = 0;
-	ccapi_timestamp_t *timestamp = get_timestamp();
+	ccapi_timestamp_t timestamp = { 0 };
 
+	/* Milliseconds resolution, close edges must not share the timestamp. */
+	timestamp.epoch_msec = get_timestamp_ms();
 	data->value = data->value ? GPIO_LOW : GPIO_HIGH;
 
 	dp_error = ccapi_dp_add(data->dp_collection, DATA_STREAM_USER_BUTTON,
-			data->value, timestamp);
-	free_timestamp(timestamp);
+			data->value, &timestamp);
 	if (dp_error != CCAPI_DP_ERROR_NONE) {
 		log_mon_error("Cannot add user_button value, %d", dp_error);
 		return;
@@ -260,65 +270,73 @@ static void add_button_sample(button_cb_data_t *data)
 		log_mon_debug("user_button = %d %s", data->value, DATA_STREAM_BUTTON_UNITS);
 	}
 
-	ccapi_dp_get_collection_points_count(data->dp_collection, &count);
-	if (count >= data->num_samples_upload) {
-		log_mon_debug("Sending %s samples", USER_BUTTON_ALIAS);
+	add_button_sample_csv(data, timestamp.epoch_msec);
 
-		dp_error = ccapi_dp_send_collection(CCAPI_TRANSPORT_TCP, data->dp_collection);
-		if (dp_error != CCAPI_DP_ERROR_NONE) {
-			log_mon_error("Error sending monitor samples, %d", dp_error);
-			ccapi_dp_get_collection_points_count(data->dp_collection, &count);
-		}
-	}
+	ccapi_dp_get_collection_points_count(data->dp_collection, &count);
+	if (count >= data->num_samples_upload)
+		send_button_samples(data);
 }
 
 /*
- * get_timestamp() - Get the current timestamp of the system
+ * add_button_sample_csv() - Add USER_BUTTON value to the CSV samples
  *
- * Return: The timestamp of the system.
+ * @data:			Button interrupt data (button_cb_data_t).
+ * @timestamp_ms:	Timestamp of the sample, in milliseconds since the Epoch.
+ *
+ * The line uses the default Remote Manager CSV data point fields order: DATA,
+ * TIMESTAMP, QUALITY, DESCRIPTION, LOCATION, DATATYPE, UNITS, FORWARDTO,
+ * STREAMID.
  */
-static ccapi_timestamp_t *get_timestamp(void)
+static void add_button_sample_csv(button_cb_data_t *data, uint64_t timestamp_ms)
 {
-	ccapi_timestamp_t *timestamp = NULL;
-	size_t len = strlen("2016-09-27T07:07:09.546Z") + 1;
-	char *date = NULL;
-	time_t now;
-
-	timestamp = (ccapi_timestamp_t*) malloc(sizeof (ccapi_timestamp_t));
-	if (timestamp == NULL)
-		return NULL;
-
-	date = (char*) malloc(sizeof (char) * len);
-	if (date == NULL) {
-		free(timestamp);
-		return NULL;
-	}
-
-	time(&now);
-	if (strftime(date, len, "%FT%TZ", gmtime(&now)) > 0) {
-		timestamp->iso8601 = date;
-	} else {
-		free(date);
-		timestamp->iso8601 = strdup("");
+	size_t available = sizeof(data->csv) - data->csv_len;
+	int len;
+
+	len = snprintf(data->csv + data->csv_len, available, "%d,%lld,,,,INTEGER,%s,,%s\n",
+			data->value, (long long) timestamp_ms,
+			DATA_STREAM_BUTTON_UNITS, DATA_STREAM_USER_BUTTON);
+	if (len < 0 || (size_t) len >= available) {
+		/* Keep only complete lines. */
+		data->csv[data->csv_len] = '\0';
+		return;
 	}
 
-	return timestamp;
+	data->csv_len += len;
 }
 
 /*
- * free_timestamp() - Free given timestamp structure
+ * send_button_samples() - Upload the USER_BUTTON samples
+ *
+ * @data:	Button interrupt data (button_cb_data_t).
  *
- * @timestamp:	The timestamp structure to release.
+ * If the samples cannot be uploaded, they are stored in the Cloud Connector
+ * data spool to upload them once the connection is restored.
  */
-static void free_timestamp(ccapi_timestamp_t *timestamp)
+static void send_button_samples(button_cb_data_t *data)
 {
-	if (timestamp == NULL)
+	ccapi_dp_error_t dp_error = CCAPI_DP_ERROR_NONE;
+
+	if (get_cloud_connection_status() == CC_STATUS_CONNECTED || !is_spool_enabled()) {
+		log_mon_debug("Sending %s samples", USER_BUTTON_ALIAS);
+
+		dp_error = ccapi_dp_send_collection(CCAPI_TRANSPORT_TCP, data->dp_collection);
+		if (dp_error == CCAPI_DP_ERROR_NONE) {
+			data->csv_len = 0;
+			return;
+		}
+		log_mon_error("Error sending monitor samples, %d", dp_error);
+	}
+
+	if (data->csv_len == 0 || !is_spool_enabled())
 		return;
 
-	if (timestamp->iso8601 != NULL) {
-		free((char *) timestamp->iso8601);
-		timestamp->iso8601 = NULL;
+	if (spool_data(SPOOL_RECORD_DP_CSV, SPOOL_DP_CSV_CLOUD_PATH,
+			data->csv, data->csv_len) != SPOOL_ERROR_NONE) {
+		log_mon_error("Cannot store %s samples", USER_BUTTON_ALIAS);
+		return;
 	}
-	free(timestamp);
-	timestamp = NULL;
+
+	log_mon_debug("%s samples stored in the data spool", USER_BUTTON_ALIAS);
+	ccapi_dp_clear_collection(data->dp_collection);
+	data->csv_len = 0;
 }
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/*
+ * Cloud control socket of cc-bench-daemon
+ *
+ * cc-bench-daemon replaces Remote Manager with a stub of CCAPI. cc-bench
+ * connects to its cloud control socket to play the role of Remote Manager,
+ * using the framing of the local services protocol (v1):
+ *
+ * - BENCH_CMD_REQUEST, target (string), payload (blob): the stub delivers a
+ *   device request to the target and answers the response (blob) once the
+ *   status of the response was reported to the application.
+ * - BENCH_CMD_STATS: the stub answers its counters since it started as a
+ *   string of "<name> <count>" lines: BENCH_STAT_* and, for every counted
+ *   system call, BENCH_STAT_SYSCALL_PREFIX followed by its name.
+ */
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define BENCH_CLOUD_SOCKET		"/tmp/cc-bench-cloud.sock"
+
+#define BENCH_CMD_REQUEST		"request"
+#define BENCH_CMD_STATS			"stats"
+
+#define BENCH_STAT_ALLOCATIONS	"allocations"
+#define BENCH_STAT_UPLOADS		"uploads"
+#define BENCH_STAT_BYTES		"bytes"
+#define BENCH_STAT_POINTS		"points"
+#define BENCH_STAT_SYSCALL_PREFIX	"syscall."
+
+#endif /* BENCH_H_ */
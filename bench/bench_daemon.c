@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "ccapi_stub.h"
+#include "cc_logging.h"
+#include "counters.h"
+#include "services.h"
+#include "services_util.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define VERSION		"0.1" GIT_REVISION
+
+#define USAGE \
+	"Local services of Cloud Connector with a stub of Remote Manager.\n" \
+	"Copyright(c) Digi International Inc.\n" \
+	"\n" \
+	"Version: %s\n" \
+	"\n" \
+	"Usage: %s [options]\n\n" \
+	"  -s  --socket=<PATH>           Unix domain socket for local requests\n" \
+	"                                (default /tmp/cc-bench.sock)\n" \
+	"  -t  --tcp                     Also listen on the TCP loopback port\n" \
+	"  -c  --cloud-socket=<PATH>     Cloud control socket used by cc-bench\n" \
+	"                                (default " BENCH_CLOUD_SOCKET ")\n" \
+	"  -w  --workers=<N>             Threads attending local requests (default 4)\n" \
+	"  -l  --latency=<MS>            Simulated round trip to Remote Manager\n" \
+	"                                (default 0)\n" \
+	"  -W  --coalesce-window=<MS>    Window to merge data point uploads\n" \
+	"                                (default 0, disabled)\n" \
+	"  -r  --rings=<N>               Maximum data point rings (default 4)\n" \
+	"  -v  --verbose                 Log debug messages\n" \
+	"  -h  --help                    Print help and exit\n" \
+	"\n"
+
+#define DEFAULT_SOCKET		"/tmp/cc-bench.sock"
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static int listen_cloud_socket(const char *path);
+static void *attend_cloud_client(void *arg);
+static void signal_handler(int signum);
+static void usage(char const *const name);
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static volatile sig_atomic_t stop = 0;
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	int result = EXIT_SUCCESS;
+	char *name = basename(argv[0]);
+	static int opt, opt_index;
+	int log_level = LOG_WARNING;
+	const char *cloud_socket = BENCH_CLOUD_SOCKET;
+	int cloud_fd = -1;
+	cc_cfg_t cc_cfg = {
+		.local_backlog = 64,
+		.local_workers = 4,
+		.local_tcp = CCAPI_FALSE,
+		.local_socket = DEFAULT_SOCKET,
+		.local_max_value = 16384,
+		.local_max_memory = 65536,
+		.local_staging_path = "/tmp",
+		.local_max_upload = 16384,
+		.local_coalesce_window = 0,
+		.local_coalesce_size = 64,
+		.local_max_rings = 4
+	};
+	struct sigaction action;
+	static const char *short_options = "s:tc:w:l:W:r:vh";
+	static const struct option long_options[] = {
+			{"socket", required_argument, NULL, 's'},
+			{"tcp", no_argument, NULL, 't'},
+			{"cloud-socket", required_argument, NULL, 'c'},
+			{"workers", required_argument, NULL, 'w'},
+			{"latency", required_argument, NULL, 'l'},
+			{"coalesce-window", required_argument, NULL, 'W'},
+			{"rings", required_argument, NULL, 'r'},
+			{"verbose", no_argument, NULL, 'v'},
+			{"help", no_argument, NULL, 'h'},
+			{NULL, 0, NULL, 0}
+	};
+
+	while (1) {
+		opt = getopt_long(argc, argv, short_options, long_options,
+				&opt_index);
+		if (opt == -1)
+			break;
+
+		switch (opt) {
+		case 's':
+			cc_cfg.local_socket = optarg;
+			break;
+		case 't':
+			cc_cfg.local_tcp = CCAPI_TRUE;
+			break;
+		case 'c':
+			cloud_socket = optarg;
+			break;
+		case 'w':
+			cc_cfg.local_workers = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			stub_set_latency(strtoul(optarg, NULL, 10));
+			break;
+		case 'W':
+			cc_cfg.local_coalesce_window = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			cc_cfg.local_max_rings = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			log_level = LOG_DEBUG;
+			break;
+		case 'h':
+			usage(name);
+			return EXIT_SUCCESS;
+		default:
+			usage(name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (cc_cfg.local_workers < 1) {
+		fprintf(stderr, "%s\n", "Invalid number of workers");
+		return EXIT_FAILURE;
+	}
+
+	init_logger(log_level, LOG_CONS | LOG_NDELAY | LOG_PID | LOG_PERROR);
+
+	/* Threads of the local services count, this one serves the stub */
+	counters_pause(true);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = signal_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	cloud_fd = listen_cloud_socket(cloud_socket);
+	if (cloud_fd < 0) {
+		result = EXIT_FAILURE;
+		goto done;
+	}
+
+	start_listening_for_local_requests(&cc_cfg);
+
+	while (!stop) {
+		struct pollfd pfd = {
+			.fd = cloud_fd,
+			.events = POLLIN
+		};
+		pthread_attr_t attr;
+		pthread_t thread;
+		long fd;
+
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+
+		fd = accept4(cloud_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&thread, &attr, attend_cloud_client, (void *) fd) != 0)
+			close((int) fd);
+		pthread_attr_destroy(&attr);
+	}
+
+	stop_listening_for_local_requests();
+
+done:
+	if (cloud_fd >= 0) {
+		close(cloud_fd);
+		unlink(cloud_socket);
+	}
+	closelog();
+
+	return result;
+}
+
+/*
+ * listen_cloud_socket() - Listen on the cloud control socket
+ *
+ * @path:	Unix domain socket to listen on, an existing file is replaced.
+ *
+ * Return: The listening socket, -1 on error.
+ */
+static int listen_cloud_socket(const char *path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX
+	};
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		log_error("Invalid cloud control socket '%s'", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		log_error("Cannot create cloud control socket: %s", strerror(errno));
+		return -1;
+	}
+
+	unlink(path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+		log_error("Cannot listen on '%s': %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * attend_cloud_client() - Attend the commands of a cloud control connection
+ *
+ * @arg:	The accepted connection.
+ *
+ * Return: NULL.
+ */
+static void *attend_cloud_client(void *arg)
+{
+	int fd = (int) (long) arg;
+	char *command = NULL;
+
+	counters_pause(true);
+
+	while (read_string(fd, &command, NULL, NULL) == 0) {
+		if (!strcmp(command, BENCH_CMD_REQUEST)) {
+			char *target = NULL;
+			void *request = NULL, *response = NULL;
+			size_t request_length = 0, response_length = 0;
+			int error;
+
+			error = read_string(fd, &target, NULL, NULL) || read_blob(fd, &request, &request_length, NULL);
+			if (!error) {
+				/* Account the delivery as the local services would do it */
+				counters_pause(false);
+				error = stub_device_request(target, request, request_length, &response, &response_length);
+				counters_pause(true);
+				error = error ? send_error(fd, "Target not registered")
+					: write_blob(fd, response, response_length);
+			}
+			free(target);
+			free(request);
+			free(response);
+			if (error)
+				break;
+		} else if (!strcmp(command, BENCH_CMD_STATS)) {
+			char stats_string[2048];
+			stub_stats_t stats;
+			int len;
+
+			stub_get_stats(&stats);
+			len = counters_format(stats_string, sizeof(stats_string));
+			if (len < 0
+				|| snprintf(stats_string + len, sizeof(stats_string) - len,
+					"%s %llu\n%s %llu\n%s %llu\n",
+					BENCH_STAT_UPLOADS, (unsigned long long) stats.uploads,
+					BENCH_STAT_BYTES, (unsigned long long) stats.bytes,
+					BENCH_STAT_POINTS, (unsigned long long) stats.points)
+					>= (int) sizeof(stats_string) - len
+				|| write_string(fd, stats_string))
+				break;
+		} else if (send_error(fd, "Unknown command")) {
+			break;
+		}
+		free(command);
+		command = NULL;
+	}
+
+	free(command);
+	close(fd);
+
+	return NULL;
+}
+
+/*
+ * signal_handler() - Stop the daemon
+ *
+ * @signum:	Received signal.
+ */
+static void signal_handler(int signum)
+{
+	UNUSED_ARGUMENT(signum);
+
+	stop = 1;
+}
+
+/*
+ * usage() - Print usage information
+ *
+ * @name:	Name of the daemon.
+ */
+static void usage(char const *const name)
+{
+	printf(USAGE, VERSION, name);
+}
@@ -0,0 +1,851 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "cc_client.h"
+#include "services_util.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define VERSION		"0.1" GIT_REVISION
+
+#define USAGE \
+	"Load generator for the local services of Cloud Connector.\n" \
+	"Copyright(c) Digi International Inc.\n" \
+	"\n" \
+	"Version: %s\n" \
+	"\n" \
+	"Usage: %s [options]\n\n" \
+	"  -m  --mode=<MODE>             Requests to generate:\n" \
+	"                                  upload:   data point uploads (default)\n" \
+	"                                  register: device request (un)registrations\n" \
+	"                                  request:  device request round trips, only\n" \
+	"                                            against cc-bench-daemon\n" \
+	"  -s  --socket=<PATH>           Unix domain socket of Cloud Connector, empty\n" \
+	"                                for the TCP port (default /tmp/cc-bench.sock)\n" \
+	"  -c  --cloud-socket=<PATH>     Cloud control socket of cc-bench-daemon\n" \
+	"                                (default " BENCH_CLOUD_SOCKET ")\n" \
+	"  -t  --threads=<N>             Concurrent clients (default 4)\n" \
+	"  -d  --duration=<SECONDS>      Time to generate load (default 10)\n" \
+	"  -n  --points=<N>              Data points per upload (default 10)\n" \
+	"  -p  --pipeline=<N>            Uploads in flight per client (default 1)\n" \
+	"  -b  --bytes=<N>               Size of a device request (default 64)\n" \
+	"  -h  --help                    Print help and exit\n" \
+	"\n" \
+	"Latencies are measured per request; with a pipeline, per batch of\n" \
+	"pipelined uploads. Context switches are read from /proc for the process\n" \
+	"listening on the Unix domain socket; allocations, system calls and cloud\n" \
+	"traffic are only available from cc-bench-daemon.\n" \
+	"\n"
+
+#define DEFAULT_SOCKET		"/tmp/cc-bench.sock"
+
+/* Histogram of latencies in microseconds with a precision of 1/32 */
+#define HIST_SUB_BITS		6
+#define HIST_HALF			(1 << (HIST_SUB_BITS - 1))
+#define HIST_MAX_SHIFT		32
+#define HIST_BUCKETS		(HIST_HALF * (HIST_MAX_SHIFT + 2))
+
+#define MAX_STATS			64
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+typedef enum {
+	MODE_UPLOAD,
+	MODE_REGISTER,
+	MODE_REQUEST
+} bench_mode_t;
+
+/**
+ * bench_cfg_t - Parameters of a run
+ *
+ * @mode:			Requests to generate.
+ * @socket_path:	Unix domain socket of Cloud Connector, NULL for TCP.
+ * @cloud_socket:	Cloud control socket of cc-bench-daemon.
+ * @n_threads:		Number of concurrent clients.
+ * @duration:		Seconds to generate load.
+ * @n_points:		Data points per upload.
+ * @pipeline:		Uploads in flight per client.
+ * @request_size:	Bytes of a device request.
+ */
+typedef struct {
+	bench_mode_t mode;
+	const char *socket_path;
+	const char *cloud_socket;
+	unsigned int n_threads;
+	unsigned int duration;
+	unsigned int n_points;
+	unsigned int pipeline;
+	size_t request_size;
+} bench_cfg_t;
+
+/**
+ * worker_t - Client generating load
+ *
+ * @id:				Index of the client.
+ * @thread:			Thread of the client.
+ * @client:			Connection to Cloud Connector.
+ * @target:			Device request target of the client.
+ * @listen_path:	Socket where device requests are received, empty for a TCP
+ *					port.
+ * @n_ops:			Completed requests.
+ * @n_errors:		Failed requests.
+ * @hist:			Latencies of the completed requests (or batches).
+ */
+typedef struct {
+	unsigned int id;
+	pthread_t thread;
+	cc_client_t *client;
+	char target[64];
+	char listen_path[108];
+	uint64_t n_ops;
+	uint64_t n_errors;
+	uint64_t hist[HIST_BUCKETS];
+} worker_t;
+
+/**
+ * stat_t - Counter of cc-bench-daemon
+ *
+ * @name:	Name of the counter.
+ * @value:	Value of the counter.
+ */
+typedef struct {
+	char name[48];
+	unsigned long long value;
+} stat_t;
+
+/**
+ * counters_t - Resources used by the daemon
+ *
+ * @has_ctxt:	Whether the context switches could be read from /proc.
+ * @ctxt:		Voluntary and involuntary context switches of its threads.
+ * @n_stats:	Number of counters answered by cc-bench-daemon.
+ * @stats:		Counters answered by cc-bench-daemon.
+ */
+typedef struct {
+	bool has_ctxt;
+	unsigned long long ctxt;
+	unsigned int n_stats;
+	stat_t stats[MAX_STATS];
+} counters_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static void *run_worker(void *arg);
+static void usage(char const *const name);
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static bench_cfg_t cfg = {
+	.mode = MODE_UPLOAD,
+	.socket_path = DEFAULT_SOCKET,
+	.cloud_socket = BENCH_CLOUD_SOCKET,
+	.n_threads = 4,
+	.duration = 10,
+	.n_points = 10,
+	.pipeline = 1,
+	.request_size = 64
+};
+
+static volatile int stop = 0;
+static pthread_barrier_t start_barrier, end_barrier;
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * now_us() - Get a monotonic time in microseconds
+ */
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+/*
+ * hist_index() - Get the bucket of a latency
+ *
+ * Values below 2^HIST_SUB_BITS have their own bucket, larger ones share it
+ * with the values that only differ in the bits below the HIST_SUB_BITS - 1
+ * most significant ones.
+ */
+static unsigned int hist_index(uint64_t value)
+{
+	unsigned int shift = 0;
+
+	while ((value >> shift) >= 2 * HIST_HALF)
+		shift++;
+	if (shift > HIST_MAX_SHIFT)
+		return HIST_BUCKETS - 1;
+
+	return HIST_HALF * shift + (unsigned int) (value >> shift);
+}
+
+/*
+ * hist_value() - Get the largest latency of a bucket
+ */
+static uint64_t hist_value(unsigned int index)
+{
+	unsigned int shift = index < 2 * HIST_HALF ? 0 : index / HIST_HALF - 1;
+
+	return (((uint64_t) (index - HIST_HALF * shift) + 1) << shift) - 1;
+}
+
+/*
+ * hist_percentile() - Get a percentile of a histogram
+ *
+ * @hist:		The histogram.
+ * @total:		Number of samples of the histogram.
+ * @fraction:	Percentile, between 0 and 1.
+ *
+ * Return: The latency below which the given fraction of the samples are.
+ */
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total, double fraction)
+{
+	uint64_t rank = (uint64_t) (fraction * (double) total + 0.999999), seen = 0;
+	unsigned int i;
+
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= rank)
+			return hist_value(i);
+	}
+
+	return 0;
+}
+
+/*
+ * record() - Account a completed request
+ */
+static void record(worker_t *worker, uint64_t start, int error)
+{
+	if (error) {
+		worker->n_errors++;
+		return;
+	}
+
+	worker->n_ops++;
+	worker->hist[hist_index(now_us() - start)]++;
+}
+
+/*
+ * echo_cb() - Answer a device request with its own payload
+ */
+static int echo_cb(const char *target, const void *request, size_t request_length,
+		void **response, size_t *response_length, void *user_data)
+{
+	(void) target;
+	(void) user_data;
+
+	*response = malloc(request_length > 0 ? request_length : 1);
+	if (*response == NULL)
+		return -1;
+	memcpy(*response, request, request_length);
+	*response_length = request_length;
+
+	return 0;
+}
+
+/*
+ * connect_unix() - Connect to a Unix domain socket
+ *
+ * Return: The connected socket, -1 on error.
+ */
+static int connect_unix(const char *path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX
+	};
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * run_uploads() - Upload data points until the run is over
+ */
+static void run_uploads(worker_t *worker)
+{
+	char *csv;
+	size_t length = 0, capacity = (size_t) cfg.n_points * 64 + 1;
+	unsigned int i;
+
+	csv = malloc(capacity);
+	if (csv == NULL) {
+		worker->n_errors++;
+		return;
+	}
+	for (i = 0; i < cfg.n_points; i++)
+		length += snprintf(csv + length, capacity - length, "%u,,,,,INTEGER,,,bench/%u\n",
+				i, worker->id);
+
+	while (!stop) {
+		uint64_t start = now_us();
+
+		if (cfg.pipeline <= 1) {
+			record(worker, start, cc_client_upload_datapoints(worker->client,
+					CC_CLIENT_DP_METRICS, csv, length));
+		} else {
+			unsigned int n_submitted = 0, n_failed = 0;
+
+			while (n_submitted < cfg.pipeline
+				&& cc_client_submit_datapoints(worker->client, CC_CLIENT_DP_METRICS,
+					csv, length) == 0)
+				n_submitted++;
+			if (n_submitted < cfg.pipeline)
+				worker->n_errors++;
+			cc_client_collect(worker->client, &n_failed);
+
+			/* The latency of the batch is recorded once */
+			worker->n_errors += n_failed;
+			if (n_submitted > n_failed) {
+				worker->n_ops += n_submitted - n_failed;
+				worker->hist[hist_index(now_us() - start)]++;
+			}
+		}
+	}
+
+	free(csv);
+}
+
+/*
+ * run_registrations() - Register and unregister a target until the run is over
+ */
+static void run_registrations(worker_t *worker)
+{
+	while (!stop) {
+		uint64_t start = now_us();
+
+		record(worker, start, cc_client_register_device_request(worker->client,
+				worker->target, echo_cb, NULL, NULL));
+
+		start = now_us();
+		record(worker, start, cc_client_unregister_device_request(worker->client,
+				worker->target));
+	}
+}
+
+/*
+ * run_requests() - Make the cloud stub send device requests to the client
+ *
+ * A request is complete when its response was received and the status of
+ * the response was reported to the client.
+ */
+static void run_requests(worker_t *worker)
+{
+	struct timeval timeout = {
+		.tv_sec = 30
+	};
+	void *payload = malloc(cfg.request_size > 0 ? cfg.request_size : 1);
+	int fd = -1;
+
+	if (payload == NULL) {
+		worker->n_errors++;
+		return;
+	}
+	memset(payload, 'x', cfg.request_size);
+
+	while (!stop) {
+		uint64_t start = now_us();
+		void *response = NULL;
+		size_t response_length = 0;
+		int error;
+
+		if (fd < 0)
+			fd = connect_unix(cfg.cloud_socket);
+
+		error = fd < 0
+			|| write_string(fd, BENCH_CMD_REQUEST)
+			|| write_string(fd, worker->target)
+			|| write_blob(fd, payload, cfg.request_size)
+			|| read_blob(fd, &response, &response_length, &timeout)
+			|| response_length != cfg.request_size;
+		record(worker, start, error);
+		free(response);
+
+		if (error && fd >= 0) {
+			/* The connection may be out of sync, start over */
+			close(fd);
+			fd = -1;
+		} else if (error) {
+			usleep(100000);
+		}
+	}
+
+	if (fd >= 0)
+		close(fd);
+	free(payload);
+}
+
+/*
+ * setup_worker() - Prepare the client of a worker for the run
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int setup_worker(worker_t *worker)
+{
+	worker->client = cc_client_open(cfg.socket_path);
+	if (worker->client == NULL)
+		return -1;
+
+	if (cfg.mode == MODE_UPLOAD)
+		return 0;
+
+	snprintf(worker->target, sizeof(worker->target), "cc-bench-%d-%u", getpid(), worker->id);
+	/* Socket paths are only accepted through the Unix domain socket. */
+	if (cfg.socket_path != NULL)
+		snprintf(worker->listen_path, sizeof(worker->listen_path), "/tmp/%s.sock", worker->target);
+	if (cc_client_listen(worker->client, cfg.socket_path != NULL ? worker->listen_path : NULL, 0) != 0)
+		return -1;
+
+	if (cfg.mode == MODE_REQUEST
+		&& cc_client_register_device_request(worker->client, worker->target,
+			echo_cb, NULL, NULL) != 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * run_worker() - Generate load from a client
+ *
+ * @arg:	The worker (worker_t).
+ *
+ * Return: NULL.
+ */
+static void *run_worker(void *arg)
+{
+	worker_t *worker = arg;
+	bool ready = setup_worker(worker) == 0;
+
+	if (!ready) {
+		worker->n_errors++;
+		fprintf(stderr, "Client %u: %s\n", worker->id,
+			worker->client != NULL ? cc_client_get_error(worker->client) : strerror(ENOMEM));
+	}
+
+	pthread_barrier_wait(&start_barrier);
+
+	if (ready) {
+		switch (cfg.mode) {
+		case MODE_UPLOAD:
+			run_uploads(worker);
+			break;
+		case MODE_REGISTER:
+			run_registrations(worker);
+			break;
+		case MODE_REQUEST:
+			run_requests(worker);
+			break;
+		}
+	}
+
+	pthread_barrier_wait(&end_barrier);
+
+	if (ready && cfg.mode == MODE_REQUEST)
+		cc_client_unregister_device_request(worker->client, worker->target);
+	cc_client_close(worker->client);
+	if (*worker->listen_path != '\0')
+		unlink(worker->listen_path);
+
+	return NULL;
+}
+
+/*
+ * get_daemon_pid() - Get the process listening on a Unix domain socket
+ *
+ * Return: The process ID, -1 if it cannot be known.
+ */
+static pid_t get_daemon_pid(const char *path)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	pid_t pid = -1;
+	int fd;
+
+	if (path == NULL)
+		return -1;
+
+	fd = connect_unix(path);
+	if (fd < 0)
+		return -1;
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+		pid = cred.pid;
+	close(fd);
+
+	return pid;
+}
+
+/*
+ * read_context_switches() - Add up the context switches of the daemon threads
+ *
+ * @pid:		Process ID of the daemon.
+ * @counters:	Where to store the count.
+ */
+static void read_context_switches(pid_t pid, counters_t *counters)
+{
+	char path[300], line[128];
+	unsigned long long value;
+	struct dirent *entry;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	dir = opendir(path);
+	if (dir == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		FILE *fp;
+
+		if (*entry->d_name == '.')
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%d/task/%s/status", pid, entry->d_name);
+		fp = fopen(path, "r");
+		if (fp == NULL)
+			continue;
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			if (sscanf(line, "voluntary_ctxt_switches: %llu", &value) == 1
+				|| sscanf(line, "nonvoluntary_ctxt_switches: %llu", &value) == 1) {
+				counters->ctxt += value;
+				counters->has_ctxt = true;
+			}
+		}
+		fclose(fp);
+	}
+
+	closedir(dir);
+}
+
+/*
+ * read_counters() - Get the resources used by the daemon so far
+ *
+ * @pid:		Process ID of the daemon, -1 if unknown.
+ * @counters:	Where to store the counters.
+ */
+static void read_counters(pid_t pid, counters_t *counters)
+{
+	struct timeval timeout = {
+		.tv_sec = 5
+	};
+	char *stats = NULL, *line, *saveptr = NULL;
+	int fd;
+
+	memset(counters, 0, sizeof(*counters));
+
+	if (pid > 0)
+		read_context_switches(pid, counters);
+
+	fd = connect_unix(cfg.cloud_socket);
+	if (fd < 0)
+		return;
+
+	if (write_string(fd, BENCH_CMD_STATS) == 0 && read_string(fd, &stats, NULL, &timeout) == 0) {
+		for (line = strtok_r(stats, "\n", &saveptr);
+			line != NULL && counters->n_stats < MAX_STATS;
+			line = strtok_r(NULL, "\n", &saveptr)) {
+			stat_t *stat = &counters->stats[counters->n_stats];
+
+			if (sscanf(line, "%47s %llu", stat->name, &stat->value) == 2)
+				counters->n_stats++;
+		}
+	}
+
+	free(stats);
+	close(fd);
+}
+
+/*
+ * get_stat() - Get the increase of a counter of cc-bench-daemon during the run
+ *
+ * @before:	Counters at the start of the run.
+ * @after:	Counters at the end of the run.
+ * @name:	Name of the counter.
+ *
+ * Return: The increase, 0 if the counter does not exist.
+ */
+static unsigned long long get_stat(const counters_t *before, const counters_t *after,
+		const char *name)
+{
+	unsigned long long start = 0, end = 0;
+	unsigned int i;
+
+	for (i = 0; i < before->n_stats; i++)
+		if (!strcmp(before->stats[i].name, name))
+			start = before->stats[i].value;
+	for (i = 0; i < after->n_stats; i++)
+		if (!strcmp(after->stats[i].name, name))
+			end = after->stats[i].value;
+
+	return end - start;
+}
+
+/*
+ * print_report() - Print the results of the run
+ */
+static void print_report(const worker_t *workers, double elapsed,
+		const counters_t *before, const counters_t *after)
+{
+	static const char *mode_names[] = { "upload", "register", "request" };
+	static const size_t prefix_len = sizeof(BENCH_STAT_SYSCALL_PREFIX) - 1;
+	uint64_t hist[HIST_BUCKETS] = { 0 };
+	uint64_t n_ops = 0, n_errors = 0, n_samples = 0, min = 0, max = 0;
+	unsigned long long n_allocs, n_syscalls = 0;
+	unsigned int i, j;
+	double per_op;
+
+	for (i = 0; i < cfg.n_threads; i++) {
+		n_ops += workers[i].n_ops;
+		n_errors += workers[i].n_errors;
+		for (j = 0; j < HIST_BUCKETS; j++)
+			hist[j] += workers[i].hist[j];
+	}
+	for (j = 0; j < HIST_BUCKETS; j++) {
+		if (hist[j] == 0)
+			continue;
+		n_samples += hist[j];
+		if (min == 0)
+			min = hist_value(j);
+		max = hist_value(j);
+	}
+
+	printf("Mode: %s, %u clients, %.1f s", mode_names[cfg.mode], cfg.n_threads, elapsed);
+	if (cfg.mode == MODE_UPLOAD)
+		printf(", %u points per upload, pipeline %u", cfg.n_points, cfg.pipeline);
+	else if (cfg.mode == MODE_REQUEST)
+		printf(", %zu bytes per request", cfg.request_size);
+	printf("\n");
+
+	printf("Operations: %llu (%.1f/s), errors: %llu\n", (unsigned long long) n_ops,
+		elapsed > 0 ? (double) n_ops / elapsed : 0.0, (unsigned long long) n_errors);
+	if (n_samples > 0)
+		printf("Latency (us): min %llu, p50 %llu, p99 %llu, p999 %llu, max %llu\n",
+			(unsigned long long) min,
+			(unsigned long long) hist_percentile(hist, n_samples, 0.5),
+			(unsigned long long) hist_percentile(hist, n_samples, 0.99),
+			(unsigned long long) hist_percentile(hist, n_samples, 0.999),
+			(unsigned long long) max);
+
+	if (n_ops == 0)
+		return;
+	per_op = 1.0 / (double) n_ops;
+
+	if (before->has_ctxt && after->has_ctxt)
+		printf("Daemon per operation: %.2f context switches\n",
+			(double) (after->ctxt - before->ctxt) * per_op);
+
+	if (before->n_stats == 0 || after->n_stats == 0)
+		return;
+
+	for (i = 0; i < after->n_stats; i++)
+		if (!strncmp(after->stats[i].name, BENCH_STAT_SYSCALL_PREFIX, prefix_len))
+			n_syscalls += get_stat(before, after, after->stats[i].name);
+
+	n_allocs = get_stat(before, after, BENCH_STAT_ALLOCATIONS);
+	printf("Daemon per operation: %.2f allocations, %.2f system calls",
+		(double) n_allocs * per_op, (double) n_syscalls * per_op);
+	for (i = 0, j = 0; i < after->n_stats; i++) {
+		const char *name = after->stats[i].name;
+		unsigned long long n;
+
+		if (strncmp(name, BENCH_STAT_SYSCALL_PREFIX, prefix_len))
+			continue;
+		n = get_stat(before, after, name);
+		if (n == 0)
+			continue;
+		printf("%s%s %.2f", j++ == 0 ? " (" : ", ", name + prefix_len, (double) n * per_op);
+	}
+	printf("%s\n", j > 0 ? ")" : "");
+
+	printf("Cloud: %llu uploads, %llu bytes, %llu data points\n",
+		get_stat(before, after, BENCH_STAT_UPLOADS),
+		get_stat(before, after, BENCH_STAT_BYTES),
+		get_stat(before, after, BENCH_STAT_POINTS));
+}
+
+int main(int argc, char *argv[])
+{
+	char *name = basename(argv[0]);
+	static int opt, opt_index;
+	worker_t *workers = NULL;
+	counters_t before, after;
+	unsigned int i;
+	uint64_t start;
+	double elapsed;
+	pid_t pid;
+	static const char *short_options = "m:s:c:t:d:n:p:b:h";
+	static const struct option long_options[] = {
+			{"mode", required_argument, NULL, 'm'},
+			{"socket", required_argument, NULL, 's'},
+			{"cloud-socket", required_argument, NULL, 'c'},
+			{"threads", required_argument, NULL, 't'},
+			{"duration", required_argument, NULL, 'd'},
+			{"points", required_argument, NULL, 'n'},
+			{"pipeline", required_argument, NULL, 'p'},
+			{"bytes", required_argument, NULL, 'b'},
+			{"help", no_argument, NULL, 'h'},
+			{NULL, 0, NULL, 0}
+	};
+
+	while (1) {
+		opt = getopt_long(argc, argv, short_options, long_options,
+				&opt_index);
+		if (opt == -1)
+			break;
+
+		switch (opt) {
+		case 'm':
+			if (!strcmp(optarg, "upload")) {
+				cfg.mode = MODE_UPLOAD;
+			} else if (!strcmp(optarg, "register")) {
+				cfg.mode = MODE_REGISTER;
+			} else if (!strcmp(optarg, "request")) {
+				cfg.mode = MODE_REQUEST;
+			} else {
+				usage(name);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			cfg.socket_path = *optarg != '\0' ? optarg : NULL;
+			break;
+		case 'c':
+			cfg.cloud_socket = optarg;
+			break;
+		case 't':
+			cfg.n_threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			cfg.duration = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			cfg.n_points = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			cfg.pipeline = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			cfg.request_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			usage(name);
+			return EXIT_SUCCESS;
+		default:
+			usage(name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (cfg.n_threads < 1 || cfg.duration < 1 || cfg.n_points < 1) {
+		usage(name);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	workers = calloc(cfg.n_threads, sizeof(*workers));
+	if (workers == NULL) {
+		fprintf(stderr, "%s\n", strerror(ENOMEM));
+		return EXIT_FAILURE;
+	}
+
+	pthread_barrier_init(&start_barrier, NULL, cfg.n_threads + 1);
+	pthread_barrier_init(&end_barrier, NULL, cfg.n_threads + 1);
+
+	for (i = 0; i < cfg.n_threads; i++) {
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+			/* The barriers count on every client, so the run cannot go on */
+			fprintf(stderr, "Cannot create client %u\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	pid = get_daemon_pid(cfg.socket_path);
+	read_counters(pid, &before);
+
+	pthread_barrier_wait(&start_barrier);
+	start = now_us();
+
+	for (i = 0; i < cfg.duration && !stop; i++)
+		sleep(1);
+	stop = 1;
+
+	pthread_barrier_wait(&end_barrier);
+	elapsed = (double) (now_us() - start) / 1000000.0;
+	read_counters(pid, &after);
+
+	for (i = 0; i < cfg.n_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	print_report(workers, elapsed, &before, &after);
+
+	pthread_barrier_destroy(&start_barrier);
+	pthread_barrier_destroy(&end_barrier);
+	free(workers);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * usage() - Print usage information
+ *
+ * @name:	Name of the program.
+ */
+static void usage(char const *const name)
+{
+	printf(USAGE, VERSION, name);
+}
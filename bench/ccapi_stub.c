@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ccapi/ccapi.h"
+#include "cc_init.h"
+#include "cc_logging.h"
+#include "cc_spool.h"
+#include "ccapi_stub.h"
+#include "counters.h"
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * struct ccapi_dp_collection - Data point collection of the stub
+ *
+ * @n_points:	Data points added since the collection was last sent.
+ */
+struct ccapi_dp_collection {
+	uint64_t n_points;
+};
+
+/**
+ * stub_target_t - Device request target registered in the stub
+ *
+ * @name:		Name of the target.
+ * @data_cb:	Callback to get the response of a request.
+ * @status_cb:	Callback to report the result of sending the response.
+ * @next:		Next registered target.
+ */
+typedef struct stub_target {
+	char *name;
+	ccapi_receive_data_cb_t data_cb;
+	ccapi_receive_status_cb_t status_cb;
+	struct stub_target *next;
+} stub_target_t;
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static unsigned int latency_ms = 0;
+static stub_stats_t stats = { 0 };
+
+static stub_target_t *targets = NULL;
+static pthread_mutex_t targets_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * simulate_round_trip() - Wait for the simulated answer of Remote Manager
+ */
+static void simulate_round_trip(void)
+{
+	if (latency_ms > 0)
+		usleep(latency_ms * 1000);
+}
+
+/*
+ * stub_set_latency() - Set the simulated round trip time to Remote Manager
+ *
+ * @ms:	Milliseconds every upload waits for its answer, 0 for none.
+ */
+void stub_set_latency(unsigned int ms)
+{
+	latency_ms = ms;
+}
+
+/*
+ * stub_get_stats() - Get the traffic received by the stub so far
+ *
+ * @totals:	Where to store the counters.
+ */
+void stub_get_stats(stub_stats_t *totals)
+{
+	totals->uploads = __atomic_load_n(&stats.uploads, __ATOMIC_RELAXED);
+	totals->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+	totals->points = __atomic_load_n(&stats.points, __ATOMIC_RELAXED);
+}
+
+/*
+ * stub_device_request() - Deliver a device request as Remote Manager would
+ *
+ * @target:				Target of the request.
+ * @request:			Payload of the request.
+ * @request_length:		Length of the payload.
+ * @response:			Allocated response, to be freed by the caller.
+ * @response_length:	Length of the response.
+ *
+ * The result of sending the response is reported to the target before
+ * returning. Must be called with the counters of the thread running, the
+ * copy of the response is not counted.
+ *
+ * Return: 0 on success, -1 if the target is not registered or there is not
+ *         enough memory.
+ */
+int stub_device_request(const char *target, const void *request, size_t request_length,
+		void **response, size_t *response_length)
+{
+	ccapi_receive_data_cb_t data_cb = NULL;
+	ccapi_receive_status_cb_t status_cb = NULL;
+	ccapi_buffer_info_t request_info = {
+		.buffer = (void *) request,
+		.length = request_length
+	};
+	ccapi_buffer_info_t response_info = { 0 };
+	ccapi_receive_error_t error;
+	stub_target_t *t;
+
+	pthread_mutex_lock(&targets_lock);
+	for (t = targets; t != NULL; t = t->next) {
+		if (!strcmp(t->name, target)) {
+			data_cb = t->data_cb;
+			status_cb = t->status_cb;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&targets_lock);
+
+	if (data_cb == NULL)
+		return -1;
+
+	error = data_cb(target, CCAPI_TRANSPORT_TCP, &request_info, &response_info);
+
+	/* The status callback releases the response, so keep a copy */
+	counters_pause(true);
+	*response_length = response_info.length;
+	*response = malloc(response_info.length > 0 ? response_info.length : 1);
+	if (*response != NULL && response_info.length > 0)
+		memcpy(*response, response_info.buffer, response_info.length);
+	counters_pause(false);
+
+	if (status_cb != NULL)
+		status_cb(target, CCAPI_TRANSPORT_TCP, &response_info, error);
+	else
+		free(response_info.buffer);
+
+	return *response != NULL ? 0 : -1;
+}
+
+ccapi_dp_error_t ccapi_dp_create_collection(ccapi_dp_collection_handle_t * const dp_collection)
+{
+	*dp_collection = calloc(1, sizeof(**dp_collection));
+
+	return *dp_collection != NULL ? CCAPI_DP_ERROR_NONE : CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+}
+
+ccapi_dp_error_t ccapi_dp_destroy_collection(ccapi_dp_collection_handle_t const dp_collection)
+{
+	free(dp_collection);
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+ccapi_dp_error_t ccapi_dp_add_data_stream_to_collection_extra(ccapi_dp_collection_handle_t const dp_collection,
+		char const * const stream_id, char const * const format_string,
+		char const * const units, char const * const forward_to)
+{
+	UNUSED_ARGUMENT(stream_id);
+	UNUSED_ARGUMENT(format_string);
+	UNUSED_ARGUMENT(units);
+	UNUSED_ARGUMENT(forward_to);
+
+	return dp_collection != NULL ? CCAPI_DP_ERROR_NONE : CCAPI_DP_ERROR_INVALID_ARGUMENT;
+}
+
+ccapi_dp_error_t ccapi_dp_add(ccapi_dp_collection_handle_t const dp_collection, char const * const stream_id, ...)
+{
+	UNUSED_ARGUMENT(stream_id);
+
+	if (dp_collection == NULL)
+		return CCAPI_DP_ERROR_INVALID_ARGUMENT;
+
+	dp_collection->n_points++;
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+ccapi_dp_error_t ccapi_dp_send_collection_with_reply(ccapi_transport_t const transport,
+		ccapi_dp_collection_handle_t const dp_collection, unsigned long const timeout,
+		ccapi_string_info_t * const hint)
+{
+	UNUSED_ARGUMENT(transport);
+	UNUSED_ARGUMENT(timeout);
+	UNUSED_ARGUMENT(hint);
+
+	if (dp_collection == NULL)
+		return CCAPI_DP_ERROR_INVALID_ARGUMENT;
+
+	simulate_round_trip();
+
+	__atomic_add_fetch(&stats.uploads, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats.points, dp_collection->n_points, __ATOMIC_RELAXED);
+	/* Sent data points are removed from the collection */
+	dp_collection->n_points = 0;
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+ccapi_send_error_t ccapi_send_data_with_reply(ccapi_transport_t const transport,
+		char const * const cloud_path, char const * const content_type,
+		void const * const data, size_t const bytes, ccapi_send_behavior_t const behavior,
+		unsigned long const timeout, ccapi_string_info_t * const hint)
+{
+	UNUSED_ARGUMENT(transport);
+	UNUSED_ARGUMENT(content_type);
+	UNUSED_ARGUMENT(behavior);
+	UNUSED_ARGUMENT(timeout);
+	UNUSED_ARGUMENT(hint);
+
+	if (cloud_path == NULL || (data == NULL && bytes > 0))
+		return CCAPI_SEND_ERROR_INVALID_DATA;
+
+	simulate_round_trip();
+
+	__atomic_add_fetch(&stats.uploads, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats.bytes, bytes, __ATOMIC_RELAXED);
+
+	return CCAPI_SEND_ERROR_NONE;
+}
+
+ccapi_send_error_t ccapi_send_file_with_reply(ccapi_transport_t const transport,
+		char const * const local_path, char const * const cloud_path,
+		char const * const content_type, ccapi_send_behavior_t const behavior,
+		unsigned long const timeout, ccapi_string_info_t * const hint)
+{
+	struct stat sb;
+
+	UNUSED_ARGUMENT(transport);
+	UNUSED_ARGUMENT(cloud_path);
+	UNUSED_ARGUMENT(content_type);
+	UNUSED_ARGUMENT(behavior);
+	UNUSED_ARGUMENT(timeout);
+	UNUSED_ARGUMENT(hint);
+
+	if (local_path == NULL || stat(local_path, &sb) != 0)
+		return CCAPI_SEND_ERROR_ACCESSING_FILE;
+
+	simulate_round_trip();
+
+	__atomic_add_fetch(&stats.uploads, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats.bytes, (uint64_t) sb.st_size, __ATOMIC_RELAXED);
+
+	return CCAPI_SEND_ERROR_NONE;
+}
+
+ccapi_receive_error_t ccapi_receive_add_target(char const * const target,
+		ccapi_receive_data_cb_t const data_cb, ccapi_receive_status_cb_t const status_cb,
+		size_t const max_request_size)
+{
+	ccapi_receive_error_t error = CCAPI_RECEIVE_ERROR_NONE;
+	stub_target_t *t;
+
+	UNUSED_ARGUMENT(max_request_size);
+
+	if (target == NULL || *target == '\0')
+		return CCAPI_RECEIVE_ERROR_INVALID_TARGET;
+	if (data_cb == NULL)
+		return CCAPI_RECEIVE_ERROR_INVALID_DATA_CB;
+
+	pthread_mutex_lock(&targets_lock);
+
+	for (t = targets; t != NULL; t = t->next) {
+		if (!strcmp(t->name, target)) {
+			error = CCAPI_RECEIVE_ERROR_TARGET_ALREADY_ADDED;
+			goto done;
+		}
+	}
+
+	t = calloc(1, sizeof(*t));
+	if (t == NULL || (t->name = strdup(target)) == NULL) {
+		free(t);
+		error = CCAPI_RECEIVE_ERROR_INSUFFICIENT_MEMORY;
+		goto done;
+	}
+	t->data_cb = data_cb;
+	t->status_cb = status_cb;
+	t->next = targets;
+	targets = t;
+
+done:
+	pthread_mutex_unlock(&targets_lock);
+
+	return error;
+}
+
+ccapi_receive_error_t ccapi_receive_remove_target(char const * const target)
+{
+	ccapi_receive_error_t error = CCAPI_RECEIVE_ERROR_TARGET_NOT_ADDED;
+	stub_target_t **t;
+
+	if (target == NULL)
+		return CCAPI_RECEIVE_ERROR_INVALID_TARGET;
+
+	pthread_mutex_lock(&targets_lock);
+	for (t = &targets; *t != NULL; t = &(*t)->next) {
+		if (!strcmp((*t)->name, target)) {
+			stub_target_t *found = *t;
+
+			*t = found->next;
+			free(found->name);
+			free(found);
+			error = CCAPI_RECEIVE_ERROR_NONE;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&targets_lock);
+
+	return error;
+}
+
+/* The stub is always connected, so uploads never go to the data spool */
+cc_status_t get_cloud_connection_status(void)
+{
+	return CC_STATUS_CONNECTED;
+}
+
+bool is_spool_enabled(void)
+{
+	return false;
+}
+
+spool_error_t spool_data(spool_record_type_t type, const char *cloud_path, const void *data, size_t size)
+{
+	UNUSED_ARGUMENT(type);
+	UNUSED_ARGUMENT(cloud_path);
+	UNUSED_ARGUMENT(data);
+	UNUSED_ARGUMENT(size);
+
+	return SPOOL_ERROR_DISABLED;
+}
+
+spool_error_t spool_data_tracked(spool_record_type_t type, const char *cloud_path, const void *data, size_t size,
+		spool_position_t *position)
+{
+	UNUSED_ARGUMENT(position);
+
+	return spool_data(type, cloud_path, data, size);
+}
+
+spool_status_t get_spool_status(const spool_position_t *position)
+{
+	UNUSED_ARGUMENT(position);
+
+	return SPOOL_STATUS_UPLOADED;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef CCAPI_STUB_H_
+#define CCAPI_STUB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * stub_stats_t - Traffic received by the stub of Remote Manager
+ *
+ * @uploads:	Number of data uploads and data point collections sent.
+ * @bytes:		Bytes of the data uploads.
+ * @points:		Data points of the collections.
+ */
+typedef struct {
+	uint64_t uploads;
+	uint64_t bytes;
+	uint64_t points;
+} stub_stats_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+void stub_set_latency(unsigned int ms);
+void stub_get_stats(stub_stats_t *totals);
+int stub_device_request(const char *target, const void *request, size_t request_length,
+		void **response, size_t *response_length);
+
+#endif /* CCAPI_STUB_H_ */
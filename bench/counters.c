@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "counters.h"
+
+/*
+ * Allocations and system calls of cc-bench-daemon
+ *
+ * Allocations are counted for the whole process, including the ones made
+ * inside libc (strdup(), asprintf()...). System calls are counted when they
+ * are made by the linked objects: the Makefile wraps every function of
+ * COUNTED_SYSCALLS with the '--wrap' option of the linker, so both lists must
+ * be kept in sync. System calls made inside libc, such as the ones of stdio,
+ * are not counted.
+ *
+ * Counting is paused per thread, so the traffic of the cloud control socket
+ * is not accounted to the local services.
+ */
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define COUNTED_SYSCALLS(X) \
+	X(accept4, int, (int fd, struct sockaddr *addr, socklen_t *len, int flags), (fd, addr, len, flags)) \
+	X(close, int, (int fd), (fd)) \
+	X(connect, int, (int fd, const struct sockaddr *addr, socklen_t len), (fd, addr, len)) \
+	X(epoll_ctl, int, (int epfd, int op, int fd, struct epoll_event *event), (epfd, op, fd, event)) \
+	X(epoll_wait, int, (int epfd, struct epoll_event *events, int max, int timeout), (epfd, events, max, timeout)) \
+	X(eventfd, int, (unsigned int count, int flags), (count, flags)) \
+	X(ftruncate, int, (int fd, off_t length), (fd, length)) \
+	X(getsockopt, int, (int fd, int level, int name, void *value, socklen_t *len), (fd, level, name, value, len)) \
+	X(memfd_create, int, (const char *name, unsigned int flags), (name, flags)) \
+	X(mkostemp, int, (char *template, int flags), (template, flags)) \
+	X(mmap, void *, (void *addr, size_t length, int prot, int flags, int fd, off_t offset), (addr, length, prot, flags, fd, offset)) \
+	X(munmap, int, (void *addr, size_t length), (addr, length)) \
+	X(poll, int, (struct pollfd *fds, nfds_t nfds, int timeout), (fds, nfds, timeout)) \
+	X(read, ssize_t, (int fd, void *buf, size_t count), (fd, buf, count)) \
+	X(recv, ssize_t, (int fd, void *buf, size_t count, int flags), (fd, buf, count, flags)) \
+	X(select, int, (int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds, struct timeval *timeout), (nfds, rfds, wfds, efds, timeout)) \
+	X(send, ssize_t, (int fd, const void *buf, size_t count, int flags), (fd, buf, count, flags)) \
+	X(sendmsg, ssize_t, (int fd, const struct msghdr *msg, int flags), (fd, msg, flags)) \
+	X(setsockopt, int, (int fd, int level, int name, const void *value, socklen_t len), (fd, level, name, value, len)) \
+	X(socket, int, (int domain, int type, int protocol), (domain, type, protocol)) \
+	X(unlink, int, (const char *path), (path)) \
+	X(write, ssize_t, (int fd, const void *buf, size_t count), (fd, buf, count))
+
+#define SYSCALL_INDEX(name, ...)	SYSCALL_##name,
+#define SYSCALL_NAME(name, ...)		#name,
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+typedef enum {
+	COUNTED_SYSCALLS(SYSCALL_INDEX)
+	SYSCALL_COUNT
+} syscall_index_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static const char *syscall_names[SYSCALL_COUNT] = {
+	COUNTED_SYSCALLS(SYSCALL_NAME)
+};
+
+static uint64_t syscall_counts[SYSCALL_COUNT];
+static uint64_t n_allocs = 0;
+static __thread bool paused = false;
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+static void increment(uint64_t *counter)
+{
+	if (!paused)
+		__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+#define SYSCALL_WRAPPER(name, ret, params, args) \
+	ret __real_##name params; \
+	ret __wrap_##name params; \
+	ret __wrap_##name params \
+	{ \
+		increment(&syscall_counts[SYSCALL_##name]); \
+		return __real_##name args; \
+	}
+
+COUNTED_SYSCALLS(SYSCALL_WRAPPER)
+
+void *malloc(size_t size)
+{
+	increment(&n_allocs);
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	increment(&n_allocs);
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	increment(&n_allocs);
+
+	return __libc_realloc(ptr, size);
+}
+
+/*
+ * counters_pause() - Stop or resume counting in the calling thread
+ *
+ * @pause:	true to stop counting, false to resume it.
+ */
+void counters_pause(bool pause)
+{
+	paused = pause;
+}
+
+/*
+ * counters_format() - Format the counters as BENCH_CMD_STATS lines
+ *
+ * @buffer:	Where to store the lines.
+ * @size:	Size of the buffer.
+ *
+ * Return: The length of the lines, -1 if they do not fit.
+ */
+int counters_format(char *buffer, size_t size)
+{
+	size_t length;
+	int len, i;
+
+	len = snprintf(buffer, size, "%s %llu\n", BENCH_STAT_ALLOCATIONS,
+		(unsigned long long) __atomic_load_n(&n_allocs, __ATOMIC_RELAXED));
+	if (len < 0 || (size_t) len >= size)
+		return -1;
+	length = len;
+
+	for (i = 0; i < SYSCALL_COUNT; i++) {
+		len = snprintf(buffer + length, size - length, "%s%s %llu\n",
+			BENCH_STAT_SYSCALL_PREFIX, syscall_names[i],
+			(unsigned long long) __atomic_load_n(&syscall_counts[i], __ATOMIC_RELAXED));
+		if (len < 0 || (size_t) len >= size - length)
+			return -1;
+		length += len;
+	}
+
+	return (int) length;
+}
@@ -0,0 +1,962 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cc_client.h"
+#include "service_device_request.h"
+#include "service_dp_upload.h"
+#include "services_util.h"
+
+/*
+ * Client side of the local services protocol
+ *
+ * Requests are sent with the protocol v2 framing over a connection that is
+ * kept open between calls and opened again if Cloud Connector closed it.
+ * Cloud Connector attends the requests of a connection in order, so several
+ * requests may be submitted before collecting their responses, oldest first.
+ * Cloud Connector stops reading a connection while it cannot write a
+ * response, so at most MAX_PENDING_REQUESTS are sent before reading the
+ * oldest response, otherwise both sides would block writing.
+ *
+ * Device requests are forwarded by Cloud Connector, with the v1 framing, to
+ * a socket this library listens on.
+ */
+
+#define CC_LOCAL_PORT			977
+
+/* Uploads larger than this are sent in UPLOAD_CHUNK_SIZE chunks */
+#define CHUNK_THRESHOLD			(32 * UPLOAD_CHUNK_SIZE)
+
+/* Requests sent before reading the response of the oldest one */
+#define MAX_PENDING_REQUESTS	32
+
+/* Largest response accepted */
+#define RESPONSE_MAX_LENGTH		4096
+
+/**
+ * target_t - Device request target registered by the application
+ *
+ * @name:		Name of the target.
+ * @request_cb:	Callback for the requests of the target.
+ * @status_cb:	Callback for the result of the responses, may be NULL.
+ * @user_data:	Data passed to the callbacks.
+ * @next:		Next target of the list.
+ */
+typedef struct target {
+	char *name;
+	cc_client_request_cb_t request_cb;
+	cc_client_status_cb_t status_cb;
+	void *user_data;
+	struct target *next;
+} target_t;
+
+/**
+ * struct cc_client - Connection of a local application to Cloud Connector
+ *
+ * @lock:			Serialises the requests of several threads.
+ * @fd:				Connection socket, -1 if not connected.
+ * @socket_path:	Unix domain socket of Cloud Connector, NULL for the TCP port.
+ * @timeout:		Seconds to wait for a response.
+ * @next_id:		Identifier of the next request.
+ * @n_pending:		Requests sent whose response was not read yet. Their
+ *					identifiers are the 'n_pending' before 'next_id'.
+ * @n_failed:		Submitted requests that failed and were not collected yet.
+ * @resend:			Request sent on an idle connection and not answered yet,
+ *					with its tag. Its data belongs to the caller.
+ * @n_resend:		Number of values of 'resend', 0 if there is none.
+ * @error:			Description of the last error.
+ * @listen_fd:		Socket to receive device requests, -1 if not listening.
+ * @wake_fd:		Eventfd to stop the listener thread.
+ * @listen_path:	Unix domain socket path of 'listen_fd', NULL for TCP.
+ * @listen_port:	TCP port of 'listen_fd'.
+ * @listen_thread:	Thread attending the device requests.
+ * @targets_lock:	Protects 'targets'.
+ * @targets:		Registered device request targets.
+ */
+struct cc_client {
+	pthread_mutex_t lock;
+	int fd;
+	char *socket_path;
+	unsigned int timeout;
+	uint32_t next_id;
+	unsigned int n_pending;
+	unsigned int n_failed;
+	service_value_t resend[REQUEST_MAX_VALUES];
+	unsigned int n_resend;
+	char error[256];
+
+	int listen_fd;
+	int wake_fd;
+	char *listen_path;
+	uint16_t listen_port;
+	pthread_t listen_thread;
+	pthread_mutex_t targets_lock;
+	target_t *targets;
+};
+
+/*
+ * set_error() - Record the description of the last error
+ *
+ * @client:	The client.
+ * @format:	Format of the description.
+ */
+static void set_error(cc_client_t *client, const char *format, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static void set_error(cc_client_t *client, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(client->error, sizeof(client->error), format, args);
+	va_end(args);
+}
+
+/*
+ * disconnect() - Close the connection, failing the requests without response
+ *
+ * @client:	The client.
+ */
+static void disconnect(cc_client_t *client)
+{
+	if (client->fd >= 0)
+		close(client->fd);
+	client->fd = -1;
+	client->n_failed += client->n_pending;
+	client->n_pending = 0;
+	client->n_resend = 0;
+}
+
+/*
+ * is_connection_closed() - Check whether Cloud Connector closed an idle connection
+ *
+ * @fd:	Connection socket, without pending requests.
+ *
+ * Return: true if the connection cannot be used any more, false otherwise.
+ */
+static bool is_connection_closed(int fd)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLIN | POLLRDHUP
+	};
+
+	/* Nothing is expected on an idle connection, not even data */
+	return poll(&pfd, 1, 0) != 0;
+}
+
+/*
+ * connect_client() - Make sure the client is connected
+ *
+ * @client:	The client.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int connect_client(cc_client_t *client)
+{
+	int fd;
+
+	if (client->fd >= 0) {
+		if (client->n_pending > 0 || !is_connection_closed(client->fd))
+			return 0;
+		disconnect(client);
+	}
+
+	if (client->socket_path != NULL) {
+		struct sockaddr_un addr = {
+			.sun_family = AF_UNIX
+		};
+
+		strncpy(addr.sun_path, client->socket_path, sizeof(addr.sun_path) - 1);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+			client->fd = fd;
+			return 0;
+		}
+	} else {
+		struct sockaddr_in addr = {
+			.sin_family = AF_INET,
+			.sin_port = htons(CC_LOCAL_PORT),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+		};
+
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+			client->fd = fd;
+			return 0;
+		}
+	}
+
+	set_error(client, "Cannot connect to Cloud Connector: %s", strerror(errno));
+	if (fd >= 0)
+		close(fd);
+
+	return -1;
+}
+
+/*
+ * resend_request() - Send again the request sent on an idle connection
+ *
+ * @client:	The client, whose only pending request is 'resend'.
+ *
+ * Cloud Connector closes a connection idle for too long, answering an
+ * unsolicited "Timeout" response. A request sent meanwhile is never read,
+ * so it is sent once more on a new connection.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int resend_request(cc_client_t *client)
+{
+	v2_header_t header = {
+		.type = V2_MSG_REQUEST
+	};
+	unsigned int n_values = client->n_resend;
+
+	client->n_resend = 0;
+	close(client->fd);
+	client->fd = -1;
+	if (connect_client(client) != 0)
+		return -1;
+
+	header.request_id = client->next_id;
+	if (write_v2_message(client->fd, &header, client->resend, n_values) != 0) {
+		set_error(client, "Cannot send request: %s", strerror(errno));
+		return -1;
+	}
+	client->next_id++;
+
+	return 0;
+}
+
+/*
+ * wait_response() - Read the response of the oldest pending request
+ *
+ * @client:	The client, with at least one pending request.
+ *
+ * If Cloud Connector closed the connection before reading a request sent
+ * while it was idle, the request is sent again.
+ *
+ * Return: 0 if the request succeeded, -1 otherwise.
+ */
+static int wait_response(cc_client_t *client)
+{
+	struct timeval timeout;
+	request_values_t response;
+	v2_header_t header;
+	char *payload;
+	int ret;
+
+	for (;;) {
+		uint32_t id = client->next_id - client->n_pending;
+
+		timeout.tv_sec = client->timeout;
+		timeout.tv_usec = 0;
+		ret = read_v2_message(client->fd, &header, &payload, &response, RESPONSE_MAX_LENGTH, &timeout);
+		if (ret == 0 && header.type == V2_MSG_RESPONSE && header.request_id == id
+			&& response.n_values > 0 && response.values[0].type == DT_INTEGER)
+			break;
+
+		free(payload);
+		/* An unsolicited response or a close instead of the response */
+		if (ret != -ETIMEDOUT && client->n_resend > 0 && resend_request(client) == 0)
+			continue;
+
+		if (ret == -ETIMEDOUT)
+			set_error(client, "%s", "Timeout waiting for Cloud Connector");
+		else
+			set_error(client, "%s", "Connection to Cloud Connector lost");
+		/* The responses of the later requests are lost too */
+		client->n_pending--;
+		disconnect(client);
+
+		return -1;
+	}
+	client->n_pending--;
+	client->n_resend = 0;
+
+	ret = 0;
+	if (response.values[0].integer == RESP_ERROR) {
+		if (response.n_values > 1 && response.values[1].type != DT_INTEGER)
+			set_error(client, "%s", response.values[1].data);
+		else
+			set_error(client, "%s", "Request failed");
+		ret = -1;
+	}
+	free(payload);
+
+	return ret;
+}
+
+/*
+ * send_request() - Send a request without waiting for its response
+ *
+ * @client:		The client.
+ * @tag:		Request tag.
+ * @values:		Values of the request.
+ * @n_values:	Number of values, up to REQUEST_MAX_VALUES - 1.
+ *
+ * If the connection was closed, it is opened again. A request that cannot
+ * be sent on an idle connection is retried once on a new one, and it is
+ * kept to be sent again if Cloud Connector closes the connection before
+ * reading it, so no other request is sent until it is answered. With
+ * MAX_PENDING_REQUESTS requests in flight, the oldest response is read
+ * first. Responses read here are counted in 'n_failed' if they failed.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int send_request(cc_client_t *client, const char *tag, const service_value_t *values,
+		unsigned int n_values)
+{
+	service_value_t message[REQUEST_MAX_VALUES];
+	v2_header_t header = {
+		.type = V2_MSG_REQUEST
+	};
+	int attempt;
+
+	message[0].type = DT_STRING;
+	message[0].data = (char *) tag;
+	message[0].length = strlen(tag);
+	memcpy(message + 1, values, n_values * sizeof(*values));
+
+	while (client->n_pending >= MAX_PENDING_REQUESTS || client->n_resend > 0) {
+		if (wait_response(client) != 0)
+			client->n_failed++;
+	}
+
+	for (attempt = 0; attempt < 2; attempt++) {
+		bool idle;
+
+		if (connect_client(client) != 0)
+			return -1;
+
+		idle = client->n_pending == 0;
+		header.request_id = client->next_id;
+		if (write_v2_message(client->fd, &header, message, n_values + 1) == 0) {
+			client->next_id++;
+			client->n_pending++;
+			if (idle) {
+				memcpy(client->resend, message, (n_values + 1) * sizeof(*message));
+				client->n_resend = n_values + 1;
+			}
+			return 0;
+		}
+
+		set_error(client, "Cannot send request: %s", strerror(errno));
+		disconnect(client);
+		if (!idle)
+			break;
+	}
+
+	return -1;
+}
+
+/*
+ * collect_responses() - Read the responses of all the pending requests
+ *
+ * @client:	The client.
+ */
+static void collect_responses(cc_client_t *client)
+{
+	while (client->n_pending > 0) {
+		if (wait_response(client) != 0)
+			client->n_failed++;
+	}
+}
+
+/*
+ * submit_upload() - Send the requests of a data point upload
+ *
+ * @client:	The client.
+ * @type:	Format of the data points.
+ * @data:	Data points.
+ * @length:	Length of the data points.
+ *
+ * Large uploads are sent in chunks, each one is a request.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int submit_upload(cc_client_t *client, cc_client_dp_type_t type, const void *data, size_t length)
+{
+	service_value_t values[2] = {
+		{ .type = DT_INTEGER },
+		{ .type = DT_BLOB }
+	};
+	const char *p = data;
+	bool metrics = type == CC_CLIENT_DP_METRICS;
+
+	if (!metrics && type != CC_CLIENT_DP_EVENTS) {
+		set_error(client, "%s", "Invalid data point type");
+		return -1;
+	}
+
+	if (length <= CHUNK_THRESHOLD) {
+		values[0].integer = metrics ? upload_datapoint_file_metrics : upload_datapoint_file_events;
+		values[1].data = (char *) data;
+		values[1].length = length;
+
+		return send_request(client, REQ_TAG_DP_FILE_REQUEST, values, 2);
+	}
+
+	values[0].integer = metrics ? upload_datapoint_file_metrics_chunk : upload_datapoint_file_events_chunk;
+	for (;;) {
+		size_t chunk = length < UPLOAD_CHUNK_SIZE ? length : UPLOAD_CHUNK_SIZE;
+
+		values[1].data = (char *) p;
+		values[1].length = chunk;
+		if (send_request(client, REQ_TAG_DP_FILE_REQUEST, values, 2) != 0)
+			return -1;
+		/* The empty chunk completes the upload */
+		if (chunk == 0)
+			return 0;
+		p += chunk;
+		length -= chunk;
+	}
+}
+
+/*
+ * cc_client_open() - Create a client of Cloud Connector
+ *
+ * @socket_path:	Unix domain socket of Cloud Connector, NULL or empty to
+ *					use the TCP loopback port.
+ *
+ * The connection is opened on the first request.
+ *
+ * Return: The client, NULL if there is not enough memory.
+ */
+cc_client_t *cc_client_open(const char *socket_path)
+{
+	cc_client_t *client = calloc(1, sizeof(*client));
+
+	if (client == NULL)
+		return NULL;
+
+	if (socket_path != NULL && *socket_path != '\0') {
+		client->socket_path = strdup(socket_path);
+		if (client->socket_path == NULL) {
+			free(client);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&client->lock, NULL);
+	pthread_mutex_init(&client->targets_lock, NULL);
+	client->fd = -1;
+	client->listen_fd = -1;
+	client->wake_fd = -1;
+	client->timeout = CC_CLIENT_DEFAULT_TIMEOUT;
+	client->next_id = 1;
+
+	return client;
+}
+
+/*
+ * cc_client_close() - Close the connection and release a client
+ *
+ * @client:	The client.
+ *
+ * The responses of the submitted requests are not waited for, the listener
+ * of device requests is stopped. Registered targets are kept by Cloud
+ * Connector until they are unregistered.
+ */
+void cc_client_close(cc_client_t *client)
+{
+	if (client == NULL)
+		return;
+
+	if (client->listen_fd >= 0) {
+		uint64_t wake = 1;
+
+		if (write(client->wake_fd, &wake, sizeof(wake)) == sizeof(wake))
+			pthread_join(client->listen_thread, NULL);
+		close(client->listen_fd);
+		close(client->wake_fd);
+		if (client->listen_path != NULL)
+			unlink(client->listen_path);
+	}
+
+	while (client->targets != NULL) {
+		target_t *target = client->targets;
+
+		client->targets = target->next;
+		free(target->name);
+		free(target);
+	}
+
+	disconnect(client);
+	pthread_mutex_destroy(&client->lock);
+	pthread_mutex_destroy(&client->targets_lock);
+	free(client->listen_path);
+	free(client->socket_path);
+	free(client);
+}
+
+/*
+ * cc_client_set_timeout() - Set the time to wait for a response
+ *
+ * @client:		The client.
+ * @seconds:	Seconds to wait for each response.
+ */
+void cc_client_set_timeout(cc_client_t *client, unsigned int seconds)
+{
+	pthread_mutex_lock(&client->lock);
+	client->timeout = seconds;
+	pthread_mutex_unlock(&client->lock);
+}
+
+/*
+ * cc_client_get_error() - Get the description of the last error
+ *
+ * @client:	The client.
+ *
+ * Return: The description, empty if there was no error.
+ */
+const char *cc_client_get_error(const cc_client_t *client)
+{
+	return client->error;
+}
+
+/*
+ * cc_client_upload_datapoints() - Upload data points and wait for the result
+ *
+ * @client:	The client.
+ * @type:	Format of the data points.
+ * @data:	Data points.
+ * @length:	Length of the data points.
+ *
+ * The responses of the previously submitted uploads are read first, their
+ * failures are reported by cc_client_collect().
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int cc_client_upload_datapoints(cc_client_t *client, cc_client_dp_type_t type,
+		const void *data, size_t length)
+{
+	unsigned int n_failed;
+	int ret = -1;
+
+	pthread_mutex_lock(&client->lock);
+	collect_responses(client);
+	/* Requests of this upload lost with the connection are not submitted ones */
+	n_failed = client->n_failed;
+	if (submit_upload(client, type, data, length) == 0) {
+		ret = 0;
+		/* Every chunk of a large upload has its own response */
+		while (client->n_pending > 0) {
+			if (wait_response(client) != 0)
+				ret = -1;
+		}
+		/* Chunks whose response was read while sending the upload */
+		if (client->n_failed != n_failed)
+			ret = -1;
+	}
+	client->n_failed = n_failed;
+	pthread_mutex_unlock(&client->lock);
+
+	return ret;
+}
+
+/*
+ * cc_client_submit_datapoints() - Upload data points without waiting for the result
+ *
+ * @client:	The client.
+ * @type:	Format of the data points.
+ * @data:	Data points, they can be reused once the function returns.
+ * @length:	Length of the data points.
+ *
+ * The results are read with cc_client_collect(). If the connection was
+ * idle, the response of the first request is read before returning, so it
+ * can be sent again if Cloud Connector closed the connection meanwhile.
+ *
+ * Return: 0 if the upload was sent, -1 otherwise.
+ */
+int cc_client_submit_datapoints(cc_client_t *client, cc_client_dp_type_t type,
+		const void *data, size_t length)
+{
+	int ret;
+
+	pthread_mutex_lock(&client->lock);
+	ret = submit_upload(client, type, data, length);
+	/* The data of a request that may be sent again is about to be reused */
+	if (client->n_resend > 0 && wait_response(client) != 0)
+		client->n_failed++;
+	pthread_mutex_unlock(&client->lock);
+
+	return ret;
+}
+
+/*
+ * cc_client_collect() - Wait for the results of the submitted uploads
+ *
+ * @client:		The client.
+ * @n_failed:	Number of failed requests since the last collection, NULL
+ *				if not needed. Each chunk of a large upload counts.
+ *
+ * Return: 0 if every request succeeded, -1 otherwise.
+ */
+int cc_client_collect(cc_client_t *client, unsigned int *n_failed)
+{
+	unsigned int failed;
+
+	pthread_mutex_lock(&client->lock);
+	collect_responses(client);
+	failed = client->n_failed;
+	client->n_failed = 0;
+	pthread_mutex_unlock(&client->lock);
+
+	if (n_failed != NULL)
+		*n_failed = failed;
+
+	return failed == 0 ? 0 : -1;
+}
+
+/*
+ * find_target() - Find a registered target
+ *
+ * @client:	The client.
+ * @name:	Name of the target.
+ *
+ * Must be called with the targets lock held.
+ *
+ * Return: The target, NULL if it is not registered.
+ */
+static target_t *find_target(cc_client_t *client, const char *name)
+{
+	target_t *target;
+
+	for (target = client->targets; target != NULL; target = target->next) {
+		if (!strcmp(target->name, name))
+			return target;
+	}
+
+	return NULL;
+}
+
+/*
+ * remove_target() - Remove a registered target and release it
+ *
+ * @client:	The client.
+ * @target:	The target.
+ */
+static void remove_target(cc_client_t *client, target_t *target)
+{
+	target_t **link;
+
+	pthread_mutex_lock(&client->targets_lock);
+	for (link = &client->targets; *link != NULL; link = &(*link)->next) {
+		if (*link == target) {
+			*link = target->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&client->targets_lock);
+
+	free(target->name);
+	free(target);
+}
+
+/*
+ * attend_device_request() - Attend a connection of Cloud Connector
+ *
+ * @client:	The client.
+ * @fd:		The accepted connection.
+ *
+ * Cloud Connector connects once for every device request and once more to
+ * report the result of sending its response.
+ */
+static void attend_device_request(cc_client_t *client, int fd)
+{
+	struct timeval timeout = {
+		.tv_sec = SOCKET_READ_TIMEOUT_SEC
+	};
+	char *type = NULL, *name = NULL;
+	target_t *target, found = { 0 };
+
+	if (read_string(fd, &type, NULL, &timeout) != 0 || read_string(fd, &name, NULL, &timeout) != 0)
+		goto done;
+
+	pthread_mutex_lock(&client->targets_lock);
+	target = find_target(client, name);
+	if (target != NULL)
+		found = *target;
+	pthread_mutex_unlock(&client->targets_lock);
+
+	if (!strcmp(type, DR_TYPE_REQUEST)) {
+		void *request = NULL, *response = NULL;
+		size_t request_length = 0, response_length = 0;
+
+		if (read_blob(fd, &request, &request_length, &timeout) == 0
+			&& (found.request_cb == NULL
+				|| found.request_cb(name, request, request_length, &response,
+					&response_length, found.user_data) != 0))
+			response_length = 0;
+		write_blob(fd, response != NULL ? response : "", response_length);
+		free(request);
+		free(response);
+	} else if (!strcmp(type, DR_TYPE_STATUS)) {
+		char *msg = NULL;
+		uint32_t error;
+
+		if (read_uint32(fd, &error, &timeout) == 0 && read_string(fd, &msg, NULL, &timeout) == 0
+			&& found.status_cb != NULL)
+			found.status_cb(name, error, msg, found.user_data);
+		free(msg);
+	}
+
+done:
+	free(type);
+	free(name);
+}
+
+/*
+ * listen_threaded() - Attend the device requests forwarded by Cloud Connector
+ *
+ * @arg:	The client.
+ *
+ * Return: NULL.
+ */
+static void *listen_threaded(void *arg)
+{
+	cc_client_t *client = arg;
+	struct pollfd pfds[2] = {
+		{ .fd = client->listen_fd, .events = POLLIN },
+		{ .fd = client->wake_fd, .events = POLLIN }
+	};
+
+	for (;;) {
+		int fd;
+
+		if (poll(pfds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pfds[1].revents != 0)
+			break;
+
+		fd = accept4(client->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+			continue;
+		attend_device_request(client, fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/*
+ * cc_client_listen() - Listen for the device requests of the registered targets
+ *
+ * @client:	The client.
+ * @path:	Unix domain socket to listen on, NULL to use a TCP loopback port.
+ *			An existing file with this path is replaced. Cloud Connector
+ *			only accepts it if the client was opened with its Unix
+ *			domain socket.
+ * @port:	TCP port to listen on if there is no path, 0 for any free port.
+ *
+ * The callbacks of the targets are called from a thread of the library.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int cc_client_listen(cc_client_t *client, const char *path, uint16_t port)
+{
+	int fd = -1;
+
+	if (client->listen_fd >= 0) {
+		set_error(client, "%s", "Already listening for device requests");
+		return -1;
+	}
+
+	if (path != NULL) {
+		struct sockaddr_un addr = {
+			.sun_family = AF_UNIX
+		};
+
+		if (strlen(path) >= sizeof(addr.sun_path)) {
+			set_error(client, "%s", "Invalid socket path");
+			return -1;
+		}
+		strcpy(addr.sun_path, path);
+		client->listen_path = strdup(path);
+		unlink(path);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (client->listen_path == NULL || fd < 0
+			|| bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+			goto error;
+	} else {
+		struct sockaddr_in addr = {
+			.sin_family = AF_INET,
+			.sin_port = htons(port),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+		};
+		socklen_t length = sizeof(addr);
+
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+			|| getsockname(fd, (struct sockaddr *) &addr, &length) != 0)
+			goto error;
+		client->listen_port = ntohs(addr.sin_port);
+	}
+
+	client->wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (client->wake_fd < 0 || listen(fd, SOMAXCONN) != 0)
+		goto error;
+
+	client->listen_fd = fd;
+	errno = pthread_create(&client->listen_thread, NULL, listen_threaded, client);
+	if (errno == 0)
+		return 0;
+	client->listen_fd = -1;
+
+error:
+	set_error(client, "Cannot listen for device requests: %s", strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	if (client->wake_fd >= 0)
+		close(client->wake_fd);
+	client->wake_fd = -1;
+	if (client->listen_path != NULL)
+		unlink(client->listen_path);
+	free(client->listen_path);
+	client->listen_path = NULL;
+
+	return -1;
+}
+
+/*
+ * send_device_request_target() - (Un)register a target in Cloud Connector
+ *
+ * @client:	The client, already listening.
+ * @tag:	REQ_TAG_REGISTER_DR or REQ_TAG_UNREGISTER_DR.
+ * @name:	Name of the target.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int send_device_request_target(cc_client_t *client, const char *tag, const char *name)
+{
+	service_value_t values[4] = {
+		{ .type = DT_INTEGER, .integer = client->listen_port },
+		{ .type = DT_STRING, .data = (char *) name, .length = strlen(name) },
+	};
+	unsigned int n_values = 2;
+	int ret = -1;
+
+	if (client->listen_path != NULL) {
+		values[n_values].type = DT_STRING;
+		values[n_values].data = client->listen_path;
+		values[n_values++].length = strlen(client->listen_path);
+	}
+	values[n_values].type = DT_INTEGER;
+	values[n_values++].integer = 0;
+
+	pthread_mutex_lock(&client->lock);
+	collect_responses(client);
+	if (send_request(client, tag, values, n_values) == 0)
+		ret = wait_response(client);
+	pthread_mutex_unlock(&client->lock);
+
+	return ret;
+}
+
+/*
+ * cc_client_register_device_request() - Receive the device requests of a target
+ *
+ * @client:		The client, already listening with cc_client_listen().
+ * @target:		Name of the target.
+ * @request_cb:	Callback for the requests of the target.
+ * @status_cb:	Callback for the result of the responses, NULL if not needed.
+ * @user_data:	Data passed to the callbacks.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int cc_client_register_device_request(cc_client_t *client, const char *target,
+		cc_client_request_cb_t request_cb, cc_client_status_cb_t status_cb, void *user_data)
+{
+	target_t *new_target;
+
+	if (client->listen_fd < 0) {
+		set_error(client, "%s", "Not listening for device requests");
+		return -1;
+	}
+
+	new_target = calloc(1, sizeof(*new_target));
+	if (new_target == NULL || (new_target->name = strdup(target)) == NULL) {
+		free(new_target);
+		set_error(client, "%s", "Out of memory");
+		return -1;
+	}
+	new_target->request_cb = request_cb;
+	new_target->status_cb = status_cb;
+	new_target->user_data = user_data;
+
+	/* Registered before Cloud Connector may forward a request */
+	pthread_mutex_lock(&client->targets_lock);
+	new_target->next = client->targets;
+	client->targets = new_target;
+	pthread_mutex_unlock(&client->targets_lock);
+
+	if (send_device_request_target(client, REQ_TAG_REGISTER_DR, target) == 0)
+		return 0;
+
+	remove_target(client, new_target);
+
+	return -1;
+}
+
+/*
+ * cc_client_unregister_device_request() - Stop receiving the device requests of a target
+ *
+ * @client:	The client.
+ * @target:	Name of the target.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int cc_client_unregister_device_request(cc_client_t *client, const char *target)
+{
+	target_t *found;
+
+	if (client->listen_fd < 0) {
+		set_error(client, "%s", "Not listening for device requests");
+		return -1;
+	}
+
+	if (send_device_request_target(client, REQ_TAG_UNREGISTER_DR, target) != 0)
+		return -1;
+
+	pthread_mutex_lock(&client->targets_lock);
+	found = find_target(client, target);
+	pthread_mutex_unlock(&client->targets_lock);
+	if (found != NULL)
+		remove_target(client, found);
+
+	return 0;
+}
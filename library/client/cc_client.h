@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef CC_CLIENT_H_
+#define CC_CLIENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/* Seconds to wait for a response of Cloud Connector by default */
+#define CC_CLIENT_DEFAULT_TIMEOUT	75
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * cc_client_t - Connection of a local application to Cloud Connector
+ */
+typedef struct cc_client cc_client_t;
+
+/**
+ * enum cc_client_dp_type_t - Format of a data point upload
+ *
+ * @CC_CLIENT_DP_METRICS:	Data points in CSV format
+ * @CC_CLIENT_DP_EVENTS:	Data points in JSON format
+ */
+typedef enum {
+	CC_CLIENT_DP_METRICS = 1,
+	CC_CLIENT_DP_EVENTS = 2
+} cc_client_dp_type_t;
+
+/**
+ * cc_client_request_cb_t - Device request received from Remote Manager
+ *
+ * @target:				Target of the device request.
+ * @request:			Payload of the request.
+ * @request_length:		Length of the payload.
+ * @response:			Allocated (malloc()) response, freed by the library.
+ * @response_length:	Length of the response.
+ * @user_data:			Data given when registering the target.
+ *
+ * Return: 0 on success, any other value to answer an empty response.
+ */
+typedef int (*cc_client_request_cb_t)(const char *target, const void *request,
+		size_t request_length, void **response, size_t *response_length, void *user_data);
+
+/**
+ * cc_client_status_cb_t - Result of sending the response of a device request
+ *
+ * @target:		Target of the device request.
+ * @error:		0 if the response was sent, the Cloud Connector error otherwise.
+ * @error_msg:	Description of the error.
+ * @user_data:	Data given when registering the target.
+ */
+typedef void (*cc_client_status_cb_t)(const char *target, uint32_t error,
+		const char *error_msg, void *user_data);
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+cc_client_t *cc_client_open(const char *socket_path);
+void cc_client_close(cc_client_t *client);
+void cc_client_set_timeout(cc_client_t *client, unsigned int seconds);
+const char *cc_client_get_error(const cc_client_t *client);
+
+int cc_client_upload_datapoints(cc_client_t *client, cc_client_dp_type_t type,
+		const void *data, size_t length);
+int cc_client_submit_datapoints(cc_client_t *client, cc_client_dp_type_t type,
+		const void *data, size_t length);
+int cc_client_collect(cc_client_t *client, unsigned int *n_failed);
+
+int cc_client_listen(cc_client_t *client, const char *path, uint16_t port);
+int cc_client_register_device_request(cc_client_t *client, const char *target,
+		cc_client_request_cb_t request_cb, cc_client_status_cb_t status_cb, void *user_data);
+int cc_client_unregister_device_request(cc_client_t *client, const char *target);
+
+#endif /* CC_CLIENT_H_ */
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <string.h>
+
+#include "aggregate.h"
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static void sort_values(double *values, int n_values);
+static void init_markers(aggregate_t *aggregate);
+static void adjust_marker(aggregate_t *aggregate, int i);
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+/* Increments of the desired positions of the markers for every new value. */
+static const double increments[AGGREGATE_MARKERS] = {
+	0,
+	AGGREGATE_PERCENTILE / 2,
+	AGGREGATE_PERCENTILE,
+	(1 + AGGREGATE_PERCENTILE) / 2,
+	1
+};
+
+static const char *const function_names[AGGREGATE_N_FUNCTIONS] = {
+	[AGGREGATE_MIN] = "min",
+	[AGGREGATE_MAX] = "max",
+	[AGGREGATE_MEAN] = "mean",
+	[AGGREGATE_LAST] = "last",
+	[AGGREGATE_P95] = "p95"
+};
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * aggregate_reset() - Discard the values of an aggregate to start a new window
+ *
+ * @aggregate:	The aggregate to reset.
+ */
+void aggregate_reset(aggregate_t *aggregate)
+{
+	memset(aggregate, 0, sizeof(*aggregate));
+}
+
+/*
+ * aggregate_add() - Add a value to an aggregate
+ *
+ * @aggregate:	The aggregate to update.
+ * @value:		The value to add.
+ */
+void aggregate_add(aggregate_t *aggregate, double value)
+{
+	int i, k;
+
+	if (aggregate->count == 0 || value < aggregate->min)
+		aggregate->min = value;
+	if (aggregate->count == 0 || value > aggregate->max)
+		aggregate->max = value;
+	aggregate->sum += value;
+	aggregate->last = value;
+
+	if (aggregate->count < AGGREGATE_MARKERS) {
+		aggregate->heights[aggregate->count++] = value;
+		if (aggregate->count == AGGREGATE_MARKERS)
+			init_markers(aggregate);
+		return;
+	}
+	aggregate->count++;
+
+	/* Find the cell of the value, extending the extreme markers if needed. */
+	if (value < aggregate->heights[0]) {
+		aggregate->heights[0] = value;
+		k = 0;
+	} else if (value >= aggregate->heights[AGGREGATE_MARKERS - 1]) {
+		aggregate->heights[AGGREGATE_MARKERS - 1] = value;
+		k = AGGREGATE_MARKERS - 2;
+	} else {
+		for (k = 0; value >= aggregate->heights[k + 1]; k++)
+			;
+	}
+
+	for (i = k + 1; i < AGGREGATE_MARKERS; i++)
+		aggregate->positions[i]++;
+	for (i = 0; i < AGGREGATE_MARKERS; i++)
+		aggregate->desired[i] += increments[i];
+
+	for (i = 1; i < AGGREGATE_MARKERS - 1; i++)
+		adjust_marker(aggregate, i);
+}
+
+/*
+ * aggregate_is_empty() - Check whether a value was added since the last reset
+ *
+ * @aggregate:	The aggregate to check.
+ *
+ * Return: true if the aggregate has no values, false otherwise.
+ */
+bool aggregate_is_empty(const aggregate_t *aggregate)
+{
+	return aggregate->count == 0;
+}
+
+/*
+ * aggregate_get() - Get a summary of the values of an aggregate
+ *
+ * @aggregate:	The aggregate to summarize, it must not be empty.
+ * @function:	The summary to get.
+ *
+ * Return: The summary value.
+ */
+double aggregate_get(const aggregate_t *aggregate, aggregate_function_t function)
+{
+	switch (function) {
+		case AGGREGATE_MIN:
+			return aggregate->min;
+		case AGGREGATE_MAX:
+			return aggregate->max;
+		case AGGREGATE_MEAN:
+			return aggregate->count > 0 ? aggregate->sum / aggregate->count : 0;
+		case AGGREGATE_LAST:
+			return aggregate->last;
+		case AGGREGATE_P95:
+		default:
+			break;
+	}
+
+	if (aggregate->count < AGGREGATE_MARKERS) {
+		double values[AGGREGATE_MARKERS];
+		int rank;
+
+		if (aggregate->count == 0)
+			return 0;
+
+		/* Nearest rank of the few values available. */
+		memcpy(values, aggregate->heights, aggregate->count * sizeof(double));
+		sort_values(values, aggregate->count);
+		rank = (int) (AGGREGATE_PERCENTILE * aggregate->count + 0.999999);
+
+		return values[rank > 0 ? rank - 1 : 0];
+	}
+
+	return aggregate->heights[2];
+}
+
+/*
+ * aggregate_function_name() - Get the name of a summary function
+ *
+ * @function:	The summary function.
+ *
+ * Return: The name of the function ("min", "max", ...).
+ */
+const char *aggregate_function_name(aggregate_function_t function)
+{
+	if (function >= AGGREGATE_N_FUNCTIONS)
+		return "unknown";
+
+	return function_names[function];
+}
+
+/*
+ * sort_values() - Sort a few values in ascending order
+ *
+ * @values:		The values to sort.
+ * @n_values:	Number of values.
+ */
+static void sort_values(double *values, int n_values)
+{
+	int i, j;
+
+	for (i = 1; i < n_values; i++) {
+		double value = values[i];
+
+		for (j = i; j > 0 && values[j - 1] > value; j--)
+			values[j] = values[j - 1];
+		values[j] = value;
+	}
+}
+
+/*
+ * init_markers() - Initialize the percentile markers with the first values
+ *
+ * @aggregate:	The aggregate with AGGREGATE_MARKERS values.
+ */
+static void init_markers(aggregate_t *aggregate)
+{
+	int i;
+
+	sort_values(aggregate->heights, AGGREGATE_MARKERS);
+
+	for (i = 0; i < AGGREGATE_MARKERS; i++) {
+		aggregate->positions[i] = i + 1;
+		aggregate->desired[i] = 1 + 4 * increments[i];
+	}
+}
+
+/*
+ * adjust_marker() - Move a middle marker towards its desired position
+ *
+ * @aggregate:	The aggregate to update.
+ * @i:			Index of the marker, between 1 and AGGREGATE_MARKERS - 2.
+ *
+ * The height is interpolated with a parabola through the neighbour markers,
+ * or linearly if the parabola does not keep the heights ordered.
+ */
+static void adjust_marker(aggregate_t *aggregate, int i)
+{
+	double *q = aggregate->heights;
+	double *n = aggregate->positions;
+	double d = aggregate->desired[i] - n[i];
+	double height;
+	int s;
+
+	if (!((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)))
+		return;
+
+	s = d > 0 ? 1 : -1;
+	height = q[i] + s / (n[i + 1] - n[i - 1])
+			* ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i])
+				+ (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+	if (height <= q[i - 1] || height >= q[i + 1])
+		height = q[i] + s * (q[i + s] - q[i]) / (n[i + s] - n[i]);
+
+	q[i] = height;
+	n[i] += s;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define AGGREGATE_PERCENTILE		0.95
+#define AGGREGATE_MARKERS			5
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * aggregate_function_t - Summary of the values of a window
+ *
+ * @AGGREGATE_MIN:		Minimum value.
+ * @AGGREGATE_MAX:		Maximum value.
+ * @AGGREGATE_MEAN:		Arithmetic mean of the values.
+ * @AGGREGATE_LAST:		Last value.
+ * @AGGREGATE_P95:		Approximate 95th percentile.
+ * @AGGREGATE_N_FUNCTIONS:	Number of functions.
+ */
+typedef enum {
+	AGGREGATE_MIN,
+	AGGREGATE_MAX,
+	AGGREGATE_MEAN,
+	AGGREGATE_LAST,
+	AGGREGATE_P95,
+	AGGREGATE_N_FUNCTIONS
+} aggregate_function_t;
+
+/**
+ * aggregate_t - Streaming summary of a window of values
+ *
+ * @count:		Number of values added since the last reset.
+ * @min:		Minimum value.
+ * @max:		Maximum value.
+ * @sum:		Sum of the values.
+ * @last:		Last value.
+ * @heights:	Heights of the P-square percentile markers. Until there are
+ *				enough values, the values themselves.
+ * @positions:	Actual positions of the markers.
+ * @desired:	Desired positions of the markers.
+ *
+ * The percentile is estimated with the P-square algorithm (Jain and Chlamtac,
+ * 1985), so the memory used does not depend on the number of values.
+ */
+typedef struct {
+	uint32_t count;
+	double min;
+	double max;
+	double sum;
+	double last;
+	double heights[AGGREGATE_MARKERS];
+	double positions[AGGREGATE_MARKERS];
+	double desired[AGGREGATE_MARKERS];
+} aggregate_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+void aggregate_reset(aggregate_t *aggregate);
+void aggregate_add(aggregate_t *aggregate, double value);
+bool aggregate_is_empty(const aggregate_t *aggregate);
+double aggregate_get(const aggregate_t *aggregate, aggregate_function_t function);
+const char *aggregate_function_name(aggregate_function_t function);
+
+#endif /* AGGREGATE_H_ */
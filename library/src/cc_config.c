@@ -70,13 +70,77 @@
 
 #define SETTING_FW_DOWNLOAD_PATH	"firmware_download_path"
 
+#define SETTING_SPOOL_PATH			"data_spool_path"
+#define SETTING_SPOOL_MAX_SIZE		"data_spool_max_size"
+#define SETTING_SPOOL_MAX_SIZE_MIN		64
+#define SETTING_SPOOL_MAX_SIZE_MAX		1024 * 1024 /* 1 GB */
+#define SETTING_SPOOL_SEGMENT_SIZE	"data_spool_segment_size"
+#define SETTING_SPOOL_SEGMENT_SIZE_MIN	16
+#define SETTING_SPOOL_SEGMENT_SIZE_MAX	64 * 1024 /* 64 MB */
+#define SETTING_SPOOL_SYNC_RECORDS	"data_spool_sync_records"
+#define SETTING_SPOOL_SYNC_RECORDS_MIN	1
+#define SETTING_SPOOL_SYNC_RECORDS_MAX	1024
+#define SETTING_LOCAL_BACKLOG		"local_requests_backlog"
+#define SETTING_LOCAL_BACKLOG_MIN	1
+#define SETTING_LOCAL_BACKLOG_MAX	1024
+#define SETTING_LOCAL_WORKERS		"local_requests_workers"
+#define SETTING_LOCAL_WORKERS_MIN	1
+#define SETTING_LOCAL_WORKERS_MAX	64
+#define SETTING_LOCAL_TCP			"local_requests_tcp"
+#define SETTING_LOCAL_SOCKET		"local_requests_socket"
+#define SETTING_LOCAL_SOCKET_MAX	107
+#define SETTING_LOCAL_UIDS			"local_requests_allowed_uids"
+#define SETTING_LOCAL_MAX_VALUE		"local_requests_max_value_size"
+#define SETTING_LOCAL_MAX_VALUE_MIN	64
+#define SETTING_LOCAL_MAX_VALUE_MAX	1024 * 1024 /* 1 GB */
+#define SETTING_LOCAL_MAX_MEMORY		"local_requests_max_memory"
+#define SETTING_LOCAL_MAX_MEMORY_MIN	64
+#define SETTING_LOCAL_MAX_MEMORY_MAX	1024 * 1024 /* 1 GB */
+#define SETTING_LOCAL_STAGING_PATH	"local_requests_staging_path"
+#define SETTING_LOCAL_MAX_UPLOAD		"local_requests_max_upload_size"
+#define SETTING_LOCAL_MAX_UPLOAD_MIN	1
+#define SETTING_LOCAL_MAX_UPLOAD_MAX	1024 * 1024 /* 1 GB */
+#define SETTING_LOCAL_COALESCE_WINDOW		"local_requests_coalesce_window"
+#define SETTING_LOCAL_COALESCE_WINDOW_MIN	0
+#define SETTING_LOCAL_COALESCE_WINDOW_MAX	10000
+#define SETTING_LOCAL_COALESCE_SIZE			"local_requests_coalesce_size"
+#define SETTING_LOCAL_COALESCE_SIZE_MIN		1
+#define SETTING_LOCAL_COALESCE_SIZE_MAX		1024
+#define SETTING_LOCAL_MAX_RINGS				"local_requests_max_rings"
+#define SETTING_LOCAL_MAX_RINGS_MIN			0
+#define SETTING_LOCAL_MAX_RINGS_MAX			64
+
 #define SETTING_SYS_MON_METRICS		"system_monitor_metrics"
 #define SETTING_SYS_MON_SAMPLE_RATE	"system_monitor_sample_rate"
 #define SETTING_SYS_MON_SAMPLE_RATE_MIN		1
 #define SETTING_SYS_MON_SAMPLE_RATE_MAX		365 * 24 * 60 * 60UL /* A year */
+#define SETTING_SYS_MON_SAMPLE_RATES	"system_monitor_sample_rates"
+#define SETTING_SYS_MON_AGGREGATIONS	"system_monitor_aggregations"
 #define SETTING_SYS_MON_UPLOAD_SIZE	"system_monitor_upload_samples_size"
 #define SETTING_SYS_MON_UPLOAD_SIZE_MIN		1
 #define SETTING_SYS_MON_UPLOAD_SIZE_MAX		250
+#define SETTING_SYS_MON_BACKLOG_SIZE	"system_monitor_backlog_size"
+#define SETTING_SYS_MON_BACKLOG_SIZE_MIN	1
+#define SETTING_SYS_MON_BACKLOG_SIZE_MAX	1000
+#define SETTING_SYS_MON_BACKLOG_POLICY	"system_monitor_backlog_policy"
+#define SETTING_SYS_MON_SEND_TIMEOUT	"system_monitor_send_timeout"
+#define SETTING_SYS_MON_SEND_TIMEOUT_MIN	1
+#define SETTING_SYS_MON_SEND_TIMEOUT_MAX	3600
+#define SETTING_SYS_MON_NET_EXTRA_STATS	"system_monitor_net_extra_stats"
+#define SETTING_SYS_MON_DEADBANDS	"system_monitor_deadbands"
+#define SETTING_SYS_MON_HEARTBEAT	"system_monitor_heartbeat"
+#define SETTING_SYS_MON_HEARTBEAT_MIN		0
+#define SETTING_SYS_MON_HEARTBEAT_MAX		7 * 24 * 60 * 60 /* A week */
+#define SETTING_SYS_MON_TOP_PROCESSES	"system_monitor_top_processes"
+#define SETTING_SYS_MON_TOP_PROCESSES_MIN	0
+#define SETTING_SYS_MON_TOP_PROCESSES_MAX	20
+#define SETTING_SYS_MON_ADAPTIVE	"system_monitor_adaptive"
+#define SETTING_SYS_MON_LAN_MIN_STRETCH	"system_monitor_lan_min_stretch"
+#define SETTING_SYS_MON_LAN_MAX_STRETCH	"system_monitor_lan_max_stretch"
+#define SETTING_SYS_MON_WAN_MIN_STRETCH	"system_monitor_wan_min_stretch"
+#define SETTING_SYS_MON_WAN_MAX_STRETCH	"system_monitor_wan_max_stretch"
+#define SETTING_SYS_MON_STRETCH_MIN		1
+#define SETTING_SYS_MON_STRETCH_MAX		100
 
 #define SETTING_USE_STATIC_LOCATION "static_location"
 #define SETTING_LATITUDE			"latitude"
@@ -97,6 +161,9 @@
 #define LOG_LEVEL_INFO_STR			"info"
 #define LOG_LEVEL_DEBUG_STR			"debug"
 
+#define BACKLOG_DROP_OLDEST_STR		"drop_oldest"
+#define BACKLOG_DROP_NEWEST_STR		"drop_newest"
+
 #define ALL_METRICS			"*"
 
 /*------------------------------------------------------------------------------
@@ -119,6 +186,16 @@ static int cfg_check_wait_times(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_sys_mon_sample_rate(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_sys_mon_upload_size(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_sys_mon_metrics(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_sys_mon_sample_rates(cfg_t *cfg, cfg_opt_t *opt);
+static int parse_sys_mon_sample_rate(const char *value, char **pattern, uint32_t *period);
+static int cfg_check_sys_mon_backlog_size(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_sys_mon_backlog_policy(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_sys_mon_send_timeout(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_sys_mon_deadbands(cfg_t *cfg, cfg_opt_t *opt);
+static int parse_sys_mon_deadband(const char *value, char **pattern, double *deadband, bool *percent);
+static int cfg_check_sys_mon_heartbeat(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_sys_mon_top_processes(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_sys_mon_stretch(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_latitude(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_longitude(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_description(cfg_t *cfg, cfg_opt_t *opt);
@@ -126,9 +203,33 @@ static int cfg_check_contact(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_location(cfg_t *cfg, cfg_opt_t *opt);
 static int cfg_check_string_length(cfg_t *cfg, cfg_opt_t *opt, uint16_t min, uint16_t max);
 static int cfg_check_fw_download_path(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_spool_path(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_spool_max_size(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_spool_segment_size(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_spool_sync_records(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_backlog(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_workers(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_socket(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_uids(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_max_value(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_max_memory(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_staging_path(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_max_upload(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_coalesce_window(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_coalesce_size(cfg_t *cfg, cfg_opt_t *opt);
+static int cfg_check_local_max_rings(cfg_t *cfg, cfg_opt_t *opt);
+static void get_local_uids(cfg_t *const cfg, cc_cfg_t *const cc_cfg);
 static void get_virtual_directories(cfg_t *const cfg, cc_cfg_t *const cc_cfg);
 static int get_log_level(void);
 static void get_sys_mon_metrics(cfg_t *const cfg, cc_cfg_t *const cc_cfg);
+static void get_sys_mon_rates(cfg_t *const cfg, const char *setting, sys_mon_rate_t **rates,
+		unsigned int *n_rates);
+static void set_sys_mon_rates(cfg_t *const cfg, const char *setting, const sys_mon_rate_t *rates,
+		unsigned int n_rates);
+static void get_sys_mon_deadbands(cfg_t *const cfg, cc_cfg_t *const cc_cfg);
+static sys_mon_backlog_policy_t get_sys_mon_backlog_policy(void);
+static void get_sys_mon_stretch(const char *min_setting, const char *max_setting,
+		sys_mon_stretch_t *stretch);
 
 /*------------------------------------------------------------------------------
                          G L O B A L  V A R I A B L E S
@@ -206,6 +307,22 @@ int parse_configuration(const char *const filename, cc_cfg_t *cc_cfg)
 			CFG_BOOL	(ENABLE_FS_SERVICE,		cfg_true,		CFGF_NONE),
 			CFG_STR		(SETTING_FW_DOWNLOAD_PATH, NULL,		CFGF_NODEFAULT),
 			CFG_BOOL	(SETTING_ON_THE_FLY,	cfg_false,		CFGF_NONE),
+			CFG_STR		(SETTING_SPOOL_PATH,	"",				CFGF_NONE),
+			CFG_INT		(SETTING_SPOOL_MAX_SIZE,		4096,	CFGF_NONE),
+			CFG_INT		(SETTING_SPOOL_SEGMENT_SIZE,	256,	CFGF_NONE),
+			CFG_INT		(SETTING_SPOOL_SYNC_RECORDS,	16,		CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_BACKLOG,			16,		CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_WORKERS,			4,		CFGF_NONE),
+			CFG_BOOL	(SETTING_LOCAL_TCP,		cfg_true,		CFGF_NONE),
+			CFG_STR		(SETTING_LOCAL_SOCKET,	"",				CFGF_NONE),
+			CFG_INT_LIST(SETTING_LOCAL_UIDS,	"{}",			CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_MAX_VALUE,		16384,	CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_MAX_MEMORY,		65536,	CFGF_NONE),
+			CFG_STR		(SETTING_LOCAL_STAGING_PATH,	"/mnt/data/cc_staging",	CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_MAX_UPLOAD,		16384,	CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_COALESCE_WINDOW,	250,	CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_COALESCE_SIZE,	64,		CFGF_NONE),
+			CFG_INT		(SETTING_LOCAL_MAX_RINGS,		4,		CFGF_NONE),
 
 			/* File system settings. */
 			CFG_SEC		(GROUP_VIRTUAL_DIRS, virtual_dirs_opts, CFGF_NONE),
@@ -213,8 +330,22 @@ int parse_configuration(const char *const filename, cc_cfg_t *cc_cfg)
 			/* System monitor settings. */
 			CFG_BOOL	(ENABLE_SYSTEM_MONITOR,		cfg_true,	CFGF_NONE),
 			CFG_INT		(SETTING_SYS_MON_SAMPLE_RATE,	5,		CFGF_NONE),
+			CFG_STR_LIST(SETTING_SYS_MON_SAMPLE_RATES,	"{}",	CFGF_NONE),
+			CFG_STR_LIST(SETTING_SYS_MON_AGGREGATIONS,	"{}",	CFGF_NONE),
 			CFG_INT		(SETTING_SYS_MON_UPLOAD_SIZE,	10,		CFGF_NONE),
 			CFG_STR_LIST(SETTING_SYS_MON_METRICS,	"{*}",		CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_BACKLOG_SIZE,	20,		CFGF_NONE),
+			CFG_STR		(SETTING_SYS_MON_BACKLOG_POLICY, BACKLOG_DROP_OLDEST_STR, CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_SEND_TIMEOUT,	30,		CFGF_NONE),
+			CFG_BOOL	(SETTING_SYS_MON_NET_EXTRA_STATS, cfg_false, CFGF_NONE),
+			CFG_STR_LIST(SETTING_SYS_MON_DEADBANDS,	"{}",		CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_HEARTBEAT,		600,	CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_TOP_PROCESSES,	0,		CFGF_NONE),
+			CFG_BOOL	(SETTING_SYS_MON_ADAPTIVE,	cfg_false,	CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_LAN_MIN_STRETCH,	1,	CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_LAN_MAX_STRETCH,	2,	CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_WAN_MIN_STRETCH,	2,	CFGF_NONE),
+			CFG_INT		(SETTING_SYS_MON_WAN_MAX_STRETCH,	8,	CFGF_NONE),
 
 			/* Static location settings */
 			CFG_BOOL	(SETTING_USE_STATIC_LOCATION,	cfg_true,	CFGF_NONE),
@@ -255,11 +386,46 @@ int parse_configuration(const char *const filename, cc_cfg_t *cc_cfg)
 	cfg_set_validate_func(cfg, SETTING_KEEPALIVE_TX, cfg_check_keepalive_tx);
 	cfg_set_validate_func(cfg, SETTING_WAIT_TIMES, cfg_check_wait_times);
 	cfg_set_validate_func(cfg, SETTING_FW_DOWNLOAD_PATH, cfg_check_fw_download_path);
+	cfg_set_validate_func(cfg, SETTING_SPOOL_PATH, cfg_check_spool_path);
+	cfg_set_validate_func(cfg, SETTING_SPOOL_MAX_SIZE, cfg_check_spool_max_size);
+	cfg_set_validate_func(cfg, SETTING_SPOOL_SEGMENT_SIZE, cfg_check_spool_segment_size);
+	cfg_set_validate_func(cfg, SETTING_SPOOL_SYNC_RECORDS, cfg_check_spool_sync_records);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_BACKLOG, cfg_check_local_backlog);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_WORKERS, cfg_check_local_workers);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_SOCKET, cfg_check_local_socket);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_UIDS, cfg_check_local_uids);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_MAX_VALUE, cfg_check_local_max_value);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_MAX_MEMORY, cfg_check_local_max_memory);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_STAGING_PATH, cfg_check_local_staging_path);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_MAX_UPLOAD, cfg_check_local_max_upload);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_COALESCE_WINDOW, cfg_check_local_coalesce_window);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_COALESCE_SIZE, cfg_check_local_coalesce_size);
+	cfg_set_validate_func(cfg, SETTING_LOCAL_MAX_RINGS, cfg_check_local_max_rings);
 	cfg_set_validate_func(cfg, SETTING_SYS_MON_SAMPLE_RATE,
 			cfg_check_sys_mon_sample_rate);
 	cfg_set_validate_func(cfg, SETTING_SYS_MON_UPLOAD_SIZE,
 			cfg_check_sys_mon_upload_size);
 	cfg_set_validate_func(cfg, SETTING_SYS_MON_METRICS, cfg_check_sys_mon_metrics);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_SAMPLE_RATES,
+			cfg_check_sys_mon_sample_rates);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_AGGREGATIONS,
+			cfg_check_sys_mon_sample_rates);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_BACKLOG_SIZE,
+			cfg_check_sys_mon_backlog_size);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_BACKLOG_POLICY,
+			cfg_check_sys_mon_backlog_policy);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_SEND_TIMEOUT,
+			cfg_check_sys_mon_send_timeout);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_DEADBANDS,
+			cfg_check_sys_mon_deadbands);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_HEARTBEAT,
+			cfg_check_sys_mon_heartbeat);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_TOP_PROCESSES,
+			cfg_check_sys_mon_top_processes);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_LAN_MIN_STRETCH, cfg_check_sys_mon_stretch);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_LAN_MAX_STRETCH, cfg_check_sys_mon_stretch);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_WAN_MIN_STRETCH, cfg_check_sys_mon_stretch);
+	cfg_set_validate_func(cfg, SETTING_SYS_MON_WAN_MAX_STRETCH, cfg_check_sys_mon_stretch);
 	cfg_set_validate_func(cfg, SETTING_LATITUDE, cfg_check_latitude);
 	cfg_set_validate_func(cfg, SETTING_LONGITUDE, cfg_check_longitude);
 
@@ -326,11 +492,35 @@ void free_configuration(cc_cfg_t *cc_cfg)
 
 		free(cc_cfg->fw_download_path);
 		cc_cfg->fw_download_path = NULL;
+		free(cc_cfg->spool_path);
+		cc_cfg->spool_path = NULL;
+		free(cc_cfg->local_socket);
+		cc_cfg->local_socket = NULL;
+		free(cc_cfg->local_uids);
+		cc_cfg->local_uids = NULL;
+		free(cc_cfg->local_staging_path);
+		cc_cfg->local_staging_path = NULL;
 
 		for (i = 0; i < cc_cfg->n_sys_mon_metrics; i++) {
 			free(cc_cfg->sys_mon_metrics[i]);
 		}
 		free(cc_cfg->sys_mon_metrics);
+		metric_filter_free(cc_cfg->sys_mon_filter);
+
+		for (i = 0; i < cc_cfg->n_sys_mon_rates; i++) {
+			free(cc_cfg->sys_mon_rates[i].pattern);
+		}
+		free(cc_cfg->sys_mon_rates);
+
+		for (i = 0; i < cc_cfg->n_sys_mon_aggregations; i++) {
+			free(cc_cfg->sys_mon_aggregations[i].pattern);
+		}
+		free(cc_cfg->sys_mon_aggregations);
+
+		for (i = 0; i < cc_cfg->n_sys_mon_deadbands; i++) {
+			free(cc_cfg->sys_mon_deadbands[i].pattern);
+		}
+		free(cc_cfg->sys_mon_deadbands);
 
 		free(cc_cfg);
 		cc_cfg = NULL;
@@ -450,6 +640,34 @@ static int fill_connector_config(cc_cfg_t *cc_cfg)
 	if (cc_cfg->fw_download_path == NULL)
 		return -1;
 
+	/* Fill data spool settings. */
+	cc_cfg->spool_path = strdup(cfg_getstr(cfg, SETTING_SPOOL_PATH));
+	if (cc_cfg->spool_path == NULL)
+		return -1;
+	cc_cfg->spool_max_size = cfg_getint(cfg, SETTING_SPOOL_MAX_SIZE);
+	cc_cfg->spool_segment_size = cfg_getint(cfg, SETTING_SPOOL_SEGMENT_SIZE);
+	if (cc_cfg->spool_segment_size > cc_cfg->spool_max_size)
+		cc_cfg->spool_segment_size = cc_cfg->spool_max_size;
+	cc_cfg->spool_sync_records = cfg_getint(cfg, SETTING_SPOOL_SYNC_RECORDS);
+
+	/* Fill local requests settings */
+	cc_cfg->local_backlog = cfg_getint(cfg, SETTING_LOCAL_BACKLOG);
+	cc_cfg->local_workers = cfg_getint(cfg, SETTING_LOCAL_WORKERS);
+	cc_cfg->local_tcp = (ccapi_bool_t) cfg_getbool(cfg, SETTING_LOCAL_TCP);
+	cc_cfg->local_socket = strdup(cfg_getstr(cfg, SETTING_LOCAL_SOCKET));
+	if (cc_cfg->local_socket == NULL)
+		return -1;
+	get_local_uids(cfg, cc_cfg);
+	cc_cfg->local_max_value = cfg_getint(cfg, SETTING_LOCAL_MAX_VALUE);
+	cc_cfg->local_max_memory = cfg_getint(cfg, SETTING_LOCAL_MAX_MEMORY);
+	cc_cfg->local_staging_path = strdup(cfg_getstr(cfg, SETTING_LOCAL_STAGING_PATH));
+	if (cc_cfg->local_staging_path == NULL)
+		return -1;
+	cc_cfg->local_max_upload = cfg_getint(cfg, SETTING_LOCAL_MAX_UPLOAD);
+	cc_cfg->local_coalesce_window = cfg_getint(cfg, SETTING_LOCAL_COALESCE_WINDOW);
+	cc_cfg->local_coalesce_size = cfg_getint(cfg, SETTING_LOCAL_COALESCE_SIZE);
+	cc_cfg->local_max_rings = cfg_getint(cfg, SETTING_LOCAL_MAX_RINGS);
+
 	/* Fill On the fly setting */
 	cc_cfg->on_the_fly = (ccapi_bool_t) cfg_getbool(cfg, SETTING_ON_THE_FLY);
 
@@ -457,6 +675,22 @@ static int fill_connector_config(cc_cfg_t *cc_cfg)
 	cc_cfg->sys_mon_sample_rate = cfg_getint(cfg, SETTING_SYS_MON_SAMPLE_RATE);
 	cc_cfg->sys_mon_num_samples_upload = cfg_getint(cfg, SETTING_SYS_MON_UPLOAD_SIZE);
 	get_sys_mon_metrics(cfg, cc_cfg);
+	get_sys_mon_rates(cfg, SETTING_SYS_MON_SAMPLE_RATES, &cc_cfg->sys_mon_rates,
+			&cc_cfg->n_sys_mon_rates);
+	get_sys_mon_rates(cfg, SETTING_SYS_MON_AGGREGATIONS, &cc_cfg->sys_mon_aggregations,
+			&cc_cfg->n_sys_mon_aggregations);
+	cc_cfg->sys_mon_backlog_size = cfg_getint(cfg, SETTING_SYS_MON_BACKLOG_SIZE);
+	cc_cfg->sys_mon_backlog_policy = get_sys_mon_backlog_policy();
+	cc_cfg->sys_mon_send_timeout = cfg_getint(cfg, SETTING_SYS_MON_SEND_TIMEOUT);
+	cc_cfg->sys_mon_net_extra_stats = (ccapi_bool_t) cfg_getbool(cfg, SETTING_SYS_MON_NET_EXTRA_STATS);
+	get_sys_mon_deadbands(cfg, cc_cfg);
+	cc_cfg->sys_mon_heartbeat = cfg_getint(cfg, SETTING_SYS_MON_HEARTBEAT);
+	cc_cfg->sys_mon_top_processes = cfg_getint(cfg, SETTING_SYS_MON_TOP_PROCESSES);
+	cc_cfg->sys_mon_adaptive = (ccapi_bool_t) cfg_getbool(cfg, SETTING_SYS_MON_ADAPTIVE);
+	get_sys_mon_stretch(SETTING_SYS_MON_LAN_MIN_STRETCH, SETTING_SYS_MON_LAN_MAX_STRETCH,
+			&cc_cfg->sys_mon_lan_stretch);
+	get_sys_mon_stretch(SETTING_SYS_MON_WAN_MIN_STRETCH, SETTING_SYS_MON_WAN_MAX_STRETCH,
+			&cc_cfg->sys_mon_wan_stretch);
 
 	/* Fill static location settings. */
 	cc_cfg->use_static_location = (ccapi_bool_t) cfg_getbool(cfg, SETTING_USE_STATIC_LOCATION);
@@ -509,6 +743,23 @@ static int set_connector_config(cc_cfg_t *cc_cfg)
 	cfg_setbool(cfg, ENABLE_FS_SERVICE, cc_cfg->services & FS_SERVICE ? cfg_true : cfg_false);
 	cfg_setbool(cfg, ENABLE_SYSTEM_MONITOR, cc_cfg->services & SYS_MONITOR_SERVICE ? cfg_true : cfg_false);
 	cfg_setstr(cfg, SETTING_FW_DOWNLOAD_PATH, cc_cfg->fw_download_path);
+	cfg_setstr(cfg, SETTING_SPOOL_PATH, cc_cfg->spool_path);
+	cfg_setint(cfg, SETTING_SPOOL_MAX_SIZE, cc_cfg->spool_max_size);
+	cfg_setint(cfg, SETTING_SPOOL_SEGMENT_SIZE, cc_cfg->spool_segment_size);
+	cfg_setint(cfg, SETTING_SPOOL_SYNC_RECORDS, cc_cfg->spool_sync_records);
+	cfg_setint(cfg, SETTING_LOCAL_BACKLOG, cc_cfg->local_backlog);
+	cfg_setint(cfg, SETTING_LOCAL_WORKERS, cc_cfg->local_workers);
+	cfg_setbool(cfg, SETTING_LOCAL_TCP, (cfg_bool_t) cc_cfg->local_tcp);
+	cfg_setstr(cfg, SETTING_LOCAL_SOCKET, cc_cfg->local_socket);
+	for (i = 0; i < cc_cfg->n_local_uids; i++)
+		cfg_setnint(cfg, SETTING_LOCAL_UIDS, cc_cfg->local_uids[i], i);
+	cfg_setint(cfg, SETTING_LOCAL_MAX_VALUE, cc_cfg->local_max_value);
+	cfg_setint(cfg, SETTING_LOCAL_MAX_MEMORY, cc_cfg->local_max_memory);
+	cfg_setstr(cfg, SETTING_LOCAL_STAGING_PATH, cc_cfg->local_staging_path);
+	cfg_setint(cfg, SETTING_LOCAL_MAX_UPLOAD, cc_cfg->local_max_upload);
+	cfg_setint(cfg, SETTING_LOCAL_COALESCE_WINDOW, cc_cfg->local_coalesce_window);
+	cfg_setint(cfg, SETTING_LOCAL_COALESCE_SIZE, cc_cfg->local_coalesce_size);
+	cfg_setint(cfg, SETTING_LOCAL_MAX_RINGS, cc_cfg->local_max_rings);
 	/* TODO: Set virtual directories */
 
 	/* Fill system monitor settings. */
@@ -517,6 +768,31 @@ static int set_connector_config(cc_cfg_t *cc_cfg)
 	for (i = 0; i < cc_cfg->n_sys_mon_metrics; i++) {
 		cfg_setnstr(cfg, SETTING_SYS_MON_METRICS, cc_cfg->sys_mon_metrics[i], i);
 	}
+	set_sys_mon_rates(cfg, SETTING_SYS_MON_SAMPLE_RATES, cc_cfg->sys_mon_rates,
+			cc_cfg->n_sys_mon_rates);
+	set_sys_mon_rates(cfg, SETTING_SYS_MON_AGGREGATIONS, cc_cfg->sys_mon_aggregations,
+			cc_cfg->n_sys_mon_aggregations);
+	cfg_setint(cfg, SETTING_SYS_MON_BACKLOG_SIZE, cc_cfg->sys_mon_backlog_size);
+	cfg_setstr(cfg, SETTING_SYS_MON_BACKLOG_POLICY,
+			cc_cfg->sys_mon_backlog_policy == SYS_MON_BACKLOG_DROP_NEWEST ?
+					BACKLOG_DROP_NEWEST_STR : BACKLOG_DROP_OLDEST_STR);
+	cfg_setint(cfg, SETTING_SYS_MON_SEND_TIMEOUT, cc_cfg->sys_mon_send_timeout);
+	cfg_setbool(cfg, SETTING_SYS_MON_NET_EXTRA_STATS, (cfg_bool_t) cc_cfg->sys_mon_net_extra_stats);
+	for (i = 0; i < cc_cfg->n_sys_mon_deadbands; i++) {
+		char deadband[256];
+
+		snprintf(deadband, sizeof(deadband), "%s=%g%s", cc_cfg->sys_mon_deadbands[i].pattern,
+				cc_cfg->sys_mon_deadbands[i].deadband,
+				cc_cfg->sys_mon_deadbands[i].percent ? "%" : "");
+		cfg_setnstr(cfg, SETTING_SYS_MON_DEADBANDS, deadband, i);
+	}
+	cfg_setint(cfg, SETTING_SYS_MON_HEARTBEAT, cc_cfg->sys_mon_heartbeat);
+	cfg_setint(cfg, SETTING_SYS_MON_TOP_PROCESSES, cc_cfg->sys_mon_top_processes);
+	cfg_setbool(cfg, SETTING_SYS_MON_ADAPTIVE, (cfg_bool_t) cc_cfg->sys_mon_adaptive);
+	cfg_setint(cfg, SETTING_SYS_MON_LAN_MIN_STRETCH, cc_cfg->sys_mon_lan_stretch.min);
+	cfg_setint(cfg, SETTING_SYS_MON_LAN_MAX_STRETCH, cc_cfg->sys_mon_lan_stretch.max);
+	cfg_setint(cfg, SETTING_SYS_MON_WAN_MIN_STRETCH, cc_cfg->sys_mon_wan_stretch.min);
+	cfg_setint(cfg, SETTING_SYS_MON_WAN_MAX_STRETCH, cc_cfg->sys_mon_wan_stretch.max);
 
 	/* Fill static location settings. */
 	cfg_setbool(cfg, SETTING_USE_STATIC_LOCATION, (cfg_bool_t) cc_cfg->use_static_location);
@@ -798,6 +1074,237 @@ static int cfg_check_sys_mon_metrics(cfg_t *cfg, cfg_opt_t *opt)
 	return 0;
 }
 
+/*
+ * cfg_check_sys_mon_sample_rates() - Check system monitor per metric sample rates
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * Each element must be '<metric>=<seconds>', where the metric may contain
+ * wildcards.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_sample_rates(cfg_t *cfg, cfg_opt_t *opt)
+{
+	unsigned int i;
+
+	for (i = 0; i < cfg_opt_size(opt); i++) {
+		char *val = cfg_opt_getnstr(opt, i);
+		uint32_t period;
+
+		if (parse_sys_mon_sample_rate(val, NULL, &period) != 0) {
+			cfg_error(cfg, "Invalid %s (%s): must be '<metric>=<seconds>'", opt->name, val);
+			return -1;
+		}
+		if (period < SETTING_SYS_MON_SAMPLE_RATE_MIN || period > SETTING_SYS_MON_SAMPLE_RATE_MAX) {
+			cfg_error(cfg, "Invalid %s (%s): rate must be between %d and %lu", opt->name, val,
+					SETTING_SYS_MON_SAMPLE_RATE_MIN, SETTING_SYS_MON_SAMPLE_RATE_MAX);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * parse_sys_mon_sample_rate() - Split a '<metric>=<seconds>' sample rate
+ *
+ * @value:		The sample rate to parse.
+ * @pattern:	Allocated metric pattern, NULL to ignore it.
+ * @period:		Sample period in seconds.
+ *
+ * @Return: 0 on success, -1 otherwise.
+ */
+static int parse_sys_mon_sample_rate(const char *value, char **pattern, uint32_t *period)
+{
+	const char *sep;
+	char *endptr = NULL;
+	unsigned long seconds;
+
+	if (value == NULL)
+		return -1;
+
+	sep = strrchr(value, '=');
+	if (sep == NULL || sep == value || *(sep + 1) == '\0')
+		return -1;
+
+	errno = 0;
+	seconds = strtoul(sep + 1, &endptr, 10);
+	if (errno != 0 || *endptr != '\0' || seconds > UINT32_MAX)
+		return -1;
+
+	if (pattern != NULL) {
+		*pattern = strndup(value, sep - value);
+		if (*pattern == NULL)
+			return -1;
+	}
+	*period = seconds;
+
+	return 0;
+}
+
+/*
+ * cfg_check_sys_mon_backlog_size() - Check system monitor backlog size value is between 1 and 1000
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_backlog_size(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SYS_MON_BACKLOG_SIZE_MIN, SETTING_SYS_MON_BACKLOG_SIZE_MAX);
+}
+
+/*
+ * cfg_check_sys_mon_backlog_policy() - Check system monitor backlog policy is a known value
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_backlog_policy(cfg_t *cfg, cfg_opt_t *opt)
+{
+	char *val = cfg_opt_getnstr(opt, 0);
+
+	if (val == NULL
+		|| (strcmp(val, BACKLOG_DROP_OLDEST_STR) != 0 && strcmp(val, BACKLOG_DROP_NEWEST_STR) != 0)) {
+		cfg_error(cfg, "Invalid %s (%s): value must be '%s' or '%s'", opt->name, val,
+				BACKLOG_DROP_OLDEST_STR, BACKLOG_DROP_NEWEST_STR);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * cfg_check_sys_mon_send_timeout() - Check system monitor send timeout value is between 1s and 1h
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_send_timeout(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SYS_MON_SEND_TIMEOUT_MIN, SETTING_SYS_MON_SEND_TIMEOUT_MAX);
+}
+
+/*
+ * cfg_check_sys_mon_deadbands() - Check system monitor per metric deadbands
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * Each element must be '<metric>=<value>' or '<metric>=<value>%', where the
+ * metric may contain wildcards and the value is not negative.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_deadbands(cfg_t *cfg, cfg_opt_t *opt)
+{
+	unsigned int i;
+
+	for (i = 0; i < cfg_opt_size(opt); i++) {
+		char *val = cfg_opt_getnstr(opt, i);
+		double deadband;
+		bool percent;
+
+		if (parse_sys_mon_deadband(val, NULL, &deadband, &percent) != 0) {
+			cfg_error(cfg, "Invalid %s (%s): must be '<metric>=<value>' or '<metric>=<value>%%'",
+					opt->name, val);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * parse_sys_mon_deadband() - Split a '<metric>=<value>[%]' deadband
+ *
+ * @value:		The deadband to parse.
+ * @pattern:	Allocated metric pattern, NULL to ignore it.
+ * @deadband:	Minimum change of the metric value to report it.
+ * @percent:	Whether the deadband is a percentage of the last reported value.
+ *
+ * @Return: 0 on success, -1 otherwise.
+ */
+static int parse_sys_mon_deadband(const char *value, char **pattern, double *deadband, bool *percent)
+{
+	const char *sep;
+	char *endptr = NULL;
+	double band;
+
+	if (value == NULL)
+		return -1;
+
+	sep = strrchr(value, '=');
+	if (sep == NULL || sep == value || *(sep + 1) == '\0')
+		return -1;
+
+	errno = 0;
+	band = strtod(sep + 1, &endptr);
+	if (errno != 0 || endptr == sep + 1 || !(band >= 0))
+		return -1;
+
+	*percent = *endptr == '%';
+	if (*percent)
+		endptr++;
+	if (*endptr != '\0')
+		return -1;
+
+	if (pattern != NULL) {
+		*pattern = strndup(value, sep - value);
+		if (*pattern == NULL)
+			return -1;
+	}
+	*deadband = band;
+
+	return 0;
+}
+
+/*
+ * cfg_check_sys_mon_heartbeat() - Check system monitor heartbeat value is between 0 and a week
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_heartbeat(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SYS_MON_HEARTBEAT_MIN, SETTING_SYS_MON_HEARTBEAT_MAX);
+}
+
+/*
+ * cfg_check_sys_mon_top_processes() - Check system monitor top processes value is between 0 and 20
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_top_processes(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SYS_MON_TOP_PROCESSES_MIN, SETTING_SYS_MON_TOP_PROCESSES_MAX);
+}
+
+/*
+ * cfg_check_sys_mon_stretch() - Check system monitor stretch value is between 1 and 100
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_sys_mon_stretch(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SYS_MON_STRETCH_MIN, SETTING_SYS_MON_STRETCH_MAX);
+}
+
 /*
  * cfg_check_latitude() - Check latitude value is between -90.0 and 90.0
  *
@@ -964,6 +1471,143 @@ static int cfg_check_fw_download_path(cfg_t *cfg, cfg_opt_t *opt)
 	return 0;
 }
 
+/*
+ * cfg_check_spool_path() - Check data spool path is empty or an absolute path
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_spool_path(cfg_t *cfg, cfg_opt_t *opt)
+{
+	char *val = cfg_opt_getnstr(opt, 0);
+
+	/* An empty path disables the spool. */
+	if (val == NULL || strlen(val) == 0)
+		return 0;
+
+	if (val[0] != '/') {
+		cfg_error(cfg, "Invalid %s (%s): must be an absolute path", opt->name, val);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * cfg_check_spool_max_size() - Check data spool maximum size is between 64 KB and 1 GB
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_spool_max_size(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SPOOL_MAX_SIZE_MIN, SETTING_SPOOL_MAX_SIZE_MAX);
+}
+
+/*
+ * cfg_check_spool_segment_size() - Check data spool segment size is between 16 KB and 64 MB
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_spool_segment_size(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SPOOL_SEGMENT_SIZE_MIN, SETTING_SPOOL_SEGMENT_SIZE_MAX);
+}
+
+/*
+ * cfg_check_spool_sync_records() - Check data spool sync records is between 1 and 1024
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_spool_sync_records(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_SPOOL_SYNC_RECORDS_MIN, SETTING_SPOOL_SYNC_RECORDS_MAX);
+}
+
+/*
+ * cfg_check_local_backlog() - Check local requests backlog is between 1 and 1024
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_backlog(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_BACKLOG_MIN, SETTING_LOCAL_BACKLOG_MAX);
+}
+
+/*
+ * cfg_check_local_workers() - Check local requests workers is between 1 and 64
+ *
+ * @cfg:	The section where the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_workers(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_WORKERS_MIN, SETTING_LOCAL_WORKERS_MAX);
+}
+
+/*
+ * cfg_check_local_socket() - Check local requests socket is empty or an absolute path
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_socket(cfg_t *cfg, cfg_opt_t *opt)
+{
+	char *val = cfg_opt_getnstr(opt, 0);
+
+	/* An empty path disables the Unix domain socket. */
+	if (val == NULL || strlen(val) == 0)
+		return 0;
+
+	if (val[0] != '/') {
+		cfg_error(cfg, "Invalid %s (%s): must be an absolute path", opt->name, val);
+		return -1;
+	}
+
+	return cfg_check_string_length(cfg, opt, 1, SETTING_LOCAL_SOCKET_MAX);
+}
+
+/*
+ * cfg_check_local_uids() - Check the user IDs allowed to use the local socket
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_uids(cfg_t *cfg, cfg_opt_t *opt)
+{
+	unsigned int i;
+
+	for (i = 0; i < cfg_opt_size(opt); i++) {
+		long val = cfg_opt_getnint(opt, i);
+
+		if (val < 0 || (uint64_t) val > UINT32_MAX) {
+			cfg_error(cfg, "Invalid %s (%ld): must be a user ID", opt->name, val);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * check_vendor_id() - Validate the given Vendor ID
  *
@@ -1014,6 +1658,134 @@ static void get_virtual_directories(cfg_t *const cfg, cc_cfg_t *const cc_cfg)
 	}
 }
 
+/*
+ * cfg_check_local_max_value() - Check local requests maximum value size is between 64 KB and 1 GB
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_max_value(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_MAX_VALUE_MIN, SETTING_LOCAL_MAX_VALUE_MAX);
+}
+
+/*
+ * cfg_check_local_max_memory() - Check local requests maximum memory is between 64 KB and 1 GB
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_max_memory(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_MAX_MEMORY_MIN, SETTING_LOCAL_MAX_MEMORY_MAX);
+}
+
+/*
+ * cfg_check_local_staging_path() - Check local requests staging path is an absolute path
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * The directory is created when the local services start.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_staging_path(cfg_t *cfg, cfg_opt_t *opt)
+{
+	char *val = cfg_opt_getnstr(opt, 0);
+
+	if (val == NULL || val[0] != '/') {
+		cfg_error(cfg, "Invalid %s (%s): must be an absolute path", opt->name, val);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * cfg_check_local_max_upload() - Check local requests maximum upload size is between 1 KB and 1 GB
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_max_upload(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_MAX_UPLOAD_MIN, SETTING_LOCAL_MAX_UPLOAD_MAX);
+}
+
+/*
+ * cfg_check_local_coalesce_window() - Check local uploads coalesce window is between 0 and 10000 ms
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_coalesce_window(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_COALESCE_WINDOW_MIN, SETTING_LOCAL_COALESCE_WINDOW_MAX);
+}
+
+/*
+ * cfg_check_local_coalesce_size() - Check local uploads coalesce size is between 1 and 1024 KB
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_coalesce_size(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_COALESCE_SIZE_MIN, SETTING_LOCAL_COALESCE_SIZE_MAX);
+}
+
+/*
+ * cfg_check_local_max_rings() - Check maximum number of local data point rings is between 0 and 64
+ *
+ * @cfg:	The section were the option is defined.
+ * @opt:	The option to check.
+ *
+ * @Return: 0 on success, any other value otherwise.
+ */
+static int cfg_check_local_max_rings(cfg_t *cfg, cfg_opt_t *opt)
+{
+	return cfg_check_range(cfg, opt, SETTING_LOCAL_MAX_RINGS_MIN, SETTING_LOCAL_MAX_RINGS_MAX);
+}
+
+/*
+ * get_local_uids() - Get the list of user IDs allowed to use the local socket
+ *
+ * @cfg:	Configuration struct from config file to read the user IDs
+ * @cc_cfg:	Cloud Connector configuration to store the user IDs
+ */
+static void get_local_uids(cfg_t *const cfg, cc_cfg_t *const cc_cfg)
+{
+	unsigned int i;
+
+	free(cc_cfg->local_uids);
+	cc_cfg->local_uids = NULL;
+	cc_cfg->n_local_uids = cfg_size(cfg, SETTING_LOCAL_UIDS);
+	if (cc_cfg->n_local_uids == 0)
+		return;
+
+	cc_cfg->local_uids = calloc(cc_cfg->n_local_uids, sizeof(*cc_cfg->local_uids));
+	if (cc_cfg->local_uids == NULL) {
+		log_info("%s", "Cannot initialize local requests allowed user IDs");
+		cc_cfg->n_local_uids = 0;
+
+		return;
+	}
+
+	for (i = 0; i < cc_cfg->n_local_uids; i++)
+		cc_cfg->local_uids[i] = cfg_getnint(cfg, SETTING_LOCAL_UIDS, i);
+}
+
 /*
  * get_log_level() - Get the log level setting value
  *
@@ -1058,10 +1830,139 @@ static void get_sys_mon_metrics(cfg_t *const cfg, cc_cfg_t *const cc_cfg)
 			log_info("%s", "Cannot initialize system monitor metric");
 			cc_cfg->n_sys_mon_metrics = i;
 
-			return;
+			break;
 		}
 		if (strcmp(ALL_METRICS, cc_cfg->sys_mon_metrics[i]) == 0) {
 			cc_cfg->sys_mon_all_metrics = true;
 		}
 	}
+
+	metric_filter_free(cc_cfg->sys_mon_filter);
+	cc_cfg->sys_mon_filter = metric_filter_compile(cc_cfg->sys_mon_metrics, cc_cfg->n_sys_mon_metrics);
+	if (cc_cfg->sys_mon_filter == NULL)
+		log_info("%s", "Cannot initialize system monitor metrics filter");
+}
+
+/*
+ * get_sys_mon_rates() - Get a list of system monitor '<metric>=<seconds>' settings
+ *
+ * @cfg:		The configuration struct.
+ * @setting:	Name of the setting (sample rates, aggregation windows).
+ * @rates:		Allocated list of parsed elements.
+ * @n_rates:	Number of elements of the list.
+ */
+static void get_sys_mon_rates(cfg_t *const cfg, const char *setting, sys_mon_rate_t **rates,
+		unsigned int *n_rates)
+{
+	unsigned int i, size = cfg_size(cfg, setting);
+
+	*n_rates = 0;
+	*rates = NULL;
+	if (size == 0)
+		return;
+
+	*rates = calloc(size, sizeof(**rates));
+	if (*rates == NULL) {
+		log_info("Cannot initialize %s", setting);
+		return;
+	}
+
+	for (i = 0; i < size; i++) {
+		sys_mon_rate_t *rate = &(*rates)[*n_rates];
+
+		if (parse_sys_mon_sample_rate(cfg_getnstr(cfg, setting, i),
+				&rate->pattern, &rate->period) != 0) {
+			log_info("Cannot initialize %s element", setting);
+			continue;
+		}
+		(*n_rates)++;
+	}
+}
+
+/*
+ * set_sys_mon_rates() - Set a list of system monitor '<metric>=<seconds>' settings
+ *
+ * @cfg:		The configuration struct.
+ * @setting:	Name of the setting (sample rates, aggregation windows).
+ * @rates:		List of elements to set.
+ * @n_rates:	Number of elements of the list.
+ */
+static void set_sys_mon_rates(cfg_t *const cfg, const char *setting, const sys_mon_rate_t *rates,
+		unsigned int n_rates)
+{
+	unsigned int i;
+
+	for (i = 0; i < n_rates; i++) {
+		char rate[256];
+
+		snprintf(rate, sizeof(rate), "%s=%" PRIu32, rates[i].pattern, rates[i].period);
+		cfg_setnstr(cfg, setting, rate, i);
+	}
+}
+
+/*
+ * get_sys_mon_deadbands() - Get the list of system monitor per metric deadbands
+ *
+ * @cfg:	The configuration struct.
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ */
+static void get_sys_mon_deadbands(cfg_t *const cfg, cc_cfg_t *const cc_cfg)
+{
+	unsigned int i, n_deadbands = cfg_size(cfg, SETTING_SYS_MON_DEADBANDS);
+
+	cc_cfg->n_sys_mon_deadbands = 0;
+	cc_cfg->sys_mon_deadbands = NULL;
+	if (n_deadbands == 0)
+		return;
+
+	cc_cfg->sys_mon_deadbands = calloc(n_deadbands, sizeof(*cc_cfg->sys_mon_deadbands));
+	if (cc_cfg->sys_mon_deadbands == NULL) {
+		log_info("%s", "Cannot initialize system monitor deadbands");
+		return;
+	}
+
+	for (i = 0; i < n_deadbands; i++) {
+		sys_mon_deadband_t *deadband = &cc_cfg->sys_mon_deadbands[cc_cfg->n_sys_mon_deadbands];
+
+		if (parse_sys_mon_deadband(cfg_getnstr(cfg, SETTING_SYS_MON_DEADBANDS, i),
+				&deadband->pattern, &deadband->deadband, &deadband->percent) != 0) {
+			log_info("%s", "Cannot initialize system monitor deadband");
+			continue;
+		}
+		cc_cfg->n_sys_mon_deadbands++;
+	}
+}
+
+/*
+ * get_sys_mon_backlog_policy() - Get the system monitor backlog policy setting value
+ *
+ * @Return: The backlog policy value.
+ */
+static sys_mon_backlog_policy_t get_sys_mon_backlog_policy(void)
+{
+	char *policy = cfg_getstr(cfg, SETTING_SYS_MON_BACKLOG_POLICY);
+
+	if (policy != NULL && strcmp(policy, BACKLOG_DROP_NEWEST_STR) == 0)
+		return SYS_MON_BACKLOG_DROP_NEWEST;
+
+	return SYS_MON_BACKLOG_DROP_OLDEST;
+}
+
+/*
+ * get_sys_mon_stretch() - Get the bounds of a system monitor adaptive profile
+ *
+ * @min_setting:	Setting of the minimum stretch factor.
+ * @max_setting:	Setting of the maximum stretch factor.
+ * @stretch:		Bounds of the profile.
+ *
+ * A maximum lower than the minimum is raised to the minimum.
+ */
+static void get_sys_mon_stretch(const char *min_setting, const char *max_setting,
+		sys_mon_stretch_t *stretch)
+{
+	stretch->min = cfg_getint(cfg, min_setting);
+	stretch->max = cfg_getint(cfg, max_setting);
+	if (stretch->max < stretch->min)
+		stretch->max = stretch->min;
 }
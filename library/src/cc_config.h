@@ -25,6 +25,7 @@
 #include <stdint.h>
 
 #include "ccimp/ccimp_types.h"
+#include "metric_filter.h"
 
 /*------------------------------------------------------------------------------
                              D E F I N I T I O N S
@@ -39,6 +40,17 @@
 /*------------------------------------------------------------------------------
                  D A T A    T Y P E S    D E F I N I T I O N S
 ------------------------------------------------------------------------------*/
+/**
+ * enum sys_mon_backlog_policy_t - Batch to discard when the backlog is full
+ *
+ * @SYS_MON_BACKLOG_DROP_OLDEST:	Discard the oldest pending batch
+ * @SYS_MON_BACKLOG_DROP_NEWEST:	Discard the batch that was just completed
+ */
+typedef enum {
+	SYS_MON_BACKLOG_DROP_OLDEST,
+	SYS_MON_BACKLOG_DROP_NEWEST
+} sys_mon_backlog_policy_t;
+
 /**
  * struct vdir_t - Virtual directory configuration type
  *
@@ -50,6 +62,41 @@ typedef struct {
 	char *path;
 } vdir_t;
 
+/**
+ * sys_mon_rate_t - Period of the system monitor metrics matching a pattern
+ *
+ * @pattern:	Metric name, it may contain wildcards ("cpu_load", "eth*", ...).
+ * @period:		Sample period or aggregation window in seconds.
+ */
+typedef struct {
+	char *pattern;
+	uint32_t period;
+} sys_mon_rate_t;
+
+/**
+ * sys_mon_deadband_t - Deadband of the system monitor metrics matching a pattern
+ *
+ * @pattern:	Metric name, it may contain wildcards ("cpu_temperature", "eth*", ...).
+ * @deadband:	Minimum change of the value to report a new sample.
+ * @percent:	Whether 'deadband' is a percentage of the last reported value.
+ */
+typedef struct {
+	char *pattern;
+	double deadband;
+	bool percent;
+} sys_mon_deadband_t;
+
+/**
+ * sys_mon_stretch_t - Bounds of a system monitor adaptive profile
+ *
+ * @min:	Factor applied to the sample periods with an empty backlog.
+ * @max:	Factor applied to the sample periods with a full backlog.
+ */
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+} sys_mon_stretch_t;
+
 /**
  * struct cc_cfg_t - Cloud Connector configuration type
  *
@@ -70,11 +117,44 @@ typedef struct {
  * @vdirs:						List of virtual directories
  * @n_vdirs:					Number of virtual directories in the list
  * @fw_download_path			Absolute path to download firmware files
+ * @spool_path:					Directory of the outbound data spool, empty to disable it
+ * @spool_max_size:				Maximum size of the data spool (KB)
+ * @spool_segment_size:			Size of each data spool segment file (KB)
+ * @spool_sync_records:			Number of spooled records between disk synchronizations
+ * @local_backlog:				Pending connections of local applications before refusing new ones
+ * @local_workers:				Number of threads attending requests of local applications
+ * @local_tcp:					Listen for local requests on the TCP loopback port
+ * @local_socket:				Unix domain socket to listen for local requests, empty to disable it
+ * @local_uids:					User IDs allowed to connect to 'local_socket', empty for any user
+ * @n_local_uids:				Number of allowed user IDs
+ * @local_max_value:			Maximum size of a value received from a local application (KB)
+ * @local_max_memory:			Maximum memory to receive the large values of all local applications (KB)
+ * @local_staging_path:			Directory to stage the chunked uploads of local applications
+ * @local_max_upload:			Maximum size of a chunked upload of a local application (KB)
+ * @local_coalesce_window:		Milliseconds to merge data point uploads of local applications, 0 to disable it
+ * @local_coalesce_size:		Maximum size of a merged data point upload (KB)
+ * @local_max_rings:			Maximum number of shared memory data point rings, 0 to disable them
  * @sys_mon_sample_rate:		Frequency at which gather system information
  * @sys_mon_num_samples_upload:	Number of samples of each channel to gather before uploading
  * @sys_mon_metrics:			List of metrics and interfaces to measure and upload to Remote Manager
  * @n_sys_mon_metrics:			Number of system monitor metrics and interfaces to measure
  * @sys_mon_all_metrics:		Whether all system monitor metrics should be measured or not
+ * @sys_mon_filter:			Filter compiled from the system monitor metrics
+ * @sys_mon_rates:				List of per metric sample rates
+ * @n_sys_mon_rates:			Number of per metric sample rates
+ * @sys_mon_aggregations:		List of per metric aggregation windows
+ * @n_sys_mon_aggregations:		Number of per metric aggregation windows
+ * @sys_mon_backlog_size:		Maximum number of completed sample batches kept while they cannot be sent
+ * @sys_mon_backlog_policy:		Batch to discard when the backlog is full
+ * @sys_mon_send_timeout:		Seconds to wait for Remote Manager to acknowledge an upload
+ * @sys_mon_net_extra_stats:	Monitor also packets, errors and drops of network interfaces
+ * @sys_mon_deadbands:			List of per metric deadbands
+ * @n_sys_mon_deadbands:		Number of per metric deadbands
+ * @sys_mon_heartbeat:			Maximum seconds without reporting a metric with deadband, 0 for no limit
+ * @sys_mon_top_processes:		Number of processes using more CPU and memory to upload, 0 to disable
+ * @sys_mon_adaptive:			Stretch the sample periods depending on the link type and the backlog
+ * @sys_mon_lan_stretch:		Bounds of the sample period factor on a LAN link
+ * @sys_mon_wan_stretch:		Bounds of the sample period factor on a WAN (cellular) link
  * @use_static_location			If true, use static location as GPS value
  * @latitude					Latitude value for static location
  * @longitude					Longitude value for static location
@@ -107,11 +187,46 @@ typedef struct {
 
 	char *fw_download_path;
 
+	char *spool_path;
+	uint32_t spool_max_size;
+	uint32_t spool_segment_size;
+	uint32_t spool_sync_records;
+
+	uint32_t local_backlog;
+	uint32_t local_workers;
+	ccapi_bool_t local_tcp;
+	char *local_socket;
+	uint32_t *local_uids;
+	unsigned int n_local_uids;
+	uint32_t local_max_value;
+	uint32_t local_max_memory;
+	char *local_staging_path;
+	uint32_t local_max_upload;
+	uint32_t local_coalesce_window;
+	uint32_t local_coalesce_size;
+	uint32_t local_max_rings;
+
 	uint32_t sys_mon_sample_rate;
 	uint32_t sys_mon_num_samples_upload;
 	char **sys_mon_metrics;
 	unsigned int n_sys_mon_metrics;
 	ccapi_bool_t sys_mon_all_metrics;
+	metric_filter_t *sys_mon_filter;
+	sys_mon_rate_t *sys_mon_rates;
+	unsigned int n_sys_mon_rates;
+	sys_mon_rate_t *sys_mon_aggregations;
+	unsigned int n_sys_mon_aggregations;
+	uint32_t sys_mon_backlog_size;
+	sys_mon_backlog_policy_t sys_mon_backlog_policy;
+	uint32_t sys_mon_send_timeout;
+	ccapi_bool_t sys_mon_net_extra_stats;
+	sys_mon_deadband_t *sys_mon_deadbands;
+	unsigned int n_sys_mon_deadbands;
+	uint32_t sys_mon_heartbeat;
+	uint32_t sys_mon_top_processes;
+	ccapi_bool_t sys_mon_adaptive;
+	sys_mon_stretch_t sys_mon_lan_stretch;
+	sys_mon_stretch_t sys_mon_wan_stretch;
 
 	ccapi_bool_t use_static_location;
 	float latitude;
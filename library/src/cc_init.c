@@ -27,6 +27,7 @@
 #include "cc_firmware_update.h"
 #include "cc_init.h"
 #include "cc_logging.h"
+#include "cc_spool.h"
 #include "cc_system_monitor.h"
 #include "network_utils.h"
 #include "service_device_request.h"
@@ -72,6 +73,7 @@ extern ccapi_receive_service_t receive_service;
 extern ccapi_streaming_cli_service_t streaming_cli_service;
 
 static volatile cc_status_t connection_status = CC_STATUS_DISCONNECTED;
+static volatile cc_link_t connection_link = CC_LINK_LAN;
 static pthread_t reconnect_thread;
 static bool reconnect_thread_valid;
 static bool initial_reconnection;
@@ -225,10 +227,14 @@ cc_start_error_t start_cloud_connection(void)
 			return CC_START_ERROR_NOT_INITIALIZE;
 	}
 
+	if (start_spool(cc_cfg->spool_path, cc_cfg->spool_max_size,
+			cc_cfg->spool_segment_size, cc_cfg->spool_sync_records) != 0)
+		log_error("%s", "Cannot start data spool, outbound data will not be stored");
+
 	if (start_system_monitor(cc_cfg) != CC_SYS_MON_ERROR_NONE)
 		return CC_START_ERROR_SYSTEM_MONITOR;
 
-	start_listening_for_local_requests();
+	start_listening_for_local_requests(cc_cfg);
 
 	log_info("%s", "Cloud connection started");
 
@@ -255,6 +261,8 @@ cc_stop_error_t stop_cloud_connection(void)
 
 	stop_system_monitor();
 
+	stop_spool();
+
 	{
 		ccapi_tcp_stop_t tcp_stop = { .behavior = CCAPI_TRANSPORT_STOP_GRACEFULLY };
 		ccapi_stop_transport_tcp(&tcp_stop);
@@ -301,6 +309,18 @@ cc_status_t get_cloud_connection_status(void)
 	return connection_status;
 }
 
+/*
+ * get_cloud_connection_link() - Return the type of link used to connect
+ *
+ * Return:	CC_LINK_WAN if the last connection attempt used an interface
+ * 		without MAC address (like ppp of cellular modems), CC_LINK_LAN
+ * 		otherwise.
+ */
+cc_link_t get_cloud_connection_link(void)
+{
+	return connection_link;
+}
+
 /*
  * set_cloud_connection_status() - Configure the status of the connection
  *
@@ -482,10 +502,12 @@ static int create_ccapi_tcp_start_info_struct(const cc_cfg_t *const cc_cfg, ccap
 	 */
 	if (is_zero_array(active_interface.mac, sizeof(active_interface.mac))) {
 		tcp_info->connection.type = CCAPI_CONNECTION_WAN;
+		connection_link = CC_LINK_WAN;
 		tcp_info->connection.info.wan.link_speed = 0;
 		tcp_info->connection.info.wan.phone_number = "*99#";
 	} else {
 		tcp_info->connection.type = CCAPI_CONNECTION_LAN;
+		connection_link = CC_LINK_LAN;
 		memcpy(tcp_info->connection.info.lan.mac_address,
 				active_interface.mac,
 				sizeof(tcp_info->connection.info.lan.mac_address));
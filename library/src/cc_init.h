@@ -73,6 +73,11 @@ typedef enum {
 	CC_STATUS_CONNECTED
 } cc_status_t;
 
+typedef enum {
+	CC_LINK_LAN,
+	CC_LINK_WAN
+} cc_link_t;
+
 /*------------------------------------------------------------------------------
                     F U N C T I O N  D E C L A R A T I O N S
 ------------------------------------------------------------------------------*/
@@ -80,5 +85,6 @@ cc_init_error_t init_cloud_connection(const char *config_file);
 cc_start_error_t start_cloud_connection(void);
 cc_stop_error_t stop_cloud_connection(void);
 cc_status_t get_cloud_connection_status(void);
+cc_link_t get_cloud_connection_link(void);
 
 #endif /* CC_INIT_H_ */
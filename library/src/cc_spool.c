@@ -0,0 +1,1143 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "ccapi/ccapi.h"
+#include "cc_init.h"
+#include "cc_logging.h"
+#include "cc_spool.h"
+#include "file_utils.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define SPOOL_TAG				"SPOOL:"
+
+#define SEGMENT_SUFFIX			".seg"
+#define SEGMENT_NAME_FORMAT		"%08u" SEGMENT_SUFFIX
+#define SEGMENT_NAME_LEN		(8 + sizeof(SEGMENT_SUFFIX))
+#define CURSOR_FILE				"cursor"
+#define CURSOR_TMP_FILE			"cursor.tmp"
+
+#define RECORD_MAGIC			0x50534343 /* "CCSP" */
+#define MAX_CLOUD_PATH_LEN		255
+
+#define REPLAY_MAX_BYTES		(256 * 1024)
+#define REPLAY_SEND_TIMEOUT		30
+#define REPLAY_RETRY_SECONDS	10
+#define CHECK_SECONDS			5
+#define SYNC_SECONDS			5
+
+#define DISCARDED_MAX			32
+
+#define UPLOAD_CONTENT_TYPE		"text/plain"
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * record_header_t - Header of each record stored in a segment
+ *
+ * @magic:		RECORD_MAGIC.
+ * @type:		Type of the record (spool_record_type_t).
+ * @path_len:	Length of the cloud path following the header.
+ * @data_len:	Length of the data following the cloud path.
+ * @crc:		CRC32 of the cloud path and the data.
+ *
+ * A record is the header followed by the cloud path (without '\0') and the
+ * data. Records are only appended, so a power failure can only leave an
+ * incomplete record at the end of the newest segment, which is discarded the
+ * next time the spool is started.
+ */
+typedef struct {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t path_len;
+	uint32_t data_len;
+	uint32_t crc;
+} record_header_t;
+
+/**
+ * spool_cursor_t - Position of the next record to replay
+ *
+ * @seq:	Sequence number of the segment.
+ * @offset:	Offset of the record in the segment.
+ */
+typedef struct {
+	uint32_t seq;
+	uint32_t offset;
+} spool_cursor_t;
+
+/**
+ * discarded_range_t - Records that left the spool without being uploaded
+ *
+ * @start:	Position of the first discarded record.
+ * @end:	Position after the last discarded record.
+ */
+typedef struct {
+	spool_cursor_t start;
+	spool_cursor_t end;
+} discarded_range_t;
+
+/**
+ * spool_t - Outbound data spool
+ *
+ * @dir_fd:			Descriptor of the spool directory.
+ * @max_size:		Maximum size of all the segments (bytes).
+ * @segment_size:	Size at which a new segment is started (bytes).
+ * @sync_records:	Number of appended records between synchronizations.
+ * @first_seq:		Sequence number of the oldest segment.
+ * @write_seq:		Sequence number of the segment being written.
+ * @write_fd:		Descriptor of the segment being written.
+ * @write_size:		Size of the segment being written.
+ * @total_size:		Size of all the segments.
+ * @unsynced:		Number of records appended since the last synchronization.
+ * @last_sync:		Time of the last synchronization.
+ * @cursor:			Position of the next record to replay.
+ * @discarded:		Last ranges of discarded records, oldest first.
+ * @n_discarded:	Number of ranges in 'discarded'.
+ * @lock:			Lock to access the spool.
+ * @cond:			Condition signaled when data is appended or the spool is
+ *					stopped.
+ */
+typedef struct {
+	int dir_fd;
+	uint64_t max_size;
+	uint32_t segment_size;
+	uint32_t sync_records;
+	uint32_t first_seq;
+	uint32_t write_seq;
+	int write_fd;
+	uint32_t write_size;
+	uint64_t total_size;
+	uint32_t unsynced;
+	time_t last_sync;
+	spool_cursor_t cursor;
+	discarded_range_t discarded[DISCARDED_MAX];
+	unsigned int n_discarded;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} spool_t;
+
+/**
+ * replay_buffer_t - Data read from the spool to upload
+ *
+ * @type:		Type of the read records.
+ * @cloud_path:	Cloud path of the read records.
+ * @data:		Read data.
+ * @len:		Number of bytes in 'data'.
+ * @capacity:	Size of 'data'.
+ */
+typedef struct {
+	spool_record_type_t type;
+	char cloud_path[MAX_CLOUD_PATH_LEN + 1];
+	char *data;
+	size_t len;
+	size_t capacity;
+} replay_buffer_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static int scan_segments(void);
+static int recover_segment(uint32_t seq);
+static int open_write_segment(void);
+static int rotate_segment(void);
+static int sync_segment(void);
+static void drop_oldest_segment(void);
+static off_t get_segment_size(uint32_t seq);
+static void remove_segment(uint32_t seq);
+static void read_cursor(void);
+static void save_cursor(void);
+static int compare_cursors(const spool_cursor_t *a, const spool_cursor_t *b);
+static void add_discarded(const spool_cursor_t *start, const spool_cursor_t *end);
+static bool has_pending_data(void);
+static void *replay_threaded(void *unused);
+static int replay_batch(replay_buffer_t *buffer);
+static int read_records(int fd, uint32_t offset, uint32_t limit, replay_buffer_t *buffer, uint32_t *end);
+static int wait_spool(unsigned int seconds);
+
+/*------------------------------------------------------------------------------
+                                  M A C R O S
+------------------------------------------------------------------------------*/
+/**
+ * log_spool_debug() - Log the given message as debug
+ *
+ * @format:		Debug message to log.
+ * @args:		Additional arguments.
+ */
+#define log_spool_debug(format, ...)								\
+	log_debug("%s " format, SPOOL_TAG, __VA_ARGS__)
+
+/**
+ * log_spool_info() - Log the given message as info
+ *
+ * @format:		Info message to log.
+ * @args:		Additional arguments.
+ */
+#define log_spool_info(format, ...)									\
+	log_info("%s " format, SPOOL_TAG, __VA_ARGS__)
+
+/**
+ * log_spool_error() - Log the given message as error
+ *
+ * @format:		Error message to log.
+ * @args:		Additional arguments.
+ */
+#define log_spool_error(format, ...)								\
+	log_error("%s " format, SPOOL_TAG, __VA_ARGS__)
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static volatile bool spool_enabled = false;
+static volatile bool stop_requested = false;
+static pthread_t replay_thread;
+static spool_t spool = {
+	.dir_fd = -1,
+	.write_fd = -1,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * start_spool() - Open the outbound data spool and start its replay
+ *
+ * @path:			Directory of the spool. It is created if it does not exist.
+ * 					NULL or empty to disable the spool.
+ * @max_size:		Maximum size of the spool in KB.
+ * @segment_size:	Size of each segment file in KB.
+ * @sync_records:	Number of records to append before flushing them to disk.
+ *
+ * Data stored in a previous execution is kept and replayed once the
+ * connection with Remote Manager is established.
+ *
+ * Return: 0 on success or if the spool is disabled, -1 otherwise.
+ */
+int start_spool(const char *path, uint32_t max_size, uint32_t segment_size, uint32_t sync_records)
+{
+	char *dir = NULL;
+	int error;
+
+	if (spool_enabled)
+		return 0;
+
+	if (path == NULL || strlen(path) == 0) {
+		log_spool_debug("%s", "Data spool disabled");
+		return 0;
+	}
+
+	dir = strdup(path);
+	if (dir == NULL) {
+		log_spool_error("Cannot start data spool: %s", "Out of memory");
+		return -1;
+	}
+	if (mkpath(dir, S_IRWXU) != 0) {
+		log_spool_error("Cannot create data spool directory '%s': %s", path, strerror(errno));
+		free(dir);
+		return -1;
+	}
+	free(dir);
+
+	spool.dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (spool.dir_fd < 0) {
+		log_spool_error("Cannot open data spool directory '%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	spool.max_size = (uint64_t) max_size * 1024;
+	spool.segment_size = segment_size * 1024;
+	spool.sync_records = sync_records > 0 ? sync_records : 1;
+	spool.unsynced = 0;
+	spool.last_sync = time(NULL);
+	spool.n_discarded = 0;
+
+	if (scan_segments() != 0 || open_write_segment() != 0)
+		goto error;
+
+	read_cursor();
+
+	stop_requested = false;
+	error = pthread_create(&replay_thread, NULL, replay_threaded, NULL);
+	if (error != 0) {
+		log_spool_error("Cannot start data spool replay, %d", error);
+		goto error;
+	}
+
+	spool_enabled = true;
+
+	log_spool_info("Data spool started at '%s' (%llu bytes stored)", path,
+			(unsigned long long) spool.total_size);
+
+	return 0;
+
+error:
+	if (spool.write_fd >= 0) {
+		close(spool.write_fd);
+		spool.write_fd = -1;
+	}
+	close(spool.dir_fd);
+	spool.dir_fd = -1;
+
+	return -1;
+}
+
+/*
+ * stop_spool() - Stop the replay and close the outbound data spool
+ *
+ * An upload in progress is not interrupted, it finishes or times out in
+ * REPLAY_SEND_TIMEOUT seconds. Stored data that is not replayed yet is kept
+ * on disk.
+ */
+void stop_spool(void)
+{
+	if (!spool_enabled)
+		return;
+
+	pthread_mutex_lock(&spool.lock);
+	spool_enabled = false;
+	stop_requested = true;
+	pthread_cond_broadcast(&spool.cond);
+	pthread_mutex_unlock(&spool.lock);
+
+	pthread_join(replay_thread, NULL);
+
+	sync_segment();
+	close(spool.write_fd);
+	spool.write_fd = -1;
+	close(spool.dir_fd);
+	spool.dir_fd = -1;
+
+	log_spool_info("%s", "Data spool stopped");
+}
+
+/*
+ * is_spool_enabled() - Check if outbound data can be stored in the spool
+ *
+ * Return: True if the spool is started, false otherwise.
+ */
+bool is_spool_enabled(void)
+{
+	return spool_enabled;
+}
+
+/*
+ * spool_data() - Store data to upload to Remote Manager once it is possible
+ *
+ * @type:		Type of the data.
+ * @cloud_path:	Remote Manager path to upload the data to.
+ * @data:		Data to store.
+ * @size:		Number of bytes of the data.
+ *
+ * The data is appended to the newest segment of the spool. If the spool
+ * exceeds its maximum size, the oldest segments are discarded.
+ *
+ * Return: SPOOL_ERROR_NONE on success, any other error code otherwise.
+ */
+spool_error_t spool_data(spool_record_type_t type, const char *cloud_path, const void *data, size_t size)
+{
+	return spool_data_tracked(type, cloud_path, data, size, NULL);
+}
+
+/*
+ * spool_data_tracked() - Store data and get its position in the spool
+ *
+ * @type:		Type of the data.
+ * @cloud_path:	Remote Manager path to upload the data to.
+ * @data:		Data to store.
+ * @size:		Number of bytes of the data.
+ * @position:	Where to store the position after the record, NULL if it
+ *				is not needed.
+ *
+ * Same as spool_data(), the returned position allows to check with
+ * is_spool_replayed() whether the record already left the spool. When the
+ * position is requested the segment is flushed before returning, so the
+ * record survives a power failure once this function succeeds.
+ *
+ * Return: SPOOL_ERROR_NONE on success, any other error code otherwise.
+ */
+spool_error_t spool_data_tracked(spool_record_type_t type, const char *cloud_path, const void *data, size_t size,
+		spool_position_t *position)
+{
+	record_header_t header;
+	struct iovec iov[3];
+	size_t path_len;
+	size_t record_size;
+	ssize_t written;
+	spool_error_t error = SPOOL_ERROR_NONE;
+
+	if (!spool_enabled)
+		return SPOOL_ERROR_DISABLED;
+
+	if (cloud_path == NULL || data == NULL || size == 0)
+		return SPOOL_ERROR_INVALID_ARGUMENT;
+
+	path_len = strlen(cloud_path);
+	record_size = sizeof(header) + path_len + size;
+	if (path_len == 0 || path_len > MAX_CLOUD_PATH_LEN
+		|| size > UINT32_MAX || record_size > spool.max_size) {
+		log_spool_error("Cannot store data for '%s': invalid size", cloud_path);
+		return SPOOL_ERROR_INVALID_ARGUMENT;
+	}
+
+	header.magic = RECORD_MAGIC;
+	header.type = type;
+	header.path_len = path_len;
+	header.data_len = size;
+	header.crc = crc32(crc32(0, (const Bytef *) cloud_path, path_len), data, size);
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void *) cloud_path;
+	iov[1].iov_len = path_len;
+	iov[2].iov_base = (void *) data;
+	iov[2].iov_len = size;
+
+	pthread_mutex_lock(&spool.lock);
+
+	if (!spool_enabled) {
+		error = SPOOL_ERROR_DISABLED;
+		goto done;
+	}
+
+	if (spool.write_size > 0 && spool.write_size + record_size > spool.segment_size
+		&& rotate_segment() != 0) {
+		error = SPOOL_ERROR_IO;
+		goto done;
+	}
+
+	written = writev(spool.write_fd, iov, 3);
+	if (written < 0 || (size_t) written != record_size) {
+		log_spool_error("Cannot store data for '%s': %s", cloud_path,
+				written < 0 ? strerror(errno) : "short write");
+		/* Do not leave an incomplete record behind. */
+		if (written > 0 && ftruncate(spool.write_fd, spool.write_size) != 0)
+			log_spool_error("Cannot discard incomplete record: %s", strerror(errno));
+		error = SPOOL_ERROR_IO;
+		goto done;
+	}
+
+	spool.write_size += record_size;
+	spool.total_size += record_size;
+	if (position != NULL) {
+		position->seq = spool.write_seq;
+		position->offset = spool.write_size;
+	}
+	spool.unsynced++;
+	if (position != NULL) {
+		if (sync_segment() != 0)
+			error = SPOOL_ERROR_IO;
+	} else if (spool.unsynced >= spool.sync_records) {
+		sync_segment();
+	}
+
+	while (spool.total_size > spool.max_size && spool.first_seq != spool.write_seq)
+		drop_oldest_segment();
+
+	pthread_cond_signal(&spool.cond);
+
+	log_spool_debug("Stored %zu bytes for '%s'", size, cloud_path);
+
+done:
+	pthread_mutex_unlock(&spool.lock);
+
+	return error;
+}
+
+/*
+ * get_spool_status() - Get the delivery status of a stored record
+ *
+ * @position:	Position after the record, from spool_data_tracked().
+ *
+ * A record leaves the spool once it is uploaded, or discarded because
+ * Remote Manager rejected it, it was corrupted or the spool was full. Only
+ * the last DISCARDED_MAX ranges of discarded records are kept, older ones are
+ * merged, so an old uploaded record may be reported as discarded but a
+ * discarded one is never reported as uploaded.
+ *
+ * Return: The delivery status of the record.
+ */
+spool_status_t get_spool_status(const spool_position_t *position)
+{
+	spool_cursor_t record = { .seq = position->seq, .offset = position->offset };
+	spool_status_t status = SPOOL_STATUS_PENDING;
+	unsigned int i;
+
+	pthread_mutex_lock(&spool.lock);
+	if (compare_cursors(&record, &spool.cursor) <= 0) {
+		status = SPOOL_STATUS_UPLOADED;
+		for (i = 0; i < spool.n_discarded; i++) {
+			if (compare_cursors(&record, &spool.discarded[i].start) > 0
+				&& compare_cursors(&record, &spool.discarded[i].end) <= 0) {
+				status = SPOOL_STATUS_DISCARDED;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&spool.lock);
+
+	return status;
+}
+
+/*
+ * scan_segments() - Find the segments stored in the spool directory
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int scan_segments(void)
+{
+	struct dirent *entry;
+	bool found = false;
+	int fd;
+	DIR *dir;
+
+	fd = dup(spool.dir_fd);
+	if (fd < 0 || (dir = fdopendir(fd)) == NULL) {
+		log_spool_error("Cannot read data spool directory: %s", strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	spool.first_seq = 0;
+	spool.write_seq = 0;
+	spool.total_size = 0;
+
+	while ((entry = readdir(dir)) != NULL) {
+		char *endptr = NULL;
+		unsigned long seq;
+		off_t size;
+
+		if (strlen(entry->d_name) != SEGMENT_NAME_LEN - 1
+			|| strcmp(entry->d_name + 8, SEGMENT_SUFFIX) != 0)
+			continue;
+
+		seq = strtoul(entry->d_name, &endptr, 10);
+		if (endptr != entry->d_name + 8 || seq > UINT32_MAX)
+			continue;
+
+		size = get_segment_size(seq);
+		if (size < 0)
+			continue;
+
+		if (!found || seq < spool.first_seq)
+			spool.first_seq = seq;
+		if (!found || seq > spool.write_seq)
+			spool.write_seq = seq;
+		spool.total_size += size;
+		found = true;
+	}
+	closedir(dir);
+
+	if (!found)
+		return 0;
+
+	return recover_segment(spool.write_seq);
+}
+
+/*
+ * recover_segment() - Discard any incomplete record at the end of a segment
+ *
+ * @seq:	Sequence number of the segment.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int recover_segment(uint32_t seq)
+{
+	char name[SEGMENT_NAME_LEN];
+	off_t size, offset = 0;
+	int fd;
+
+	snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, seq);
+	fd = openat(spool.dir_fd, name, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		log_spool_error("Cannot open data spool segment '%s': %s", name, strerror(errno));
+		return -1;
+	}
+
+	size = lseek(fd, 0, SEEK_END);
+	while (offset + (off_t) sizeof(record_header_t) <= size) {
+		record_header_t header;
+		off_t record_end;
+		uLong crc = 0;
+		off_t pos;
+
+		if (pread(fd, &header, sizeof(header), offset) != sizeof(header)
+			|| header.magic != RECORD_MAGIC)
+			break;
+
+		record_end = offset + sizeof(header) + header.path_len + header.data_len;
+		if (record_end > size)
+			break;
+
+		for (pos = offset + sizeof(header); pos < record_end;) {
+			Bytef buff[4096];
+			size_t len = record_end - pos < (off_t) sizeof(buff) ? (size_t) (record_end - pos) : sizeof(buff);
+			ssize_t read_bytes = pread(fd, buff, len, pos);
+
+			if (read_bytes <= 0)
+				break;
+			crc = crc32(crc, buff, read_bytes);
+			pos += read_bytes;
+		}
+		if (pos != record_end || crc != header.crc)
+			break;
+
+		offset = record_end;
+	}
+
+	if (offset != size) {
+		log_spool_error("Discarding %lld bytes of incomplete data in segment '%s'",
+				(long long) (size - offset), name);
+		if (ftruncate(fd, offset) != 0 || fsync(fd) != 0) {
+			log_spool_error("Cannot recover data spool segment '%s': %s", name, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		spool.total_size -= size - offset;
+	}
+	close(fd);
+
+	return 0;
+}
+
+/*
+ * open_write_segment() - Open the newest segment to append records
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int open_write_segment(void)
+{
+	char name[SEGMENT_NAME_LEN];
+	off_t size;
+
+	snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, spool.write_seq);
+	spool.write_fd = openat(spool.dir_fd, name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (spool.write_fd < 0) {
+		log_spool_error("Cannot open data spool segment '%s': %s", name, strerror(errno));
+		return -1;
+	}
+
+	size = lseek(spool.write_fd, 0, SEEK_END);
+	spool.write_size = size > 0 ? size : 0;
+
+	/* Make the new directory entry persistent. */
+	fsync(spool.dir_fd);
+
+	return 0;
+}
+
+/*
+ * rotate_segment() - Close the segment being written and start a new one
+ *
+ * The spool lock must be held.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int rotate_segment(void)
+{
+	sync_segment();
+	close(spool.write_fd);
+	spool.write_fd = -1;
+
+	spool.write_seq++;
+
+	return open_write_segment();
+}
+
+/*
+ * sync_segment() - Flush the records appended to the segment being written
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int sync_segment(void)
+{
+	int ret = 0;
+
+	if (spool.unsynced == 0 || spool.write_fd < 0)
+		return 0;
+
+	if (fdatasync(spool.write_fd) != 0) {
+		log_spool_error("Cannot flush data spool: %s", strerror(errno));
+		ret = -1;
+	}
+
+	spool.unsynced = 0;
+	spool.last_sync = time(NULL);
+
+	return ret;
+}
+
+/*
+ * drop_oldest_segment() - Discard the oldest segment of the spool
+ *
+ * The spool lock must be held.
+ */
+static void drop_oldest_segment(void)
+{
+	uint32_t seq = spool.first_seq;
+
+	log_spool_error("Data spool full, discarding segment %u", seq);
+
+	remove_segment(seq);
+
+	if (spool.cursor.seq == seq) {
+		spool_cursor_t end = { .seq = seq + 1, .offset = 0 };
+
+		add_discarded(&spool.cursor, &end);
+		spool.cursor.seq = spool.first_seq;
+		spool.cursor.offset = 0;
+	}
+}
+
+/*
+ * get_segment_size() - Get the size of a segment
+ *
+ * @seq:	Sequence number of the segment.
+ *
+ * Return: Size of the segment, -1 if it does not exist.
+ */
+static off_t get_segment_size(uint32_t seq)
+{
+	char name[SEGMENT_NAME_LEN];
+	struct stat sb;
+
+	snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, seq);
+	if (fstatat(spool.dir_fd, name, &sb, 0) != 0 || !S_ISREG(sb.st_mode))
+		return -1;
+
+	return sb.st_size;
+}
+
+/*
+ * remove_segment() - Delete the oldest segment
+ *
+ * @seq:	Sequence number of the segment, it must be the oldest one.
+ *
+ * The spool lock must be held.
+ */
+static void remove_segment(uint32_t seq)
+{
+	char name[SEGMENT_NAME_LEN];
+	off_t size = get_segment_size(seq);
+
+	snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, seq);
+	if (unlinkat(spool.dir_fd, name, 0) != 0 && errno != ENOENT)
+		log_spool_error("Cannot remove data spool segment '%s': %s", name, strerror(errno));
+
+	if (size > 0)
+		spool.total_size -= (uint64_t) size < spool.total_size ? (uint64_t) size : spool.total_size;
+	if (spool.first_seq == seq)
+		spool.first_seq = seq + 1;
+}
+
+/*
+ * read_cursor() - Read the replay position stored in the spool directory
+ */
+static void read_cursor(void)
+{
+	spool_cursor_t cursor;
+	int fd = openat(spool.dir_fd, CURSOR_FILE, O_RDONLY | O_CLOEXEC);
+	bool valid = false;
+
+	if (fd >= 0) {
+		valid = read(fd, &cursor, sizeof(cursor)) == sizeof(cursor);
+		close(fd);
+	}
+
+	if (!valid || cursor.seq < spool.first_seq || cursor.seq > spool.write_seq
+		|| (cursor.seq == spool.write_seq && cursor.offset > spool.write_size)) {
+		cursor.seq = spool.first_seq;
+		cursor.offset = 0;
+	}
+
+	spool.cursor = cursor;
+
+	/* Remove segments completely replayed before stopping. */
+	while (spool.first_seq < spool.cursor.seq)
+		remove_segment(spool.first_seq);
+}
+
+/*
+ * save_cursor() - Store the replay position in the spool directory
+ *
+ * The file is replaced atomically, so a power failure leaves either the
+ * previous or the new position.
+ *
+ * The spool lock must be held.
+ */
+static void save_cursor(void)
+{
+	int fd = openat(spool.dir_fd, CURSOR_TMP_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+	if (fd < 0)
+		goto error;
+
+	if (write(fd, &spool.cursor, sizeof(spool.cursor)) != sizeof(spool.cursor)
+		|| fdatasync(fd) != 0) {
+		close(fd);
+		goto error;
+	}
+	close(fd);
+
+	if (renameat(spool.dir_fd, CURSOR_TMP_FILE, spool.dir_fd, CURSOR_FILE) != 0)
+		goto error;
+
+	return;
+
+error:
+	log_spool_error("Cannot save data spool position: %s", strerror(errno));
+}
+
+/*
+ * compare_cursors() - Compare two positions of the spool
+ *
+ * @a:	First position.
+ * @b:	Second position.
+ *
+ * Return: Negative if 'a' is before 'b', 0 if they are equal, positive if 'a'
+ *         is after 'b'.
+ */
+static int compare_cursors(const spool_cursor_t *a, const spool_cursor_t *b)
+{
+	if (a->seq != b->seq)
+		return a->seq < b->seq ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * add_discarded() - Remember a range of records discarded without uploading them
+ *
+ * @start:	Position of the first discarded record.
+ * @end:	Position after the last discarded record.
+ *
+ * Consecutive ranges are merged. When there is no room, the two oldest
+ * ranges are merged, including the records uploaded between them.
+ *
+ * The spool lock must be held.
+ */
+static void add_discarded(const spool_cursor_t *start, const spool_cursor_t *end)
+{
+	if (spool.n_discarded > 0) {
+		discarded_range_t *last = &spool.discarded[spool.n_discarded - 1];
+
+		if (compare_cursors(&last->end, start) == 0) {
+			last->end = *end;
+			return;
+		}
+	}
+
+	if (spool.n_discarded == DISCARDED_MAX) {
+		spool.discarded[1].start = spool.discarded[0].start;
+		memmove(&spool.discarded[0], &spool.discarded[1],
+				(DISCARDED_MAX - 1) * sizeof(spool.discarded[0]));
+		spool.n_discarded--;
+	}
+
+	spool.discarded[spool.n_discarded].start = *start;
+	spool.discarded[spool.n_discarded].end = *end;
+	spool.n_discarded++;
+}
+
+/*
+ * has_pending_data() - Check if there are records to replay
+ *
+ * The spool lock must be held.
+ *
+ * Return: True if there are records to replay, false otherwise.
+ */
+static bool has_pending_data(void)
+{
+	return spool.cursor.seq != spool.write_seq || spool.cursor.offset < spool.write_size;
+}
+
+/*
+ * replay_threaded() - Upload the stored records while connected
+ *
+ * @unused:	Unused.
+ */
+static void *replay_threaded(void *unused)
+{
+	replay_buffer_t buffer = { 0 };
+
+	UNUSED_ARGUMENT(unused);
+
+	buffer.data = malloc(REPLAY_MAX_BYTES);
+	if (buffer.data == NULL) {
+		log_spool_error("Cannot start data spool replay: %s", "Out of memory");
+		return NULL;
+	}
+	buffer.capacity = REPLAY_MAX_BYTES;
+
+	while (!stop_requested) {
+		bool pending;
+		int ret;
+
+		if (wait_spool(CHECK_SECONDS) != 0)
+			break;
+
+		pthread_mutex_lock(&spool.lock);
+		if (spool.unsynced > 0 && time(NULL) - spool.last_sync >= SYNC_SECONDS)
+			sync_segment();
+		pending = has_pending_data();
+		pthread_mutex_unlock(&spool.lock);
+
+		if (!pending || get_cloud_connection_status() != CC_STATUS_CONNECTED)
+			continue;
+
+		do {
+			ret = replay_batch(&buffer);
+		} while (ret > 0 && !stop_requested);
+
+		if (ret < 0)
+			wait_spool(REPLAY_RETRY_SECONDS);
+	}
+
+	free(buffer.data);
+
+	return NULL;
+}
+
+/*
+ * replay_batch() - Upload the next group of stored records
+ *
+ * @buffer:	Buffer to read the records into.
+ *
+ * Consecutive data point records are merged in a single upload of up to
+ * REPLAY_MAX_BYTES. Replayed segments are deleted.
+ *
+ * Return: 1 if records were replayed, 0 if there is nothing to replay, -1 if
+ *         the upload failed.
+ */
+static int replay_batch(replay_buffer_t *buffer)
+{
+	char name[SEGMENT_NAME_LEN];
+	spool_cursor_t start;
+	uint32_t limit, end;
+	int fd, ret;
+	bool discarded = false;
+	ccapi_send_error_t send_error;
+	char hint[256];
+	ccapi_string_info_t hint_info = {
+		.string = hint,
+		.length = sizeof(hint)
+	};
+
+	pthread_mutex_lock(&spool.lock);
+	start = spool.cursor;
+	if (start.seq == spool.write_seq) {
+		limit = spool.write_size;
+	} else {
+		off_t size = get_segment_size(start.seq);
+
+		limit = size > 0 ? size : 0;
+	}
+
+	if (start.offset >= limit) {
+		if (start.seq == spool.write_seq) {
+			pthread_mutex_unlock(&spool.lock);
+			return 0;
+		}
+		/* Segment completely replayed. */
+		remove_segment(start.seq);
+		spool.cursor.seq = start.seq + 1;
+		spool.cursor.offset = 0;
+		save_cursor();
+		pthread_mutex_unlock(&spool.lock);
+		return 1;
+	}
+
+	snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, start.seq);
+	fd = openat(spool.dir_fd, name, O_RDONLY | O_CLOEXEC);
+	pthread_mutex_unlock(&spool.lock);
+
+	if (fd < 0) {
+		log_spool_error("Cannot open data spool segment '%s': %s", name, strerror(errno));
+		ret = -1;
+		end = limit;
+	} else {
+		ret = read_records(fd, start.offset, limit, buffer, &end);
+		close(fd);
+	}
+
+	if (ret != 0) {
+		/* Skip the unreadable data of the segment. */
+		log_spool_error("Discarding corrupted data in segment '%s'", name);
+		end = limit;
+		discarded = true;
+	} else {
+		hint[0] = '\0';
+		log_spool_debug("Replaying %zu bytes to '%s'", buffer->len, buffer->cloud_path);
+		send_error = ccapi_send_data_with_reply(CCAPI_TRANSPORT_TCP,
+				buffer->cloud_path, UPLOAD_CONTENT_TYPE,
+				buffer->data, buffer->len,
+				CCAPI_SEND_BEHAVIOR_OVERWRITE,
+				REPLAY_SEND_TIMEOUT, &hint_info);
+		switch (send_error) {
+			case CCAPI_SEND_ERROR_NONE:
+				break;
+			case CCAPI_SEND_ERROR_INVALID_CLOUD_PATH:
+			case CCAPI_SEND_ERROR_INVALID_CONTENT_TYPE:
+			case CCAPI_SEND_ERROR_INVALID_DATA:
+			case CCAPI_SEND_ERROR_RESPONSE_BAD_REQUEST:
+				/* Retrying would fail again and block the rest of the spool. */
+				log_spool_error("Discarding stored data rejected by Remote Manager, error %d %s",
+						send_error, hint);
+				discarded = true;
+				break;
+			default:
+				log_spool_error("Cannot replay stored data, error %d %s", send_error, hint);
+				return -1;
+		}
+	}
+
+	pthread_mutex_lock(&spool.lock);
+	/* The segment may have been discarded while uploading. */
+	if (spool.cursor.seq == start.seq && spool.cursor.offset == start.offset) {
+		if (discarded) {
+			spool_cursor_t last = { .seq = start.seq, .offset = end };
+
+			add_discarded(&start, &last);
+		}
+		spool.cursor.offset = end;
+		save_cursor();
+	}
+	pthread_mutex_unlock(&spool.lock);
+
+	return 1;
+}
+
+/*
+ * read_records() - Read the next group of records of a segment
+ *
+ * @fd:		Descriptor of the segment.
+ * @offset:	Offset of the first record to read.
+ * @limit:	Size of the valid data of the segment.
+ * @buffer:	Buffer to read the records into.
+ * @end:	Offset after the last read record.
+ *
+ * Return: 0 on success, -1 if the segment is corrupted.
+ */
+static int read_records(int fd, uint32_t offset, uint32_t limit, replay_buffer_t *buffer, uint32_t *end)
+{
+	buffer->len = 0;
+
+	while (offset + sizeof(record_header_t) <= limit) {
+		record_header_t header;
+		char cloud_path[MAX_CLOUD_PATH_LEN + 1];
+		size_t needed;
+		uLong crc;
+
+		if (pread(fd, &header, sizeof(header), offset) != sizeof(header)
+			|| header.magic != RECORD_MAGIC
+			|| header.path_len == 0 || header.path_len > MAX_CLOUD_PATH_LEN
+			|| (uint64_t) offset + sizeof(header) + header.path_len + header.data_len > limit)
+			break;
+
+		if (pread(fd, cloud_path, header.path_len, offset + sizeof(header)) != header.path_len)
+			break;
+		cloud_path[header.path_len] = '\0';
+
+		needed = header.data_len + 1;
+		if (buffer->len > 0) {
+			/* Only data point records to the same path are merged. */
+			if (header.type != SPOOL_RECORD_DP_CSV || buffer->type != SPOOL_RECORD_DP_CSV
+				|| strcmp(cloud_path, buffer->cloud_path) != 0
+				|| buffer->len + needed > buffer->capacity)
+				break;
+		} else if (needed > buffer->capacity) {
+			char *tmp = realloc(buffer->data, needed);
+
+			if (tmp == NULL) {
+				log_spool_error("Cannot replay stored data: %s", "Out of memory");
+				break;
+			}
+			buffer->data = tmp;
+			buffer->capacity = needed;
+		}
+
+		if (pread(fd, buffer->data + buffer->len, header.data_len,
+				offset + sizeof(header) + header.path_len) != (ssize_t) header.data_len)
+			break;
+
+		crc = crc32(crc32(0, (const Bytef *) cloud_path, header.path_len),
+				(const Bytef *) buffer->data + buffer->len, header.data_len);
+		if (crc != header.crc)
+			break;
+
+		if (buffer->len == 0) {
+			buffer->type = header.type;
+			strcpy(buffer->cloud_path, cloud_path);
+		}
+		buffer->len += header.data_len;
+		if (header.type == SPOOL_RECORD_DP_CSV && buffer->data[buffer->len - 1] != '\n')
+			buffer->data[buffer->len++] = '\n';
+
+		offset += sizeof(header) + header.path_len + header.data_len;
+
+		if (header.type != SPOOL_RECORD_DP_CSV)
+			break;
+	}
+
+	*end = offset;
+
+	return buffer->len > 0 ? 0 : -1;
+}
+
+/*
+ * wait_spool() - Wait for new data or the spool to be stopped
+ *
+ * @seconds:	Maximum number of seconds to wait.
+ *
+ * Return: 0 if the wait finished, -1 if the spool is stopped.
+ */
+static int wait_spool(unsigned int seconds)
+{
+	struct timespec deadline;
+	int ret;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += seconds;
+
+	pthread_mutex_lock(&spool.lock);
+	if (!stop_requested)
+		pthread_cond_timedwait(&spool.cond, &spool.lock, &deadline);
+	ret = stop_requested ? -1 : 0;
+	pthread_mutex_unlock(&spool.lock);
+
+	return ret;
+}
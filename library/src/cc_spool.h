@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef CC_SPOOL_H_
+#define CC_SPOOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define SPOOL_DP_CSV_CLOUD_PATH		"DataPoint/.csv"
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+typedef enum {
+	SPOOL_ERROR_NONE,
+	SPOOL_ERROR_DISABLED,
+	SPOOL_ERROR_INVALID_ARGUMENT,
+	SPOOL_ERROR_INSUFFICIENT_MEMORY,
+	SPOOL_ERROR_IO
+} spool_error_t;
+
+/**
+ * spool_record_type_t - Type of the data stored in a spool record
+ *
+ * @SPOOL_RECORD_DP_CSV:	Data points in CSV format without header, one per
+ *							line. Consecutive records are merged in a single
+ *							upload when they are replayed.
+ * @SPOOL_RECORD_FILE:		Any other file, uploaded as it was stored.
+ */
+typedef enum {
+	SPOOL_RECORD_DP_CSV,
+	SPOOL_RECORD_FILE
+} spool_record_type_t;
+
+/**
+ * spool_position_t - Position of the spool right after a stored record
+ *
+ * @seq:	Sequence number of the segment holding the record.
+ * @offset:	Offset after the record in the segment.
+ */
+typedef struct {
+	uint32_t seq;
+	uint32_t offset;
+} spool_position_t;
+
+/**
+ * spool_status_t - Delivery status of a stored record
+ *
+ * @SPOOL_STATUS_PENDING:	Stored, waiting to be uploaded.
+ * @SPOOL_STATUS_UPLOADED:	Uploaded to Remote Manager.
+ * @SPOOL_STATUS_DISCARDED:	Discarded without being uploaded, because Remote
+ *							Manager rejected it, it was corrupted or the
+ *							spool was full.
+ */
+typedef enum {
+	SPOOL_STATUS_PENDING,
+	SPOOL_STATUS_UPLOADED,
+	SPOOL_STATUS_DISCARDED
+} spool_status_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+int start_spool(const char *path, uint32_t max_size, uint32_t segment_size, uint32_t sync_records);
+void stop_spool(void);
+bool is_spool_enabled(void);
+spool_error_t spool_data(spool_record_type_t type, const char *cloud_path, const void *data, size_t size);
+spool_error_t spool_data_tracked(spool_record_type_t type, const char *cloud_path, const void *data, size_t size,
+		spool_position_t *position);
+spool_status_t get_spool_status(const spool_position_t *position);
+
+#endif /* CC_SPOOL_H_ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef CC_SYSMON_H_
+#define CC_SYSMON_H_
+
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+typedef enum {
+	SYSMON_ERROR_NONE,
+	SYSMON_ERROR_INVALID_ARGUMENT,
+	SYSMON_ERROR_ALREADY_REGISTERED,
+	SYSMON_ERROR_NOT_FOUND,
+	SYSMON_ERROR_INSUFFICIENT_MEMORY
+} sysmon_error_t;
+
+/**
+ * sysmon_value_type_t - Type of the values of a metric provider
+ *
+ * @SYSMON_VALUE_DOUBLE:	Floating point values, stored in 'd'.
+ * @SYSMON_VALUE_INT32:		32-bit integer values, stored in 'i'.
+ * @SYSMON_VALUE_INT64:		64-bit integer values, stored in 'i'.
+ */
+typedef enum {
+	SYSMON_VALUE_DOUBLE,
+	SYSMON_VALUE_INT32,
+	SYSMON_VALUE_INT64
+} sysmon_value_type_t;
+
+typedef union {
+	double d;
+	int64_t i;
+} sysmon_value_t;
+
+/**
+ * sysmon_sample_fn_t - Read the current value of a metric provider
+ *
+ * @value:	Where to store the value, the member depends on the provider type.
+ * @ctx:	Context given when the provider was registered.
+ *
+ * The function is called from the system monitor thread every sample period
+ * of the metric, so it must not block. It runs with the lock of the providers
+ * held: it must not register or unregister providers, and other threads doing
+ * so wait until it returns. This is what guarantees the function is not called
+ * once cc_sysmon_unregister_provider() returns.
+ *
+ * Return: 0 on success, any other value to skip this sample.
+ */
+typedef int (*sysmon_sample_fn_t)(sysmon_value_t *value, void *ctx);
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+sysmon_error_t cc_sysmon_register_provider(const char *name, const char *units,
+		sysmon_value_type_t type, sysmon_sample_fn_t sample_fn, void *ctx);
+sysmon_error_t cc_sysmon_unregister_provider(const char *name);
+
+#endif /* CC_SYSMON_H_ */
@@ -17,25 +17,49 @@
  * ===========================================================================
  */
 
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <libdigiapix/bluetooth.h>
 #include <libdigiapix/network.h>
+#include <limits.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <sys/sysinfo.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "aggregate.h"
 #include "ccapi/ccapi.h"
 #include "cc_config.h"
 #include "cc_init.h"
 #include "cc_logging.h"
+#include "cc_spool.h"
+#include "cc_sysmon.h"
 #include "cc_system_monitor.h"
+#include "cc_timestamp.h"
 #include "file_utils.h"
+#include "link_stats.h"
+#include "process_scanner.h"
+#include "resource_stats.h"
+#include "storage_stats.h"
+#include "string_utils.h"
 
 /*------------------------------------------------------------------------------
                              D E F I N I T I O N S
 ------------------------------------------------------------------------------*/
-#define LOOP_MS						100
+#define SEND_MAX_SAMPLES			2000
+#define SEND_RETRY_SECONDS			10
+#define CONNECTION_CHECK_SECONDS	5
 
 #define MAX_LENGTH					256
 
@@ -45,26 +69,65 @@
 
 #define METRIC_FREE_MEMORY			"free_memory"
 #define METRIC_USED_MEMORY			"used_memory"
+#define METRIC_CACHED_MEMORY		"cached_memory"
+#define METRIC_DIRTY_MEMORY			"dirty_memory"
+#define METRIC_FREE_SWAP			"free_swap"
+#define METRIC_USED_SWAP			"used_swap"
 #define METRIC_CPU_LOAD				"cpu_load"
 #define METRIC_CPU_TEMP				"cpu_temperature"
 #define METRIC_FREQ					"frequency"
 #define METRIC_UPTIME				"uptime"
+#define METRIC_SUPPRESSED			"suppressed_samples"
+#define METRIC_PROCESSES			"processes"
+#define METRIC_PROCESS_CPU_LOAD		METRIC_PROCESSES "/%s/" METRIC_CPU_LOAD
+#define METRIC_PROCESS_MEMORY		METRIC_PROCESSES "/%s/memory"
+#define METRIC_DISK_READ			"disk/%s/read_throughput"
+#define METRIC_DISK_WRITE			"disk/%s/write_throughput"
+#define METRIC_DISK_IOPS			"disk/%s/iops"
+#define METRIC_DISK_UTILIZATION		"disk/%s/utilization"
+#define METRIC_FS_FREE				"filesystem/%s/free"
+#define METRIC_FS_USED				"filesystem/%s/used"
+#define METRIC_FS_USAGE				"filesystem/%s/usage"
+#define METRIC_PSI_SOME_AVG10		"pressure/%s/some_avg10"
+#define METRIC_PSI_SOME_AVG60		"pressure/%s/some_avg60"
+#define METRIC_PSI_SOME_STALL		"pressure/%s/some_stall"
+#define METRIC_PSI_FULL_AVG10		"pressure/%s/full_avg10"
+#define METRIC_PSI_FULL_AVG60		"pressure/%s/full_avg60"
+#define METRIC_PSI_FULL_STALL		"pressure/%s/full_stall"
 #define METRIC_STATE				"state"
 #define METRIC_RX_BYTES				"rx_bytes"
 #define METRIC_TX_BYTES				"tx_bytes"
+#define METRIC_RX_PACKETS			"rx_packets"
+#define METRIC_TX_PACKETS			"tx_packets"
+#define METRIC_RX_ERRORS			"rx_errors"
+#define METRIC_TX_ERRORS			"tx_errors"
+#define METRIC_RX_DROPPED			"rx_dropped"
+#define METRIC_TX_DROPPED			"tx_dropped"
 
 #define SYS_MON_DATA_STREAM_PREFIX	"system_monitor/"
 
 #define DATA_STREAM_FREE_MEMORY		SYS_MON_DATA_STREAM_PREFIX METRIC_FREE_MEMORY
 #define DATA_STREAM_USED_MEMORY		SYS_MON_DATA_STREAM_PREFIX METRIC_USED_MEMORY
+#define DATA_STREAM_CACHED_MEMORY	SYS_MON_DATA_STREAM_PREFIX METRIC_CACHED_MEMORY
+#define DATA_STREAM_DIRTY_MEMORY	SYS_MON_DATA_STREAM_PREFIX METRIC_DIRTY_MEMORY
+#define DATA_STREAM_FREE_SWAP		SYS_MON_DATA_STREAM_PREFIX METRIC_FREE_SWAP
+#define DATA_STREAM_USED_SWAP		SYS_MON_DATA_STREAM_PREFIX METRIC_USED_SWAP
 #define DATA_STREAM_CPU_LOAD		SYS_MON_DATA_STREAM_PREFIX METRIC_CPU_LOAD
 #define DATA_STREAM_CPU_TEMP		SYS_MON_DATA_STREAM_PREFIX METRIC_CPU_TEMP
 #define DATA_STREAM_FREQ			SYS_MON_DATA_STREAM_PREFIX METRIC_FREQ
 #define DATA_STREAM_UPTIME			SYS_MON_DATA_STREAM_PREFIX METRIC_UPTIME
+#define DATA_STREAM_SUPPRESSED		SYS_MON_DATA_STREAM_PREFIX METRIC_SUPPRESSED
+#define DATA_STREAM_PROCESSES		SYS_MON_DATA_STREAM_PREFIX METRIC_PROCESSES
 
 #define DATA_STREAM_NET_STATE		SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_STATE
 #define DATA_STREAM_NET_TRAFFIC_RX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_RX_BYTES
 #define DATA_STREAM_NET_TRAFFIC_TX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_TX_BYTES
+#define DATA_STREAM_NET_PACKETS_RX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_RX_PACKETS
+#define DATA_STREAM_NET_PACKETS_TX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_TX_PACKETS
+#define DATA_STREAM_NET_ERRORS_RX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_RX_ERRORS
+#define DATA_STREAM_NET_ERRORS_TX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_TX_ERRORS
+#define DATA_STREAM_NET_DROPPED_RX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_RX_DROPPED
+#define DATA_STREAM_NET_DROPPED_TX	SYS_MON_DATA_STREAM_PREFIX "%s/" METRIC_TX_DROPPED
 
 #define DATA_STREAM_MEMORY_UNITS	"kB"
 #define DATA_STREAM_CPU_LOAD_UNITS	"%"
@@ -73,65 +136,470 @@
 #define DATA_STREAM_UPTIME_UNITS	"s"
 #define DATA_STREAM_STATE_UNITS		"state"
 #define DATA_STREAM_BYTES_UNITS		"bytes"
+#define DATA_STREAM_PACKETS_UNITS	"packets"
+#define DATA_STREAM_SAMPLES_UNITS	"samples"
+#define DATA_STREAM_THROUGHPUT_UNITS	"bytes/s"
+#define DATA_STREAM_IOPS_UNITS		"ops/s"
+#define DATA_STREAM_STALL_UNITS		"us"
+
+#define METRIC_CORE_LOAD			"cpu%d/load"
+#define METRIC_ZONE_TEMP			"thermal_zone%d/temperature"
+#define METRIC_POLICY_FREQ			"cpufreq_policy%d/frequency"
 
 #define FILE_CPU_LOAD				"/proc/stat"
 #define FILE_CPU_TEMP				"/sys/class/thermal/thermal_zone0/temp"
 #define FILE_CPU_FREQ				"/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_cur_freq"
 
+#define DIR_BLOCK					"/sys/block"
+#define FW_DOWNLOAD_FS_NAME			"firmware"
+
+#define NETLINK_BUFFER_SIZE			8192
+
+#define MAX_PROCESS_STREAMS			64
+/* Scans out of the top processes before the stream of a process can be reused */
+#define PROCESS_STREAM_IDLE_SCANS	10
+
+#define DIR_THERMAL					"/sys/class/thermal"
+#define DIR_CPUFREQ					"/sys/devices/system/cpu/cpufreq"
+#define THERMAL_ZONE_PREFIX			"thermal_zone"
+#define CPUFREQ_POLICY_PREFIX		"policy"
+
 /*------------------------------------------------------------------------------
                  D A T A    T Y P E S    D E F I N I T I O N S
 ------------------------------------------------------------------------------*/
 typedef enum {
 	STREAM_FREE_MEM,
 	STREAM_USED_MEM,
+	STREAM_CACHED_MEM,
+	STREAM_DIRTY_MEM,
+	STREAM_FREE_SWAP,
+	STREAM_USED_SWAP,
 	STREAM_CPU_LOAD,
 	STREAM_CPU_TEMP,
 	STREAM_FREQ,
 	STREAM_UPTIME,
+	STREAM_SUPPRESSED,
 	STREAM_STATE,
 	STREAM_RX_BYTES,
 	STREAM_TX_BYTES,
+	STREAM_RX_PACKETS,
+	STREAM_TX_PACKETS,
+	STREAM_RX_ERRORS,
+	STREAM_TX_ERRORS,
+	STREAM_RX_DROPPED,
+	STREAM_TX_DROPPED,
+	STREAM_PROVIDER,
+	STREAM_PROCESSES,
+	STREAM_PROCESS_CPU_LOAD,
+	STREAM_PROCESS_MEMORY,
+	STREAM_DISK_READ,
+	STREAM_DISK_WRITE,
+	STREAM_DISK_IOPS,
+	STREAM_DISK_UTILIZATION,
+	STREAM_FS_FREE,
+	STREAM_FS_USED,
+	STREAM_FS_USAGE,
+	STREAM_PSI_SOME_AVG10,
+	STREAM_PSI_SOME_AVG60,
+	STREAM_PSI_SOME_STALL,
+	STREAM_PSI_FULL_AVG10,
+	STREAM_PSI_FULL_AVG60,
+	STREAM_PSI_FULL_STALL,
 } stream_type_t;
 
-typedef struct {
+/* Disk and filesystem streams keep their device or mount point in 'file'. */
+#define IS_STORAGE_STREAM(type)		((type) >= STREAM_DISK_READ && (type) <= STREAM_FS_USAGE)
+
+/* Process and network streams count their pending samples, they are freed while running. */
+#define IS_COUNTED_STREAM(stream)	((stream)->type == STREAM_PROCESS_CPU_LOAD		\
+									|| (stream)->type == STREAM_PROCESS_MEMORY		\
+									|| (stream)->source == STREAM_SOURCE_NET)
+
+typedef enum {
+	STREAM_SOURCE_SYSTEM,
+	STREAM_SOURCE_NET,
+	STREAM_SOURCE_BT,
+	STREAM_SOURCE_PROVIDER
+} stream_source_t;
+
+typedef enum {
+	VALUE_DOUBLE,
+	VALUE_INT32,
+	VALUE_INT64
+} value_type_t;
+
+typedef union {
+	double d;
+	int64_t i;
+} sample_value_t;
+
+/**
+ * provider_t - Metric provider registered by an application
+ *
+ * @name:		Metric name.
+ * @units:		Units of the values.
+ * @type:		Type of the values.
+ * @sample_fn:	Function that reads the value.
+ * @ctx:		Context for 'sample_fn'.
+ * @removed:	Whether the provider was unregistered. It is kept until the
+ *				monitor stops if samples not uploaded yet may refer to it.
+ * @checked:	Whether the sampling thread already processed the provider.
+ * @stream:		Stream of the provider, NULL if none.
+ * @next:		Next registered provider.
+ */
+typedef struct provider {
+	char *name;
+	char *units;
+	sysmon_value_type_t type;
+	sysmon_sample_fn_t sample_fn;
+	void *ctx;
+	bool removed;
+	bool checked;
+	struct stream *stream;
+	struct provider *next;
+} provider_t;
+
+/**
+ * stream_t - System monitor data stream
+ *
+ * @name:		Metric or interface name.
+ * @path:		Data stream path in Remote Manager.
+ * @units:		Units of the values.
+ * @format:		Data point format string.
+ * @type:		Metric of the stream.
+ * @source:		Where the values of the stream are read from.
+ * @value_type:	Type of the values stored in the samples of this stream.
+ * @period:		Sample period in seconds.
+ * @file:		File the values are read from, the device or mount point of a
+ *				storage stream, NULL if none.
+ * @fd:			Descriptor of 'file', opened once and re-read on every sample.
+ * @cpu:		CPU core of a load stream, -1 for the whole system. Index in
+ *				'pressures' of a pressure stream.
+ * @last_work:	CPU work time at the previous sample of a load stream, counter
+ *				at the previous sample of a disk or pressure stall stream,
+ *				number of the last scan a process stream was in the top.
+ * @last_total:	CPU total time at the previous sample of a load stream, time
+ *				of the previous sample of a disk stream, non-zero once a
+ *				pressure stall stream has been read.
+ * @active:		Whether the stream is sampled. Streams of removed interfaces
+ *				are kept inactive while samples not uploaded yet refer to them.
+ * @send_id:	Identifier of the last upload that added this stream to its
+ *				collection (only used by the sender thread).
+ * @deadband:	Minimum change of the value to report a new sample, negative
+ *				to report every sample.
+ * @deadband_percent:	Whether 'deadband' is a percentage of 'last_value'.
+ * @reported:	Whether a sample of the stream has been reported.
+ * @last_value:	Last reported value.
+ * @last_report:	Timestamp of the last reported value, in milliseconds.
+ * @n_reported:	Number of samples reported.
+ * @n_suppressed:	Number of samples suppressed by the deadband.
+ * @aggregate:	Summary of the current window, NULL if the samples of the
+ *				stream are uploaded instead of aggregated.
+ * @window:		Aggregation window in seconds.
+ * @window_end:	Timestamp that closes the current window, in milliseconds, 0
+ *				if not started.
+ * @summaries:	Streams of the window summaries, one per aggregate function.
+ * @provider:	Metric provider of the stream, NULL if it is not a provider
+ *				stream or the provider was unregistered.
+ * @n_pending:	Number of samples of a process or network stream in batches
+ *				not freed yet, the stream cannot be freed until it is 0.
+ */
+typedef struct stream {
 	char *name;
 	char *path;
 	const char *units;
 	const char *format;
 	stream_type_t type;
+	stream_source_t source;
+	value_type_t value_type;
+	uint32_t period;
+	char *file;
+	int fd;
+	int cpu;
+	unsigned long long last_work;
+	unsigned long long last_total;
+	bool active;
+	unsigned long send_id;
+	double deadband;
+	bool deadband_percent;
+	bool reported;
+	sample_value_t last_value;
+	uint64_t last_report;
+	unsigned long n_reported;
+	unsigned long n_suppressed;
+	aggregate_t *aggregate;
+	uint32_t window;
+	uint64_t window_end;
+	struct stream *summaries;
+	struct provider *provider;
+	unsigned int n_pending;
 } stream_t;
 
 typedef struct {
-	stream_t *streams;
+	stream_t **streams;
 	int n_streams;
 } stream_list_t;
 
+/**
+ * schedule_entry_t - Group of streams sampled with the same period
+ *
+ * @next_ms:	CLOCK_MONOTONIC time of the next sample, in milliseconds.
+ * @period_ms:	Sample period in milliseconds.
+ * @streams:	Streams of the group.
+ * @n_streams:	Number of streams of the group.
+ */
+typedef struct {
+	uint64_t next_ms;
+	uint64_t period_ms;
+	stream_t **streams;
+	int n_streams;
+} schedule_entry_t;
+
+/**
+ * scheduler_t - Schedule of the stream samples
+ *
+ * @entries:	Min-heap of entries ordered by 'next_ms'.
+ * @n_entries:	Number of entries.
+ * @timer_fd:	Timer that expires when the first entry is due.
+ * @stretch:	Factor applied to the period of every entry by the adaptive
+ *				sampling, 1 to sample with the configured periods.
+ */
+typedef struct {
+	schedule_entry_t *entries;
+	int n_entries;
+	int timer_fd;
+	uint32_t stretch;
+} scheduler_t;
+
+/**
+ * cpu_times_t - CPU times read from '/proc/stat'
+ *
+ * @work:	Time spent in user, nice and system modes.
+ * @total:	Total time.
+ * @online:	Whether the CPU was listed in the last read.
+ */
+typedef struct {
+	unsigned long long work;
+	unsigned long long total;
+	bool online;
+} cpu_times_t;
+
+/**
+ * tick_t - Values shared by all the samples taken at the same time
+ *
+ * @timestamp:	The timestamp for the samples, in milliseconds since the Epoch.
+ * @info:		System information, read once per tick when first needed.
+ * @info_read:	Whether 'info' has been read in this tick.
+ * @info_error:	Whether reading 'info' failed in this tick.
+ * @stat_read:	Whether the CPU times have been read in this tick.
+ * @stat_error:	Whether reading the CPU times failed in this tick.
+ * @links_read:	Whether the network interfaces have been read in this tick.
+ * @links_error:	Whether reading the network interfaces failed in this tick.
+ * @meminfo_read:	Whether the memory statistics have been read in this tick.
+ * @meminfo_error:	Whether reading the memory statistics failed in this tick.
+ * @psi_read:	Bitmask of the 'pressures' read in this tick.
+ * @psi_error:	Bitmask of the 'pressures' that failed to be read in this tick.
+ * @disks_read:	Whether the block device statistics have been read in this tick.
+ * @disks_error:	Whether reading the block device statistics failed in this tick.
+ * @fs_path:	Mount point of 'fs_usage', NULL if none has been read in this tick.
+ * @fs_usage:	Usage of the last filesystem read in this tick.
+ * @fs_error:	Whether reading 'fs_usage' failed.
+ */
+typedef struct {
+	uint64_t timestamp;
+	struct sysinfo info;
+	bool info_read;
+	bool info_error;
+	bool stat_read;
+	bool stat_error;
+	bool links_read;
+	bool links_error;
+	bool meminfo_read;
+	bool meminfo_error;
+	unsigned int psi_read;
+	unsigned int psi_error;
+	bool disks_read;
+	bool disks_error;
+	const char *fs_path;
+	fs_usage_t fs_usage;
+	bool fs_error;
+} tick_t;
+
+/**
+ * iface_cache_t - Statistics of a Bluetooth interface shared by its streams
+ *
+ * @iface_name:	Name of the interface the statistics belong to.
+ * @bt_state:	Bluetooth interface state.
+ * @bt_stats:	Bluetooth interface statistics.
+ */
+typedef struct {
+	const char *iface_name;
+	bt_state_t bt_state;
+	bt_stats_t bt_stats;
+} iface_cache_t;
+
+/**
+ * sample_t - A single value read from a stream
+ *
+ * @stream:		Stream the value belongs to.
+ * @value:		Read value, its type depends on 'stream->value_type'.
+ * @timestamp:	Time the value was read, in milliseconds since the Epoch.
+ */
+typedef struct {
+	stream_t *stream;
+	sample_value_t value;
+	uint64_t timestamp;
+} sample_t;
+
+/**
+ * batch_t - Group of samples that are uploaded together
+ *
+ * @samples:	Samples of the batch.
+ * @n_samples:	Number of samples stored in the batch.
+ * @capacity:	Maximum number of samples of the batch.
+ * @next:		Next batch in the backlog.
+ */
+typedef struct batch {
+	sample_t *samples;
+	uint32_t n_samples;
+	uint32_t capacity;
+	struct batch *next;
+} batch_t;
+
+/**
+ * backlog_t - Queue of complete batches pending to be uploaded
+ *
+ * @head:			Oldest pending batch.
+ * @tail:			Newest pending batch.
+ * @n_batches:		Number of batches in the queue.
+ * @max_batches:	Maximum number of batches in the queue.
+ * @policy:			Batch to discard when the queue is full.
+ * @lock:			Lock to access the queue.
+ * @cond:			Condition signaled when a batch is queued or the monitor
+ *					is stopped.
+ */
+typedef struct {
+	batch_t *head;
+	batch_t *tail;
+	uint32_t n_batches;
+	uint32_t max_batches;
+	sys_mon_backlog_policy_t policy;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} backlog_t;
+
 /*------------------------------------------------------------------------------
                     F U N C T I O N  D E C L A R A T I O N S
 ------------------------------------------------------------------------------*/
 static void *system_monitor_threaded(void *cc_cfg);
+static void *system_monitor_sender_threaded(void *cc_cfg);
 static void system_monitor_loop(const cc_cfg_t *const cc_cfg);
+static void system_monitor_sender_loop(const cc_cfg_t *const cc_cfg);
 static ccapi_dp_error_t init_system_monitor(const cc_cfg_t *const cc_cfg);
-static ccapi_dp_error_t init_iface_streams(const char *const iface_name, stream_list_t *stream_list, const cc_cfg_t *const cc_cfg);
+static ccapi_dp_error_t init_iface_streams(const char *const iface_name, stream_list_t *stream_list,
+		stream_source_t source, const cc_cfg_t *const cc_cfg);
+static ccapi_dp_error_t add_iface_stream(const char *const iface_name, stream_list_t *stream_list,
+		stream_source_t source, const stream_t *stream_format, const cc_cfg_t *const cc_cfg);
 static ccapi_dp_error_t init_sys_streams(const cc_cfg_t *const cc_cfg);
+static ccapi_dp_error_t add_sys_stream(const stream_t *stream_format, const char *name,
+		const char *path, const char *file, int cpu, const cc_cfg_t *const cc_cfg);
+static ccapi_dp_error_t add_cpu_core_streams(const cc_cfg_t *const cc_cfg);
+static ccapi_dp_error_t add_sysfs_streams(const char *dir, const char *prefix, const char *metric,
+		const char *const files[], stream_type_t type, const cc_cfg_t *const cc_cfg);
+static const stream_t *get_sys_stream_format(stream_type_t type);
 static ccapi_dp_error_t init_net_streams(const cc_cfg_t *const cc_cfg);
 static ccapi_dp_error_t init_bt_streams(const cc_cfg_t *const cc_cfg);
-static void add_samples(void);
-static void add_sys_samples(ccapi_timestamp_t timestamp);
-static void add_net_samples(ccapi_timestamp_t timestamp);
-static void add_bt_samples(ccapi_timestamp_t timestamp);
-static ccapi_timestamp_t *get_timestamp(void);
-static double get_free_memory(void);
-static double get_used_memory(void);
-static double get_cpu_load(void);
-static double get_cpu_temp(void);
-static unsigned long get_cpu_freq(void);
-static unsigned long get_uptime(void);
+static stream_t *new_stream(stream_list_t *stream_list);
+static int open_link_monitor(void);
+static void close_link_monitor(void);
+static void handle_link_events(const cc_cfg_t *const cc_cfg);
+static void handle_link_message(const struct nlmsghdr *msg, const cc_cfg_t *const cc_cfg);
+static void sync_net_streams(const cc_cfg_t *const cc_cfg);
+static void add_net_iface(const char *iface_name, const cc_cfg_t *const cc_cfg);
+static void remove_net_iface(const char *iface_name);
+static void retire_net_streams(void);
+static void update_batch_capacity(const cc_cfg_t *const cc_cfg);
+static int open_provider_events(void);
+static void close_provider_events(void);
+static void sync_provider_streams(const cc_cfg_t *const cc_cfg);
+static void add_provider_stream(provider_t *provider, const cc_cfg_t *const cc_cfg);
+static void reset_providers(void);
+static provider_t *find_provider(const char *name);
+static bool has_valid_provider_chars(const char *text, const char *symbols);
+static bool is_valid_provider_name(const char *name);
+static bool is_valid_provider_units(const char *units);
+static int open_link_stats(void);
+static void close_link_stats(void);
+static int read_links(tick_t *tick);
+static const link_info_t *find_link(const char *iface_name);
+static int init_scheduler(void);
+static int schedule_stream(stream_t *stream, uint64_t now);
+static void unschedule_stream(const stream_t *stream);
+static void sift_up_entry(int index);
+static void free_scheduler(void);
+static void sift_down_entry(int index);
+static int arm_timer(uint64_t due_ms);
+static uint64_t get_monotonic_ms(void);
+static void update_stretch(const cc_cfg_t *const cc_cfg, uint64_t now);
+static uint32_t get_stream_period(const char *metric_name, const cc_cfg_t *const cc_cfg);
+static void set_stream_deadband(stream_t *stream, const char *metric_name, const cc_cfg_t *const cc_cfg);
+static bool is_sample_reportable(stream_t *stream, sample_value_t value, uint64_t timestamp);
+static void log_suppressed_samples(void);
+static int set_stream_aggregation(stream_t *stream, const char *metric_name, const cc_cfg_t *const cc_cfg);
+static void aggregate_sample(stream_t *stream, sample_value_t value, uint64_t timestamp);
+static void add_entry_samples(const schedule_entry_t *entry, tick_t *tick);
+static int read_sys_value(stream_t *stream, tick_t *tick, sample_value_t *value);
+static int read_net_value(const stream_t *stream, tick_t *tick, sample_value_t *value);
+static int read_bt_value(const stream_t *stream, iface_cache_t *cache, sample_value_t *value);
+static int read_provider_value(const stream_t *stream, sample_value_t *value);
+static int init_processes(const cc_cfg_t *const cc_cfg);
+static void free_processes(void);
+static void add_process_samples(tick_t *tick);
+static stream_t *get_process_stream(const char *process_name, stream_type_t type);
+static bool has_pending_samples(stream_t *stream);
+static int retire_process_stream(void);
+static void add_sample(stream_t *stream, sample_value_t value, uint64_t timestamp);
+static batch_t *create_batch(uint32_t capacity);
+static void free_batch_list(batch_t *batch);
+static void seal_batch(void);
+static batch_t *take_batches(void);
+static void requeue_batches(batch_t *batches);
+static batch_t *trim_backlog(void);
+static void wait_before_retry(unsigned int seconds);
+static ccapi_dp_error_t send_batches(batch_t *batches, unsigned long timeout);
+static ccapi_dp_error_t add_sample_to_collection(ccapi_dp_collection_handle_t collection,
+		const sample_t *const sample, unsigned long send_id);
+static int spool_batches(const batch_t *batches);
+static int format_sample_csv(char *buffer, size_t size, const sample_t *sample);
+static int init_cpu_stat(void);
+static void free_cpu_stat(void);
+static int read_cpu_stat(tick_t *tick);
+static const struct sysinfo *get_tick_sysinfo(tick_t *tick);
+static int init_resource_stats(void);
+static void free_resource_stats(void);
+static int read_meminfo(tick_t *tick);
+static double get_memory(const stream_t *stream, tick_t *tick);
+static ccapi_dp_error_t add_pressure_streams(const cc_cfg_t *const cc_cfg);
+static int read_pressure(int index, tick_t *tick);
+static int get_pressure(stream_t *stream, tick_t *tick, double *value);
+static double get_cpu_load(stream_t *stream, tick_t *tick);
+static double get_cpu_temp(const stream_t *stream);
+static unsigned long get_cpu_freq(const stream_t *stream);
+static unsigned long get_uptime(tick_t *tick);
+static int init_disk_stats(void);
+static void free_disk_stats(void);
+static int read_disk_stats(tick_t *tick);
+static const disk_stats_t *find_disk_stats(const char *name);
+static ccapi_dp_error_t add_storage_streams(const cc_cfg_t *const cc_cfg);
+static ccapi_dp_error_t add_fs_streams(const char *name, const char *mount_point,
+		const cc_cfg_t *const cc_cfg);
+static int get_disk_rate(stream_t *stream, tick_t *tick, double *rate);
+static int get_fs_usage(const stream_t *stream, tick_t *tick, sample_value_t *value);
+static void free_sys_readers(void);
+static void free_stream(stream_t *stream);
 static void free_stream_list(stream_list_t *stream_list);
-static void free_timestamp(ccapi_timestamp_t *timestamp);
-static ccapi_bool_t should_read_metric(char *metric_name, const cc_cfg_t *const cc_cfg);
-static ccapi_bool_t should_read_interface(char *iface_name, const cc_cfg_t *const cc_cfg);
-static ccapi_bool_t value_matches_wildcard_pattern(char* value, char* pattern);
+static ccapi_bool_t should_read_metric(const char *metric_name, const cc_cfg_t *const cc_cfg);
+static ccapi_bool_t should_read_interface(const char *iface_name, const cc_cfg_t *const cc_cfg);
 
 /*------------------------------------------------------------------------------
                                   M A C R O S
@@ -168,33 +636,127 @@ static ccapi_bool_t value_matches_wildcard_pattern(char* value, char* pattern);
 ------------------------------------------------------------------------------*/
 static volatile bool stop_requested = false;
 static volatile ccapi_bool_t dp_thread_valid = CCAPI_FALSE;
+static volatile ccapi_bool_t sender_thread_valid = CCAPI_FALSE;
 static pthread_t dp_thread;
-static ccapi_dp_collection_handle_t dp_collection;
-static unsigned long long last_work = 0, last_total = 0;
+static pthread_t sender_thread;
+static int stop_fd = -1;
+static int netlink_fd = -1;
+static char netlink_buffer[NETLINK_BUFFER_SIZE] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+static link_stats_t *link_stats;
+static const link_info_t *links;
+static int n_links;
+static scheduler_t scheduler = {
+	.timer_fd = -1,
+	.stretch = 1
+};
+static batch_t *current_batch;
+static uint32_t batch_capacity;
+static backlog_t backlog = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+static int proc_stat_fd = -1;
+static char *proc_stat_buffer;
+static long proc_stat_size;
+static cpu_times_t *cpu_times;
+static int n_cpu_times;
+static resource_stats_t *resource_stats;
+static meminfo_t meminfo;
+static psi_t pressures[PSI_N_RESOURCES];
+static disk_stats_reader_t *disk_stats_reader;
+static const disk_stats_t *disk_stats;
+static int n_disk_stats;
+static uint64_t disk_stats_time;
+static uint32_t heartbeat;
+static unsigned long n_suppressed_samples;
 static stream_list_t bt_stream_list;
 static stream_list_t net_stream_list;
 static stream_list_t sys_stream_list;
+static stream_list_t provider_stream_list;
+static stream_list_t process_stream_list;
+static process_scanner_t *process_scanner;
+static process_info_t *top_cpu_processes;
+static process_info_t *top_memory_processes;
+static uint32_t n_top_processes;
+static unsigned long long n_process_scans;
+static const cc_cfg_t *processes_cfg;
+static provider_t *providers;
+static int provider_fd = -1;
+static pthread_mutex_t providers_lock = PTHREAD_MUTEX_INITIALIZER;
 static stream_t net_stream_formats[] = {
 	{
 		.name = METRIC_STATE,
 		.path = DATA_STREAM_NET_STATE,
 		.units = DATA_STREAM_STATE_UNITS,
-		.format = "int64 ts_iso",
-		.type = STREAM_STATE
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_STATE,
+		.value_type = VALUE_INT64
 	},
 	{
 		.name = METRIC_RX_BYTES,
 		.path = DATA_STREAM_NET_TRAFFIC_RX,
 		.units = DATA_STREAM_BYTES_UNITS,
-		.format = "int64 ts_iso",
-		.type = STREAM_RX_BYTES
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_RX_BYTES,
+		.value_type = VALUE_INT64
 	},
 	{
 		.name = METRIC_TX_BYTES,
 		.path = DATA_STREAM_NET_TRAFFIC_TX,
 		.units = DATA_STREAM_BYTES_UNITS,
-		.format = "int64 ts_iso",
-		.type = STREAM_TX_BYTES
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_TX_BYTES,
+		.value_type = VALUE_INT64
+	},
+};
+static stream_t net_extra_stream_formats[] = {
+	{
+		.name = METRIC_RX_PACKETS,
+		.path = DATA_STREAM_NET_PACKETS_RX,
+		.units = DATA_STREAM_PACKETS_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_RX_PACKETS,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_TX_PACKETS,
+		.path = DATA_STREAM_NET_PACKETS_TX,
+		.units = DATA_STREAM_PACKETS_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_TX_PACKETS,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_RX_ERRORS,
+		.path = DATA_STREAM_NET_ERRORS_RX,
+		.units = DATA_STREAM_PACKETS_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_RX_ERRORS,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_TX_ERRORS,
+		.path = DATA_STREAM_NET_ERRORS_TX,
+		.units = DATA_STREAM_PACKETS_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_TX_ERRORS,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_RX_DROPPED,
+		.path = DATA_STREAM_NET_DROPPED_RX,
+		.units = DATA_STREAM_PACKETS_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_RX_DROPPED,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_TX_DROPPED,
+		.path = DATA_STREAM_NET_DROPPED_TX,
+		.units = DATA_STREAM_PACKETS_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_TX_DROPPED,
+		.value_type = VALUE_INT64
 	},
 };
 static stream_t sys_streams_formats[] = {
@@ -202,45 +764,201 @@ static stream_t sys_streams_formats[] = {
 		.name = METRIC_FREE_MEMORY,
 		.path = DATA_STREAM_FREE_MEMORY,
 		.units = DATA_STREAM_MEMORY_UNITS,
-		.format = "double ts_iso",
-		.type = STREAM_FREE_MEM
+		.format = "double ts_epoch_ms",
+		.type = STREAM_FREE_MEM,
+		.value_type = VALUE_DOUBLE
 	},
 	{
 		.name = METRIC_USED_MEMORY,
 		.path = DATA_STREAM_USED_MEMORY,
 		.units = DATA_STREAM_MEMORY_UNITS,
-		.format = "double ts_iso",
-		.type = STREAM_USED_MEM
+		.format = "double ts_epoch_ms",
+		.type = STREAM_USED_MEM,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_CACHED_MEMORY,
+		.path = DATA_STREAM_CACHED_MEMORY,
+		.units = DATA_STREAM_MEMORY_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_CACHED_MEM,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_DIRTY_MEMORY,
+		.path = DATA_STREAM_DIRTY_MEMORY,
+		.units = DATA_STREAM_MEMORY_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_DIRTY_MEM,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_FREE_SWAP,
+		.path = DATA_STREAM_FREE_SWAP,
+		.units = DATA_STREAM_MEMORY_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_FREE_SWAP,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_USED_SWAP,
+		.path = DATA_STREAM_USED_SWAP,
+		.units = DATA_STREAM_MEMORY_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_USED_SWAP,
+		.value_type = VALUE_DOUBLE
 	},
 	{
 		.name = METRIC_CPU_LOAD,
 		.path = DATA_STREAM_CPU_LOAD,
 		.units = DATA_STREAM_CPU_LOAD_UNITS,
-		.format = "double ts_iso",
-		.type = STREAM_CPU_LOAD
+		.format = "double ts_epoch_ms",
+		.type = STREAM_CPU_LOAD,
+		.value_type = VALUE_DOUBLE,
+		.cpu = -1
 	},
 	{
 		.name = METRIC_CPU_TEMP,
 		.path = DATA_STREAM_CPU_TEMP,
 		.units = DATA_STREAM_CPU_TEMP_UNITS,
-		.format = "double ts_iso",
-		.type = STREAM_CPU_TEMP
+		.format = "double ts_epoch_ms",
+		.type = STREAM_CPU_TEMP,
+		.value_type = VALUE_DOUBLE,
+		.file = FILE_CPU_TEMP
 	},
 	{
 		.name = METRIC_FREQ,
 		.path = DATA_STREAM_FREQ,
 		.units = DATA_STREAM_FREQ_UNITS,
-		.format = "int32 ts_iso",
-		.type = STREAM_FREQ
+		.format = "int32 ts_epoch_ms",
+		.type = STREAM_FREQ,
+		.value_type = VALUE_INT32,
+		.file = FILE_CPU_FREQ
 	},
 	{
 		.name = METRIC_UPTIME,
 		.path = DATA_STREAM_UPTIME,
 		.units = DATA_STREAM_UPTIME_UNITS,
-		.format = "int32 ts_iso",
-		.type = STREAM_UPTIME
+		.format = "int32 ts_epoch_ms",
+		.type = STREAM_UPTIME,
+		.value_type = VALUE_INT32
 	}
 };
+static stream_t disk_streams_formats[] = {
+	{
+		.name = METRIC_DISK_READ,
+		.units = DATA_STREAM_THROUGHPUT_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_DISK_READ,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_DISK_WRITE,
+		.units = DATA_STREAM_THROUGHPUT_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_DISK_WRITE,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_DISK_IOPS,
+		.units = DATA_STREAM_IOPS_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_DISK_IOPS,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_DISK_UTILIZATION,
+		.units = DATA_STREAM_CPU_LOAD_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_DISK_UTILIZATION,
+		.value_type = VALUE_DOUBLE
+	},
+};
+static stream_t fs_streams_formats[] = {
+	{
+		.name = METRIC_FS_FREE,
+		.units = DATA_STREAM_MEMORY_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_FS_FREE,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_FS_USED,
+		.units = DATA_STREAM_MEMORY_UNITS,
+		.format = "int64 ts_epoch_ms",
+		.type = STREAM_FS_USED,
+		.value_type = VALUE_INT64
+	},
+	{
+		.name = METRIC_FS_USAGE,
+		.units = DATA_STREAM_CPU_LOAD_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_FS_USAGE,
+		.value_type = VALUE_DOUBLE
+	},
+};
+static stream_t psi_streams_formats[] = {
+	{
+		.name = METRIC_PSI_SOME_AVG10,
+		.units = DATA_STREAM_CPU_LOAD_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_PSI_SOME_AVG10,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_PSI_SOME_AVG60,
+		.units = DATA_STREAM_CPU_LOAD_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_PSI_SOME_AVG60,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_PSI_SOME_STALL,
+		.units = DATA_STREAM_STALL_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_PSI_SOME_STALL,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_PSI_FULL_AVG10,
+		.units = DATA_STREAM_CPU_LOAD_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_PSI_FULL_AVG10,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_PSI_FULL_AVG60,
+		.units = DATA_STREAM_CPU_LOAD_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_PSI_FULL_AVG60,
+		.value_type = VALUE_DOUBLE
+	},
+	{
+		.name = METRIC_PSI_FULL_STALL,
+		.units = DATA_STREAM_STALL_UNITS,
+		.format = "double ts_epoch_ms",
+		.type = STREAM_PSI_FULL_STALL,
+		.value_type = VALUE_DOUBLE
+	},
+};
+static stream_t processes_stream_format = {
+	.name = METRIC_PROCESSES,
+	.path = DATA_STREAM_PROCESSES,
+	.units = DATA_STREAM_CPU_LOAD_UNITS,
+	.format = "double ts_epoch_ms",
+	.type = STREAM_PROCESSES,
+	.value_type = VALUE_DOUBLE,
+	.cpu = -1
+};
+static stream_t suppressed_stream_format = {
+	.name = METRIC_SUPPRESSED,
+	.path = DATA_STREAM_SUPPRESSED,
+	.units = DATA_STREAM_SAMPLES_UNITS,
+	.format = "int64 ts_epoch_ms",
+	.type = STREAM_SUPPRESSED,
+	.value_type = VALUE_INT64,
+	.cpu = -1
+};
 
 /*------------------------------------------------------------------------------
                      F U N C T I O N  D E F I N I T I O N S
@@ -267,6 +985,15 @@ cc_sys_mon_error_t start_system_monitor(const cc_cfg_t *const cc_cfg)
 	if (is_system_monitor_running())
 		return CC_SYS_MON_ERROR_NONE;
 
+	stop_requested = false;
+	stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (stop_fd < 0) {
+		log_sm_error("Error while starting the system monitor: %s", strerror(errno));
+		return CC_SYS_MON_ERROR_THREAD;
+	}
+	backlog.max_batches = cc_cfg->sys_mon_backlog_size;
+	backlog.policy = cc_cfg->sys_mon_backlog_policy;
+
 	error = pthread_attr_init(&attr);
 	if (error != 0) {
 		/* On Linux this function always succeeds. */
@@ -278,6 +1005,16 @@ cc_sys_mon_error_t start_system_monitor(const cc_cfg_t *const cc_cfg)
 		pthread_attr_destroy(&attr);
 		return CC_SYS_MON_ERROR_THREAD;
 	}
+	dp_thread_valid = CCAPI_TRUE;
+
+	error = pthread_create(&sender_thread, &attr, system_monitor_sender_threaded, (void *) cc_cfg);
+	if (error != 0) {
+		log_sm_error("Error while starting the system monitor sender, %d", error);
+		pthread_attr_destroy(&attr);
+		stop_system_monitor();
+		return CC_SYS_MON_ERROR_THREAD;
+	}
+	sender_thread_valid = CCAPI_TRUE;
 	pthread_attr_destroy(&attr);
 
 	return CC_SYS_MON_ERROR_NONE;
@@ -292,22 +1029,208 @@ ccapi_bool_t is_system_monitor_running(void) {
 	return dp_thread_valid;
 }
 
+/*
+ * cc_sysmon_register_provider() - Add a metric to the system monitor
+ *
+ * @name:		Metric name, its data stream is "system_monitor/<name>". It
+ *				may contain '/' to group metrics ("modbus/pressure").
+ *				Only letters, digits, '-', '_', '.' and '/' are allowed.
+ * @units:		Units of the values, with the same characters as 'name' and
+ *				'%'.
+ * @type:		Type of the values.
+ * @sample_fn:	Function that reads the value of the metric.
+ * @ctx:		Context passed to 'sample_fn'.
+ *
+ * The metric is sampled by the system monitor thread with the rest of
+ * metrics and its samples are uploaded in the same collection. Sample rates,
+ * deadbands, aggregations and the metrics filter apply to it as to any other
+ * metric. Providers can be registered before the monitor starts, they are
+ * kept when it restarts.
+ *
+ * A metric unregistered while the monitor samples it can only be registered
+ * again with the same units and type until the monitor stops.
+ *
+ * Return: SYSMON_ERROR_NONE on success, any other sysmon_error_t otherwise.
+ */
+sysmon_error_t cc_sysmon_register_provider(const char *name, const char *units,
+		sysmon_value_type_t type, sysmon_sample_fn_t sample_fn, void *ctx)
+{
+	sysmon_error_t error = SYSMON_ERROR_NONE;
+	provider_t *provider;
+
+	if (!is_valid_provider_name(name) || !is_valid_provider_units(units) || sample_fn == NULL
+		|| (type != SYSMON_VALUE_DOUBLE && type != SYSMON_VALUE_INT32 && type != SYSMON_VALUE_INT64))
+		return SYSMON_ERROR_INVALID_ARGUMENT;
+
+	pthread_mutex_lock(&providers_lock);
+
+	provider = find_provider(name);
+	if (provider != NULL) {
+		if (!provider->removed) {
+			error = SYSMON_ERROR_ALREADY_REGISTERED;
+		} else if (provider->type != type || strcmp(provider->units, units) != 0) {
+			error = SYSMON_ERROR_INVALID_ARGUMENT;
+		} else {
+			provider->sample_fn = sample_fn;
+			provider->ctx = ctx;
+			provider->removed = false;
+			provider->checked = false;
+		}
+		goto done;
+	}
+
+	provider = calloc(1, sizeof(*provider));
+	if (provider == NULL) {
+		error = SYSMON_ERROR_INSUFFICIENT_MEMORY;
+		goto done;
+	}
+	provider->name = strdup(name);
+	provider->units = strdup(units);
+	if (provider->name == NULL || provider->units == NULL) {
+		free(provider->name);
+		free(provider->units);
+		free(provider);
+		error = SYSMON_ERROR_INSUFFICIENT_MEMORY;
+		goto done;
+	}
+	provider->type = type;
+	provider->sample_fn = sample_fn;
+	provider->ctx = ctx;
+	provider->next = providers;
+	providers = provider;
+
+done:
+	if (error == SYSMON_ERROR_NONE && provider_fd >= 0 && eventfd_write(provider_fd, 1) != 0)
+		log_sm_error("Cannot notify metric provider '%s': %s", name, strerror(errno));
+
+	pthread_mutex_unlock(&providers_lock);
+
+	return error;
+}
+
+/*
+ * cc_sysmon_unregister_provider() - Remove a metric from the system monitor
+ *
+ * @name:	Name of the metric given in cc_sysmon_register_provider().
+ *
+ * The sample function of the provider is not called once this function
+ * returns. A provider without stream is freed right away, the monitor is
+ * stopped or does not sample it. Otherwise its samples not uploaded yet may
+ * refer to it and it is freed by reset_providers() when the monitor stops.
+ * Both decisions are taken with the providers lock held, so the monitor
+ * cannot start sampling a provider being freed.
+ *
+ * Return: SYSMON_ERROR_NONE on success, SYSMON_ERROR_NOT_FOUND if there is
+ *         no provider with that name.
+ */
+sysmon_error_t cc_sysmon_unregister_provider(const char *name)
+{
+	provider_t *provider, **link;
+
+	if (name == NULL)
+		return SYSMON_ERROR_INVALID_ARGUMENT;
+
+	pthread_mutex_lock(&providers_lock);
+
+	provider = find_provider(name);
+	if (provider == NULL || provider->removed) {
+		pthread_mutex_unlock(&providers_lock);
+		return SYSMON_ERROR_NOT_FOUND;
+	}
+
+	if (provider->stream == NULL) {
+		for (link = &providers; *link != provider; link = &(*link)->next)
+			;
+		*link = provider->next;
+		free(provider->name);
+		free(provider->units);
+		free(provider);
+		pthread_mutex_unlock(&providers_lock);
+
+		return SYSMON_ERROR_NONE;
+	}
+
+	provider->removed = true;
+	provider->checked = false;
+	provider->sample_fn = NULL;
+	provider->ctx = NULL;
+
+	if (provider_fd >= 0 && eventfd_write(provider_fd, 1) != 0)
+		log_sm_error("Cannot notify metric provider '%s': %s", name, strerror(errno));
+
+	pthread_mutex_unlock(&providers_lock);
+
+	return SYSMON_ERROR_NONE;
+}
+
 /*
  * stop_system_monitor() - Stop the monitoring of system variables
+ *
+ * An upload in progress is not interrupted, it finishes or times out in
+ * 'sys_mon_send_timeout' seconds. Samples not uploaded yet are stored in the
+ * data spool, or discarded if it is disabled.
  */
 void stop_system_monitor(void)
 {
+	batch_t *pending;
+
+	pthread_mutex_lock(&backlog.lock);
 	stop_requested = true;
+	pthread_cond_broadcast(&backlog.cond);
+	pthread_mutex_unlock(&backlog.lock);
+
+	/* Wake up the sampling thread, it finishes immediately. */
+	if (stop_fd >= 0 && eventfd_write(stop_fd, 1) != 0)
+		log_sm_error("Cannot stop the system monitor: %s", strerror(errno));
 
 	if (dp_thread_valid) {
-		pthread_cancel(dp_thread);
 		pthread_join(dp_thread, NULL);
+		dp_thread_valid = CCAPI_FALSE;
+	}
+
+	if (stop_fd >= 0) {
+		close(stop_fd);
+		stop_fd = -1;
+	}
+
+	/* The sender thread finishes the upload in progress, if any. */
+	if (sender_thread_valid) {
+		pthread_join(sender_thread, NULL);
+		sender_thread_valid = CCAPI_FALSE;
+	}
+
+	/* The batch being filled is the newest one. */
+	pending = backlog.head;
+	if (current_batch != NULL) {
+		if (backlog.tail == NULL)
+			pending = current_batch;
+		else
+			backlog.tail->next = current_batch;
+		current_batch = NULL;
 	}
+	backlog.head = NULL;
+	backlog.tail = NULL;
+	backlog.n_batches = 0;
+	if (pending != NULL && spool_batches(pending) != 0) {
+		const batch_t *batch;
+		uint32_t n_samples = 0;
+
+		for (batch = pending; batch != NULL; batch = batch->next)
+			n_samples += batch->n_samples;
+		log_sm_error("Discarding %u system monitor samples not uploaded yet", n_samples);
+	}
+	free_batch_list(pending);
+
+	log_suppressed_samples();
+
+	reset_providers();
 
 	free_stream_list(&sys_stream_list);
 	free_stream_list(&net_stream_list);
 	free_stream_list(&bt_stream_list);
-	ccapi_dp_destroy_collection(dp_collection);
+	free_stream_list(&provider_stream_list);
+	free_stream_list(&process_stream_list);
+	free_sys_readers();
 
 	log_sm_info("%s", "Stop monitoring the system");
 }
@@ -320,13 +1243,47 @@ void stop_system_monitor(void)
  */
 static void *system_monitor_threaded(void *cc_cfg)
 {
-	ccapi_dp_error_t dp_error = init_system_monitor(cc_cfg);
-	if (dp_error != CCAPI_DP_ERROR_NONE)
-		/* The data point collection could not be created. */
-		return NULL;
+	ccapi_dp_error_t dp_error;
+
+	/* Subscribe before listing the interfaces so no change is missed. */
+	open_link_monitor();
+	open_link_stats();
+	open_provider_events();
+
+	dp_error = init_system_monitor(cc_cfg);
+	if (dp_error != CCAPI_DP_ERROR_NONE) {
+		/* The streams could not be initialized. */
+		goto done;
+	}
+
+	if (init_scheduler() != 0)
+		goto done;
 
 	system_monitor_loop(cc_cfg);
 
+	free_scheduler();
+
+done:
+	close_provider_events();
+	close_link_stats();
+	close_link_monitor();
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+/*
+ * system_monitor_sender_threaded() - Upload the system monitor samples in a
+ *                                    new thread
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ */
+static void *system_monitor_sender_threaded(void *cc_cfg)
+{
+	system_monitor_sender_loop(cc_cfg);
+
 	pthread_exit(NULL);
 
 	return NULL;
@@ -338,10 +1295,19 @@ static void *system_monitor_threaded(void *cc_cfg)
  * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
  * 			settings parsed from the configuration file are stored.
  *
- * This loop reads the values of the parameters to monitor every
- * 'cc_cfg->sys_mon_sample_rate' seconds and send them to Remote Manager when
- * the number of samples per parameter is at least
- * 'cc_cfg->sys_mon_num_samples_upload'.
+ * This loop sleeps until the next group of streams is due, reads their
+ * values and schedules their next sample one period later. Each stream has
+ * its own period, 'cc_cfg->sys_mon_sample_rate' unless it matches any of
+ * 'cc_cfg->sys_mon_rates'. The loop finishes as soon as the monitor is
+ * stopped.
+ *
+ * Network interfaces added or removed while the monitor runs are notified
+ * through RTNETLINK, their streams are added to or removed from the
+ * schedule without touching the rest.
+ *
+ * Once the current batch holds 'cc_cfg->sys_mon_num_samples_upload' samples
+ * per stream, it is queued in the backlog and uploaded by the sender thread,
+ * so the sampling never waits for Remote Manager.
  *
  * The monitored values are defined in 'cc_cfg->sys_mon_metrics'.
  */
@@ -349,71 +1315,132 @@ static void system_monitor_loop(const cc_cfg_t *const cc_cfg)
 {
 	log_sm_info("%s", "Start monitoring the system");
 
+	sync_provider_streams(cc_cfg);
+
 	while (!stop_requested) {
-		uint32_t n_samples_to_send = (sys_stream_list.n_streams + net_stream_list.n_streams + bt_stream_list.n_streams) * cc_cfg->sys_mon_num_samples_upload;
-		long n_loops = cc_cfg->sys_mon_sample_rate * 1000 / LOOP_MS;
-		uint32_t count = 0;
-		long loop;
+		struct pollfd fds[] = {
+			{ .fd = stop_fd, .events = POLLIN },
+			{ .fd = scheduler.timer_fd, .events = POLLIN },
+			{ .fd = netlink_fd, .events = POLLIN },
+			{ .fd = provider_fd, .events = POLLIN }
+		};
+		uint64_t now = get_monotonic_ms();
+		uint64_t expirations;
+		tick_t tick = { 0 };
+
+		update_stretch(cc_cfg, now);
+
+		tick.timestamp = get_timestamp_ms();
+		while (scheduler.n_entries > 0 && scheduler.entries[0].next_ms <= now) {
+			schedule_entry_t *entry = &scheduler.entries[0];
+			uint64_t period_ms = entry->period_ms * scheduler.stretch;
+
+			add_entry_samples(entry, &tick);
+
+			entry->next_ms += period_ms;
+			if (entry->next_ms <= now) {
+				/* Do not try to catch up with missed samples. */
+				entry->next_ms = now + period_ms;
+			}
+			sift_down_entry(0);
+		}
 
-		add_samples();
+		if (scheduler.n_entries > 0 && arm_timer(scheduler.entries[0].next_ms) != 0)
+			break;
 
-		ccapi_dp_get_collection_points_count(dp_collection, &count);
-		if (count >= n_samples_to_send && !stop_requested) {
-			ccapi_dp_error_t dp_error;
+		if (poll(fds, ARRAY_SIZE(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			log_sm_error("Error waiting for the next sample: %s", strerror(errno));
+			break;
+		}
 
-			/*
-			 * TODO: If the connection is lost, this thread blocks at this point
-			 * and does not continue collecting data points.
-			 *
-			 * The expected behavior is an error after a timeout to keep the
-			 * sampling process, so all the collected data is sent when the
-			 * connection is restored.
-			 * We tried to get this by using 'ccapi_dp_send_collection_with_reply'
-			 * but it seems it does not work:
-			 *
-			 * unsigned long timeout = 2; // seconds
-			 * dp_error = ccapi_dp_send_collection_with_reply(CCAPI_TRANSPORT_TCP, dp_collection, timeout, NULL);
-			 */
-			if (get_cloud_connection_status() == CC_STATUS_CONNECTED) {
-				log_sm_debug("%s", "Sending system monitor samples");
-				dp_error = ccapi_dp_send_collection(CCAPI_TRANSPORT_TCP, dp_collection);
-				if (dp_error != CCAPI_DP_ERROR_NONE)
-					log_sm_error("Error sending system monitor samples, %d", dp_error);
-			}
+		if (fds[0].revents & POLLIN)
+			break;
+
+		if ((fds[1].revents & POLLIN)
+			&& read(scheduler.timer_fd, &expirations, sizeof(expirations)) < 0
+			&& errno != EAGAIN)
+			log_sm_error("Error reading system monitor timer: %s", strerror(errno));
+
+		if (fds[2].revents & POLLIN)
+			handle_link_events(cc_cfg);
+
+		if (fds[3].revents & POLLIN) {
+			eventfd_t events;
+
+			if (eventfd_read(provider_fd, &events) != 0 && errno != EAGAIN)
+				log_sm_error("Error reading system monitor providers event: %s", strerror(errno));
+			sync_provider_streams(cc_cfg);
 		}
+	}
+}
 
-		for (loop = 0; loop < n_loops; loop++) {
-			struct timespec sleepValue = {0};
+/*
+ * system_monitor_sender_loop() - Start the system monitor upload loop
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ *
+ * This loop waits for batches in the backlog and uploads them while the
+ * connection with Remote Manager is established. Pending batches are merged
+ * in uploads of up to SEND_MAX_SAMPLES samples, so the backlog collected
+ * during a connection loss drains quickly once it is restored.
+ *
+ * If an upload fails or is not acknowledged in 'cc_cfg->sys_mon_send_timeout'
+ * seconds, its batches are stored in the data spool, or queued again and
+ * retried later if the spool is disabled. While disconnected, batches go
+ * directly to the spool.
+ */
+static void system_monitor_sender_loop(const cc_cfg_t *const cc_cfg)
+{
+	while (!stop_requested) {
+		ccapi_dp_error_t dp_error;
+		batch_t *batches = take_batches();
 
-			if (stop_requested)
-				break;
+		if (batches == NULL)
+			break;
 
-			sleepValue.tv_nsec = LOOP_MS * 1000 * 1000;
-			nanosleep(&sleepValue, NULL);
+		/* Store the samples on disk while there is no connection. */
+		if (get_cloud_connection_status() != CC_STATUS_CONNECTED
+			&& spool_batches(batches) == 0) {
+			free_batch_list(batches);
+			continue;
+		}
+
+		dp_error = send_batches(batches, cc_cfg->sys_mon_send_timeout);
+		if (dp_error == CCAPI_DP_ERROR_NONE) {
+			free_batch_list(batches);
+			continue;
 		}
+
+		log_sm_error("Error sending system monitor samples, %d", dp_error);
+		if (spool_batches(batches) == 0) {
+			free_batch_list(batches);
+			continue;
+		}
+		requeue_batches(batches);
+		wait_before_retry(SEND_RETRY_SECONDS);
 	}
 }
 
 /*
- * init_system_monitor() - Create and initialize the system monitor data point
- *                         collection
+ * init_system_monitor() - Initialize the system monitor data streams
  *
  * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
  * 			settings parsed from the configuration file are stored.
  *
- * Return: Error code after the initialization of the system monitor collection.
+ * Return: Error code after the initialization of the system monitor streams.
  *
  * The return value will always be 'CCAPI_DP_ERROR_NONE' unless there is any
- * problem creating the collection.
+ * problem allocating the streams.
  */
 static ccapi_dp_error_t init_system_monitor(const cc_cfg_t *const cc_cfg)
 {
-	/* Create data point collection. */
-	ccapi_dp_error_t dp_error = ccapi_dp_create_collection(&dp_collection);
-	if (dp_error != CCAPI_DP_ERROR_NONE) {
-		log_sm_error("Error initalizing system monitor, %d", dp_error);
-		return dp_error;
-	}
+	ccapi_dp_error_t dp_error;
+
+	heartbeat = cc_cfg->sys_mon_heartbeat;
+	n_suppressed_samples = 0;
 
 	/* Initialize system metrics streams. */
 	dp_error = init_sys_streams(cc_cfg);
@@ -424,6 +1451,7 @@ static ccapi_dp_error_t init_system_monitor(const cc_cfg_t *const cc_cfg)
 	dp_error = init_net_streams(cc_cfg);
 	if (dp_error != CCAPI_DP_ERROR_NONE) {
 		free_stream_list(&sys_stream_list);
+		free_sys_readers();
 		return dp_error;
 	}
 
@@ -432,6 +1460,7 @@ static ccapi_dp_error_t init_system_monitor(const cc_cfg_t *const cc_cfg)
 	if (dp_error != CCAPI_DP_ERROR_NONE) {
 		free_stream_list(&sys_stream_list);
 		free_stream_list(&net_stream_list);
+		free_sys_readers();
 		return dp_error;
 	}
 
@@ -439,88 +1468,281 @@ static ccapi_dp_error_t init_system_monitor(const cc_cfg_t *const cc_cfg)
 }
 
 /*
- * init_sys_streams() - Add the system data point streams to collection
+ * init_sys_streams() - Initialize the system data point streams
  *
  * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
  * 			settings parsed from the configuration file are stored.
  *
- * Return: Error code after the addition to the collection.
+ * Return: Error code after the initialization.
  *
  * The return value will always be 'CCAPI_DP_ERROR_NONE' unless there is any
- * problem creating the collection.
+ * problem allocating the streams.
  */
 static ccapi_dp_error_t init_sys_streams(const cc_cfg_t *const cc_cfg)
 {
+	static const char *const zone_files[] = { "temp", NULL };
+	static const char *const policy_files[] = { "cpuinfo_cur_freq", "scaling_cur_freq", NULL };
 	unsigned int i;
-	int n_metrics_to_monitor = 0;
 	ccapi_dp_error_t dp_error = CCAPI_DP_ERROR_NONE;
 
-	/* Calculate the number of metrics to monitor. */
-	for (i = 0; i < ARRAY_SIZE(sys_streams_formats); i++) {
-		if (should_read_metric(sys_streams_formats[i].name, cc_cfg)) {
-			n_metrics_to_monitor += 1;
-		}
-	}
-
-	/* Allocate memory for the metric streams. */
-	sys_stream_list.streams = calloc(n_metrics_to_monitor, sizeof(stream_t));
-	if (sys_stream_list.streams == NULL) {
+	if (init_cpu_stat() != 0 || init_resource_stats() != 0) {
 		log_sm_error("Cannot initialize system metrics: %s", "Out of memory");
 		dp_error = CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
 		goto error;
 	}
 
-	/* Initialize streams. */
 	for (i = 0; i < ARRAY_SIZE(sys_streams_formats); i++) {
-		/* Check if the metric should be skipped. */
-		if (!should_read_metric(sys_streams_formats[i].name, cc_cfg)) {
-			log_sm_debug("Skipping metric '%s'...", sys_streams_formats[i].name);
-			continue;
-		}
+		stream_t *stream_format = &sys_streams_formats[i];
 
-		stream_t stream_format = sys_streams_formats[i];
-		stream_t *stream = &sys_stream_list.streams[sys_stream_list.n_streams];
+		dp_error = add_sys_stream(stream_format, stream_format->name, stream_format->path,
+				stream_format->file, stream_format->cpu, cc_cfg);
+		if (dp_error != CCAPI_DP_ERROR_NONE)
+			goto error;
+	}
 
-		sys_stream_list.n_streams++;
+	dp_error = add_cpu_core_streams(cc_cfg);
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		goto error;
 
-		stream->name = strdup(sys_streams_formats[i].name);
-		stream->path = strdup(sys_streams_formats[i].path);
-		stream->format = stream_format.format;
-		stream->units = stream_format.units;
-		stream->type = stream_format.type;
-		if (stream->name == NULL || stream->path == NULL) {
-			log_sm_error("Cannot initialize '%s' metric stream: Out of memory", sys_streams_formats[i].name);
-			dp_error = CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
-			goto error;
-		}
+	dp_error = add_sysfs_streams(DIR_THERMAL, THERMAL_ZONE_PREFIX, METRIC_ZONE_TEMP,
+			zone_files, STREAM_CPU_TEMP, cc_cfg);
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		goto error;
 
-		dp_error = ccapi_dp_add_data_stream_to_collection_extra(
-					dp_collection, stream->path, stream->format, stream->units, NULL);
-		if (dp_error != CCAPI_DP_ERROR_NONE) {
-			log_sm_error("Cannot add '%s' stream to data point collection, error %d",
-				stream->path, dp_error);
-			goto error;
+	dp_error = add_sysfs_streams(DIR_CPUFREQ, CPUFREQ_POLICY_PREFIX, METRIC_POLICY_FREQ,
+			policy_files, STREAM_FREQ, cc_cfg);
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		goto error;
+
+	dp_error = add_pressure_streams(cc_cfg);
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		goto error;
+
+	dp_error = add_storage_streams(cc_cfg);
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		goto error;
+
+	if (cc_cfg->sys_mon_top_processes > 0 && should_read_metric(METRIC_PROCESSES, cc_cfg)) {
+		if (init_processes(cc_cfg) != 0) {
+			log_sm_error("Cannot initialize '%s' metric", METRIC_PROCESSES);
+		} else {
+			dp_error = add_sys_stream(&processes_stream_format, processes_stream_format.name,
+					processes_stream_format.path, NULL, processes_stream_format.cpu, cc_cfg);
+			if (dp_error != CCAPI_DP_ERROR_NONE)
+				goto error;
 		}
 	}
 
+	/* Report the savings of the deadbands, if any. */
+	if (cc_cfg->n_sys_mon_deadbands > 0)
+		dp_error = add_sys_stream(&suppressed_stream_format, suppressed_stream_format.name,
+				suppressed_stream_format.path, NULL, suppressed_stream_format.cpu, cc_cfg);
+
 error:
-	if (dp_error != CCAPI_DP_ERROR_NONE)
+	if (dp_error != CCAPI_DP_ERROR_NONE) {
 		free_stream_list(&sys_stream_list);
+		free_sys_readers();
+	}
+
+	return dp_error;
+}
+
+/*
+ * add_sys_stream() - Add a system metric stream to the list of streams
+ *
+ * @stream_format:	Format of the stream (units, type, ...).
+ * @name:			Metric name of the stream.
+ * @path:			Data stream path in Remote Manager.
+ * @file:			File the values are read from, NULL if none.
+ * @cpu:			CPU core of a load stream, -1 for the whole system.
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
+ *
+ * The stream is not added if the metric is not configured to be monitored.
+ *
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
+ */
+static ccapi_dp_error_t add_sys_stream(const stream_t *stream_format, const char *name,
+		const char *path, const char *file, int cpu, const cc_cfg_t *const cc_cfg)
+{
+	stream_t *stream;
+
+	/* Check if the metric should be skipped. */
+	if (!should_read_metric(name, cc_cfg)) {
+		log_sm_debug("Skipping metric '%s'...", name);
+		return CCAPI_DP_ERROR_NONE;
+	}
+
+	stream = new_stream(&sys_stream_list);
+	if (stream == NULL) {
+		log_sm_error("Cannot initialize '%s' metric stream: Out of memory", name);
+		return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+	}
+
+	stream->name = strdup(name);
+	stream->path = strdup(path);
+	stream->format = stream_format->format;
+	stream->units = stream_format->units;
+	stream->type = stream_format->type;
+	stream->source = STREAM_SOURCE_SYSTEM;
+	stream->value_type = stream_format->value_type;
+	stream->period = get_stream_period(name, cc_cfg);
+	set_stream_deadband(stream, name, cc_cfg);
+	stream->cpu = cpu;
+	if (stream->name == NULL || stream->path == NULL
+		|| set_stream_aggregation(stream, name, cc_cfg) != 0) {
+		log_sm_error("Cannot initialize '%s' metric stream: Out of memory", name);
+		return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+	}
+
+	if (file != NULL) {
+		stream->file = strdup(file);
+		if (stream->file == NULL) {
+			log_sm_error("Cannot initialize '%s' metric stream: Out of memory", name);
+			return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+		}
+		/* Keeping a mount point open would prevent unmounting it. */
+		if (IS_STORAGE_STREAM(stream->type))
+			return CCAPI_DP_ERROR_NONE;
+		stream->fd = open(stream->file, O_RDONLY | O_CLOEXEC);
+		if (stream->fd < 0)
+			log_sm_debug("Cannot open '%s': %s", stream->file, strerror(errno));
+	}
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+/*
+ * add_cpu_core_streams() - Add a load stream for every CPU core
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ *
+ * The cores are the 'cpuN' lines of '/proc/stat', their metrics are named
+ * 'cpuN/load'.
+ *
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
+ */
+static ccapi_dp_error_t add_cpu_core_streams(const cc_cfg_t *const cc_cfg)
+{
+	const stream_t *stream_format = get_sys_stream_format(STREAM_CPU_LOAD);
+	tick_t tick = { 0 };
+	int i;
+
+	if (read_cpu_stat(&tick) != 0)
+		return CCAPI_DP_ERROR_NONE;
+
+	for (i = 1; i < n_cpu_times; i++) {
+		char name[32], path[64];
+		ccapi_dp_error_t dp_error;
+
+		if (!cpu_times[i].online)
+			continue;
+
+		snprintf(name, sizeof(name), METRIC_CORE_LOAD, i - 1);
+		snprintf(path, sizeof(path), SYS_MON_DATA_STREAM_PREFIX "%s", name);
+		dp_error = add_sys_stream(stream_format, name, path, NULL, i - 1, cc_cfg);
+		if (dp_error != CCAPI_DP_ERROR_NONE)
+			return dp_error;
+	}
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+/*
+ * add_sysfs_streams() - Add a stream for every numbered sysfs directory
+ *
+ * @dir:		Directory containing the numbered directories.
+ * @prefix:		Name of the numbered directories without the number.
+ * @metric:		Format of the metric names, with a '%d' for the number.
+ * @files:		NULL terminated list of files to read in every numbered
+ * 				directory. The first readable one is used.
+ * @type:		Type of the streams.
+ * @cc_cfg:		Connector configuration struct (cc_cfg_t) where the
+ * 				settings parsed from the configuration file are stored.
+ *
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
+ */
+static ccapi_dp_error_t add_sysfs_streams(const char *dir, const char *prefix, const char *metric,
+		const char *const files[], stream_type_t type, const cc_cfg_t *const cc_cfg)
+{
+	const stream_t *stream_format = get_sys_stream_format(type);
+	ccapi_dp_error_t dp_error = CCAPI_DP_ERROR_NONE;
+	size_t prefix_len = strlen(prefix);
+	struct dirent **entries;
+	int n_entries, i;
+
+	n_entries = scandir(dir, &entries, NULL, versionsort);
+	if (n_entries < 0) {
+		log_sm_debug("Cannot list '%s': %s", dir, strerror(errno));
+		return CCAPI_DP_ERROR_NONE;
+	}
+
+	for (i = 0; i < n_entries; i++) {
+		const char *entry_name = entries[i]->d_name;
+		char name[64], path[96], file[PATH_MAX];
+		const char *end;
+		uint64_t number;
+		int f;
+
+		if (dp_error != CCAPI_DP_ERROR_NONE
+			|| strncmp(entry_name, prefix, prefix_len) != 0)
+			goto next;
+		end = scan_uint64(entry_name + prefix_len, &number);
+		if (end == NULL || *end != '\0')
+			goto next;
+
+		for (f = 0; files[f] != NULL; f++) {
+			snprintf(file, sizeof(file), "%s/%s/%s", dir, entry_name, files[f]);
+			if (file_readable(file))
+				break;
+		}
+		if (files[f] == NULL) {
+			log_sm_debug("Skipping '%s/%s', no readable value", dir, entry_name);
+			goto next;
+		}
+
+		snprintf(name, sizeof(name), metric, (int) number);
+		snprintf(path, sizeof(path), SYS_MON_DATA_STREAM_PREFIX "%s", name);
+		dp_error = add_sys_stream(stream_format, name, path, file, -1, cc_cfg);
+next:
+		free(entries[i]);
+	}
+	free(entries);
 
 	return dp_error;
 }
 
 /*
- * init_net_streams() - Add the network interfaces data point streams to
- *                      collection
+ * get_sys_stream_format() - Get the format of the system streams of a type
+ *
+ * @type:	Type of the stream.
+ *
+ * Return: The stream format.
+ */
+static const stream_t *get_sys_stream_format(stream_type_t type)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sys_streams_formats); i++) {
+		if (sys_streams_formats[i].type == type)
+			return &sys_streams_formats[i];
+	}
+
+	/* Should not occur */
+	return &sys_streams_formats[0];
+}
+
+/*
+ * init_net_streams() - Initialize the network interfaces data point streams
  *
  * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
  * 			settings parsed from the configuration file are stored.
  *
- * Return: Error code after the addition to the collection.
+ * Return: Error code after the initialization.
  *
  * The return value will always be 'CCAPI_DP_ERROR_NONE' unless there is any
- * problem creating the collection.
+ * problem allocating the streams.
  */
 static ccapi_dp_error_t init_net_streams(const cc_cfg_t *const cc_cfg)
 {
@@ -537,7 +1759,7 @@ static ccapi_dp_error_t init_net_streams(const cc_cfg_t *const cc_cfg)
 			log_sm_debug("Skipping interface '%s'...", list_ifaces.names[i]);
 			continue;
 		}
-		dp_error = init_iface_streams(list_ifaces.names[i], &net_stream_list, cc_cfg);
+		dp_error = init_iface_streams(list_ifaces.names[i], &net_stream_list, STREAM_SOURCE_NET, cc_cfg);
 		if (dp_error != CCAPI_DP_ERROR_NONE)
 			goto error;
 	}
@@ -552,16 +1774,15 @@ error:
 }
 
 /*
- * init_bt_streams() - Add the bluetooth interface data point streams to
- *                     collection
+ * init_bt_streams() - Initialize the bluetooth interface data point streams
  *
  * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
  * 			settings parsed from the configuration file are stored.
  *
- * Return: Error code after the addition to the collection.
+ * Return: Error code after the initialization.
  *
  * The return value will always be 'CCAPI_DP_ERROR_NONE' unless there is any
- * problem creating the collection.
+ * problem allocating the streams.
  */
 static ccapi_dp_error_t init_bt_streams(const cc_cfg_t *const cc_cfg)
 {
@@ -574,7 +1795,7 @@ static ccapi_dp_error_t init_bt_streams(const cc_cfg_t *const cc_cfg)
 	}
 
 	/* Initialize streams. */
-	dp_error = init_iface_streams(BLUETOOTH_INTERFACE, &bt_stream_list, cc_cfg);
+	dp_error = init_iface_streams(BLUETOOTH_INTERFACE, &bt_stream_list, STREAM_SOURCE_BT, cc_cfg);
 	if (dp_error != CCAPI_DP_ERROR_NONE)
 		free_stream_list(&bt_stream_list);
 
@@ -582,431 +1803,2607 @@ static ccapi_dp_error_t init_bt_streams(const cc_cfg_t *const cc_cfg)
 }
 
 /*
- * init_iface_streams() - Add to collection the given interface data point streams
+ * new_stream() - Allocate a new stream and append it to a list
  *
- * @iface_name:		Name of the interface to init.
- * @stream_list:	Structure to initialize.
- * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
- * 					settings parsed from the configuration file are stored.
+ * @stream_list:	List to append the stream to.
  *
- * Return: Error code after the addition to the collection.
+ * Streams are allocated one by one so their address does not change while
+ * the list grows: the scheduler and the pending samples refer to them.
  *
- * The return value will always be 'CCAPI_DP_ERROR_NONE' unless there is any
- * problem creating the collection.
+ * Return: The new active stream, NULL if there is not enough memory.
  */
-static ccapi_dp_error_t init_iface_streams(const char *const iface_name, stream_list_t *stream_list, const cc_cfg_t *const cc_cfg)
+static stream_t *new_stream(stream_list_t *stream_list)
 {
-	unsigned int i;
-
-	for (i = 0; i < ARRAY_SIZE(net_stream_formats); i++) {
-		char *metric_name;
-		void *tmp;
-		stream_t stream_format = net_stream_formats[i];
-
-		/* Build metric name. */
-		metric_name = calloc(snprintf(NULL, 0, "%s/%s", iface_name, stream_format.name) + 1, sizeof(char));
-		if (metric_name == NULL) {
-			log_sm_error("Cannot initialize interface '%s' metric name '%s': Out of memory", iface_name, net_stream_formats[i].name);
-			return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
-		}
-		sprintf(metric_name, "%s/%s", iface_name, stream_format.name);
-
-		/* Check if metric should be measured. */
-		if (!should_read_metric(metric_name, cc_cfg)) {
-			log_sm_debug("Skipping %s...", metric_name);
-			free(metric_name);
-			continue;
-		}
-		free(metric_name);
+	stream_t **tmp;
+	stream_t *stream;
 
-		/* Allocate memory for the metric stream. */
-		if (stream_list->streams == NULL) {
-			tmp = calloc(1, sizeof(stream_t));
-		} else {
-			tmp = realloc(stream_list->streams, (stream_list->n_streams + 1) * sizeof(stream_t));
-		}
-		if (tmp == NULL) {
-			log_sm_error("Cannot initialize interface '%s' metric '%s': Out of memory", iface_name, net_stream_formats[i].name);
-			return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
-		}
-		stream_list->streams = tmp;
+	tmp = realloc(stream_list->streams, (stream_list->n_streams + 1) * sizeof(stream_t *));
+	if (tmp == NULL)
+		return NULL;
+	stream_list->streams = tmp;
 
-		stream_t *stream = &stream_list->streams[stream_list->n_streams];
-		size_t path_len = snprintf(NULL, 0, stream_format.path, iface_name);
-		ccapi_dp_error_t dp_error;
+	stream = calloc(1, sizeof(stream_t));
+	if (stream == NULL)
+		return NULL;
 
-		stream_list->n_streams++;
+	stream->fd = -1;
+	stream->active = true;
+	stream_list->streams[stream_list->n_streams++] = stream;
 
-		stream->name = strdup(iface_name);
-		stream->path = calloc(path_len + 1, sizeof(char));
-		if (stream->name == NULL || stream->path == NULL) {
-			log_sm_error("Cannot initialize interface '%s' metric '%s': Out of memory", iface_name, net_stream_formats[i].name);
-			return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
-		}
+	return stream;
+}
 
-		sprintf(stream->path, stream_format.path, iface_name);
+/*
+ * open_link_monitor() - Subscribe to the network interface notifications
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int open_link_monitor(void)
+{
+	struct sockaddr_nl addr = { 0 };
 
-		stream->format = stream_format.format;
-		stream->units = stream_format.units;
-		stream->type = stream_format.type;
+	netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+	if (netlink_fd < 0) {
+		log_sm_error("Cannot monitor network interfaces: %s", strerror(errno));
+		return -1;
+	}
 
-		dp_error = ccapi_dp_add_data_stream_to_collection_extra(
-					dp_collection, stream->path, stream->format, stream->units, NULL);
-		if (dp_error != CCAPI_DP_ERROR_NONE) {
-			log_sm_error("Cannot add '%s' stream to data point collection, error %d",
-				stream->path, dp_error);
-			return dp_error;
-		}
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK;
+	if (bind(netlink_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		log_sm_error("Cannot monitor network interfaces: %s", strerror(errno));
+		close_link_monitor();
+		return -1;
 	}
 
-	return CCAPI_DP_ERROR_NONE;
+	return 0;
 }
 
 /*
- * add_samples() - Add samples to the data point collection
+ * close_link_monitor() - Unsubscribe from the network interface notifications
  */
-static void add_samples(void)
+static void close_link_monitor(void)
 {
-	ccapi_timestamp_t *timestamp = get_timestamp();
-
-	add_sys_samples(*timestamp);
-
-	add_net_samples(*timestamp);
-
-	add_bt_samples(*timestamp);
-
-	free_timestamp(timestamp);
+	if (netlink_fd >= 0)
+		close(netlink_fd);
+	netlink_fd = -1;
 }
 
 /*
- * add_sys_samples() - Add system metrics values to the data point collection
+ * handle_link_events() - Process the pending network interface notifications
  *
- * @timestamp: The timestamp for the samples.
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
  */
-static void add_sys_samples(ccapi_timestamp_t timestamp)
+static void handle_link_events(const cc_cfg_t *const cc_cfg)
 {
-	int i;
-	double free_mem, used_mem, load, temp;
-	unsigned long freq, uptime;
-	ccapi_dp_error_t dp_error;
+	char *buffer = netlink_buffer;
 
-	for (i = 0; i < sys_stream_list.n_streams; i++) {
-		stream_t stream = sys_stream_list.streams[i];
+	while (true) {
+		ssize_t len = recv(netlink_fd, buffer, sizeof(netlink_buffer), 0);
+		const struct nlmsghdr *msg;
 
-		switch(stream.type) {
-			case STREAM_FREE_MEM:
-				free_mem = get_free_memory();
-				dp_error = ccapi_dp_add(dp_collection, stream.path, free_mem, &timestamp);
-				log_sm_debug("%s = %f %s", stream.name, free_mem, stream.units);
-				break;
-			case STREAM_USED_MEM:
-				used_mem = get_used_memory();
-				dp_error = ccapi_dp_add(dp_collection, stream.path, used_mem, &timestamp);
-				log_sm_debug("%s = %f %s", stream.name, used_mem, stream.units);
-				break;
-			case STREAM_CPU_LOAD:
-				load = get_cpu_load();
-				dp_error = ccapi_dp_add(dp_collection, stream.path, load, &timestamp);
-				log_sm_debug("%s = %f %s", stream.name, load, stream.units);
-				break;
-			case STREAM_CPU_TEMP:
-				temp =  get_cpu_temp();
-				dp_error = ccapi_dp_add(dp_collection, stream.path, temp, &timestamp);
-				log_sm_debug("%s = %f %s", stream.name, temp, stream.units);
-				break;
-			case STREAM_FREQ:
-				freq = get_cpu_freq();
-				dp_error = ccapi_dp_add(dp_collection, stream.path, freq, &timestamp);
-				log_sm_debug("%s = %lu %s", stream.name, freq, stream.units);
-				break;
-			case STREAM_UPTIME:
-				uptime = get_uptime();
-				dp_error = ccapi_dp_add(dp_collection, stream.path, uptime, &timestamp);
-				log_sm_debug("%s = %lu %s", stream.name, uptime, stream.units);
-				break;
-			default:
-				/* Should not occur */
-				log_sm_error("Cannot add %s value, unknown stream (%d)", stream.name, stream.type);
+		if (len < 0) {
+			if (errno == EINTR)
 				continue;
+			if (errno == ENOBUFS) {
+				/* Notifications were lost, check all the interfaces. */
+				log_sm_debug("%s", "Network interface notifications lost, resynchronizing");
+				sync_net_streams(cc_cfg);
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_sm_error("Error reading network interface notifications: %s", strerror(errno));
+			break;
 		}
 
-		if (dp_error != CCAPI_DP_ERROR_NONE)
-			log_sm_error("Cannot add %s value, %d", stream.name, dp_error);
+		for (msg = (const struct nlmsghdr *) buffer; NLMSG_OK(msg, (size_t) len); msg = NLMSG_NEXT(msg, len))
+			handle_link_message(msg, cc_cfg);
 	}
+
+	update_batch_capacity(cc_cfg);
 }
 
 /*
- * add_net_samples() - Add network interfaces RX and TX bytes values to the
- *                     data point collection
+ * handle_link_message() - Process a network interface notification
  *
- * @timestamp: The timestamp for the samples.
+ * @msg:	The RTM_NEWLINK or RTM_DELLINK message.
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
  */
-static void add_net_samples(ccapi_timestamp_t timestamp)
+static void handle_link_message(const struct nlmsghdr *msg, const cc_cfg_t *const cc_cfg)
 {
-	net_state_t net_state;
-	char *iface_name = NULL;
-	int i;
+	const struct ifinfomsg *info = NLMSG_DATA(msg);
+	const struct rtattr *attr;
+	const char *iface_name = NULL;
+	int len;
 
-	for (i = 0; i < net_stream_list.n_streams; i++) {
-		char desc[50] = {0};
-		unsigned long long value = 0;
-		ccapi_dp_error_t dp_error;
-		net_stats_t stats;
-		stream_t stream = net_stream_list.streams[i];
+	if (msg->nlmsg_type != RTM_NEWLINK && msg->nlmsg_type != RTM_DELLINK)
+		return;
 
-		if (iface_name == NULL || strcmp(iface_name, stream.name) != 0) {
-			iface_name = stream.name;
-			ldx_net_get_iface_stats(iface_name, &stats);
-			ldx_net_get_iface_state(iface_name, &net_state);
-		}
+	/* A truncated message has no room for the interface header. */
+	if (msg->nlmsg_len < NLMSG_LENGTH(sizeof(*info)))
+		return;
 
-		switch(stream.type) {
-			case STREAM_STATE:
-				value = net_state.status == NET_STATUS_CONNECTED;
-				strcpy(desc, " status");
-				break;
-			case STREAM_RX_BYTES:
-				value = stats.rx_bytes;
-				strcpy(desc, " RX bytes");
-				break;
-			case STREAM_TX_BYTES:
-				value = stats.tx_bytes;
-				strcpy(desc, " TX bytes");
-				break;
-			default:
-				/* Should not occur */
-				strcpy(desc, "");
-				break;
+	len = IFLA_PAYLOAD(msg);
+	for (attr = IFLA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		if (attr->rta_type == IFLA_IFNAME
+			&& strnlen(RTA_DATA(attr), RTA_PAYLOAD(attr)) < RTA_PAYLOAD(attr)) {
+			iface_name = RTA_DATA(attr);
+			break;
 		}
+	}
 
-		dp_error = ccapi_dp_add(dp_collection, stream.path, value, &timestamp);
+	if (iface_name == NULL || (info->ifi_flags & IFF_LOOPBACK))
+		return;
 
-		if (dp_error != CCAPI_DP_ERROR_NONE)
-			log_sm_error("Cannot add %s%s value, %d", stream.name, desc, dp_error);
-		else
-			log_sm_debug("%s%s = %llu %s", stream.name, desc, value, stream.units);
-	}
+	if (msg->nlmsg_type == RTM_NEWLINK)
+		add_net_iface(iface_name, cc_cfg);
+	else
+		remove_net_iface(iface_name);
 }
 
 /*
- * add_bt_samples() - Add Bluetooth interface RX and TX bytes values to the
- *                    data point collection
+ * sync_net_streams() - Synchronize the network streams with the interfaces
+ *                      of the system
  *
- * @timestamp: The timestamp for the samples.
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
  */
-static void add_bt_samples(ccapi_timestamp_t timestamp)
+static void sync_net_streams(const cc_cfg_t *const cc_cfg)
 {
-	bt_state_t bt_state;
-	bt_stats_t bt_stats;
-	char *iface_name = NULL;
-	int i;
-
-	for (i = 0; i < bt_stream_list.n_streams; i++) {
-		char desc[50] = {0};
-		unsigned long long value = 0;
-		ccapi_dp_error_t dp_error;
-		stream_t stream = bt_stream_list.streams[i];
-
-		if (iface_name == NULL || strcmp(iface_name, stream.name) != 0) {
-			int dev_id = atoi(stream.name + 3);
-
-			iface_name = stream.name;
-			ldx_bt_get_state(dev_id, &bt_state);
-			ldx_bt_get_stats(dev_id, &bt_stats);
-		}
+	net_names_list_t list_ifaces;
+	int i, j;
 
-		switch(stream.type) {
-			case STREAM_STATE:
-				value = bt_state.enable == BT_ENABLED;
-				strcpy(desc, " status");
-				break;
-			case STREAM_RX_BYTES:
-				value = bt_stats.rx_bytes;
-				strcpy(desc, " RX bytes");
-				break;
-			case STREAM_TX_BYTES:
-				value = bt_stats.tx_bytes;
-				strcpy(desc, " TX bytes");
-				break;
-			default:
-				/* Should not occur */
-				strcpy(desc, "");
-				break;
-		}
+	if (ldx_net_list_available_ifaces(&list_ifaces) < 0)
+		return;
 
-		dp_error = ccapi_dp_add(dp_collection, stream.path, value, &timestamp);
+	for (i = 0; i < net_stream_list.n_streams; i++) {
+		stream_t *stream = net_stream_list.streams[i];
+		bool found = false;
 
-		if (dp_error != CCAPI_DP_ERROR_NONE)
-			log_sm_error("Cannot add %s%s value, %d", stream.name, desc, dp_error);
-		else
-			log_sm_debug("%s%s = %llu %s", stream.name, desc, value, stream.units);
+		if (stream->name == NULL)
+			continue;
+		for (j = 0; j < list_ifaces.n_ifaces && !found; j++)
+			found = strcmp(stream->name, list_ifaces.names[j]) == 0;
+		if (!found)
+			remove_net_iface(stream->name);
 	}
+
+	for (i = 0; i < list_ifaces.n_ifaces; i++)
+		add_net_iface(list_ifaces.names[i], cc_cfg);
 }
 
 /*
- * get_timestamp() - Get the current timestamp of the system
+ * add_net_iface() - Start monitoring a network interface
+ *
+ * @iface_name:	Name of the interface.
+ * @cc_cfg:		Connector configuration struct (cc_cfg_t) where the
+ * 				settings parsed from the configuration file are stored.
  *
- * Return: The timestamp of the system.
+ * The streams of an interface that was removed before are reactivated,
+ * otherwise new streams are created and scheduled, after freeing the
+ * streams of removed interfaces that are not needed anymore.
  */
-static ccapi_timestamp_t *get_timestamp(void)
+static void add_net_iface(const char *iface_name, const cc_cfg_t *const cc_cfg)
 {
-	ccapi_timestamp_t *timestamp = NULL;
-	size_t len = strlen("2016-09-27T07:07:09.546Z") + 1;
-	char *date = NULL;
-	time_t now;
+	uint64_t now = get_monotonic_ms();
+	bool known = false;
+	int first, i;
 
-	timestamp = (ccapi_timestamp_t*) malloc(sizeof(ccapi_timestamp_t));
-	if (timestamp == NULL)
-		return NULL;
+	for (i = 0; i < net_stream_list.n_streams; i++) {
+		stream_t *stream = net_stream_list.streams[i];
 
-	date = (char*) malloc(sizeof(char) * len);
-	if (date == NULL) {
-		free(timestamp);
-		return NULL;
+		if (stream->name == NULL || strcmp(stream->name, iface_name) != 0)
+			continue;
+		if (!stream->active)
+			log_sm_debug("Interface '%s' is back, resuming its %s stream", iface_name, stream->path);
+		stream->active = true;
+		known = true;
 	}
 
-	time(&now);
-	if (strftime(date, len, "%FT%TZ", gmtime(&now)) > 0) {
-		timestamp->iso8601 = date;
-	} else {
-		free(date);
-		timestamp->iso8601 = strdup("");
+	if (known)
+		return;
+
+	if (!should_read_interface(iface_name, cc_cfg)) {
+		log_sm_debug("Skipping interface '%s'...", iface_name);
+		return;
 	}
 
-	return timestamp;
-}
+	log_sm_info("Start monitoring interface '%s'", iface_name);
 
-/*
- * get_free_memory() - Get the free memory of the system
- *
- * Return: The free memory of the system in kB, -1 if error.
- */
-static double get_free_memory(void)
-{
-	struct sysinfo info;
+	retire_net_streams();
 
-	if (sysinfo(&info) != 0) {
-		log_sm_error("%s", "Error getting free memory");
-		return -1;
+	first = net_stream_list.n_streams;
+	if (init_iface_streams(iface_name, &net_stream_list, STREAM_SOURCE_NET, cc_cfg) != CCAPI_DP_ERROR_NONE)
+		log_sm_error("Cannot monitor interface '%s'", iface_name);
+
+	for (i = first; i < net_stream_list.n_streams; i++) {
+		stream_t *stream = net_stream_list.streams[i];
+
+		/* Streams that could not be scheduled are never sampled. */
+		if (stream->name == NULL || stream->path == NULL || schedule_stream(stream, now) != 0)
+			stream->active = false;
 	}
 
-	return info.freeram / 1024;
+	if (scheduler.n_entries > 0 && arm_timer(scheduler.entries[0].next_ms) != 0)
+		log_sm_error("Cannot schedule interface '%s'", iface_name);
 }
 
 /*
- * get_used_memory() - Get the usded memory of the system
+ * remove_net_iface() - Stop monitoring a network interface
+ *
+ * @iface_name:	Name of the interface.
  *
- * Return: The used memory of the system in kB, -1 if error.
+ * The streams are kept, inactive, so they are resumed if the interface comes
+ * back. They are freed by retire_net_streams() once no sample waiting to be
+ * uploaded refers to them.
  */
-static double get_used_memory(void)
+static void remove_net_iface(const char *iface_name)
 {
-	struct sysinfo info;
+	int i;
 
-	if (sysinfo(&info) != 0) {
-		log_sm_error("%s", "Error getting used memory");
-		return -1;
-	}
+	for (i = 0; i < net_stream_list.n_streams; i++) {
+		stream_t *stream = net_stream_list.streams[i];
 
-	return (info.totalram - info.freeram) / 1024;
+		if (stream->active && stream->name != NULL && strcmp(stream->name, iface_name) == 0) {
+			log_sm_debug("Interface '%s' removed, pausing its %s stream", iface_name, stream->path);
+			stream->active = false;
+		}
+	}
 }
 
 /*
- * get_cpu_load() - Get the CPU load of the system
+ * retire_net_streams() - Free the streams of the removed network interfaces
  *
- * Return: The CPU load in %, -1 if the value is not available.
+ * Only the streams whose samples have all been uploaded are freed, the rest
+ * are retired by a later call. This keeps the stream list from growing with
+ * every interface that comes and goes, such as PPP or USB gadget links.
  */
-static double get_cpu_load(void) {
-	char file_data[MAX_LENGTH] = {0};
-	long file_size;
-	unsigned long long int fields[10];
-	unsigned long long work = 0, total = 0;
-	double usage = -1;
-	int i, result;
+static void retire_net_streams(void)
+{
+	int i = 0;
 
-	file_size = read_file(FILE_CPU_LOAD, file_data, MAX_LENGTH);
-	if (file_size <= 0) {
-		log_sm_error("%s", "Error getting CPU load");
-		return -1;
-	}
+	while (i < net_stream_list.n_streams) {
+		stream_t *stream = net_stream_list.streams[i];
 
-	result = sscanf(file_data, "cpu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-			&fields[0], &fields[1], &fields[2], &fields[3], &fields[4],
-			&fields[5], &fields[6], &fields[7], &fields[8], &fields[9]);
+		if (stream->active || has_pending_samples(stream)) {
+			i++;
+			continue;
+		}
 
-	if (result < 4) {
-		log_sm_error("%s", "Error getting CPU load");
-		return -1;
+		log_sm_debug("Retiring %s stream", stream->path != NULL ? stream->path : "interface");
+		unschedule_stream(stream);
+		free_stream(stream);
+		net_stream_list.streams[i] = net_stream_list.streams[--net_stream_list.n_streams];
 	}
+}
 
-	for (i = 0; i < 3; i++)
-		work += fields[i];
-	for (i = 0; i < result; i++)
-		total += fields[i];
-
-	if (last_work == 0 && last_total == 0) {
-		/* The first time report 0%. */
-		usage = 0;
-	} else {
-		unsigned long long diff_work = work - last_work;
-		unsigned long long diff_total = total - last_total;
+/*
+ * update_batch_capacity() - Adjust the size of the batches to the number of
+ *                           active streams
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ */
+static void update_batch_capacity(const cc_cfg_t *const cc_cfg)
+{
+	stream_list_t *lists[] = { &sys_stream_list, &net_stream_list, &bt_stream_list, &provider_stream_list };
+	uint32_t n_active = 0;
+	unsigned int l;
+	int i;
 
-		usage = diff_work * 100.0 / diff_total;
+	for (l = 0; l < ARRAY_SIZE(lists); l++) {
+		for (i = 0; i < lists[l]->n_streams; i++) {
+			if (lists[l]->streams[i]->active)
+				n_active++;
+		}
 	}
+	/* Each process scan stores the samples of the top processes. */
+	n_active += 2 * n_top_processes;
 
-	last_total = total;
-	last_work = work;
-
-	return usage;
+	batch_capacity = n_active * cc_cfg->sys_mon_num_samples_upload;
 }
 
 /*
- * get_cpu_temp() - Get the CPU temperature of the system
+ * open_provider_events() - Create the descriptor that notifies provider changes
  *
- * Return: The CPU temperature in C.
+ * Return: 0 on success, -1 otherwise.
  */
-static double get_cpu_temp(void)
+static int open_provider_events(void)
 {
-	char file_data[MAX_LENGTH] = {0};
-	long file_size;
-	double temperature;
-	int result;
+	int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 
-	file_size = read_file(FILE_CPU_TEMP, file_data, MAX_LENGTH);
-	if (file_size <= 0) {
-		log_sm_error("%s", "Error getting CPU temperature");
+	if (fd < 0) {
+		log_sm_error("Cannot follow metric providers: %s", strerror(errno));
 		return -1;
 	}
 
-	result = sscanf(file_data, "%lf", &temperature);
-	if (result < 1) {
-		log_sm_error("%s", "Error getting CPU temperature");
-		return -1;
-	}
+	pthread_mutex_lock(&providers_lock);
+	provider_fd = fd;
+	pthread_mutex_unlock(&providers_lock);
 
-	return temperature / 1000;
+	return 0;
 }
 
 /*
- * get_cpu_freq() - Get the CPU frequency
+ * close_provider_events() - Close the descriptor that notifies provider changes
+ */
+static void close_provider_events(void)
+{
+	pthread_mutex_lock(&providers_lock);
+	if (provider_fd >= 0) {
+		close(provider_fd);
+		provider_fd = -1;
+	}
+	pthread_mutex_unlock(&providers_lock);
+}
+
+/*
+ * sync_provider_streams() - Create or retire the streams of the metric providers
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ *
+ * New providers get a scheduled stream. The streams of unregistered
+ * providers are kept inactive, samples not uploaded yet may refer to them.
+ */
+static void sync_provider_streams(const cc_cfg_t *const cc_cfg)
+{
+	provider_t *provider;
+
+	pthread_mutex_lock(&providers_lock);
+
+	for (provider = providers; provider != NULL; provider = provider->next) {
+		if (provider->checked)
+			continue;
+		provider->checked = true;
+
+		if (provider->removed) {
+			if (provider->stream != NULL) {
+				log_sm_info("Stop monitoring metric '%s'", provider->name);
+				provider->stream->active = false;
+			}
+			continue;
+		}
+
+		if (provider->stream != NULL) {
+			log_sm_info("Resume monitoring metric '%s'", provider->name);
+			provider->stream->active = true;
+			continue;
+		}
+
+		add_provider_stream(provider, cc_cfg);
+	}
+
+	pthread_mutex_unlock(&providers_lock);
+
+	update_batch_capacity(cc_cfg);
+}
+
+/*
+ * add_provider_stream() - Create and schedule the stream of a metric provider
+ *
+ * @provider:	The metric provider.
+ * @cc_cfg:		Connector configuration struct (cc_cfg_t) where the
+ * 				settings parsed from the configuration file are stored.
+ *
+ * The stream is not created if the metric is not configured to be monitored.
+ */
+static void add_provider_stream(provider_t *provider, const cc_cfg_t *const cc_cfg)
+{
+	stream_t *stream;
+
+	if (!should_read_metric(provider->name, cc_cfg)) {
+		log_sm_debug("Skipping metric '%s'...", provider->name);
+		return;
+	}
+
+	stream = new_stream(&provider_stream_list);
+	if (stream == NULL) {
+		log_sm_error("Cannot initialize '%s' metric stream: Out of memory", provider->name);
+		return;
+	}
+
+	stream->name = strdup(provider->name);
+	stream->path = malloc(strlen(SYS_MON_DATA_STREAM_PREFIX) + strlen(provider->name) + 1);
+	stream->provider = provider;
+	provider->stream = stream;
+	if (stream->name == NULL || stream->path == NULL) {
+		log_sm_error("Cannot initialize '%s' metric stream: Out of memory", provider->name);
+		stream->active = false;
+		return;
+	}
+	sprintf(stream->path, "%s%s", SYS_MON_DATA_STREAM_PREFIX, provider->name);
+	stream->units = provider->units;
+	stream->type = STREAM_PROVIDER;
+	stream->source = STREAM_SOURCE_PROVIDER;
+	switch (provider->type) {
+		case SYSMON_VALUE_DOUBLE:
+			stream->format = "double ts_epoch_ms";
+			stream->value_type = VALUE_DOUBLE;
+			break;
+		case SYSMON_VALUE_INT32:
+			stream->format = "int32 ts_epoch_ms";
+			stream->value_type = VALUE_INT32;
+			break;
+		case SYSMON_VALUE_INT64:
+		default:
+			stream->format = "int64 ts_epoch_ms";
+			stream->value_type = VALUE_INT64;
+			break;
+	}
+	stream->period = get_stream_period(provider->name, cc_cfg);
+	set_stream_deadband(stream, provider->name, cc_cfg);
+
+	if (set_stream_aggregation(stream, provider->name, cc_cfg) != 0
+		|| schedule_stream(stream, get_monotonic_ms()) != 0) {
+		log_sm_error("Cannot monitor metric '%s'", provider->name);
+		stream->active = false;
+		return;
+	}
+
+	log_sm_info("Start monitoring metric '%s'", provider->name);
+}
+
+/*
+ * reset_providers() - Detach the metric providers from their streams
+ *
+ * Providers unregistered while the monitor was running are freed. The rest
+ * get a new stream when the monitor starts again.
+ */
+static void reset_providers(void)
+{
+	provider_t **link;
+
+	pthread_mutex_lock(&providers_lock);
+
+	link = &providers;
+	while (*link != NULL) {
+		provider_t *provider = *link;
+
+		provider->stream = NULL;
+		provider->checked = false;
+		if (!provider->removed) {
+			link = &provider->next;
+			continue;
+		}
+
+		*link = provider->next;
+		free(provider->name);
+		free(provider->units);
+		free(provider);
+	}
+
+	pthread_mutex_unlock(&providers_lock);
+}
+
+/*
+ * find_provider() - Find a registered metric provider, removed or not
+ *
+ * @name:	Metric name of the provider.
+ *
+ * The providers lock must be held.
+ *
+ * Return: The provider, NULL if not found.
+ */
+static provider_t *find_provider(const char *name)
+{
+	provider_t *provider;
+
+	for (provider = providers; provider != NULL; provider = provider->next) {
+		if (strcmp(provider->name, name) == 0)
+			return provider;
+	}
+
+	return NULL;
+}
+
+/*
+ * has_valid_provider_chars() - Check the characters of a metric provider text
+ *
+ * @text:		The text to check.
+ * @symbols:	Characters allowed besides letters and digits.
+ *
+ * Names and units end up in stream paths and CSV uploads, so anything that
+ * could break them (separators, quotes, blanks, wildcards...) is refused.
+ *
+ * Return: true if the text is shorter than MAX_LENGTH and only has letters,
+ *         digits and 'symbols'.
+ */
+static bool has_valid_provider_chars(const char *text, const char *symbols)
+{
+	size_t i;
+
+	for (i = 0; text[i] != '\0'; i++) {
+		unsigned char c = (unsigned char) text[i];
+
+		if (i + 1 >= MAX_LENGTH || (!isalnum(c) && strchr(symbols, c) == NULL))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * is_valid_provider_name() - Check whether a metric provider name is valid
+ *
+ * @name:	The name to check.
+ *
+ * Return: true if the name is not empty, it only has letters, digits, '-',
+ *         '_', '.' and '/', and it does not start or end with '/'.
+ */
+static bool is_valid_provider_name(const char *name)
+{
+	size_t len;
+
+	if (name == NULL || !has_valid_provider_chars(name, "-_./"))
+		return false;
+
+	len = strlen(name);
+
+	return len > 0 && name[0] != '/' && name[len - 1] != '/';
+}
+
+/*
+ * is_valid_provider_units() - Check whether the units of a metric provider are valid
+ *
+ * @units:	The units to check, they may be empty.
+ *
+ * Return: true if the units only have letters, digits, '-', '_', '.', '/'
+ *         and '%'.
+ */
+static bool is_valid_provider_units(const char *units)
+{
+	return units != NULL && has_valid_provider_chars(units, "-_./%");
+}
+
+/*
+ * open_link_stats() - Open the socket to dump the network interface statistics
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int open_link_stats(void)
+{
+	link_stats = link_stats_create();
+	if (link_stats == NULL) {
+		log_sm_error("Cannot read network interfaces statistics: %s", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * close_link_stats() - Close the socket to dump the network interface statistics
+ */
+static void close_link_stats(void)
+{
+	link_stats_free(link_stats);
+	link_stats = NULL;
+	links = NULL;
+	n_links = 0;
+}
+
+/*
+ * read_links() - Read the state and statistics of all the network interfaces
+ *
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * All the interfaces are dumped once per tick and shared by all the network
+ * streams.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_links(tick_t *tick)
+{
+	if (tick->links_read)
+		return tick->links_error ? -1 : 0;
+
+	tick->links_read = true;
+	tick->links_error = true;
+	n_links = 0;
+
+	if (link_stats == NULL)
+		return -1;
+
+	if (link_stats_read(link_stats, &links, &n_links) != 0) {
+		log_sm_error("Cannot read network interfaces statistics: %s", strerror(errno));
+		return -1;
+	}
+
+	tick->links_error = false;
+
+	return 0;
+}
+
+/*
+ * find_link() - Get the state and statistics of a network interface
+ *
+ * @iface_name:	Name of the interface.
+ *
+ * Return: The interface information of the last dump, NULL if not found.
+ */
+static const link_info_t *find_link(const char *iface_name)
+{
+	int i;
+
+	for (i = 0; i < n_links; i++) {
+		if (strcmp(links[i].name, iface_name) == 0)
+			return &links[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * init_iface_streams() - Initialize the given interface data point streams
+ *
+ * @iface_name:		Name of the interface to init.
+ * @stream_list:	Structure to initialize.
+ * @source:			Where the values of the interface are read from.
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
+ *
+ * Return: Error code after the initialization.
+ *
+ * The return value will always be 'CCAPI_DP_ERROR_NONE' unless there is any
+ * problem allocating the streams.
+ */
+static ccapi_dp_error_t init_iface_streams(const char *const iface_name, stream_list_t *stream_list,
+		stream_source_t source, const cc_cfg_t *const cc_cfg)
+{
+	ccapi_dp_error_t dp_error;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(net_stream_formats); i++) {
+		dp_error = add_iface_stream(iface_name, stream_list, source, &net_stream_formats[i], cc_cfg);
+		if (dp_error != CCAPI_DP_ERROR_NONE)
+			return dp_error;
+	}
+
+	/* Packet counters are only available for network interfaces. */
+	if (source != STREAM_SOURCE_NET || !cc_cfg->sys_mon_net_extra_stats)
+		return CCAPI_DP_ERROR_NONE;
+
+	for (i = 0; i < ARRAY_SIZE(net_extra_stream_formats); i++) {
+		dp_error = add_iface_stream(iface_name, stream_list, source, &net_extra_stream_formats[i], cc_cfg);
+		if (dp_error != CCAPI_DP_ERROR_NONE)
+			return dp_error;
+	}
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+/*
+ * add_iface_stream() - Add a stream of an interface to a list of streams
+ *
+ * @iface_name:		Name of the interface.
+ * @stream_list:	List to add the stream to.
+ * @source:			Where the values of the interface are read from.
+ * @stream_format:	Format of the stream (metric name, path, units, ...).
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
+ *
+ * The stream is not added if the metric is not configured to be monitored.
+ *
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
+ */
+static ccapi_dp_error_t add_iface_stream(const char *const iface_name, stream_list_t *stream_list,
+		stream_source_t source, const stream_t *stream_format, const cc_cfg_t *const cc_cfg)
+{
+	char metric_name[IFNAMSIZ + 32];
+	uint32_t period;
+	stream_t *stream;
+	size_t path_len;
+
+	/* Build metric name. */
+	snprintf(metric_name, sizeof(metric_name), "%s/%s", iface_name, stream_format->name);
+
+	/* Check if metric should be measured. */
+	if (!should_read_metric(metric_name, cc_cfg)) {
+		log_sm_debug("Skipping %s...", metric_name);
+		return CCAPI_DP_ERROR_NONE;
+	}
+	period = get_stream_period(metric_name, cc_cfg);
+
+	/* Allocate memory for the metric stream. */
+	stream = new_stream(stream_list);
+	if (stream == NULL) {
+		log_sm_error("Cannot initialize interface '%s' metric '%s': Out of memory", iface_name, stream_format->name);
+		return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+	}
+
+	path_len = snprintf(NULL, 0, stream_format->path, iface_name);
+
+	stream->name = strdup(iface_name);
+	stream->path = calloc(path_len + 1, sizeof(char));
+	if (stream->name == NULL || stream->path == NULL) {
+		log_sm_error("Cannot initialize interface '%s' metric '%s': Out of memory", iface_name, stream_format->name);
+		return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+	}
+
+	sprintf(stream->path, stream_format->path, iface_name);
+
+	stream->format = stream_format->format;
+	stream->units = stream_format->units;
+	stream->type = stream_format->type;
+	stream->source = source;
+	stream->value_type = stream_format->value_type;
+	stream->period = period;
+	set_stream_deadband(stream, metric_name, cc_cfg);
+	if (set_stream_aggregation(stream, metric_name, cc_cfg) != 0) {
+		log_sm_error("Cannot initialize interface '%s' metric '%s': Out of memory", iface_name, stream_format->name);
+		return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
+	}
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+/*
+ * init_scheduler() - Group the streams by sample period in the scheduler
+ *
+ * Every group of streams sharing a period is an entry of a min-heap ordered
+ * by the time of its next sample. All the entries are due immediately.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int init_scheduler(void)
+{
+	stream_list_t *lists[] = { &sys_stream_list, &net_stream_list, &bt_stream_list, &provider_stream_list };
+	uint64_t now = get_monotonic_ms();
+	unsigned int l;
+	int i;
+
+	scheduler.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (scheduler.timer_fd < 0) {
+		log_sm_error("Cannot create system monitor timer: %s", strerror(errno));
+		return -1;
+	}
+
+	for (l = 0; l < ARRAY_SIZE(lists); l++) {
+		for (i = 0; i < lists[l]->n_streams; i++) {
+			if (schedule_stream(lists[l]->streams[i], now) != 0) {
+				free_scheduler();
+				return -1;
+			}
+		}
+	}
+
+	for (i = 0; i < scheduler.n_entries; i++)
+		log_sm_debug("Sampling %d streams every %llu ms", scheduler.entries[i].n_streams,
+				(unsigned long long) scheduler.entries[i].period_ms);
+
+	return 0;
+}
+
+/*
+ * schedule_stream() - Add a stream to the scheduler entry of its period
+ *
+ * @stream:	The stream to schedule.
+ * @now:	Current CLOCK_MONOTONIC time in milliseconds.
+ *
+ * If there is no entry for the period of the stream, a new one is created
+ * and it is due immediately.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int schedule_stream(stream_t *stream, uint64_t now)
+{
+	uint64_t period_ms = stream->period * 1000ULL;
+	schedule_entry_t *entry = NULL;
+	stream_t **tmp;
+	int e;
+
+	for (e = 0; e < scheduler.n_entries; e++) {
+		if (scheduler.entries[e].period_ms == period_ms) {
+			entry = &scheduler.entries[e];
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		schedule_entry_t *entries = realloc(scheduler.entries,
+				(scheduler.n_entries + 1) * sizeof(schedule_entry_t));
+
+		if (entries == NULL)
+			goto error;
+		scheduler.entries = entries;
+		e = scheduler.n_entries++;
+		entry = &scheduler.entries[e];
+		memset(entry, 0, sizeof(schedule_entry_t));
+		entry->period_ms = period_ms;
+		entry->next_ms = now;
+		sift_up_entry(e);
+		/* The new entry may have moved to keep the heap order. */
+		for (e = 0; scheduler.entries[e].period_ms != period_ms; e++)
+			;
+		entry = &scheduler.entries[e];
+	}
+
+	tmp = realloc(entry->streams, (entry->n_streams + 1) * sizeof(stream_t *));
+	if (tmp == NULL)
+		goto error;
+	entry->streams = tmp;
+	entry->streams[entry->n_streams++] = stream;
+
+	return 0;
+
+error:
+	log_sm_error("Cannot schedule '%s' stream: %s", stream->path, "Out of memory");
+
+	return -1;
+}
+
+/*
+ * unschedule_stream() - Remove a stream from the scheduler entry of its period
+ *
+ * @stream:	The stream to remove, nothing is done if it is not scheduled.
+ *
+ * The entry is kept even if it has no streams left.
+ */
+static void unschedule_stream(const stream_t *stream)
+{
+	int e, i;
+
+	for (e = 0; e < scheduler.n_entries; e++) {
+		schedule_entry_t *entry = &scheduler.entries[e];
+
+		for (i = 0; i < entry->n_streams; i++) {
+			if (entry->streams[i] == stream) {
+				entry->streams[i] = entry->streams[--entry->n_streams];
+				return;
+			}
+		}
+	}
+}
+
+/*
+ * free_scheduler() - Release the scheduler entries and its timer
+ */
+static void free_scheduler(void)
+{
+	int i;
+
+	for (i = 0; i < scheduler.n_entries; i++)
+		free(scheduler.entries[i].streams);
+	free(scheduler.entries);
+	scheduler.entries = NULL;
+	scheduler.n_entries = 0;
+
+	if (scheduler.timer_fd >= 0) {
+		close(scheduler.timer_fd);
+		scheduler.timer_fd = -1;
+	}
+	scheduler.stretch = 1;
+}
+
+/*
+ * sift_up_entry() - Move up a heap entry to restore the heap order
+ *
+ * @index:	Index of the entry to move.
+ */
+static void sift_up_entry(int index)
+{
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		schedule_entry_t tmp;
+
+		if (scheduler.entries[parent].next_ms <= scheduler.entries[index].next_ms)
+			return;
+
+		tmp = scheduler.entries[index];
+		scheduler.entries[index] = scheduler.entries[parent];
+		scheduler.entries[parent] = tmp;
+		index = parent;
+	}
+}
+
+/*
+ * sift_down_entry() - Move down a heap entry to restore the heap order
+ *
+ * @index:	Index of the entry to move.
+ */
+static void sift_down_entry(int index)
+{
+	while (true) {
+		int smallest = index;
+		int left = 2 * index + 1;
+		int right = left + 1;
+		schedule_entry_t tmp;
+
+		if (left < scheduler.n_entries
+			&& scheduler.entries[left].next_ms < scheduler.entries[smallest].next_ms)
+			smallest = left;
+		if (right < scheduler.n_entries
+			&& scheduler.entries[right].next_ms < scheduler.entries[smallest].next_ms)
+			smallest = right;
+		if (smallest == index)
+			return;
+
+		tmp = scheduler.entries[index];
+		scheduler.entries[index] = scheduler.entries[smallest];
+		scheduler.entries[smallest] = tmp;
+		index = smallest;
+	}
+}
+
+/*
+ * arm_timer() - Program the scheduler timer to expire at the given time
+ *
+ * @due_ms:	Absolute CLOCK_MONOTONIC time in milliseconds.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int arm_timer(uint64_t due_ms)
+{
+	struct itimerspec spec = { 0 };
+
+	spec.it_value.tv_sec = due_ms / 1000;
+	spec.it_value.tv_nsec = (due_ms % 1000) * 1000 * 1000;
+	/* A zero value disarms the timer. */
+	if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+		spec.it_value.tv_nsec = 1;
+
+	if (timerfd_settime(scheduler.timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+		log_sm_error("Cannot program system monitor timer: %s", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * get_monotonic_ms() - Get the current CLOCK_MONOTONIC time
+ *
+ * Return: The current time in milliseconds.
+ */
+static uint64_t get_monotonic_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / (1000 * 1000);
+}
+
+/*
+ * update_stretch() - Adapt the sample periods to the link and the backlog
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ * @now:	Current CLOCK_MONOTONIC time in milliseconds.
+ *
+ * With adaptive sampling, the configured periods are multiplied by a factor
+ * between the bounds of the profile of the link used to connect (WAN or
+ * LAN), proportional to the number of batches pending to be uploaded. As an
+ * upload is done every 'sys_mon_num_samples_upload' samples, the upload
+ * interval is stretched by the same factor.
+ *
+ * When the factor decreases, the samples scheduled with the longer periods
+ * are brought forward.
+ */
+static void update_stretch(const cc_cfg_t *const cc_cfg, uint64_t now)
+{
+	const sys_mon_stretch_t *bounds;
+	uint32_t n_batches, max_batches, stretch;
+	cc_link_t link;
+	int i;
+
+	if (!cc_cfg->sys_mon_adaptive)
+		return;
+
+	link = get_cloud_connection_link();
+	bounds = link == CC_LINK_WAN ? &cc_cfg->sys_mon_wan_stretch : &cc_cfg->sys_mon_lan_stretch;
+
+	pthread_mutex_lock(&backlog.lock);
+	n_batches = backlog.n_batches;
+	max_batches = backlog.max_batches;
+	pthread_mutex_unlock(&backlog.lock);
+
+	if (n_batches > max_batches)
+		n_batches = max_batches;
+	stretch = bounds->min;
+	if (max_batches > 0)
+		stretch += (bounds->max - bounds->min) * n_batches / max_batches;
+
+	if (stretch == scheduler.stretch)
+		return;
+
+	log_sm_info("Sampling every %" PRIu32 " times the configured periods (%s link, %" PRIu32 " batches pending)",
+			stretch, link == CC_LINK_WAN ? "WAN" : "LAN", n_batches);
+
+	if (stretch < scheduler.stretch) {
+		for (i = 0; i < scheduler.n_entries; i++) {
+			uint64_t next_ms = now + scheduler.entries[i].period_ms * stretch;
+
+			if (scheduler.entries[i].next_ms > next_ms)
+				scheduler.entries[i].next_ms = next_ms;
+		}
+		for (i = scheduler.n_entries / 2 - 1; i >= 0; i--)
+			sift_down_entry(i);
+	}
+
+	scheduler.stretch = stretch;
+}
+
+/*
+ * get_stream_period() - Get the sample period of a metric
+ *
+ * @metric_name:	The metric name ("cpu_load", "eth0/rx_bytes", ...).
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
+ *
+ * Return: The period in seconds of the first matching sample rate, or the
+ *         general sample rate if none matches.
+ */
+static uint32_t get_stream_period(const char *metric_name, const cc_cfg_t *const cc_cfg)
+{
+	unsigned int i;
+
+	for (i = 0; i < cc_cfg->n_sys_mon_rates; i++) {
+		if (metric_filter_match_pattern(cc_cfg->sys_mon_rates[i].pattern, metric_name))
+			return cc_cfg->sys_mon_rates[i].period;
+	}
+
+	return cc_cfg->sys_mon_sample_rate;
+}
+
+/*
+ * set_stream_deadband() - Configure the deadband of a stream
+ *
+ * @stream:			The stream to configure.
+ * @metric_name:	The metric name ("cpu_temperature", "eth0/state", ...).
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
+ *
+ * The first matching deadband applies. Streams not matching any deadband
+ * report every sample.
+ */
+static void set_stream_deadband(stream_t *stream, const char *metric_name, const cc_cfg_t *const cc_cfg)
+{
+	unsigned int i;
+
+	stream->deadband = -1;
+	stream->deadband_percent = false;
+
+	for (i = 0; i < cc_cfg->n_sys_mon_deadbands; i++) {
+		if (metric_filter_match_pattern(cc_cfg->sys_mon_deadbands[i].pattern, metric_name)) {
+			stream->deadband = cc_cfg->sys_mon_deadbands[i].deadband;
+			stream->deadband_percent = cc_cfg->sys_mon_deadbands[i].percent;
+			break;
+		}
+	}
+}
+
+/*
+ * is_sample_reportable() - Check whether a sample must be uploaded
+ *
+ * @stream:		Stream the value belongs to.
+ * @value:		The read value.
+ * @timestamp:	The timestamp of the value.
+ *
+ * A sample of a stream with deadband is suppressed if its value differs from
+ * the last reported one by no more than the deadband, unless the last report
+ * is 'heartbeat' seconds old or more.
+ *
+ * Return: true if the sample must be uploaded, false if it is suppressed.
+ */
+static bool is_sample_reportable(stream_t *stream, sample_value_t value, uint64_t timestamp)
+{
+	double current, last, diff, band;
+
+	if (stream->deadband >= 0 && stream->reported
+		&& (heartbeat == 0 || timestamp - stream->last_report < heartbeat * 1000ULL)) {
+		if (stream->value_type == VALUE_DOUBLE) {
+			current = value.d;
+			last = stream->last_value.d;
+		} else {
+			current = (double) value.i;
+			last = (double) stream->last_value.i;
+		}
+		diff = current > last ? current - last : last - current;
+		band = stream->deadband;
+		if (stream->deadband_percent)
+			band *= (last < 0 ? -last : last) / 100;
+
+		if (diff <= band) {
+			stream->n_suppressed++;
+			n_suppressed_samples++;
+			return false;
+		}
+	}
+
+	stream->reported = true;
+	stream->last_value = value;
+	stream->last_report = timestamp;
+	stream->n_reported++;
+
+	return true;
+}
+
+/*
+ * set_stream_aggregation() - Configure the aggregation window of a stream
+ *
+ * @stream:			The stream to configure, its path and units must be set.
+ * @metric_name:	The metric name ("cpu_load", "eth0/rx_bytes", ...).
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
+ *
+ * If the metric matches an aggregation window, a summary stream is created
+ * for every aggregate function ("system_monitor/cpu_load/max", ...). These
+ * streams are not sampled, they get a value when a window closes.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int set_stream_aggregation(stream_t *stream, const char *metric_name, const cc_cfg_t *const cc_cfg)
+{
+	unsigned int i;
+	int f;
+
+	for (i = 0; i < cc_cfg->n_sys_mon_aggregations; i++) {
+		if (metric_filter_match_pattern(cc_cfg->sys_mon_aggregations[i].pattern, metric_name))
+			break;
+	}
+	if (i == cc_cfg->n_sys_mon_aggregations)
+		return 0;
+
+	stream->window = cc_cfg->sys_mon_aggregations[i].period;
+	stream->aggregate = calloc(1, sizeof(aggregate_t));
+	stream->summaries = calloc(AGGREGATE_N_FUNCTIONS, sizeof(stream_t));
+	if (stream->aggregate == NULL || stream->summaries == NULL)
+		return -1;
+
+	for (f = 0; f < AGGREGATE_N_FUNCTIONS; f++) {
+		stream_t *summary = &stream->summaries[f];
+		const char *function = aggregate_function_name(f);
+
+		summary->name = malloc(strlen(metric_name) + strlen(function) + 2);
+		summary->path = malloc(strlen(stream->path) + strlen(function) + 2);
+		if (summary->name == NULL || summary->path == NULL)
+			return -1;
+		sprintf(summary->name, "%s/%s", metric_name, function);
+		sprintf(summary->path, "%s/%s", stream->path, function);
+
+		summary->units = stream->units;
+		summary->format = "double ts_epoch_ms";
+		summary->type = stream->type;
+		summary->source = stream->source;
+		summary->value_type = VALUE_DOUBLE;
+		summary->period = stream->window;
+		summary->fd = -1;
+		summary->cpu = -1;
+		summary->active = true;
+		set_stream_deadband(summary, summary->name, cc_cfg);
+	}
+
+	log_sm_debug("Aggregating %s every %" PRIu32 " seconds", metric_name, stream->window);
+
+	return 0;
+}
+
+/*
+ * aggregate_sample() - Add a value to the current window of a stream
+ *
+ * @stream:		Stream the value belongs to.
+ * @value:		The read value.
+ * @timestamp:	The timestamp of the value.
+ *
+ * When the window closes, its summaries are stored in the current batch and
+ * a new window starts.
+ */
+static void aggregate_sample(stream_t *stream, sample_value_t value, uint64_t timestamp)
+{
+	int f;
+
+	if (stream->window_end == 0)
+		stream->window_end = timestamp + stream->window * 1000ULL;
+
+	aggregate_add(stream->aggregate,
+			stream->value_type == VALUE_DOUBLE ? value.d : (double) value.i);
+
+	if (timestamp < stream->window_end)
+		return;
+
+	for (f = 0; f < AGGREGATE_N_FUNCTIONS; f++) {
+		stream_t *summary = &stream->summaries[f];
+		sample_value_t summary_value;
+
+		summary_value.d = aggregate_get(stream->aggregate, f);
+		if (is_sample_reportable(summary, summary_value, timestamp))
+			add_sample(summary, summary_value, timestamp);
+	}
+
+	aggregate_reset(stream->aggregate);
+	stream->window_end += stream->window * 1000ULL;
+	if (stream->window_end <= timestamp)
+		stream->window_end = timestamp + stream->window * 1000ULL;
+}
+
+/*
+ * log_suppressed_samples() - Log the number of samples suppressed per stream
+ */
+static void log_suppressed_samples(void)
+{
+	stream_list_t *lists[] = { &sys_stream_list, &net_stream_list, &bt_stream_list, &provider_stream_list };
+	unsigned long n_reported = 0, n_suppressed = 0;
+	unsigned int l;
+	int i;
+
+	for (l = 0; l < ARRAY_SIZE(lists); l++) {
+		for (i = 0; i < lists[l]->n_streams; i++) {
+			const stream_t *stream = lists[l]->streams[i];
+
+			if (stream->n_suppressed > 0)
+				log_sm_debug("%s: %lu samples reported, %lu suppressed", stream->path,
+						stream->n_reported, stream->n_suppressed);
+			n_reported += stream->n_reported;
+			n_suppressed += stream->n_suppressed;
+		}
+	}
+
+	if (n_suppressed > 0)
+		log_sm_info("%lu samples reported, %lu suppressed by deadband", n_reported, n_suppressed);
+}
+
+/*
+ * add_entry_samples() - Read a sample of every stream of a scheduler entry
+ *                       and store it in the current batch
+ *
+ * @entry:	The scheduler entry.
+ * @tick:	Values shared by all the samples of this tick.
+ */
+static void add_entry_samples(const schedule_entry_t *entry, tick_t *tick)
+{
+	iface_cache_t cache = { 0 };
+	int i;
+
+	for (i = 0; i < entry->n_streams; i++) {
+		stream_t *stream = entry->streams[i];
+		sample_value_t value;
+		int ret;
+
+		if (!stream->active)
+			continue;
+
+		/* The processes stream only triggers the samples of the processes. */
+		if (stream->type == STREAM_PROCESSES) {
+			add_process_samples(tick);
+			continue;
+		}
+
+		switch (stream->source) {
+			case STREAM_SOURCE_NET:
+				ret = read_net_value(stream, tick, &value);
+				break;
+			case STREAM_SOURCE_BT:
+				ret = read_bt_value(stream, &cache, &value);
+				break;
+			case STREAM_SOURCE_PROVIDER:
+				ret = read_provider_value(stream, &value);
+				break;
+			case STREAM_SOURCE_SYSTEM:
+			default:
+				ret = read_sys_value(stream, tick, &value);
+				break;
+		}
+
+		if (ret != 0)
+			continue;
+
+		if (stream->aggregate != NULL)
+			aggregate_sample(stream, value, tick->timestamp);
+		else if (is_sample_reportable(stream, value, tick->timestamp))
+			add_sample(stream, value, tick->timestamp);
+	}
+}
+
+/*
+ * read_sys_value() - Read the value of a system metric stream
+ *
+ * @stream:	The stream to read.
+ * @tick:	Values shared by all the samples of this tick.
+ * @value:	The read value.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_sys_value(stream_t *stream, tick_t *tick, sample_value_t *value)
+{
+	switch(stream->type) {
+		case STREAM_FREE_MEM:
+		case STREAM_USED_MEM:
+		case STREAM_CACHED_MEM:
+		case STREAM_DIRTY_MEM:
+		case STREAM_FREE_SWAP:
+		case STREAM_USED_SWAP:
+			value->d = get_memory(stream, tick);
+			log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+			break;
+		case STREAM_CPU_LOAD:
+			value->d = get_cpu_load(stream, tick);
+			log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+			break;
+		case STREAM_CPU_TEMP:
+			value->d = get_cpu_temp(stream);
+			log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+			break;
+		case STREAM_FREQ:
+			value->i = get_cpu_freq(stream);
+			log_sm_debug("%s = %lu %s", stream->name, (unsigned long) value->i, stream->units);
+			break;
+		case STREAM_UPTIME:
+			value->i = get_uptime(tick);
+			log_sm_debug("%s = %lu %s", stream->name, (unsigned long) value->i, stream->units);
+			break;
+		case STREAM_SUPPRESSED:
+			value->i = n_suppressed_samples;
+			log_sm_debug("%s = %lu %s", stream->name, (unsigned long) value->i, stream->units);
+			break;
+		case STREAM_DISK_READ:
+		case STREAM_DISK_WRITE:
+		case STREAM_DISK_IOPS:
+		case STREAM_DISK_UTILIZATION:
+			if (get_disk_rate(stream, tick, &value->d) != 0)
+				return -1;
+			log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+			break;
+		case STREAM_PSI_SOME_AVG10:
+		case STREAM_PSI_SOME_AVG60:
+		case STREAM_PSI_SOME_STALL:
+		case STREAM_PSI_FULL_AVG10:
+		case STREAM_PSI_FULL_AVG60:
+		case STREAM_PSI_FULL_STALL:
+			if (get_pressure(stream, tick, &value->d) != 0)
+				return -1;
+			log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+			break;
+		case STREAM_FS_FREE:
+		case STREAM_FS_USED:
+		case STREAM_FS_USAGE:
+			if (get_fs_usage(stream, tick, value) != 0)
+				return -1;
+			if (stream->value_type == VALUE_DOUBLE)
+				log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+			else
+				log_sm_debug("%s = %lld %s", stream->name, (long long) value->i, stream->units);
+			break;
+		default:
+			/* Should not occur */
+			log_sm_error("Cannot add %s value, unknown stream (%d)", stream->name, stream->type);
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * read_net_value() - Read the value of a network interface stream
+ *
+ * @stream:	The stream to read.
+ * @tick:	Values shared by all the samples of this tick.
+ * @value:	The read value.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_net_value(const stream_t *stream, tick_t *tick, sample_value_t *value)
+{
+	const link_info_t *link;
+	char desc[50] = {0};
+
+	if (read_links(tick) != 0)
+		return -1;
+
+	link = find_link(stream->name);
+	if (link == NULL) {
+		log_sm_debug("Cannot read %s, interface not found", stream->path);
+		return -1;
+	}
+
+	value->i = 0;
+	switch(stream->type) {
+		case STREAM_STATE:
+			value->i = (link->flags & IFF_UP)
+				&& (link->operstate == LINK_OPER_UP
+					|| (link->operstate == LINK_OPER_UNKNOWN && link->carrier));
+			strcpy(desc, " status");
+			break;
+		case STREAM_RX_BYTES:
+			value->i = link->stats.rx_bytes;
+			strcpy(desc, " RX bytes");
+			break;
+		case STREAM_TX_BYTES:
+			value->i = link->stats.tx_bytes;
+			strcpy(desc, " TX bytes");
+			break;
+		case STREAM_RX_PACKETS:
+			value->i = link->stats.rx_packets;
+			strcpy(desc, " RX packets");
+			break;
+		case STREAM_TX_PACKETS:
+			value->i = link->stats.tx_packets;
+			strcpy(desc, " TX packets");
+			break;
+		case STREAM_RX_ERRORS:
+			value->i = link->stats.rx_errors;
+			strcpy(desc, " RX errors");
+			break;
+		case STREAM_TX_ERRORS:
+			value->i = link->stats.tx_errors;
+			strcpy(desc, " TX errors");
+			break;
+		case STREAM_RX_DROPPED:
+			value->i = link->stats.rx_dropped;
+			strcpy(desc, " RX dropped");
+			break;
+		case STREAM_TX_DROPPED:
+			value->i = link->stats.tx_dropped;
+			strcpy(desc, " TX dropped");
+			break;
+		default:
+			/* Should not occur */
+			strcpy(desc, "");
+			break;
+	}
+
+	log_sm_debug("%s%s = %llu %s", stream->name, desc, (unsigned long long) value->i, stream->units);
+
+	return 0;
+}
+
+/*
+ * read_bt_value() - Read the value of a Bluetooth interface stream
+ *
+ * @stream:	The stream to read.
+ * @cache:	Statistics of the last read interface, reused by consecutive
+ * 			streams of the same interface.
+ * @value:	The read value.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_bt_value(const stream_t *stream, iface_cache_t *cache, sample_value_t *value)
+{
+	char desc[50] = {0};
+
+	if (cache->iface_name == NULL || strcmp(cache->iface_name, stream->name) != 0) {
+		int dev_id = atoi(stream->name + 3);
+
+		cache->iface_name = stream->name;
+		ldx_bt_get_state(dev_id, &cache->bt_state);
+		ldx_bt_get_stats(dev_id, &cache->bt_stats);
+	}
+
+	value->i = 0;
+	switch(stream->type) {
+		case STREAM_STATE:
+			value->i = cache->bt_state.enable == BT_ENABLED;
+			strcpy(desc, " status");
+			break;
+		case STREAM_RX_BYTES:
+			value->i = cache->bt_stats.rx_bytes;
+			strcpy(desc, " RX bytes");
+			break;
+		case STREAM_TX_BYTES:
+			value->i = cache->bt_stats.tx_bytes;
+			strcpy(desc, " TX bytes");
+			break;
+		default:
+			/* Should not occur */
+			strcpy(desc, "");
+			break;
+	}
+
+	log_sm_debug("%s%s = %llu %s", stream->name, desc, (unsigned long long) value->i, stream->units);
+
+	return 0;
+}
+
+/*
+ * read_provider_value() - Read the value of a metric provider stream
+ *
+ * @stream:	The stream to read.
+ * @value:	The read value.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_provider_value(const stream_t *stream, sample_value_t *value)
+{
+	sysmon_value_t provider_value = { 0 };
+	int ret = -1;
+
+	pthread_mutex_lock(&providers_lock);
+	if (stream->provider != NULL && !stream->provider->removed)
+		ret = stream->provider->sample_fn(&provider_value, stream->provider->ctx) == 0 ? 0 : -1;
+	pthread_mutex_unlock(&providers_lock);
+
+	if (ret != 0) {
+		log_sm_debug("Cannot get %s value", stream->name);
+		return -1;
+	}
+
+	if (stream->value_type == VALUE_DOUBLE) {
+		value->d = provider_value.d;
+		log_sm_debug("%s = %f %s", stream->name, value->d, stream->units);
+	} else {
+		value->i = stream->value_type == VALUE_INT32 ? (int32_t) provider_value.i : provider_value.i;
+		log_sm_debug("%s = %lld %s", stream->name, (long long) value->i, stream->units);
+	}
+
+	return 0;
+}
+
+/*
+ * init_processes() - Initialize the scan of the top processes
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ *			Process streams created later take their deadband and
+ *			aggregation from it.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int init_processes(const cc_cfg_t *const cc_cfg)
+{
+	uint32_t n_top = cc_cfg->sys_mon_top_processes;
+
+	process_scanner = process_scanner_create();
+	top_cpu_processes = calloc(n_top, sizeof(process_info_t));
+	top_memory_processes = calloc(n_top, sizeof(process_info_t));
+	if (process_scanner == NULL || top_cpu_processes == NULL || top_memory_processes == NULL) {
+		free_processes();
+		return -1;
+	}
+	n_top_processes = n_top;
+	n_process_scans = 0;
+	processes_cfg = cc_cfg;
+
+	return 0;
+}
+
+/*
+ * free_processes() - Release the state of the scan of the top processes
+ */
+static void free_processes(void)
+{
+	process_scanner_free(process_scanner);
+	process_scanner = NULL;
+	free(top_cpu_processes);
+	top_cpu_processes = NULL;
+	free(top_memory_processes);
+	top_memory_processes = NULL;
+	n_top_processes = 0;
+	processes_cfg = NULL;
+}
+
+/*
+ * add_process_samples() - Store the usage of the top processes in the current batch
+ *
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * The CPU load of the processes using more CPU and the memory of the
+ * processes using more memory are stored in a stream per process name,
+ * "processes/<name>/cpu_load" and "processes/<name>/memory". If several
+ * processes share a name, only the first one of each list is stored.
+ * Deadbands and aggregations apply to them as to any other metric.
+ */
+static void add_process_samples(tick_t *tick)
+{
+	unsigned int n_cpu, n_memory, i;
+
+	if (process_scanner == NULL)
+		return;
+
+	if (process_scanner_scan(process_scanner, n_top_processes, top_cpu_processes, &n_cpu,
+			top_memory_processes, &n_memory) != 0) {
+		log_sm_error("Cannot get %s value: %s", METRIC_PROCESSES, strerror(errno));
+		return;
+	}
+	n_process_scans++;
+
+	for (i = 0; i < n_cpu; i++) {
+		stream_t *stream = get_process_stream(top_cpu_processes[i].name, STREAM_PROCESS_CPU_LOAD);
+		sample_value_t value;
+
+		if (stream == NULL || stream->last_work == n_process_scans)
+			continue;
+		stream->last_work = n_process_scans;
+		value.d = top_cpu_processes[i].cpu_load;
+		log_sm_debug("%s = %f %s (pid %d)", stream->name, value.d, stream->units,
+				top_cpu_processes[i].pid);
+		if (stream->aggregate != NULL)
+			aggregate_sample(stream, value, tick->timestamp);
+		else if (is_sample_reportable(stream, value, tick->timestamp))
+			add_sample(stream, value, tick->timestamp);
+	}
+
+	for (i = 0; i < n_memory; i++) {
+		stream_t *stream = get_process_stream(top_memory_processes[i].name, STREAM_PROCESS_MEMORY);
+		sample_value_t value;
+
+		if (stream == NULL || stream->last_work == n_process_scans)
+			continue;
+		stream->last_work = n_process_scans;
+		value.i = (int64_t) top_memory_processes[i].rss;
+		log_sm_debug("%s = %lld %s (pid %d)", stream->name, (long long) value.i, stream->units,
+				top_memory_processes[i].pid);
+		if (stream->aggregate != NULL)
+			aggregate_sample(stream, value, tick->timestamp);
+		else if (is_sample_reportable(stream, value, tick->timestamp))
+			add_sample(stream, value, tick->timestamp);
+	}
+}
+
+/*
+ * get_process_stream() - Get the stream of a process metric, creating it if needed
+ *
+ * @process_name:	Name of the process.
+ * @type:			STREAM_PROCESS_CPU_LOAD or STREAM_PROCESS_MEMORY.
+ *
+ * Characters of the process name not valid in a stream path are replaced
+ * by '_'. At most MAX_PROCESS_STREAMS streams exist, once they are all in use
+ * a stream that left the top processes is retired to make room.
+ *
+ * Return: The stream, NULL if it cannot be created.
+ */
+static stream_t *get_process_stream(const char *process_name, stream_type_t type)
+{
+	char name[PROCESS_NAME_SIZE];
+	char metric_name[MAX_LENGTH];
+	stream_t *stream;
+	int i;
+
+	for (i = 0; process_name[i] != '\0' && i < PROCESS_NAME_SIZE - 1; i++) {
+		char c = process_name[i];
+
+		name[i] = (isalnum((unsigned char) c) || c == '-' || c == '_' || c == '.') ? c : '_';
+	}
+	name[i] = '\0';
+
+	snprintf(metric_name, sizeof(metric_name),
+			type == STREAM_PROCESS_CPU_LOAD ? METRIC_PROCESS_CPU_LOAD : METRIC_PROCESS_MEMORY, name);
+
+	for (i = 0; i < process_stream_list.n_streams; i++) {
+		stream = process_stream_list.streams[i];
+		if (stream->active && strcmp(stream->name, metric_name) == 0)
+			return stream;
+	}
+
+	if (process_stream_list.n_streams >= MAX_PROCESS_STREAMS && retire_process_stream() != 0) {
+		log_sm_debug("Skipping %s, too many process streams", metric_name);
+		return NULL;
+	}
+
+	stream = new_stream(&process_stream_list);
+	if (stream == NULL)
+		return NULL;
+
+	stream->name = strdup(metric_name);
+	stream->path = malloc(strlen(SYS_MON_DATA_STREAM_PREFIX) + strlen(metric_name) + 1);
+	if (stream->name == NULL || stream->path == NULL) {
+		log_sm_error("Cannot initialize '%s' metric stream: Out of memory", metric_name);
+		stream->active = false;
+		return NULL;
+	}
+	sprintf(stream->path, "%s%s", SYS_MON_DATA_STREAM_PREFIX, metric_name);
+
+	stream->type = type;
+	stream->source = STREAM_SOURCE_SYSTEM;
+	stream->cpu = -1;
+	if (type == STREAM_PROCESS_CPU_LOAD) {
+		stream->units = DATA_STREAM_CPU_LOAD_UNITS;
+		stream->format = "double ts_epoch_ms";
+		stream->value_type = VALUE_DOUBLE;
+	} else {
+		stream->units = DATA_STREAM_MEMORY_UNITS;
+		stream->format = "int64 ts_epoch_ms";
+		stream->value_type = VALUE_INT64;
+	}
+
+	set_stream_deadband(stream, metric_name, processes_cfg);
+	if (set_stream_aggregation(stream, metric_name, processes_cfg) != 0) {
+		log_sm_error("Cannot initialize '%s' metric stream: Out of memory", metric_name);
+		stream->active = false;
+		return NULL;
+	}
+
+	return stream;
+}
+
+/*
+ * has_pending_samples() - Check if samples of a stream are not freed yet
+ *
+ * @stream:	The process or network stream.
+ *
+ * Return: True if a batch not freed yet refers to the stream or to any of its
+ *         summaries, false otherwise.
+ */
+static bool has_pending_samples(stream_t *stream)
+{
+	int f;
+
+	if (__atomic_load_n(&stream->n_pending, __ATOMIC_ACQUIRE) > 0)
+		return true;
+
+	for (f = 0; stream->summaries != NULL && f < AGGREGATE_N_FUNCTIONS; f++) {
+		if (__atomic_load_n(&stream->summaries[f].n_pending, __ATOMIC_ACQUIRE) > 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * retire_process_stream() - Free a process stream to make room for a new one
+ *
+ * A stream can be retired once its process has been out of the top
+ * processes for PROCESS_STREAM_IDLE_SCANS scans, or if it could not be
+ * initialized, and none of its samples wait to be uploaded.
+ *
+ * Return: 0 if a stream was freed, -1 if none can be retired.
+ */
+static int retire_process_stream(void)
+{
+	int i;
+
+	for (i = 0; i < process_stream_list.n_streams; i++) {
+		stream_t *stream = process_stream_list.streams[i];
+
+		if ((stream->active && n_process_scans - stream->last_work < PROCESS_STREAM_IDLE_SCANS)
+			|| has_pending_samples(stream))
+			continue;
+
+		log_sm_debug("Retiring %s stream", stream->name != NULL ? stream->name : "process");
+		free_stream(stream);
+		process_stream_list.streams[i] = process_stream_list.streams[--process_stream_list.n_streams];
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * add_sample() - Store a value in the current batch
+ *
+ * @stream:		Stream the value belongs to.
+ * @value:		The value to store.
+ * @timestamp:	The timestamp of the value.
+ *
+ * The current batch is queued in the backlog once it is full.
+ */
+static void add_sample(stream_t *stream, sample_value_t value, uint64_t timestamp)
+{
+	sample_t *sample;
+
+	if (current_batch == NULL) {
+		current_batch = create_batch(batch_capacity);
+		if (current_batch == NULL) {
+			log_sm_error("Cannot add %s value: Out of memory", stream->name);
+			return;
+		}
+	}
+
+	sample = &current_batch->samples[current_batch->n_samples++];
+	sample->stream = stream;
+	sample->value = value;
+	sample->timestamp = timestamp;
+	if (IS_COUNTED_STREAM(stream))
+		__atomic_add_fetch(&stream->n_pending, 1, __ATOMIC_RELAXED);
+
+	if (current_batch->n_samples >= current_batch->capacity)
+		seal_batch();
+}
+
+/*
+ * create_batch() - Allocate an empty batch
+ *
+ * @capacity:	Maximum number of samples of the batch.
+ *
+ * Return: The new batch, NULL if there is not enough memory.
+ */
+static batch_t *create_batch(uint32_t capacity)
+{
+	batch_t *batch = calloc(1, sizeof(batch_t));
+
+	if (batch == NULL)
+		return NULL;
+
+	if (capacity == 0)
+		capacity = 1;
+
+	batch->samples = calloc(capacity, sizeof(sample_t));
+	if (batch->samples == NULL) {
+		free(batch);
+		return NULL;
+	}
+	batch->capacity = capacity;
+
+	return batch;
+}
+
+/*
+ * free_batch_list() - Free the given list of batches
+ *
+ * @batch:	First batch of the list to free.
+ */
+static void free_batch_list(batch_t *batch)
+{
+	while (batch != NULL) {
+		batch_t *next = batch->next;
+		uint32_t i;
+
+		for (i = 0; i < batch->n_samples; i++) {
+			stream_t *stream = batch->samples[i].stream;
+
+			/* Release the stream to retire_process_stream() and retire_net_streams() */
+			if (IS_COUNTED_STREAM(stream))
+				__atomic_sub_fetch(&stream->n_pending, 1, __ATOMIC_RELEASE);
+		}
+		free(batch->samples);
+		free(batch);
+		batch = next;
+	}
+}
+
+/*
+ * seal_batch() - Queue the current batch in the backlog
+ *
+ * If the backlog is full, a batch is discarded depending on the configured
+ * policy: the oldest pending batch, or the batch being queued.
+ */
+static void seal_batch(void)
+{
+	batch_t *dropped = NULL;
+
+	pthread_mutex_lock(&backlog.lock);
+	if (backlog.n_batches >= backlog.max_batches
+		&& backlog.policy == SYS_MON_BACKLOG_DROP_NEWEST) {
+		dropped = current_batch;
+	} else {
+		if (backlog.n_batches >= backlog.max_batches)
+			dropped = trim_backlog();
+		if (backlog.tail == NULL)
+			backlog.head = current_batch;
+		else
+			backlog.tail->next = current_batch;
+		backlog.tail = current_batch;
+		backlog.n_batches++;
+		pthread_cond_signal(&backlog.cond);
+	}
+	pthread_mutex_unlock(&backlog.lock);
+
+	current_batch = NULL;
+
+	if (dropped != NULL) {
+		log_sm_error("System monitor backlog full, discarding %u samples", dropped->n_samples);
+		free_batch_list(dropped);
+	}
+}
+
+/*
+ * take_batches() - Wait for pending batches and remove them from the backlog
+ *
+ * This function blocks until there is at least one batch in the backlog and
+ * the connection with Remote Manager is established, or the data spool is
+ * enabled. Consecutive batches are taken until SEND_MAX_SAMPLES samples are
+ * reached.
+ *
+ * Return: The list of taken batches, NULL if the monitor is stopped.
+ */
+static batch_t *take_batches(void)
+{
+	batch_t *first = NULL;
+	batch_t *last = NULL;
+	uint32_t n_samples = 0;
+
+	pthread_mutex_lock(&backlog.lock);
+
+	while (!stop_requested) {
+		struct timespec deadline;
+
+		if (backlog.head == NULL) {
+			pthread_cond_wait(&backlog.cond, &backlog.lock);
+			continue;
+		}
+
+		if (get_cloud_connection_status() == CC_STATUS_CONNECTED || is_spool_enabled())
+			break;
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += CONNECTION_CHECK_SECONDS;
+		pthread_cond_timedwait(&backlog.cond, &backlog.lock, &deadline);
+	}
+
+	while (!stop_requested && backlog.head != NULL
+		&& (first == NULL || n_samples + backlog.head->n_samples <= SEND_MAX_SAMPLES)) {
+		batch_t *batch = backlog.head;
+
+		backlog.head = batch->next;
+		if (backlog.head == NULL)
+			backlog.tail = NULL;
+		backlog.n_batches--;
+
+		batch->next = NULL;
+		if (last == NULL)
+			first = batch;
+		else
+			last->next = batch;
+		last = batch;
+		n_samples += batch->n_samples;
+	}
+
+	pthread_mutex_unlock(&backlog.lock);
+
+	return first;
+}
+
+/*
+ * requeue_batches() - Return to the head of the backlog batches that could
+ *                     not be uploaded
+ *
+ * @batches:	List of batches to return.
+ *
+ * If the backlog exceeds its size, batches are discarded depending on the
+ * configured policy.
+ */
+static void requeue_batches(batch_t *batches)
+{
+	batch_t *last = batches;
+	batch_t *dropped = NULL;
+	uint32_t n_dropped = 0;
+	uint32_t n_batches = 1;
+
+	while (last->next != NULL) {
+		last = last->next;
+		n_batches++;
+	}
+
+	pthread_mutex_lock(&backlog.lock);
+	last->next = backlog.head;
+	backlog.head = batches;
+	if (backlog.tail == NULL)
+		backlog.tail = last;
+	backlog.n_batches += n_batches;
+
+	while (backlog.n_batches > backlog.max_batches) {
+		batch_t *batch = trim_backlog();
+
+		n_dropped += batch->n_samples;
+		batch->next = dropped;
+		dropped = batch;
+	}
+	pthread_mutex_unlock(&backlog.lock);
+
+	if (dropped != NULL) {
+		log_sm_error("System monitor backlog full, discarding %u samples", n_dropped);
+		free_batch_list(dropped);
+	}
+}
+
+/*
+ * trim_backlog() - Remove a batch from the backlog depending on the policy
+ *
+ * The backlog lock must be held and the backlog must not be empty.
+ *
+ * Return: The removed batch.
+ */
+static batch_t *trim_backlog(void)
+{
+	batch_t *batch;
+
+	if (backlog.policy == SYS_MON_BACKLOG_DROP_OLDEST || backlog.head == backlog.tail) {
+		batch = backlog.head;
+		backlog.head = batch->next;
+		if (backlog.head == NULL)
+			backlog.tail = NULL;
+	} else {
+		batch_t *prev = backlog.head;
+
+		while (prev->next != backlog.tail)
+			prev = prev->next;
+		batch = backlog.tail;
+		prev->next = NULL;
+		backlog.tail = prev;
+	}
+	batch->next = NULL;
+	backlog.n_batches--;
+
+	return batch;
+}
+
+/*
+ * wait_before_retry() - Wait before retrying a failed upload
+ *
+ * @seconds:	Number of seconds to wait.
+ *
+ * The wait is interrupted if the monitor is stopped.
+ */
+static void wait_before_retry(unsigned int seconds)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += seconds;
+
+	pthread_mutex_lock(&backlog.lock);
+	while (!stop_requested
+		&& pthread_cond_timedwait(&backlog.cond, &backlog.lock, &deadline) != ETIMEDOUT)
+		;
+	pthread_mutex_unlock(&backlog.lock);
+}
+
+/*
+ * send_batches() - Upload the samples of the given batches to Remote Manager
+ *
+ * @batches:	List of batches to upload.
+ * @timeout:	Number of seconds to wait for the upload response.
+ *
+ * Return: Error code after the upload.
+ */
+static ccapi_dp_error_t send_batches(batch_t *batches, unsigned long timeout)
+{
+	static unsigned long send_id = 0;
+	ccapi_dp_collection_handle_t collection;
+	ccapi_dp_error_t dp_error;
+	batch_t *batch;
+
+	dp_error = ccapi_dp_create_collection(&collection);
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		return dp_error;
+
+	/* Streams are added to the collection only once per upload. */
+	send_id++;
+	if (send_id == 0)
+		send_id++;
+
+	for (batch = batches; batch != NULL; batch = batch->next) {
+		uint32_t i;
+
+		for (i = 0; i < batch->n_samples; i++) {
+			dp_error = add_sample_to_collection(collection, &batch->samples[i], send_id);
+			if (dp_error != CCAPI_DP_ERROR_NONE)
+				goto done;
+		}
+	}
+
+	log_sm_debug("%s", "Sending system monitor samples");
+
+	dp_error = ccapi_dp_send_collection_with_reply(CCAPI_TRANSPORT_TCP, collection, timeout, NULL);
+
+done:
+	ccapi_dp_destroy_collection(collection);
+
+	return dp_error;
+}
+
+/*
+ * add_sample_to_collection() - Add a sample to the given collection
+ *
+ * @collection:	The data point collection.
+ * @sample:		The sample to add.
+ * @send_id:	Identifier of the upload the collection belongs to.
+ *
+ * Return: Error code after adding the sample.
+ */
+static ccapi_dp_error_t add_sample_to_collection(ccapi_dp_collection_handle_t collection,
+		const sample_t *sample, unsigned long send_id)
+{
+	stream_t *stream = sample->stream;
+	ccapi_timestamp_t timestamp = { 0 };
+	ccapi_dp_error_t dp_error;
+
+	if (stream->send_id != send_id) {
+		dp_error = ccapi_dp_add_data_stream_to_collection_extra(
+					collection, stream->path, stream->format, stream->units, NULL);
+		if (dp_error != CCAPI_DP_ERROR_NONE) {
+			log_sm_error("Cannot add '%s' stream to data point collection, error %d",
+				stream->path, dp_error);
+			return dp_error;
+		}
+		stream->send_id = send_id;
+	}
+
+	/* Numeric timestamps ('ts_epoch_ms' streams) need no formatting. */
+	timestamp.epoch_msec = sample->timestamp;
+
+	switch (stream->value_type) {
+		case VALUE_DOUBLE:
+			dp_error = ccapi_dp_add(collection, stream->path, sample->value.d, &timestamp);
+			break;
+		case VALUE_INT32:
+			dp_error = ccapi_dp_add(collection, stream->path, (int32_t) sample->value.i, &timestamp);
+			break;
+		case VALUE_INT64:
+		default:
+			dp_error = ccapi_dp_add(collection, stream->path, sample->value.i, &timestamp);
+			break;
+	}
+
+	if (dp_error != CCAPI_DP_ERROR_NONE)
+		log_sm_error("Cannot add %s value, %d", stream->name, dp_error);
+
+	return dp_error;
+}
+
+/*
+ * spool_batches() - Store the samples of the given batches in the data spool
+ *
+ * @batches:	List of batches to store.
+ *
+ * The samples are stored as Remote Manager data points in CSV format, so they
+ * can be merged with other data points when they are replayed.
+ *
+ * Return: 0 if the samples are stored, -1 otherwise.
+ */
+static int spool_batches(const batch_t *batches)
+{
+	const batch_t *batch;
+	size_t size = 0, len = 0;
+	char *csv;
+	spool_error_t error;
+
+	if (!is_spool_enabled())
+		return -1;
+
+	for (batch = batches; batch != NULL; batch = batch->next) {
+		uint32_t i;
+
+		for (i = 0; i < batch->n_samples; i++)
+			size += format_sample_csv(NULL, 0, &batch->samples[i]);
+	}
+
+	csv = malloc(size + 1);
+	if (csv == NULL) {
+		log_sm_error("Cannot store system monitor samples: %s", "Out of memory");
+		return -1;
+	}
+
+	for (batch = batches; batch != NULL; batch = batch->next) {
+		uint32_t i;
+
+		for (i = 0; i < batch->n_samples; i++)
+			len += format_sample_csv(csv + len, size + 1 - len, &batch->samples[i]);
+	}
+
+	error = spool_data(SPOOL_RECORD_DP_CSV, SPOOL_DP_CSV_CLOUD_PATH, csv, len);
+	free(csv);
+
+	if (error != SPOOL_ERROR_NONE) {
+		log_sm_error("Cannot store system monitor samples, %d", error);
+		return -1;
+	}
+
+	log_sm_debug("%s", "System monitor samples stored in the data spool");
+
+	return 0;
+}
+
+/*
+ * format_sample_csv() - Format a sample as a Remote Manager CSV data point
+ *
+ * @buffer:	Buffer to write the data point line, NULL to only get its length.
+ * @size:	Size of the buffer.
+ * @sample:	The sample to format.
+ *
+ * The fields are in the default order: DATA, TIMESTAMP, QUALITY, DESCRIPTION,
+ * LOCATION, DATATYPE, UNITS, FORWARDTO, STREAMID. Doubles are written with
+ * enough digits to be read back without losing precision.
+ *
+ * Return: Length of the line.
+ */
+static int format_sample_csv(char *buffer, size_t size, const sample_t *sample)
+{
+	const stream_t *stream = sample->stream;
+	long long timestamp_ms = (long long) sample->timestamp;
+
+	switch (stream->value_type) {
+		case VALUE_DOUBLE:
+			return snprintf(buffer, size, "%.17g,%lld,,,,DOUBLE,%s,,%s\n",
+					sample->value.d, timestamp_ms, stream->units, stream->path);
+		case VALUE_INT32:
+			return snprintf(buffer, size, "%" PRId32 ",%lld,,,,INTEGER,%s,,%s\n",
+					(int32_t) sample->value.i, timestamp_ms, stream->units, stream->path);
+		case VALUE_INT64:
+		default:
+			return snprintf(buffer, size, "%" PRId64 ",%lld,,,,LONG,%s,,%s\n",
+					sample->value.i, timestamp_ms, stream->units, stream->path);
+	}
+}
+
+/*
+ * init_cpu_stat() - Prepare the read of the CPU times
+ *
+ * '/proc/stat' is opened once and re-read on every tick. Its buffer is big
+ * enough to hold the lines of all the configured CPUs.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int init_cpu_stat(void)
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+	if (n_cpus < 1)
+		n_cpus = 1;
+
+	/* The first entry holds the times of the whole system. */
+	n_cpu_times = n_cpus + 1;
+	cpu_times = calloc(n_cpu_times, sizeof(cpu_times_t));
+	proc_stat_size = n_cpu_times * MAX_LENGTH;
+	proc_stat_buffer = malloc(proc_stat_size);
+	if (cpu_times == NULL || proc_stat_buffer == NULL) {
+		free_cpu_stat();
+		return -1;
+	}
+
+	proc_stat_fd = open(FILE_CPU_LOAD, O_RDONLY | O_CLOEXEC);
+	if (proc_stat_fd < 0)
+		log_sm_debug("Cannot open '%s': %s", FILE_CPU_LOAD, strerror(errno));
+
+	return 0;
+}
+
+/*
+ * free_cpu_stat() - Release the resources to read the CPU times
+ */
+static void free_cpu_stat(void)
+{
+	if (proc_stat_fd >= 0)
+		close(proc_stat_fd);
+	proc_stat_fd = -1;
+
+	free(proc_stat_buffer);
+	proc_stat_buffer = NULL;
+	proc_stat_size = 0;
+
+	free(cpu_times);
+	cpu_times = NULL;
+	n_cpu_times = 0;
+}
+
+/*
+ * read_cpu_stat() - Read the times of the system and every CPU core
+ *
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * '/proc/stat' is read only once per tick, the load of all the cores is
+ * calculated from the same read.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_cpu_stat(tick_t *tick)
+{
+	const char *line = proc_stat_buffer;
+	int i;
+
+	if (tick->stat_read)
+		return tick->stat_error ? -1 : 0;
+
+	tick->stat_read = true;
+	tick->stat_error = true;
+
+	for (i = 0; i < n_cpu_times; i++)
+		cpu_times[i].online = false;
+
+	if (pread_file(proc_stat_fd, proc_stat_buffer, proc_stat_size) <= 0)
+		return -1;
+
+	/* cpu[N] user nice system idle iowait irq softirq steal guest guest_nice */
+	while (strncmp(line, "cpu", 3) == 0) {
+		const char *p = line + 3;
+		cpu_times_t *times;
+		uint64_t cpu, field;
+		int n_fields;
+
+		line = skip_line(line);
+
+		if (*p == ' ') {
+			times = &cpu_times[0];
+		} else {
+			p = scan_uint64(p, &cpu);
+			if (p == NULL || cpu + 1 >= (uint64_t) n_cpu_times)
+				continue;
+			times = &cpu_times[cpu + 1];
+		}
+
+		times->work = 0;
+		times->total = 0;
+		for (n_fields = 0; n_fields < 10; n_fields++) {
+			p = scan_uint64(p, &field);
+			if (p == NULL)
+				break;
+			if (n_fields < 3)
+				times->work += field;
+			times->total += field;
+		}
+		times->online = n_fields >= 4;
+	}
+
+	tick->stat_error = !cpu_times[0].online;
+
+	return tick->stat_error ? -1 : 0;
+}
+
+/*
+ * get_tick_sysinfo() - Get the system information of the current tick
+ *
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * The information is read only once per tick and shared by all the streams
+ * that need it.
+ *
+ * Return: The system information, NULL if error.
+ */
+static const struct sysinfo *get_tick_sysinfo(tick_t *tick)
+{
+	if (!tick->info_read) {
+		tick->info_read = true;
+		tick->info_error = sysinfo(&tick->info) != 0;
+	}
+
+	return tick->info_error ? NULL : &tick->info;
+}
+
+/*
+ * init_resource_stats() - Prepare the read of the memory and pressure statistics
+ *
+ * '/proc/meminfo' and the pressure stall information files are opened once
+ * and re-read on every tick.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int init_resource_stats(void)
+{
+	resource_stats = resource_stats_create();
+
+	return resource_stats != NULL ? 0 : -1;
+}
+
+/*
+ * free_resource_stats() - Close the memory and pressure statistics files
+ */
+static void free_resource_stats(void)
+{
+	resource_stats_free(resource_stats);
+	resource_stats = NULL;
+}
+
+/*
+ * read_meminfo() - Read the memory statistics of the system
+ *
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * '/proc/meminfo' is read only once per tick and shared by all the memory
+ * streams.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_meminfo(tick_t *tick)
+{
+	if (!tick->meminfo_read) {
+		tick->meminfo_read = true;
+		tick->meminfo_error = meminfo_read(resource_stats, &meminfo) != 0;
+	}
+
+	return tick->meminfo_error ? -1 : 0;
+}
+
+/*
+ * get_memory() - Get a memory statistic of the system
+ *
+ * @stream:	The memory stream.
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * The free memory is the memory available for new applications, not the
+ * unused one: the page cache makes the unused memory of a healthy system
+ * close to zero.
+ *
+ * Return: The statistic in kB, -1 if error.
+ */
+static double get_memory(const stream_t *stream, tick_t *tick)
+{
+	if (read_meminfo(tick) != 0) {
+		log_sm_error("Error getting %s", stream->name);
+		return -1;
+	}
+
+	switch (stream->type) {
+		case STREAM_FREE_MEM:
+			return meminfo.available;
+		case STREAM_USED_MEM:
+			return meminfo.total > meminfo.available ? meminfo.total - meminfo.available : 0;
+		case STREAM_CACHED_MEM:
+			return meminfo.cached;
+		case STREAM_DIRTY_MEM:
+			return meminfo.dirty;
+		case STREAM_FREE_SWAP:
+			return meminfo.swap_free;
+		case STREAM_USED_SWAP:
+		default:
+			return meminfo.swap_total > meminfo.swap_free ? meminfo.swap_total - meminfo.swap_free : 0;
+	}
+}
+
+/*
+ * add_pressure_streams() - Add the pressure stall information streams
  *
- * Return: The CPU frequency in kHz, -1 if error.
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
+ *
+ * The streams of a resource are added only if the kernel reports its
+ * pressure, and the 'full' ones only if it reports that line.
+ *
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
+ */
+static ccapi_dp_error_t add_pressure_streams(const cc_cfg_t *const cc_cfg)
+{
+	tick_t tick = { 0 };
+	unsigned int r, i;
+
+	for (r = 0; r < PSI_N_RESOURCES; r++) {
+		if (read_pressure(r, &tick) != 0) {
+			log_sm_debug("Skipping '%s' pressure, it is not available", psi_resource_name(r));
+			continue;
+		}
+
+		for (i = 0; i < ARRAY_SIZE(psi_streams_formats); i++) {
+			const stream_t *stream_format = &psi_streams_formats[i];
+			char name[64], path[96];
+			ccapi_dp_error_t dp_error;
+
+			if (stream_format->type >= STREAM_PSI_FULL_AVG10 && !pressures[r].has_full)
+				continue;
+
+			snprintf(name, sizeof(name), stream_format->name, psi_resource_name(r));
+			snprintf(path, sizeof(path), SYS_MON_DATA_STREAM_PREFIX "%s", name);
+			dp_error = add_sys_stream(stream_format, name, path, NULL, r, cc_cfg);
+			if (dp_error != CCAPI_DP_ERROR_NONE)
+				return dp_error;
+		}
+	}
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+/*
+ * read_pressure() - Read the pressure stall information of a resource
+ *
+ * @index:	Index of the resource in 'pressures'.
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * Every file is read only once per tick and shared by all the streams of
+ * its resource.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_pressure(int index, tick_t *tick)
+{
+	unsigned int mask = 1U << index;
+
+	if (!(tick->psi_read & mask)) {
+		tick->psi_read |= mask;
+		if (psi_read(resource_stats, index, &pressures[index]) != 0)
+			tick->psi_error |= mask;
+	}
+
+	return (tick->psi_error & mask) ? -1 : 0;
+}
+
+/*
+ * get_pressure() - Get a pressure stall value of a resource
+ *
+ * @stream:	The pressure stream, holding the stall time of its previous
+ *			sample.
+ * @tick:	Values shared by all the samples of this tick.
+ * @value:	The read value.
+ *
+ * The stall streams report the microseconds stalled since the previous
+ * sample, their first read only stores the total stall time.
+ *
+ * Return: 0 on success, -1 if the value is not available.
  */
-static unsigned long get_cpu_freq(void)
+static int get_pressure(stream_t *stream, tick_t *tick, double *value)
 {
-	char data[MAX_LENGTH] = {0};
-	long file_size;
-	long freq;
+	const psi_t *pressure = &pressures[stream->cpu];
+	const psi_line_t *psi;
+	bool first;
+
+	if (read_pressure(stream->cpu, tick) != 0) {
+		log_sm_error("Error getting %s", stream->name);
+		return -1;
+	}
+
+	psi = stream->type >= STREAM_PSI_FULL_AVG10 ? &pressure->full : &pressure->some;
+	switch (stream->type) {
+		case STREAM_PSI_SOME_AVG10:
+		case STREAM_PSI_FULL_AVG10:
+			*value = psi->avg10;
+			return 0;
+		case STREAM_PSI_SOME_AVG60:
+		case STREAM_PSI_FULL_AVG60:
+			*value = psi->avg60;
+			return 0;
+		default:
+			break;
+	}
+
+	first = stream->last_total == 0;
+	*value = psi->total >= stream->last_work ? psi->total - stream->last_work : 0;
+	stream->last_work = psi->total;
+	stream->last_total = 1;
+
+	return first ? -1 : 0;
+}
+
+/*
+ * get_cpu_load() - Get the CPU load of the system or of a CPU core
+ *
+ * @stream:	The load stream, holding the times of its previous sample.
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * Return: The CPU load in %, -1 if the value is not available.
+ */
+static double get_cpu_load(stream_t *stream, tick_t *tick) {
+	const cpu_times_t *times;
+	double usage = -1;
+
+	if (read_cpu_stat(tick) != 0 || stream->cpu + 1 >= n_cpu_times
+		|| !cpu_times[stream->cpu + 1].online) {
+		log_sm_error("Error getting %s", stream->name);
+		return -1;
+	}
+
+	times = &cpu_times[stream->cpu + 1];
+	if (stream->last_work == 0 && stream->last_total == 0) {
+		/* The first time report 0%. */
+		usage = 0;
+	} else {
+		unsigned long long diff_work = times->work - stream->last_work;
+		unsigned long long diff_total = times->total - stream->last_total;
+
+		usage = diff_total > 0 ? diff_work * 100.0 / diff_total : 0;
+	}
+
+	stream->last_total = times->total;
+	stream->last_work = times->work;
+
+	return usage;
+}
 
-	freq = -1;
+/*
+ * get_cpu_temp() - Get the temperature of a thermal zone
+ *
+ * @stream:	The temperature stream.
+ *
+ * Return: The temperature in C.
+ */
+static double get_cpu_temp(const stream_t *stream)
+{
+	char file_data[32];
+	int64_t temperature;
 
-	file_size = read_file(FILE_CPU_FREQ, data, MAX_LENGTH);
-	if (file_size <= 0) {
-		log_sm_error("%s", "Error getting CPU frequency");
+	if (pread_file(stream->fd, file_data, sizeof(file_data)) <= 0
+		|| scan_int64(file_data, &temperature) == NULL) {
+		log_sm_error("Error getting %s", stream->name);
 		return -1;
 	}
 
-	if (sscanf(data, "%ld", &freq) < 1) {
-		log_sm_error("%s", "Error getting CPU frequency");
+	return temperature / 1000.0;
+}
+
+/*
+ * get_cpu_freq() - Get the frequency of a CPU or a cpufreq policy
+ *
+ * @stream:	The frequency stream.
+ *
+ * Return: The CPU frequency in kHz, -1 if error.
+ */
+static unsigned long get_cpu_freq(const stream_t *stream)
+{
+	char data[32];
+	uint64_t freq;
+
+	if (pread_file(stream->fd, data, sizeof(data)) <= 0
+		|| scan_uint64(data, &freq) == NULL) {
+		log_sm_error("Error getting %s", stream->name);
 		return -1;
 	}
 
@@ -1016,234 +4413,386 @@ static unsigned long get_cpu_freq(void)
 /*
  * get_uptime() - Get number of seconds since boot
  *
+ * @tick:	Values shared by all the samples of this tick.
+ *
  * Return: Number of seconds since boot.
  */
-static unsigned long get_uptime(void)
+static unsigned long get_uptime(tick_t *tick)
 {
-	struct sysinfo info;
+	const struct sysinfo *info = get_tick_sysinfo(tick);
 
-	if (sysinfo(&info) != 0) {
+	if (info == NULL) {
 		log_sm_error("%s", "Error getting uptime");
 		return -1;
 	}
 
-	return info.uptime;
+	return info->uptime;
 }
 
 /*
- * free_stream_list() - Free the stream list
+ * init_disk_stats() - Prepare the read of the block device statistics
  *
- * @stream_list:	The list to free.
+ * '/proc/diskstats' is opened once and re-read on every tick.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
  */
-static void free_stream_list(stream_list_t *stream_list)
+static int init_disk_stats(void)
 {
-	int i;
+	disk_stats_reader = disk_stats_create();
 
-	for (i = 0; i < stream_list->n_streams; i++) {
-		free(stream_list->streams[i].name);
-		free(stream_list->streams[i].path);
-	}
+	return disk_stats_reader != NULL ? 0 : -1;
+}
 
-	free(stream_list->streams);
+/*
+ * free_disk_stats() - Release the resources to read the block device statistics
+ */
+static void free_disk_stats(void)
+{
+	disk_stats_free(disk_stats_reader);
+	disk_stats_reader = NULL;
+	disk_stats = NULL;
+	n_disk_stats = 0;
+}
 
-	stream_list->n_streams = 0;
+/*
+ * read_disk_stats() - Read the statistics of every block device
+ *
+ * @tick:	Values shared by all the samples of this tick.
+ *
+ * '/proc/diskstats' is read only once per tick, the values of all the disk
+ * streams are calculated from the same read.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int read_disk_stats(tick_t *tick)
+{
+	if (tick->disks_read)
+		return tick->disks_error ? -1 : 0;
+
+	tick->disks_read = true;
+	tick->disks_error = disk_stats_read(disk_stats_reader, &disk_stats, &n_disk_stats,
+			&disk_stats_time) != 0;
+
+	return tick->disks_error ? -1 : 0;
 }
 
 /*
- * free_timestamp() - Free given timestamp structure
+ * find_disk_stats() - Find the statistics of a block device in the last read
+ *
+ * @name:	Device name.
  *
- * @timestamp:	The timestamp structure to release.
+ * Return: The statistics of the device, NULL if not found.
  */
-static void free_timestamp(ccapi_timestamp_t *timestamp)
+static const disk_stats_t *find_disk_stats(const char *name)
 {
-	if (timestamp == NULL)
-		return;
+	int i;
 
-	if (timestamp->iso8601 != NULL) {
-		free((char *) timestamp->iso8601);
-		timestamp->iso8601 = NULL;
+	for (i = 0; i < n_disk_stats; i++) {
+		if (strcmp(disk_stats[i].name, name) == 0)
+			return &disk_stats[i];
 	}
-	free(timestamp);
-	timestamp = NULL;
+
+	return NULL;
 }
 
 /*
- * should_read_metric() - Determines whether the given metric must be read or not
- *                        based on the given configuration.
+ * add_storage_streams() - Add the disk and filesystem streams
  *
- * @metric_name: The metric name.
- * @cc_cfg:	The Cloud Connector configuration.
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) where the
+ * 			settings parsed from the configuration file are stored.
  *
- * Return: 'true' if metric should be read, 'false' otherwise.
+ * Disk streams are added for every block device of '/sys/block' listed in
+ * '/proc/diskstats', except loop and RAM devices. Filesystem streams are
+ * added for the virtual directories and the firmware download path.
+ *
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
  */
-static ccapi_bool_t should_read_metric(char *metric_name, const cc_cfg_t *const cc_cfg)
+static ccapi_dp_error_t add_storage_streams(const cc_cfg_t *const cc_cfg)
 {
-	unsigned int i;
+	ccapi_dp_error_t dp_error;
+	tick_t tick = { 0 };
+	unsigned int i, j;
+	int d;
 
-	if (cc_cfg->sys_mon_all_metrics) {
-		return true;
+	if (init_disk_stats() != 0) {
+		log_sm_error("Cannot initialize disk metrics: %s", "Out of memory");
+		return CCAPI_DP_ERROR_INSUFFICIENT_MEMORY;
 	}
 
-	for (i = 0; i < cc_cfg->n_sys_mon_metrics; i++) {
-		char *metric = cc_cfg->sys_mon_metrics[i];
+	if (read_disk_stats(&tick) == 0) {
+		for (d = 0; d < n_disk_stats; d++) {
+			const char *dev = disk_stats[d].name;
+			char dir[PATH_MAX];
 
-		/* Sanity check. */
-		if (metric == NULL) {
-			continue;
-		}
-		/* Check if the metric name matches the metric wildcard. */
-		if (value_matches_wildcard_pattern(metric_name, metric)) {
-			return true;
-		}
-		/* Check if the metric name is composed. */
-		if (strchr(metric_name, '/') != NULL) {
-			char *interface;
-			ccapi_bool_t matches = false;
-			char *metric_name_copy = strdup(metric_name);
-			if (metric_name_copy == NULL) {
-				log_sm_error("%s", "Not enough memory to check metrics criteria");
+			if (strncmp(dev, "loop", 4) == 0 || strncmp(dev, "ram", 3) == 0)
 				continue;
-			}
-			/* Extract interface from the metric name. */
-			interface = (char *)strtok(metric_name_copy, "/");
-			if (interface == NULL) {
-				free(metric_name_copy);
+			snprintf(dir, sizeof(dir), DIR_BLOCK "/%s", dev);
+			if (access(dir, F_OK) != 0)
 				continue;
-			}
-			/* Check if the interface matches the metric. */
-			matches = strcmp(interface, metric) == 0;
-			free(metric_name_copy);
-			if (matches) {
-				return true;
+
+			for (i = 0; i < ARRAY_SIZE(disk_streams_formats); i++) {
+				const stream_t *stream_format = &disk_streams_formats[i];
+				char name[64], path[96];
+
+				snprintf(name, sizeof(name), stream_format->name, dev);
+				snprintf(path, sizeof(path), SYS_MON_DATA_STREAM_PREFIX "%s", name);
+				dp_error = add_sys_stream(stream_format, name, path, dev, -1, cc_cfg);
+				if (dp_error != CCAPI_DP_ERROR_NONE)
+					return dp_error;
 			}
 		}
 	}
 
-	return false;
+	for (i = 0; i < cc_cfg->n_vdirs; i++) {
+		const vdir_t *vdir = &cc_cfg->vdirs[i];
+		bool duplicated = false;
+
+		for (j = 0; j < i && !duplicated; j++)
+			duplicated = strcmp(cc_cfg->vdirs[j].path, vdir->path) == 0;
+		if (duplicated)
+			continue;
+
+		dp_error = add_fs_streams(vdir->name, vdir->path, cc_cfg);
+		if (dp_error != CCAPI_DP_ERROR_NONE)
+			return dp_error;
+	}
+
+	if (cc_cfg->fw_download_path != NULL && *cc_cfg->fw_download_path != '\0') {
+		for (i = 0; i < cc_cfg->n_vdirs; i++) {
+			if (strcmp(cc_cfg->vdirs[i].path, cc_cfg->fw_download_path) == 0)
+				return CCAPI_DP_ERROR_NONE;
+		}
+
+		return add_fs_streams(FW_DOWNLOAD_FS_NAME, cc_cfg->fw_download_path, cc_cfg);
+	}
+
+	return CCAPI_DP_ERROR_NONE;
 }
 
 /*
- * should_read_interface() - Determines whether the given interface must be read or not
- *                           based on the given configuration.
+ * add_fs_streams() - Add the usage streams of a filesystem
  *
- * @iface_name:	The interface name.
- * @cc_cfg:	The Cloud Connector configuration.
+ * @name:			Name of the filesystem in the metric names.
+ * @mount_point:	Directory of the filesystem.
+ * @cc_cfg:			Connector configuration struct (cc_cfg_t) where the
+ * 					settings parsed from the configuration file are stored.
  *
- * Return: 'true' if interface should be read, 'false' otherwise.
+ * Return: CCAPI_DP_ERROR_NONE on success, any other ccapi_dp_error_t otherwise.
  */
-static ccapi_bool_t should_read_interface(char *iface_name, const cc_cfg_t *const cc_cfg)
+static ccapi_dp_error_t add_fs_streams(const char *name, const char *mount_point,
+		const cc_cfg_t *const cc_cfg)
 {
 	unsigned int i;
 
-	if (cc_cfg->sys_mon_all_metrics) {
-		return true;
+	for (i = 0; i < ARRAY_SIZE(fs_streams_formats); i++) {
+		const stream_t *stream_format = &fs_streams_formats[i];
+		char metric_name[MAX_LENGTH], path[MAX_LENGTH];
+		ccapi_dp_error_t dp_error;
+
+		snprintf(metric_name, sizeof(metric_name), stream_format->name, name);
+		snprintf(path, sizeof(path), SYS_MON_DATA_STREAM_PREFIX "%s", metric_name);
+		dp_error = add_sys_stream(stream_format, metric_name, path, mount_point, -1, cc_cfg);
+		if (dp_error != CCAPI_DP_ERROR_NONE)
+			return dp_error;
+	}
+
+	return CCAPI_DP_ERROR_NONE;
+}
+
+/*
+ * get_disk_rate() - Get the throughput, IOPS or utilization of a block device
+ *
+ * @stream:	The disk stream, holding the counter and time of its previous read.
+ * @tick:	Values shared by all the samples of this tick.
+ * @rate:	The rate since the previous read.
+ *
+ * The first read of a stream only stores its counter.
+ *
+ * Return: 0 on success, -1 if the value is not available.
+ */
+static int get_disk_rate(stream_t *stream, tick_t *tick, double *rate)
+{
+	const disk_stats_t *stats;
+	unsigned long long counter;
+	bool first = stream->last_total == 0;
+
+	if (read_disk_stats(tick) != 0 || (stats = find_disk_stats(stream->file)) == NULL) {
+		log_sm_debug("Cannot read %s, device not found", stream->name);
+		stream->last_total = 0;
+		return -1;
 	}
 
-	for (i = 0; i < cc_cfg->n_sys_mon_metrics; i++) {
-		char *metric = cc_cfg->sys_mon_metrics[i];
+	switch (stream->type) {
+		case STREAM_DISK_READ:
+			counter = stats->read_sectors;
+			break;
+		case STREAM_DISK_WRITE:
+			counter = stats->write_sectors;
+			break;
+		case STREAM_DISK_IOPS:
+			counter = stats->ios;
+			break;
+		case STREAM_DISK_UTILIZATION:
+		default:
+			counter = stats->io_ticks;
+			break;
+	}
 
-		/* Sanity check. */
-		if (metric == NULL) {
-			continue;
-		}
-		/* Check if the interface matches the metric wildcard. */
-		if (value_matches_wildcard_pattern(iface_name, metric)) {
-			return true;
-		}
-		/* Check if the metric is composed. */
-		if (strchr(metric, '/') != NULL) {
-			char *iface_wildcard;
-			ccapi_bool_t matches = false;
-			char *metric_copy = strdup(metric);
-			if (metric_copy == NULL) {
-				log_sm_error("%s", "Not enough memory to check metrics criteria");
-				continue;
-			}
-			/* Extract interface wildcard from the metric. */
-			iface_wildcard = (char *)strtok(metric_copy, "/");
-			if (iface_wildcard == NULL) {
-				free(metric_copy);
-				continue;
-			}
-			/* Check if the interface name matches the interface wildcard. */
-			matches = value_matches_wildcard_pattern(iface_name, iface_wildcard);
-			free(metric_copy);
-			if (matches) {
-				return true;
-			}
+	/* A counter going back means the device was replaced, start again. */
+	if (first || counter < stream->last_work || disk_stats_time <= stream->last_total) {
+		stream->last_work = counter;
+		stream->last_total = disk_stats_time;
+		return -1;
+	}
+
+	*rate = (counter - stream->last_work) * 1000.0 / (disk_stats_time - stream->last_total);
+	if (stream->type == STREAM_DISK_READ || stream->type == STREAM_DISK_WRITE) {
+		*rate *= DISK_SECTOR_SIZE;
+	} else if (stream->type == STREAM_DISK_UTILIZATION) {
+		/* 'io_ticks' are milliseconds, the rate is per second. */
+		*rate /= 10;
+		if (*rate > 100)
+			*rate = 100;
+	}
+
+	stream->last_work = counter;
+	stream->last_total = disk_stats_time;
+
+	return 0;
+}
+
+/*
+ * get_fs_usage() - Get the free space, used space or usage of a filesystem
+ *
+ * @stream:	The filesystem stream.
+ * @tick:	Values shared by all the samples of this tick.
+ * @value:	The read value, in kB or %.
+ *
+ * The filesystem is read by path on every tick so that filesystems mounted
+ * after the start are reported. Consecutive streams of the same filesystem
+ * share the read.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int get_fs_usage(const stream_t *stream, tick_t *tick, sample_value_t *value)
+{
+	uint64_t used, available;
+
+	if (tick->fs_path == NULL || strcmp(tick->fs_path, stream->file) != 0) {
+		tick->fs_path = stream->file;
+		tick->fs_error = fs_usage_read(stream->file, &tick->fs_usage) != 0;
+		if (tick->fs_error)
+			log_sm_debug("Cannot read '%s' usage: %s", stream->file, strerror(errno));
+	}
+	if (tick->fs_error)
+		return -1;
+
+	used = tick->fs_usage.used;
+	available = tick->fs_usage.available;
+
+	switch (stream->type) {
+		case STREAM_FS_FREE:
+			value->i = available;
+			break;
+		case STREAM_FS_USED:
+			value->i = used;
+			break;
+		case STREAM_FS_USAGE:
+		default:
+			value->d = used + available > 0 ? used * 100.0 / (used + available) : 0;
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * free_sys_readers() - Release the resources to read the system metrics
+ */
+static void free_sys_readers(void)
+{
+	free_cpu_stat();
+	free_resource_stats();
+	free_disk_stats();
+	free_processes();
+}
+
+/*
+ * free_stream() - Free a stream and its summaries
+ *
+ * @stream:	The stream to free, it may be NULL.
+ */
+static void free_stream(stream_t *stream)
+{
+	if (stream == NULL)
+		return;
+
+	if (stream->summaries != NULL) {
+		int f;
+
+		for (f = 0; f < AGGREGATE_N_FUNCTIONS; f++) {
+			free(stream->summaries[f].name);
+			free(stream->summaries[f].path);
 		}
+		free(stream->summaries);
 	}
+	free(stream->aggregate);
+	free(stream->name);
+	free(stream->path);
+	free(stream->file);
+	if (stream->source == STREAM_SOURCE_SYSTEM && stream->fd >= 0)
+		close(stream->fd);
+	free(stream);
+}
 
-	return false;
+/*
+ * free_stream_list() - Free the stream list
+ *
+ * @stream_list:	The list to free.
+ */
+static void free_stream_list(stream_list_t *stream_list)
+{
+	int i;
+
+	for (i = 0; i < stream_list->n_streams; i++)
+		free_stream(stream_list->streams[i]);
+
+	free(stream_list->streams);
+
+	stream_list->streams = NULL;
+	stream_list->n_streams = 0;
+}
+
+/*
+ * should_read_metric() - Determines whether the given metric must be read or not
+ *                        based on the given configuration.
+ *
+ * @metric_name: The metric name.
+ * @cc_cfg:	The Cloud Connector configuration.
+ *
+ * Return: 'true' if metric should be read, 'false' otherwise.
+ */
+static ccapi_bool_t should_read_metric(const char *metric_name, const cc_cfg_t *const cc_cfg)
+{
+	if (cc_cfg->sys_mon_all_metrics)
+		return true;
+
+	return metric_filter_match_metric(cc_cfg->sys_mon_filter, metric_name);
 }
 
 /*
- * value_matches_wildcard_pattern() - Determines whether the given value matches
- *                                    the given wildcard pattern.
- *
- * @value:		The string to check.
- * @pattern:	The pattern string.
- *
- * Return: 'true' if the value matches the wildcard pattern, 'false' otherwise.
- */
-static ccapi_bool_t value_matches_wildcard_pattern(char* value, char* pattern)
-{
-    int wildcard = 0;
-    char* last_pattern_start = 0;
-    char* last_value_start = 0;
-
-    do {
-        if (*pattern == *value) {
-            if (wildcard == 1) {
-                last_value_start = value + 1;
-            }
-
-            value++;
-            pattern++;
-            wildcard = 0;
-        } else if (*pattern == '?') {
-            if (*(value) == '\0') { /* the value has ended but a char was expected */
-                return false;
-            }
-            if (wildcard == 1) {
-                last_value_start = value + 1;
-            }
-            value++;
-            pattern++;
-            wildcard = 0;
-        } else if (*pattern == '*') {
-            if (*(pattern+1) == '\0') {
-                return true;
-            }
-
-            last_pattern_start = pattern;
-            wildcard = 1;
-
-            pattern++;
-        } else if (wildcard) {
-            if (*value == *pattern) {
-                wildcard = 0;
-                value++;
-                pattern++;
-                last_value_start = value + 1 ;
-            } else {
-                value++;
-            }
-        } else {
-            if ((*pattern) == '\0' && (*value) == '\0') {  /* end of mask */
-                return true; /* if the value also ends here then the pattern match */
-            } else {
-                if (last_pattern_start != 0) { /* try to restart the mask on the rest */
-                    pattern = last_pattern_start;
-                    value = last_value_start;
-                    last_value_start = 0;
-                } else {
-                    return false;
-                }
-            }
-        }
-
-    } while (*value);
-
-    return *pattern == '\0';
+ * should_read_interface() - Determines whether the given interface must be read or not
+ *                           based on the given configuration.
+ *
+ * @iface_name:	The interface name.
+ * @cc_cfg:	The Cloud Connector configuration.
+ *
+ * Return: 'true' if interface should be read, 'false' otherwise.
+ */
+static ccapi_bool_t should_read_interface(const char *iface_name, const cc_cfg_t *const cc_cfg)
+{
+	if (cc_cfg->sys_mon_all_metrics)
+		return true;
+
+	return metric_filter_match_interface(cc_cfg->sys_mon_filter, iface_name);
 }
@@ -22,6 +22,9 @@
 
 #include "cc_init.h"
 #include "cc_logging.h"
+#include "cc_spool.h"
+#include "cc_sysmon.h"
+#include "cc_timestamp.h"
 
 #include <ccimp/ccimp_types.h>
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef DP_RING_H
+#define DP_RING_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Shared memory data point ring
+ *
+ * A local application opens a ring with the REQ_TAG_DP_RING_OPEN request on
+ * the Unix domain socket of Cloud Connector. The request values are the
+ * number of slots and the names of the data streams, separated by new lines.
+ * The response carries the number of slots of the ring and two file
+ * descriptors: the shared memory (to mmap() read/write, MAP_SHARED, with the
+ * size given by DP_RING_SIZE()) and an eventfd to wake Cloud Connector.
+ *
+ * The ring has a single producer: an application pushing from several
+ * threads must serialise its calls to dp_ring_push() or open a ring per
+ * thread. Cloud Connector drains the ring periodically and only needs to be
+ * woken when it found the ring empty, so pushing a sample is a couple of
+ * stores while data keeps flowing.
+ */
+
+#define REQ_TAG_DP_RING_OPEN	"ring_1_open"
+
+#define DP_RING_MAGIC			0x44505247	/* "DPRG" */
+#define DP_RING_VERSION			1
+
+#define DP_RING_MIN_SLOTS		256
+#define DP_RING_MAX_SLOTS		(1 << 18)
+#define DP_RING_MAX_STREAMS		256
+
+#define DP_RING_CACHE_LINE		64
+#define DP_RING_HEADER_SIZE		(3 * DP_RING_CACHE_LINE)
+
+/**
+ * dp_ring_header_t - Control block at the start of the shared memory
+ *
+ * @magic:				DP_RING_MAGIC.
+ * @version:			DP_RING_VERSION.
+ * @n_slots:			Number of records of the ring, a power of two.
+ * @n_streams:			Number of data streams the records may refer to.
+ * @head:				Number of records ever pushed (written by the producer).
+ * @dropped:			Number of records discarded because the ring was full
+ *						(written by the producer).
+ * @closed:				Set by the producer when it will not push any more records.
+ * @tail:				Number of records ever drained (written by Cloud Connector).
+ * @consumer_sleeping:	Set by Cloud Connector when it found the ring empty and
+ *						waits for the eventfd to be written.
+ *
+ * The fields written by each side live in their own cache line.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t n_slots;
+	uint32_t n_streams;
+	uint8_t reserved0[DP_RING_CACHE_LINE - 4 * sizeof(uint32_t)];
+
+	uint64_t head;
+	uint64_t dropped;
+	uint32_t closed;
+	uint8_t reserved1[DP_RING_CACHE_LINE - 2 * sizeof(uint64_t) - sizeof(uint32_t)];
+
+	uint64_t tail;
+	uint32_t consumer_sleeping;
+	uint8_t reserved2[DP_RING_CACHE_LINE - sizeof(uint64_t) - sizeof(uint32_t)];
+} dp_ring_header_t;
+
+/**
+ * dp_ring_record_t - Sample of a data stream
+ *
+ * @stream:		Index of the data stream, in the order given when opening the ring.
+ * @reserved:	Must be 0.
+ * @timestamp:	Milliseconds since the epoch, 0 for the time it is drained.
+ * @value:		Value of the sample.
+ */
+typedef struct {
+	uint32_t stream;
+	uint32_t reserved;
+	int64_t timestamp;
+	double value;
+} dp_ring_record_t;
+
+/**
+ * dp_ring_t - Producer side of a mapped ring
+ *
+ * @header:			Start of the shared memory.
+ * @records:		Slots of the ring, right after the header.
+ * @mask:			Number of slots minus one.
+ * @wake_fd:		Eventfd to wake Cloud Connector.
+ * @head:			Private copy of the shared 'head'.
+ * @cached_tail:	Last 'tail' read, so the shared one is only read when
+ *					the ring looks full.
+ */
+typedef struct {
+	dp_ring_header_t *header;
+	dp_ring_record_t *records;
+	uint32_t mask;
+	int wake_fd;
+	uint64_t head;
+	uint64_t cached_tail;
+} dp_ring_t;
+
+/* Size of the shared memory of a ring with the given number of slots */
+#define DP_RING_SIZE(n_slots)	(DP_RING_HEADER_SIZE + (size_t) (n_slots) * sizeof(dp_ring_record_t))
+
+/*
+ * dp_ring_push() - Push a sample to a ring
+ *
+ * @ring:		The mapped ring.
+ * @stream:		Index of the data stream.
+ * @timestamp:	Milliseconds since the epoch, 0 for the time it is drained.
+ * @value:		Value of the sample.
+ *
+ * Return: 0 on success, -1 if the ring is full and the sample was dropped.
+ */
+static inline int dp_ring_push(dp_ring_t *ring, uint32_t stream, int64_t timestamp, double value)
+{
+	dp_ring_header_t *header = ring->header;
+	uint64_t head = ring->head;
+	dp_ring_record_t *record;
+
+	if (head - ring->cached_tail > ring->mask) {
+		ring->cached_tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+		if (head - ring->cached_tail > ring->mask) {
+			__atomic_store_n(&header->dropped, header->dropped + 1, __ATOMIC_RELAXED);
+			return -1;
+		}
+	}
+
+	record = &ring->records[head & ring->mask];
+	record->stream = stream;
+	record->reserved = 0;
+	record->timestamp = timestamp;
+	record->value = value;
+
+	ring->head = head + 1;
+	__atomic_store_n(&header->head, ring->head, __ATOMIC_RELEASE);
+
+	/* Pairs with the fence of Cloud Connector before it rechecks 'head' */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&header->consumer_sleeping, __ATOMIC_RELAXED)
+		&& __atomic_exchange_n(&header->consumer_sleeping, 0, __ATOMIC_ACQ_REL)) {
+		uint64_t wake = 1;
+
+		/* If the wake fails, the ring is drained on the next idle check */
+		if (write(ring->wake_fd, &wake, sizeof(wake)) < 0)
+			return 0;
+	}
+
+	return 0;
+}
+
+#endif
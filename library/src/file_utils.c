@@ -97,7 +97,7 @@ int mkpath(char *dir, mode_t mode)
 	if (len == 1 && dir[0] == '/')
 		return 0;
 
-	strncpy(tmp, dir, len);
+	memcpy(tmp, dir, len);
 	tmp[len] = 0;
 	if (tmp[len - 1] != '/') {
 		tmp[len] = '/';
@@ -156,6 +156,39 @@ done:
 	return read_size;
 }
 
+/**
+ * pread_file() - Read the contents of an already open file from its start
+ *
+ * @fd:				File descriptor of the file to read.
+ * @buffer:			Buffer to store the contents of the file.
+ * @buffer_size:	Size of the buffer, including the null terminator.
+ *
+ * The file offset is not modified, so the same descriptor can be read again
+ * to get the updated contents of files under '/proc' and '/sys'.
+ *
+ * Return: The number of read bytes, -1 on error.
+ */
+long pread_file(int fd, char *buffer, long buffer_size)
+{
+	ssize_t read_size;
+
+	if (fd < 0 || buffer_size <= 0)
+		return -1;
+
+	do {
+		read_size = pread(fd, buffer, buffer_size - 1, 0);
+	} while (read_size < 0 && errno == EINTR);
+
+	if (read_size < 0) {
+		log_debug("%s: pread error: %s", __func__, strerror(errno));
+		return -1;
+	}
+
+	buffer[read_size] = '\0';
+
+	return read_size;
+}
+
 /**
  * read_file_line() - Read the first line of the file and return its contents
  *
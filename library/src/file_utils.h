@@ -28,6 +28,7 @@ int file_readable(const char * const filename);
 int file_writable(const char * const filename);
 int mkpath(char *dir, mode_t mode);
 long read_file(const char *path, char *buffer, long file_size);
+long pread_file(int fd, char *buffer, long buffer_size);
 int read_file_line(const char * const path, char *buffer, int bytes_to_read);
 int write_to_file(const char * const path, const char * const format, ...);
 int crc32file(char const *const path, uint32_t *crc);
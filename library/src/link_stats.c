@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "link_stats.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define NETLINK_BUFFER_SIZE			8192
+#define NETLINK_TIMEOUT_SEC			1
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * link_stats - State and statistics of all the network interfaces
+ *
+ * @fd:			Netlink socket to dump the interfaces.
+ * @links:		Interfaces of the last dump.
+ * @n_links:	Number of interfaces of the last dump.
+ * @capacity:	Number of interfaces that fit in 'links'.
+ * @seq:		Sequence number of the last dump request.
+ * @buffer:		Buffer for the netlink messages.
+ */
+struct link_stats {
+	int fd;
+	link_info_t *links;
+	int n_links;
+	int capacity;
+	uint32_t seq;
+	char buffer[NETLINK_BUFFER_SIZE] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+};
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static int parse_link(link_stats_t *stats, const struct nlmsghdr *msg);
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * link_stats_create() - Open the socket to dump the network interface statistics
+ *
+ * Return: The new state, NULL on error with errno set.
+ */
+link_stats_t *link_stats_create(void)
+{
+	struct sockaddr_nl addr = { 0 };
+	struct timeval timeout = { .tv_sec = NETLINK_TIMEOUT_SEC };
+	link_stats_t *stats = calloc(1, sizeof(*stats));
+	int error;
+
+	if (stats == NULL)
+		return NULL;
+
+	stats->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (stats->fd < 0)
+		goto error;
+
+	addr.nl_family = AF_NETLINK;
+	if (bind(stats->fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+		|| setsockopt(stats->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0)
+		goto error;
+
+	return stats;
+
+error:
+	error = errno;
+	link_stats_free(stats);
+	errno = error;
+
+	return NULL;
+}
+
+/*
+ * link_stats_free() - Close the socket to dump the network interface statistics
+ *
+ * @stats:	The state to free.
+ */
+void link_stats_free(link_stats_t *stats)
+{
+	if (stats == NULL)
+		return;
+
+	if (stats->fd >= 0)
+		close(stats->fd);
+	free(stats->links);
+	free(stats);
+}
+
+/*
+ * link_stats_read() - Read the state and statistics of all the network interfaces
+ *
+ * @stats:		The state.
+ * @links:		The interfaces, valid until the next read.
+ * @n_links:	Number of interfaces in 'links'.
+ *
+ * All the interfaces are dumped with a single RTM_GETLINK request, instead
+ * of querying each interface separately.
+ *
+ * Return: 0 on success, -1 otherwise with errno set.
+ */
+int link_stats_read(link_stats_t *stats, const link_info_t **links, int *n_links)
+{
+	struct {
+		struct nlmsghdr hdr;
+		struct ifinfomsg info;
+	} request = { 0 };
+	bool done = false;
+
+	stats->n_links = 0;
+
+	request.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(request.info));
+	request.hdr.nlmsg_type = RTM_GETLINK;
+	request.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	request.hdr.nlmsg_seq = ++stats->seq;
+	request.info.ifi_family = AF_UNSPEC;
+
+	if (send(stats->fd, &request, request.hdr.nlmsg_len, 0) < 0)
+		return -1;
+
+	while (!done) {
+		ssize_t len = recv(stats->fd, stats->buffer, sizeof(stats->buffer), 0);
+		const struct nlmsghdr *msg;
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (msg = (const struct nlmsghdr *) stats->buffer; NLMSG_OK(msg, (size_t) len); msg = NLMSG_NEXT(msg, len)) {
+			if (msg->nlmsg_seq != stats->seq)
+				continue;
+			if (msg->nlmsg_type == NLMSG_DONE) {
+				done = true;
+				break;
+			}
+			if (msg->nlmsg_type == NLMSG_ERROR) {
+				const struct nlmsgerr *err = NLMSG_DATA(msg);
+
+				errno = msg->nlmsg_len >= NLMSG_LENGTH(sizeof(*err)) && err->error < 0 ? -err->error : EIO;
+				return -1;
+			}
+			if (msg->nlmsg_type == RTM_NEWLINK && parse_link(stats, msg) != 0)
+				return -1;
+		}
+	}
+
+	*links = stats->links;
+	*n_links = stats->n_links;
+
+	return 0;
+}
+
+/*
+ * parse_link() - Store the state and statistics of an RTM_NEWLINK message
+ *
+ * @stats:	The state.
+ * @msg:	The RTM_NEWLINK message.
+ *
+ * Truncated messages and attributes are ignored.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int parse_link(link_stats_t *stats, const struct nlmsghdr *msg)
+{
+	const struct ifinfomsg *info = NLMSG_DATA(msg);
+	const struct rtattr *attr;
+	link_info_t *link;
+	bool has_carrier = false;
+	int len;
+
+	if (msg->nlmsg_len < NLMSG_LENGTH(sizeof(*info)))
+		return 0;
+
+	if (stats->n_links == stats->capacity) {
+		int capacity = stats->capacity > 0 ? stats->capacity * 2 : 8;
+		link_info_t *links = realloc(stats->links, capacity * sizeof(link_info_t));
+
+		if (links == NULL)
+			return -1;
+		stats->links = links;
+		stats->capacity = capacity;
+	}
+
+	link = &stats->links[stats->n_links];
+	memset(link, 0, sizeof(link_info_t));
+	link->flags = info->ifi_flags;
+
+	len = IFLA_PAYLOAD(msg);
+	for (attr = IFLA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		switch (attr->rta_type) {
+			case IFLA_IFNAME:
+				strncpy(link->name, RTA_DATA(attr), sizeof(link->name) - 1);
+				break;
+			case IFLA_OPERSTATE:
+				if (RTA_PAYLOAD(attr) >= sizeof(uint8_t))
+					link->operstate = *(const uint8_t *) RTA_DATA(attr);
+				break;
+			case IFLA_CARRIER:
+				if (RTA_PAYLOAD(attr) < sizeof(uint8_t))
+					break;
+				link->carrier = *(const uint8_t *) RTA_DATA(attr) != 0;
+				has_carrier = true;
+				break;
+			case IFLA_STATS64:
+				memcpy(&link->stats, RTA_DATA(attr),
+					RTA_PAYLOAD(attr) < sizeof(link->stats) ? RTA_PAYLOAD(attr) : sizeof(link->stats));
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!has_carrier)
+		link->carrier = (link->flags & IFF_RUNNING) != 0;
+
+	if (link->name[0] != '\0')
+		stats->n_links++;
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef LINK_STATS_H_
+#define LINK_STATS_H_
+
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/* RFC 2863 operational states, from <linux/if.h> (it clashes with <net/if.h>). */
+#define LINK_OPER_UNKNOWN		0
+#define LINK_OPER_UP			6
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * link_info_t - State and statistics of a network interface
+ *
+ * @name:		Name of the interface.
+ * @flags:		Interface flags (IFF_*).
+ * @operstate:	RFC 2863 operational state (LINK_OPER_*).
+ * @carrier:	Whether the interface has carrier.
+ * @stats:		Interface statistics.
+ */
+typedef struct {
+	char name[IFNAMSIZ];
+	unsigned int flags;
+	uint8_t operstate;
+	bool carrier;
+	struct rtnl_link_stats64 stats;
+} link_info_t;
+
+typedef struct link_stats link_stats_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+link_stats_t *link_stats_create(void);
+void link_stats_free(link_stats_t *stats);
+int link_stats_read(link_stats_t *stats, const link_info_t **links, int *n_links);
+
+#endif /* LINK_STATS_H_ */
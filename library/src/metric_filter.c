@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metric_filter.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define ALL_PATTERN				"*"
+
+#define CACHE_SIZE				256
+#define CACHE_MAX_ENTRIES		(CACHE_SIZE * 3 / 4)
+
+#define FNV_OFFSET_BASIS		2166136261U
+#define FNV_PRIME				16777619U
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * pattern_kind_t - How a pattern is matched
+ *
+ * @PATTERN_ANY:		"*", matches any value.
+ * @PATTERN_LITERAL:	No wildcards, matches only the same value.
+ * @PATTERN_PREFIX:		Literal followed by a single trailing '*' ("eth*").
+ * @PATTERN_GENERIC:	Any other combination of '*' and '?' wildcards.
+ */
+typedef enum {
+	PATTERN_ANY,
+	PATTERN_LITERAL,
+	PATTERN_PREFIX,
+	PATTERN_GENERIC
+} pattern_kind_t;
+
+/**
+ * pattern_t - Compiled wildcard pattern
+ *
+ * @text:	Pattern text, not null terminated.
+ * @len:	Length of the pattern text.
+ * @kind:	How the pattern is matched.
+ */
+typedef struct {
+	const char *text;
+	size_t len;
+	pattern_kind_t kind;
+} pattern_t;
+
+/**
+ * filter_rule_t - Compiled metric pattern
+ *
+ * @whole:		The whole pattern ("eth0/rx_bytes", "wlan*", ...).
+ * @iface:		The interface segment of a composed pattern ("eth*").
+ * @composed:	Whether the pattern has an interface and a metric segment.
+ */
+typedef struct {
+	pattern_t whole;
+	pattern_t iface;
+	bool composed;
+} filter_rule_t;
+
+/**
+ * cache_entry_t - Cached filter decision
+ *
+ * @name:		Metric or interface name, NULL if the entry is free.
+ * @hash:		Hash of the name and the kind of query.
+ * @iface:		Whether the decision is for an interface or a metric.
+ * @matches:	The decision.
+ */
+typedef struct {
+	char *name;
+	uint32_t hash;
+	bool iface;
+	bool matches;
+} cache_entry_t;
+
+/**
+ * struct metric_filter - Metric filter compiled from a list of patterns
+ *
+ * @text:		Storage of the text of all the patterns.
+ * @rules:		Compiled patterns.
+ * @n_rules:	Number of compiled patterns.
+ * @match_all:	Whether any of the patterns is "*".
+ * @cache:		Open addressing table of the decisions already taken.
+ * @n_cached:	Number of used entries of the cache.
+ * @lock:		Protects the cache.
+ */
+struct metric_filter {
+	char *text;
+	filter_rule_t *rules;
+	unsigned int n_rules;
+	bool match_all;
+	cache_entry_t cache[CACHE_SIZE];
+	unsigned int n_cached;
+	pthread_mutex_t lock;
+};
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static void compile_pattern(pattern_t *pattern, const char *text, size_t len);
+static bool pattern_matches(const pattern_t *pattern, const char *value, size_t len);
+static bool glob_matches(const char *pattern, size_t pattern_len, const char *value, size_t value_len);
+static bool evaluate_metric(const metric_filter_t *filter, const char *metric_name);
+static bool evaluate_interface(const metric_filter_t *filter, const char *iface_name);
+static bool filter_match(metric_filter_t *filter, const char *name, bool iface);
+static uint32_t hash_name(const char *name, bool iface);
+static void clear_cache(metric_filter_t *filter);
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * metric_filter_compile() - Compile a list of metric patterns
+ *
+ * @patterns:	List of patterns ("cpu_load", "wlan0/state", "eth*", ...).
+ * @n_patterns:	Number of patterns in the list.
+ *
+ * The patterns are split in their interface and metric segments and
+ * classified once, so checking a name neither allocates nor copies it.
+ *
+ * Return: The compiled filter, NULL if there is not enough memory.
+ */
+metric_filter_t *metric_filter_compile(char *const patterns[], unsigned int n_patterns)
+{
+	metric_filter_t *filter;
+	size_t text_size = 0;
+	char *text;
+	unsigned int i;
+
+	filter = calloc(1, sizeof(*filter));
+	if (filter == NULL)
+		return NULL;
+
+	for (i = 0; i < n_patterns; i++) {
+		if (patterns[i] != NULL)
+			text_size += strlen(patterns[i]);
+	}
+
+	filter->text = malloc(text_size + 1);
+	filter->rules = calloc(n_patterns + 1, sizeof(*filter->rules));
+	if (filter->text == NULL || filter->rules == NULL) {
+		free(filter->text);
+		free(filter->rules);
+		free(filter);
+		return NULL;
+	}
+
+	pthread_mutex_init(&filter->lock, NULL);
+
+	text = filter->text;
+	for (i = 0; i < n_patterns; i++) {
+		filter_rule_t *rule = &filter->rules[filter->n_rules];
+		const char *separator;
+		size_t len;
+
+		/* Sanity check. */
+		if (patterns[i] == NULL)
+			continue;
+
+		len = strlen(patterns[i]);
+		memcpy(text, patterns[i], len);
+
+		compile_pattern(&rule->whole, text, len);
+		separator = memchr(text, '/', len);
+		if (separator != NULL) {
+			rule->composed = true;
+			compile_pattern(&rule->iface, text, separator - text);
+		}
+		if (strcmp(patterns[i], ALL_PATTERN) == 0)
+			filter->match_all = true;
+
+		text += len;
+		filter->n_rules++;
+	}
+
+	return filter;
+}
+
+/*
+ * metric_filter_free() - Release a compiled metric filter
+ *
+ * @filter:	The filter to release.
+ */
+void metric_filter_free(metric_filter_t *filter)
+{
+	if (filter == NULL)
+		return;
+
+	clear_cache(filter);
+	pthread_mutex_destroy(&filter->lock);
+	free(filter->rules);
+	free(filter->text);
+	free(filter);
+}
+
+/*
+ * metric_filter_match_metric() - Check whether a metric passes the filter
+ *
+ * @filter:			The compiled filter.
+ * @metric_name:	Metric name ("cpu_load", "eth0/rx_bytes", ...).
+ *
+ * A metric passes the filter if it matches any of the patterns, or if it is
+ * composed and its interface segment is equal to any of the patterns.
+ *
+ * Return: True if the metric must be read, false otherwise.
+ */
+bool metric_filter_match_metric(metric_filter_t *filter, const char *metric_name)
+{
+	return filter_match(filter, metric_name, false);
+}
+
+/*
+ * metric_filter_match_interface() - Check whether an interface passes the filter
+ *
+ * @filter:		The compiled filter.
+ * @iface_name:	Interface name ("eth0", "hci0", ...).
+ *
+ * An interface passes the filter if it matches any of the patterns or the
+ * interface segment of any composed pattern.
+ *
+ * Return: True if any metric of the interface may be read, false otherwise.
+ */
+bool metric_filter_match_interface(metric_filter_t *filter, const char *iface_name)
+{
+	return filter_match(filter, iface_name, true);
+}
+
+/*
+ * metric_filter_match_pattern() - Check whether a name matches a single pattern
+ *
+ * @pattern:	Pattern text, '*' matches any sequence and '?' any character.
+ * @name:		Metric or interface name.
+ *
+ * Used by the settings that apply to the metrics matching a pattern, such as
+ * sample rates, deadbands and aggregations.
+ *
+ * Return: True if the name matches, false otherwise.
+ */
+bool metric_filter_match_pattern(const char *pattern, const char *name)
+{
+	return glob_matches(pattern, strlen(pattern), name, strlen(name));
+}
+
+/*
+ * compile_pattern() - Classify a wildcard pattern
+ *
+ * @pattern:	The compiled pattern.
+ * @text:		Pattern text.
+ * @len:		Length of the pattern text.
+ */
+static void compile_pattern(pattern_t *pattern, const char *text, size_t len)
+{
+	size_t n_stars = 0, n_marks = 0, i;
+
+	for (i = 0; i < len; i++) {
+		if (text[i] == '*')
+			n_stars++;
+		else if (text[i] == '?')
+			n_marks++;
+	}
+
+	pattern->text = text;
+	pattern->len = len;
+	if (n_stars == 0 && n_marks == 0)
+		pattern->kind = PATTERN_LITERAL;
+	else if (n_marks == 0 && n_stars == len)
+		pattern->kind = PATTERN_ANY;
+	else if (n_marks == 0 && n_stars == 1 && text[len - 1] == '*')
+		pattern->kind = PATTERN_PREFIX;
+	else
+		pattern->kind = PATTERN_GENERIC;
+}
+
+/*
+ * pattern_matches() - Check whether a value matches a compiled pattern
+ *
+ * @pattern:	The compiled pattern.
+ * @value:		Value to check, not necessarily null terminated.
+ * @len:		Length of the value.
+ *
+ * Return: True if the value matches, false otherwise.
+ */
+static bool pattern_matches(const pattern_t *pattern, const char *value, size_t len)
+{
+	switch (pattern->kind) {
+		case PATTERN_ANY:
+			return true;
+		case PATTERN_LITERAL:
+			return len == pattern->len && memcmp(value, pattern->text, len) == 0;
+		case PATTERN_PREFIX:
+			return len >= pattern->len - 1
+				&& memcmp(value, pattern->text, pattern->len - 1) == 0;
+		case PATTERN_GENERIC:
+		default:
+			return glob_matches(pattern->text, pattern->len, value, len);
+	}
+}
+
+/*
+ * glob_matches() - Check whether a value matches a wildcard pattern
+ *
+ * @pattern:		Pattern text, '*' matches any sequence and '?' any
+ * 					character.
+ * @pattern_len:	Length of the pattern text.
+ * @value:			Value to check.
+ * @value_len:		Length of the value.
+ *
+ * Only the position of the last '*' is remembered, so the match runs in
+ * linear space without recursion.
+ *
+ * Return: True if the value matches, false otherwise.
+ */
+static bool glob_matches(const char *pattern, size_t pattern_len, const char *value, size_t value_len)
+{
+	size_t p = 0, v = 0;
+	size_t star_p = SIZE_MAX, star_v = 0;
+
+	while (v < value_len) {
+		if (p < pattern_len && (pattern[p] == '?' || pattern[p] == value[v])) {
+			p++;
+			v++;
+		} else if (p < pattern_len && pattern[p] == '*') {
+			star_p = p++;
+			star_v = v;
+		} else if (star_p != SIZE_MAX) {
+			/* Let the last '*' absorb one more character. */
+			p = star_p + 1;
+			v = ++star_v;
+		} else {
+			return false;
+		}
+	}
+
+	while (p < pattern_len && pattern[p] == '*')
+		p++;
+
+	return p == pattern_len;
+}
+
+/*
+ * evaluate_metric() - Check a metric against all the rules of the filter
+ *
+ * @filter:			The compiled filter.
+ * @metric_name:	Metric name.
+ *
+ * Return: True if the metric passes the filter, false otherwise.
+ */
+static bool evaluate_metric(const metric_filter_t *filter, const char *metric_name)
+{
+	size_t len = strlen(metric_name);
+	const char *separator = memchr(metric_name, '/', len);
+	size_t iface_len = separator != NULL ? (size_t) (separator - metric_name) : 0;
+	unsigned int i;
+
+	for (i = 0; i < filter->n_rules; i++) {
+		const pattern_t *whole = &filter->rules[i].whole;
+
+		if (pattern_matches(whole, metric_name, len))
+			return true;
+		/* A composed metric also passes if its interface is listed. */
+		if (separator != NULL && whole->len == iface_len
+			&& memcmp(whole->text, metric_name, iface_len) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * evaluate_interface() - Check an interface against all the rules of the filter
+ *
+ * @filter:		The compiled filter.
+ * @iface_name:	Interface name.
+ *
+ * Return: True if the interface passes the filter, false otherwise.
+ */
+static bool evaluate_interface(const metric_filter_t *filter, const char *iface_name)
+{
+	size_t len = strlen(iface_name);
+	unsigned int i;
+
+	for (i = 0; i < filter->n_rules; i++) {
+		const filter_rule_t *rule = &filter->rules[i];
+
+		if (pattern_matches(&rule->whole, iface_name, len))
+			return true;
+		if (rule->composed && pattern_matches(&rule->iface, iface_name, len))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * filter_match() - Get the cached decision for a name, or take and cache it
+ *
+ * @filter:	The compiled filter.
+ * @name:	Metric or interface name.
+ * @iface:	Whether the name is an interface or a metric.
+ *
+ * Return: True if the name passes the filter, false otherwise.
+ */
+static bool filter_match(metric_filter_t *filter, const char *name, bool iface)
+{
+	uint32_t hash;
+	unsigned int slot;
+	bool matches;
+
+	if (filter == NULL || name == NULL)
+		return false;
+
+	if (filter->match_all)
+		return true;
+
+	hash = hash_name(name, iface);
+
+	pthread_mutex_lock(&filter->lock);
+
+	for (slot = hash % CACHE_SIZE; filter->cache[slot].name != NULL; slot = (slot + 1) % CACHE_SIZE) {
+		cache_entry_t *entry = &filter->cache[slot];
+
+		if (entry->hash == hash && entry->iface == iface && strcmp(entry->name, name) == 0) {
+			matches = entry->matches;
+			goto done;
+		}
+	}
+
+	matches = iface ? evaluate_interface(filter, name) : evaluate_metric(filter, name);
+
+	if (filter->n_cached >= CACHE_MAX_ENTRIES) {
+		clear_cache(filter);
+		slot = hash % CACHE_SIZE;
+	}
+
+	filter->cache[slot].name = strdup(name);
+	if (filter->cache[slot].name != NULL) {
+		filter->cache[slot].hash = hash;
+		filter->cache[slot].iface = iface;
+		filter->cache[slot].matches = matches;
+		filter->n_cached++;
+	}
+
+done:
+	pthread_mutex_unlock(&filter->lock);
+
+	return matches;
+}
+
+/*
+ * hash_name() - Calculate the FNV-1a hash of a name
+ *
+ * @name:	Metric or interface name.
+ * @iface:	Whether the name is an interface or a metric.
+ *
+ * Return: The hash.
+ */
+static uint32_t hash_name(const char *name, bool iface)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	while (*name != '\0') {
+		hash ^= (uint8_t) *name++;
+		hash *= FNV_PRIME;
+	}
+
+	return iface ? ~hash : hash;
+}
+
+/*
+ * clear_cache() - Remove all the cached decisions
+ *
+ * @filter:	The compiled filter.
+ */
+static void clear_cache(metric_filter_t *filter)
+{
+	unsigned int i;
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		free(filter->cache[i].name);
+		filter->cache[i].name = NULL;
+	}
+	filter->n_cached = 0;
+}
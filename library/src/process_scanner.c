@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "process_scanner.h"
+#include "string_utils.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define PROC_DIR				"/proc"
+
+#define DIRENT_BUFFER_SIZE		8192
+#define STAT_BUFFER_SIZE		1024
+
+#define INITIAL_TABLE_SIZE		256
+
+/* Fields of '/proc/<pid>/stat' after the process name, starting at 'state' (3). */
+#define STAT_FIELD_STATE		3
+#define STAT_FIELD_UTIME		14
+#define STAT_FIELD_STIME		15
+#define STAT_FIELD_RSS			24
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * linux_dirent64 - Directory entry returned by getdents64()
+ */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/**
+ * pid_entry_t - CPU time of a process at the last scan
+ *
+ * @pid:	Process identifier, 0 if the slot is empty.
+ * @ticks:	User and system time of the process, in clock ticks.
+ */
+typedef struct {
+	int pid;
+	unsigned long long ticks;
+} pid_entry_t;
+
+/**
+ * pid_table_t - Open addressing hash map of processes indexed by pid
+ *
+ * @entries:	Slots of the table.
+ * @size:		Number of slots, a power of two.
+ * @count:		Number of used slots.
+ */
+typedef struct {
+	pid_entry_t *entries;
+	unsigned int size;
+	unsigned int count;
+} pid_table_t;
+
+/**
+ * process_scanner - Persistent state of the process scans
+ *
+ * @proc_fd:		Descriptor of '/proc', rewound on every scan.
+ * @dirents:		Buffer for the directory entries.
+ * @stat:			Buffer for the contents of '/proc/<pid>/stat'.
+ * @tables:			CPU times of the previous scan and the current one.
+ * @previous:		Index of the table of the previous scan.
+ * @last_scan_ms:	CLOCK_MONOTONIC time of the previous scan, 0 if none.
+ * @ticks_per_s:	Clock ticks per second.
+ * @page_kb:		Size of a memory page in kB.
+ */
+struct process_scanner {
+	int proc_fd;
+	char dirents[DIRENT_BUFFER_SIZE] __attribute__ ((aligned(8)));
+	char stat[STAT_BUFFER_SIZE];
+	pid_table_t tables[2];
+	int previous;
+	uint64_t last_scan_ms;
+	long ticks_per_s;
+	long page_kb;
+};
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static int read_process(process_scanner_t *scanner, int pid, process_info_t *info,
+		unsigned long long *ticks);
+static int parse_pid(const char *name);
+static unsigned int hash_pid(int pid, unsigned int size);
+static pid_entry_t *find_pid(const pid_table_t *table, int pid);
+static int insert_pid(pid_table_t *table, int pid, unsigned long long ticks);
+static void clear_table(pid_table_t *table);
+static void insert_top(process_info_t *top, unsigned int *n_top, unsigned int max,
+		const process_info_t *info, bool by_cpu);
+static uint64_t get_monotonic_ms(void);
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * process_scanner_create() - Allocate the state of the process scans
+ *
+ * Return: The new scanner, NULL on error.
+ */
+process_scanner_t *process_scanner_create(void)
+{
+	process_scanner_t *scanner = calloc(1, sizeof(*scanner));
+	int i;
+
+	if (scanner == NULL)
+		return NULL;
+
+	scanner->proc_fd = open(PROC_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (scanner->proc_fd < 0)
+		goto error;
+
+	for (i = 0; i < 2; i++) {
+		scanner->tables[i].entries = calloc(INITIAL_TABLE_SIZE, sizeof(pid_entry_t));
+		if (scanner->tables[i].entries == NULL)
+			goto error;
+		scanner->tables[i].size = INITIAL_TABLE_SIZE;
+	}
+
+	scanner->ticks_per_s = sysconf(_SC_CLK_TCK);
+	if (scanner->ticks_per_s <= 0)
+		scanner->ticks_per_s = 100;
+	scanner->page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	if (scanner->page_kb <= 0)
+		scanner->page_kb = 4;
+
+	return scanner;
+
+error:
+	process_scanner_free(scanner);
+
+	return NULL;
+}
+
+/*
+ * process_scanner_free() - Release the state of the process scans
+ *
+ * @scanner:	The scanner to free.
+ */
+void process_scanner_free(process_scanner_t *scanner)
+{
+	if (scanner == NULL)
+		return;
+
+	if (scanner->proc_fd >= 0)
+		close(scanner->proc_fd);
+	free(scanner->tables[0].entries);
+	free(scanner->tables[1].entries);
+	free(scanner);
+}
+
+/*
+ * process_scanner_scan() - Get the processes using more CPU and memory
+ *
+ * @scanner:	The scanner.
+ * @n_top:		Maximum number of processes of each list.
+ * @top_cpu:	Array of 'n_top' elements for the processes using more CPU,
+ *				sorted in descending order.
+ * @n_top_cpu:	Number of processes stored in 'top_cpu'. It is 0 on the first
+ *				scan, CPU usage needs two scans.
+ * @top_rss:	Array of 'n_top' elements for the processes using more memory,
+ *				sorted in descending order.
+ * @n_top_rss:	Number of processes stored in 'top_rss'.
+ *
+ * '/proc' is listed with getdents64() and only '/proc/<pid>/stat' is read for
+ * each process, always into the same buffers. The CPU time of every process
+ * is kept in a hash map to compute its usage in the next scan.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int process_scanner_scan(process_scanner_t *scanner, unsigned int n_top,
+		process_info_t *top_cpu, unsigned int *n_top_cpu,
+		process_info_t *top_rss, unsigned int *n_top_rss)
+{
+	pid_table_t *previous = &scanner->tables[scanner->previous];
+	pid_table_t *current = &scanner->tables[!scanner->previous];
+	uint64_t now = get_monotonic_ms();
+	double elapsed_ticks = 0;
+
+	*n_top_cpu = 0;
+	*n_top_rss = 0;
+
+	if (scanner->last_scan_ms > 0 && now > scanner->last_scan_ms)
+		elapsed_ticks = (double) (now - scanner->last_scan_ms) * scanner->ticks_per_s / 1000;
+
+	if (lseek(scanner->proc_fd, 0, SEEK_SET) < 0)
+		return -1;
+
+	clear_table(current);
+
+	for (;;) {
+		long n_bytes = syscall(SYS_getdents64, scanner->proc_fd, scanner->dirents,
+				sizeof(scanner->dirents));
+		long offset;
+
+		if (n_bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n_bytes == 0)
+			break;
+
+		for (offset = 0; offset < n_bytes;) {
+			struct linux_dirent64 *entry = (struct linux_dirent64 *) (scanner->dirents + offset);
+			process_info_t info;
+			unsigned long long ticks;
+			pid_entry_t *last;
+			int pid;
+
+			offset += entry->d_reclen;
+
+			pid = parse_pid(entry->d_name);
+			if (pid <= 0 || read_process(scanner, pid, &info, &ticks) != 0)
+				continue;
+
+			/* Processes that cannot be tracked just get no CPU usage. */
+			insert_pid(current, pid, ticks);
+
+			last = find_pid(previous, pid);
+			if (elapsed_ticks > 0 && last != NULL && ticks > last->ticks) {
+				info.cpu_load = (ticks - last->ticks) * 100.0 / elapsed_ticks;
+				insert_top(top_cpu, n_top_cpu, n_top, &info, true);
+			}
+			insert_top(top_rss, n_top_rss, n_top, &info, false);
+		}
+	}
+
+	scanner->previous = !scanner->previous;
+	scanner->last_scan_ms = now;
+
+	return 0;
+}
+
+/*
+ * read_process() - Read the name, CPU time and memory of a process
+ *
+ * @scanner:	The scanner.
+ * @pid:		Process identifier.
+ * @info:		Where to store the process name and memory.
+ * @ticks:		Where to store the user and system time of the process.
+ *
+ * Return: 0 on success, -1 if the process does not exist anymore or its
+ *         status cannot be parsed.
+ */
+static int read_process(process_scanner_t *scanner, int pid, process_info_t *info,
+		unsigned long long *ticks)
+{
+	char path[sizeof("2147483647/stat")];
+	const char *p, *name_end;
+	uint64_t utime = 0, stime = 0, rss = 0;
+	size_t name_len;
+	ssize_t len;
+	int fd, field;
+
+	snprintf(path, sizeof(path), "%d/stat", pid);
+	fd = openat(scanner->proc_fd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = read(fd, scanner->stat, sizeof(scanner->stat) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	scanner->stat[len] = '\0';
+
+	/* "<pid> (<name>) <state> ...", the name may contain spaces and ')'. */
+	p = strchr(scanner->stat, '(');
+	name_end = strrchr(scanner->stat, ')');
+	if (p == NULL || name_end == NULL || name_end < p)
+		return -1;
+	name_len = name_end - p - 1;
+	if (name_len >= sizeof(info->name))
+		name_len = sizeof(info->name) - 1;
+	memcpy(info->name, p + 1, name_len);
+	info->name[name_len] = '\0';
+
+	p = name_end + 1;
+	for (field = STAT_FIELD_STATE; field <= STAT_FIELD_RSS; field++) {
+		p = skip_blanks(p);
+		if (*p == '\0')
+			return -1;
+		switch (field) {
+			case STAT_FIELD_UTIME:
+				p = scan_uint64(p, &utime);
+				break;
+			case STAT_FIELD_STIME:
+				p = scan_uint64(p, &stime);
+				break;
+			case STAT_FIELD_RSS:
+				p = scan_uint64(p, &rss);
+				break;
+			default:
+				while (*p != '\0' && *p != ' ')
+					p++;
+				break;
+		}
+	}
+
+	info->pid = pid;
+	info->cpu_load = 0;
+	info->rss = rss * scanner->page_kb;
+	*ticks = utime + stime;
+
+	return 0;
+}
+
+/*
+ * parse_pid() - Get the pid of a '/proc' entry
+ *
+ * @name:	Name of the entry.
+ *
+ * Return: The pid, -1 if the entry is not a process.
+ */
+static int parse_pid(const char *name)
+{
+	int pid = 0;
+
+	if (*name == '\0')
+		return -1;
+
+	for (; *name != '\0'; name++) {
+		if (*name < '0' || *name > '9' || pid > (INT32_MAX - 9) / 10)
+			return -1;
+		pid = pid * 10 + (*name - '0');
+	}
+
+	return pid;
+}
+
+/*
+ * hash_pid() - Get the first slot of a pid in a table
+ *
+ * @pid:	Process identifier.
+ * @size:	Number of slots of the table, a power of two.
+ *
+ * Return: The slot index.
+ */
+static unsigned int hash_pid(int pid, unsigned int size)
+{
+	/* Fibonacci hashing, consecutive pids spread over the table. */
+	return ((uint32_t) pid * 2654435769U) & (size - 1);
+}
+
+/*
+ * find_pid() - Find the entry of a process in a table
+ *
+ * @table:	The table.
+ * @pid:	Process identifier.
+ *
+ * Return: The entry, NULL if not found.
+ */
+static pid_entry_t *find_pid(const pid_table_t *table, int pid)
+{
+	unsigned int i = hash_pid(pid, table->size);
+
+	while (table->entries[i].pid != 0) {
+		if (table->entries[i].pid == pid)
+			return &table->entries[i];
+		i = (i + 1) & (table->size - 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * insert_pid() - Add a process to a table
+ *
+ * @table:	The table, it is doubled when it gets half full.
+ * @pid:	Process identifier.
+ * @ticks:	CPU time of the process.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int insert_pid(pid_table_t *table, int pid, unsigned long long ticks)
+{
+	unsigned int i;
+
+	if ((table->count + 1) * 2 > table->size) {
+		pid_table_t bigger = { .size = table->size * 2 };
+		unsigned int j;
+
+		bigger.entries = calloc(bigger.size, sizeof(pid_entry_t));
+		if (bigger.entries == NULL)
+			return -1;
+		for (j = 0; j < table->size; j++) {
+			if (table->entries[j].pid != 0)
+				insert_pid(&bigger, table->entries[j].pid, table->entries[j].ticks);
+		}
+		free(table->entries);
+		*table = bigger;
+	}
+
+	i = hash_pid(pid, table->size);
+	while (table->entries[i].pid != 0 && table->entries[i].pid != pid)
+		i = (i + 1) & (table->size - 1);
+
+	if (table->entries[i].pid == 0)
+		table->count++;
+	table->entries[i].pid = pid;
+	table->entries[i].ticks = ticks;
+
+	return 0;
+}
+
+/*
+ * clear_table() - Remove all the processes of a table, keeping its memory
+ *
+ * @table:	The table.
+ */
+static void clear_table(pid_table_t *table)
+{
+	memset(table->entries, 0, table->size * sizeof(pid_entry_t));
+	table->count = 0;
+}
+
+/*
+ * insert_top() - Insert a process in a list sorted in descending order
+ *
+ * @top:	The list.
+ * @n_top:	Number of processes in the list.
+ * @max:	Maximum number of processes of the list.
+ * @info:	The process to insert.
+ * @by_cpu:	true to sort by CPU usage, false to sort by memory.
+ */
+static void insert_top(process_info_t *top, unsigned int *n_top, unsigned int max,
+		const process_info_t *info, bool by_cpu)
+{
+	unsigned int i;
+
+	if (max == 0)
+		return;
+
+	for (i = *n_top; i > 0; i--) {
+		bool greater = by_cpu ? info->cpu_load > top[i - 1].cpu_load : info->rss > top[i - 1].rss;
+
+		if (!greater)
+			break;
+		if (i < max)
+			top[i] = top[i - 1];
+	}
+
+	if (i >= max)
+		return;
+
+	top[i] = *info;
+	if (*n_top < max)
+		(*n_top)++;
+}
+
+/*
+ * get_monotonic_ms() - Get the CLOCK_MONOTONIC time in milliseconds
+ *
+ * Return: The time in milliseconds.
+ */
+static uint64_t get_monotonic_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / (1000 * 1000);
+}
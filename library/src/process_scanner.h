@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef PROCESS_SCANNER_H_
+#define PROCESS_SCANNER_H_
+
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/* Maximum length of a process name ('comm'), including the null character. */
+#define PROCESS_NAME_SIZE		16
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * process_info_t - Resource usage of a process
+ *
+ * @pid:		Process identifier.
+ * @name:		Process name ('comm').
+ * @cpu_load:	CPU usage since the previous scan, in percentage of one core.
+ * @rss:		Resident set size, in kB.
+ */
+typedef struct {
+	int pid;
+	char name[PROCESS_NAME_SIZE];
+	double cpu_load;
+	uint64_t rss;
+} process_info_t;
+
+typedef struct process_scanner process_scanner_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+process_scanner_t *process_scanner_create(void);
+void process_scanner_free(process_scanner_t *scanner);
+int process_scanner_scan(process_scanner_t *scanner, unsigned int n_top,
+		process_info_t *top_cpu, unsigned int *n_top_cpu,
+		process_info_t *top_rss, unsigned int *n_top_rss);
+
+#endif /* PROCESS_SCANNER_H_ */
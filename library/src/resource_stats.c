@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file_utils.h"
+#include "resource_stats.h"
+#include "string_utils.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define FILE_MEMINFO				"/proc/meminfo"
+#define DIR_PRESSURE				"/proc/pressure"
+
+#define MEMINFO_BUFFER_SIZE			4096
+#define PSI_BUFFER_SIZE				256
+
+#define ARRAY_SIZE(array)			(sizeof(array) / sizeof(array[0]))
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * resource_stats - Persistent state of the memory and pressure reads
+ *
+ * @meminfo_fd:	Descriptor of '/proc/meminfo', re-read on every read.
+ * @psi_fds:	Descriptors of the files under '/proc/pressure', -1 if the
+ *				kernel does not report the pressure of a resource.
+ * @buffer:		Buffer for the contents of '/proc/meminfo'.
+ */
+struct resource_stats {
+	int meminfo_fd;
+	int psi_fds[PSI_N_RESOURCES];
+	char buffer[MEMINFO_BUFFER_SIZE];
+};
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static const char *const psi_names[PSI_N_RESOURCES] = {
+	[PSI_CPU] = "cpu",
+	[PSI_MEMORY] = "memory",
+	[PSI_IO] = "io",
+};
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * resource_stats_create() - Allocate the state of the memory and pressure reads
+ *
+ * '/proc/meminfo' and the pressure stall information files are opened once.
+ * A file that cannot be opened makes its reads fail.
+ *
+ * Return: The new state, NULL if there is not enough memory.
+ */
+resource_stats_t *resource_stats_create(void)
+{
+	resource_stats_t *stats = malloc(sizeof(*stats));
+	int r;
+
+	if (stats == NULL)
+		return NULL;
+
+	stats->meminfo_fd = open(FILE_MEMINFO, O_RDONLY | O_CLOEXEC);
+	for (r = 0; r < PSI_N_RESOURCES; r++) {
+		char path[64];
+
+		snprintf(path, sizeof(path), DIR_PRESSURE "/%s", psi_names[r]);
+		stats->psi_fds[r] = open(path, O_RDONLY | O_CLOEXEC);
+	}
+
+	return stats;
+}
+
+/*
+ * resource_stats_free() - Release the state of the memory and pressure reads
+ *
+ * @stats:	The state to free.
+ */
+void resource_stats_free(resource_stats_t *stats)
+{
+	int r;
+
+	if (stats == NULL)
+		return;
+
+	if (stats->meminfo_fd >= 0)
+		close(stats->meminfo_fd);
+	for (r = 0; r < PSI_N_RESOURCES; r++) {
+		if (stats->psi_fds[r] >= 0)
+			close(stats->psi_fds[r]);
+	}
+	free(stats);
+}
+
+/*
+ * meminfo_read() - Read the memory statistics of the system
+ *
+ * @stats:		The state of the reads.
+ * @meminfo:	The read statistics.
+ *
+ * Kernels older than 3.14 do not report 'MemAvailable', the unused memory
+ * plus the page cache is used instead.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int meminfo_read(resource_stats_t *stats, meminfo_t *meminfo)
+{
+	struct {
+		const char *key;
+		uint64_t *value;
+		bool found;
+	} fields[] = {
+		{ "MemTotal:", &meminfo->total, false },
+		{ "MemAvailable:", &meminfo->available, false },
+		{ "Cached:", &meminfo->cached, false },
+		{ "Dirty:", &meminfo->dirty, false },
+		{ "SwapTotal:", &meminfo->swap_total, false },
+		{ "SwapFree:", &meminfo->swap_free, false },
+	};
+	uint64_t mem_free = 0;
+	const char *line;
+	unsigned int i, n_found = 0;
+
+	if (pread_file(stats->meminfo_fd, stats->buffer, sizeof(stats->buffer)) <= 0)
+		return -1;
+
+	memset(meminfo, 0, sizeof(*meminfo));
+	for (line = stats->buffer; *line != '\0' && n_found < ARRAY_SIZE(fields); line = skip_line(line)) {
+		if (strncmp(line, "MemFree:", 8) == 0) {
+			scan_uint64(line + 8, &mem_free);
+			continue;
+		}
+		for (i = 0; i < ARRAY_SIZE(fields); i++) {
+			size_t len = strlen(fields[i].key);
+
+			if (fields[i].found || strncmp(line, fields[i].key, len) != 0)
+				continue;
+			fields[i].found = scan_uint64(line + len, fields[i].value) != NULL;
+			if (fields[i].found)
+				n_found++;
+			break;
+		}
+	}
+
+	if (!fields[0].found)
+		return -1;
+	if (!fields[1].found)
+		meminfo->available = mem_free + meminfo->cached;
+
+	return 0;
+}
+
+/*
+ * psi_read() - Read the pressure stall information of a resource
+ *
+ * @stats:		The state of the reads.
+ * @resource:	The resource to read.
+ * @psi:		The read information, unchanged on error.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int psi_read(resource_stats_t *stats, psi_resource_t resource, psi_t *psi)
+{
+	char buffer[PSI_BUFFER_SIZE];
+	psi_t result = { 0 };
+	const char *line;
+	bool has_some = false;
+
+	if (pread_file(stats->psi_fds[resource], buffer, sizeof(buffer)) <= 0)
+		return -1;
+
+	/* some avg10=0.00 avg60=0.00 avg300=0.00 total=0 */
+	for (line = buffer; *line != '\0'; line = skip_line(line)) {
+		psi_line_t *psi_line;
+		const char *p;
+
+		if (strncmp(line, "some ", 5) == 0) {
+			psi_line = &result.some;
+			has_some = true;
+		} else if (strncmp(line, "full ", 5) == 0) {
+			psi_line = &result.full;
+			result.has_full = true;
+		} else {
+			continue;
+		}
+
+		p = strstr(line, "avg10=");
+		psi_line->avg10 = p != NULL ? strtod(p + 6, NULL) : 0;
+		p = strstr(line, "avg60=");
+		psi_line->avg60 = p != NULL ? strtod(p + 6, NULL) : 0;
+		p = strstr(line, "total=");
+		if (p == NULL || scan_uint64(p + 6, &psi_line->total) == NULL)
+			return -1;
+	}
+
+	if (!has_some)
+		return -1;
+
+	*psi = result;
+
+	return 0;
+}
+
+/*
+ * psi_resource_name() - Get the name of a resource with pressure information
+ *
+ * @resource:	The resource.
+ *
+ * Return: The name of the file of the resource under '/proc/pressure'.
+ */
+const char *psi_resource_name(psi_resource_t resource)
+{
+	return psi_names[resource];
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef RESOURCE_STATS_H_
+#define RESOURCE_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * meminfo_t - Memory statistics read from '/proc/meminfo', in kB
+ *
+ * @total:		Usable RAM.
+ * @available:	Memory available for new applications without swapping, it
+ *				includes the reclaimable page cache.
+ * @cached:		Page cache.
+ * @dirty:		Memory waiting to be written back to disk.
+ * @swap_total:	Swap space.
+ * @swap_free:	Unused swap space.
+ */
+typedef struct {
+	uint64_t total;
+	uint64_t available;
+	uint64_t cached;
+	uint64_t dirty;
+	uint64_t swap_total;
+	uint64_t swap_free;
+} meminfo_t;
+
+/**
+ * psi_resource_t - Resources with pressure stall information
+ */
+typedef enum {
+	PSI_CPU,
+	PSI_MEMORY,
+	PSI_IO,
+	PSI_N_RESOURCES
+} psi_resource_t;
+
+/**
+ * psi_line_t - A line of a pressure stall information file
+ *
+ * @avg10:	Percentage of time stalled in the last 10 seconds.
+ * @avg60:	Percentage of time stalled in the last 60 seconds.
+ * @total:	Total stall time in microseconds.
+ */
+typedef struct {
+	double avg10;
+	double avg60;
+	uint64_t total;
+} psi_line_t;
+
+/**
+ * psi_t - Pressure stall information of a resource
+ *
+ * @some:		Stalls of some tasks.
+ * @full:		Stalls of all non-idle tasks.
+ * @has_full:	Whether the kernel reports 'full' stalls of the resource.
+ */
+typedef struct {
+	psi_line_t some;
+	psi_line_t full;
+	bool has_full;
+} psi_t;
+
+typedef struct resource_stats resource_stats_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+resource_stats_t *resource_stats_create(void);
+void resource_stats_free(resource_stats_t *stats);
+int meminfo_read(resource_stats_t *stats, meminfo_t *meminfo);
+int psi_read(resource_stats_t *stats, psi_resource_t resource, psi_t *psi);
+const char *psi_resource_name(psi_resource_t resource);
+
+#endif /* RESOURCE_STATS_H_ */
@@ -20,6 +20,10 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "cc_config.h"
@@ -63,6 +67,8 @@
 typedef struct {
 	uint16_t port;
 	char *target;
+	char *path;	/* Unix domain socket of the client, NULL to use 'port' */
+	uid_t uid;	/* User that registered 'path', the socket must be served by it */
 } request_data_t;
 
 typedef struct {
@@ -72,10 +78,12 @@ typedef struct {
 	size_t max_size;
 } request_data_darray_t;
 
-static const char REQUEST_CB[] = "request";
-static const char STATUS_CB[] = "status";
+static const char REQUEST_CB[] = DR_TYPE_REQUEST;
+static const char STATUS_CB[] = DR_TYPE_STATUS;
 
 static request_data_darray_t active_requests = { 0 };
+/* Registrations are attended by concurrent workers */
+static pthread_mutex_t active_requests_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static const char *to_user_error_msg(ccapi_receive_error_t error) {
 	switch (error) {
@@ -136,6 +144,7 @@ static int remove_registered_target(const char * target) {
 		return -1;
 
 	free(req->target);
+	free(req->path);
 	/* Count number of valid elements after req */
 	elements_to_move = active_requests.size - (req - active_requests.array) - 1;
 	if (elements_to_move > 0)
@@ -146,25 +155,98 @@ static int remove_registered_target(const char * target) {
 	return 0;
 }
 
+static ccapi_receive_error_t unregister_target(const char *target)
+{
+	ccapi_receive_error_t ret = ccapi_receive_remove_target(target);
+
+	if (ret != CCAPI_RECEIVE_ERROR_NONE)
+		return ret;
+
+	if (remove_registered_target(target)) {
+		/*
+		 * This should never happen, and if it does happen still return OK to
+		 * the calling process, as the CCAPI did unregister the target
+		 */
+		log_dr_error("Could not remove registered target %s", target);
+	}
+
+	return ret;
+}
+
 static int get_socket_for_target(const char *target)
 {
-	request_data_t *req = find_request_data(target);
+	request_data_t *req;
 	struct sockaddr_in serv_addr;
+	struct sockaddr_un unix_addr = {
+		.sun_family = AF_UNIX
+	};
+	struct ucred cred;
+	socklen_t length = sizeof(cred);
+	uint16_t port = 0;
+	uid_t uid = 0;
+	bool use_unix = false;
 	int sock_fd = -1;
 	int ret = -1; /* Assume error */
 
+	pthread_mutex_lock(&active_requests_lock);
+	req = find_request_data(target);
+	if (req) {
+		port = req->port;
+		if (req->path) {
+			strncpy(unix_addr.sun_path, req->path, sizeof(unix_addr.sun_path) - 1);
+			uid = req->uid;
+			use_unix = true;
+		}
+	}
+	pthread_mutex_unlock(&active_requests_lock);
+
 	if (!req) {
 		log_dr_error("Could not get port for registered target %s", target);
 		goto out;
 	}
 
+	if (use_unix) {
+		if ((sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+			log_dr_error("Could not open socket to send device request: %s", strerror(errno));
+			goto out;
+		}
+
+		if (connect(sock_fd, (struct sockaddr *)&unix_addr, sizeof unix_addr) < 0) {
+			log_dr_error("Could not connect to socket to deliver device request: %s", strerror(errno));
+			goto out;
+		}
+
+		/*
+		 * The path may have been replaced after the registration, only
+		 * deliver the request to the user that registered it
+		 */
+		if (getsockopt(sock_fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+			log_dr_error("Could not get credentials of '%s': %s", unix_addr.sun_path, strerror(errno));
+			goto out;
+		}
+		if (cred.uid != uid) {
+			log_dr_error("Unregistering target %s: '%s' is served by uid %u instead of uid %u",
+				target, unix_addr.sun_path, (unsigned int) cred.uid, (unsigned int) uid);
+			pthread_mutex_lock(&active_requests_lock);
+			/* Keep the target if it was registered again meanwhile */
+			req = find_request_data(target);
+			if (req && req->path && req->uid == uid)
+				unregister_target(target);
+			pthread_mutex_unlock(&active_requests_lock);
+			goto out;
+		}
+
+		ret = 0;
+		goto out;
+	}
+
 	if ((sock_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
 		log_dr_error("Could not open socket to send device request: %s", strerror(errno));
 		goto out;
 	}
 
 	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_port = htons(req->port);
+	serv_addr.sin_port = htons(port);
 	if (inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr) <= 0) {
 		log_dr_error("Could not set serv_addr.sin_addr: %s", strerror(errno));
 		goto out;
@@ -264,57 +346,58 @@ out:
 		close(sock_fd);
 }
 
-static int read_request(int fd, request_data_t *out)
+/*
+ * parse_device_request() - Check the values received for a (un)registration
+ *
+ * @request:	Values received so far.
+ * @error:		Message for the client if the values are not valid.
+ *
+ * A local device request (un)registration is the port of the client, the
+ * target name and a 0 to end the message. Clients listening on a Unix domain
+ * socket send its path after the target, the port is then ignored. A path is
+ * only accepted through the Unix domain socket of the connector, see
+ * check_socket_path().
+ *
+ * Return: The status of the received values.
+ */
+request_status_t parse_device_request(const request_values_t *request, const char **error)
 {
-	/* Receive a local device registration request */
-	uint32_t end, port;
-	struct timeval timeout = {
-		.tv_sec = SOCKET_READ_TIMEOUT_SEC,
-		.tv_usec = 0
+	static const struct {
+		char type;
+		const char *error;
+	} fields[] = {
+		{ DT_INTEGER, "Failed to read port" },
+		{ DT_STRING, "Failed to read target" },
+		{ DT_STRING, "Failed to read socket path" },
+		{ DT_INTEGER, "Failed to read message end" },
 	};
+	unsigned int last = request->n_values - 1;
+	const service_value_t *value = &request->values[last];
 
-	if (read_uint32(fd, &port, &timeout)) {
-		send_error(fd, "Failed to read port");
-		return -1;
-	}
-	out->port = port;
+	/* The message ends after the target if there is no socket path */
+	if (last == 2 && value->type == DT_INTEGER)
+		last = 3;
 
-	if (read_string(fd, &out->target, NULL, &timeout)) {
-		send_error(fd, "Failed to read target");
-		return -1;
+	if (value->type != fields[last].type
+		|| (last == ARRAY_SIZE(fields) - 1 && value->integer != 0)) {
+		*error = fields[last].error;
+		return REQUEST_INVALID;
 	}
 
-	if (read_uint32(fd, &end, &timeout) || end != 0) {
-		send_error(fd, "Failed to read message end");
-		return -1;
-	}
-
-	return 0;
-}
-
-static ccapi_receive_error_t unregister_target(const char *target)
-{
-	ccapi_receive_error_t ret = ccapi_receive_remove_target(target);
-
-	if (ret != CCAPI_RECEIVE_ERROR_NONE)
-		return ret;
-
-	if (remove_registered_target(target)) {
-		/*
-		 * This should never happen, and if it does happen still return OK to
-		 * the calling process, as the CCAPI did unregister the target
-		 */
-		log_dr_error("Could not remove registered target %s", target);
+	if (last == 2 && (value->length == 0 || value->length >= sizeof(((struct sockaddr_un *) NULL)->sun_path))) {
+		*error = "Invalid socket path";
+		return REQUEST_INVALID;
 	}
 
-	return ret;
+	return last == ARRAY_SIZE(fields) - 1 ? REQUEST_COMPLETE : REQUEST_INCOMPLETE;
 }
 
-/* Note: fd is ignored if < 0 (when there is no need to write the error messages) */
-static int register_device_request(int fd, const request_data_t *req_data)
+/* Note: client is ignored if NULL (when there is no need to write the error messages) */
+static int register_device_request(service_client_t *client, const request_data_t *req_data)
 {
 	int result = 0;
 	bool target_used = false;
+	bool path_used = false;
 	request_data_t *previously_registered_req = NULL;
 	ccapi_receive_error_t status = ccapi_receive_add_target(req_data->target, device_request, device_request_done, CCAPI_RECEIVE_NO_LIMIT);
 
@@ -323,25 +406,29 @@ static int register_device_request(int fd, const request_data_t *req_data)
 		if (!previously_registered_req) {
 			/* This should never happen */
 			log_dr_error("%s", "Target already registered in CCAPI, but not registered on service_device_request!!");
-			if (fd >= 0)
-				send_error(fd, "Internal connector error");
+			if (client)
+				send_response_error(client, "Internal connector error");
 		} else {
 			log_dr_warning("Target %s has been overriden by new process listening on port %d",
 				req_data->target, req_data->port);
 			previously_registered_req->port = req_data->port;
+			free(previously_registered_req->path);
+			previously_registered_req->path = req_data->path;
+			previously_registered_req->uid = req_data->uid;
+			path_used = true;
 		}
 	} else if (status != CCAPI_RECEIVE_ERROR_NONE) {
 		log_dr_error("Could not register device request: %d", status);
-		if (fd >= 0)
-			send_error(fd, to_user_error_msg(status));
+		if (client)
+			send_response_error(client, to_user_error_msg(status));
 		result = status;
 		goto exit;
 	}
 
 	if (!previously_registered_req) {
 		if (add_registered_target(req_data)) {
-			if (fd >= 0)
-				send_error(fd, "Could not register device request, out of memory");
+			if (client)
+				send_response_error(client, "Could not register device request, out of memory");
 			result = -1;
 		} else {
 			target_used = true;
@@ -351,44 +438,171 @@ static int register_device_request(int fd, const request_data_t *req_data)
 exit:
 	if(!target_used)
 		free(req_data->target);
+	if (!target_used && !path_used)
+		free(req_data->path);
 
 	return result;
 }
 
-int handle_register_device_request(int fd)
+/*
+ * check_socket_path() - Check that a client may register a socket path
+ *
+ * @client:	The client registering the path.
+ * @path:	The Unix domain socket the device requests will be sent to.
+ * @uid:	Where to store the user of the client.
+ *
+ * The path must be registered through the Unix domain socket of the
+ * connector, and it must be a socket owned by the user of the client, so
+ * a client cannot make the connector write the requests to another socket.
+ * Every request is only delivered if that user still serves the socket,
+ * see get_socket_for_target().
+ * An error response is sent to the client if the path is not valid.
+ *
+ * Return: 0 if the path is valid, -1 otherwise.
+ */
+static int check_socket_path(service_client_t *client, const char *path, uid_t *uid)
+{
+	struct ucred cred;
+	struct stat st;
+	socklen_t length;
+	int domain;
+
+	length = sizeof(domain);
+	if (getsockopt(client->fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) != 0 || domain != AF_UNIX) {
+		send_response_error(client, "Socket paths require the Unix domain socket");
+		return -1;
+	}
+	length = sizeof(cred);
+	if (getsockopt(client->fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+		send_response_error(client, "Cannot get client credentials");
+		return -1;
+	}
+
+	if (lstat(path, &st) != 0 || !S_ISSOCK(st.st_mode)) {
+		log_dr_error("Could not register device request: '%s' is not a socket", path);
+		send_response_error(client, "Invalid socket path");
+		return -1;
+	}
+	if (st.st_uid != cred.uid) {
+		log_dr_error("Could not register device request: '%s' is not owned by uid %u",
+			path, (unsigned int) cred.uid);
+		send_response_error(client, "Socket path not owned by the client");
+		return -1;
+	}
+	*uid = cred.uid;
+
+	return 0;
+}
+
+int handle_register_device_request(service_client_t *client, const request_values_t *request)
 {
-	request_data_t req_data;
+	request_data_t req_data = { 0 };
+	int ret;
 
-	if (read_request(fd, &req_data))
+	if (request->n_values > 3 && check_socket_path(client, request->values[2].data, &req_data.uid) != 0)
 		return -1;
 
-	if (register_device_request(fd, &req_data))
+	req_data.port = request->values[0].integer;
+	req_data.target = strdup(request->values[1].data);
+	req_data.path = request->n_values > 3 ? strdup(request->values[2].data) : NULL;
+	if (!req_data.target || (request->n_values > 3 && !req_data.path)) {
+		send_response_error(client, "Could not register device request, out of memory");
+		free(req_data.target);
+		free(req_data.path);
 		return -1;
+	}
 
-	send_ok(fd);
+	pthread_mutex_lock(&active_requests_lock);
+	ret = register_device_request(client, &req_data);
+	pthread_mutex_unlock(&active_requests_lock);
+	if (ret)
+		return -1;
+
+	send_response_ok(client);
 
 	return 0;
 }
 
-int handle_unregister_device_request(int fd)
+int handle_unregister_device_request(service_client_t *client, const request_values_t *request)
 {
-	request_data_t req_data;
 	ccapi_receive_error_t status;
 
-	if (read_request(fd, &req_data))
-		return -1;
-
-	status = unregister_target(req_data.target);
+	pthread_mutex_lock(&active_requests_lock);
+	status = unregister_target(request->values[1].data);
+	pthread_mutex_unlock(&active_requests_lock);
 	if (status != CCAPI_RECEIVE_ERROR_NONE) {
-		send_error(fd, to_user_error_msg(status));
-		return status;
+		send_response_error(client, to_user_error_msg(status));
+		return -1;
 	}
 
-	send_ok(fd);
+	send_response_ok(client);
 
 	return 0;
 }
 
+/*
+ * read_saved_string() - Read a string of the registered targets file
+ *
+ * @file:	The registered targets file.
+ *
+ * Return: The allocated string, NULL on error.
+ */
+static char *read_saved_string(FILE *file)
+{
+	char *temp_string;
+	size_t string_len;
+	long fpos, flen;
+
+	if (fread(&string_len, sizeof string_len, 1, file) != 1)
+		return NULL;
+
+	/* Verify that the str_len is at less than the EOF */
+	fpos = ftell(file);
+	if (fseek(file, 0, SEEK_END) != 0)
+		return NULL;
+
+	flen = ftell(file);
+	if (fpos < 0 || flen < 0 || flen < fpos || string_len <= 0 || (long)string_len > (flen - fpos))
+		return NULL;
+
+	if (fseek(file, fpos, SEEK_SET) != 0)
+		return NULL;
+
+	temp_string = malloc(string_len + 1);
+	/*
+	 * We need to check for overflow (as this data can be exposed to an
+	 * attacker). If there is an overflow it will be caused by string_len
+	 * equalling the maximum memory and then the +1 causing the overflow.
+	 * We can't just check that its equal in size as this will just check
+	 * that 0 is equal to 0, we need to check that the allocated memory
+	 * is greater than string_len as this means that it hasn't wrapped
+	 * around e.g. 0 < 0xfffffffffff
+	 */
+	if (!temp_string || malloc_usable_size(temp_string) < (size_t) (string_len)) {
+		log_dr_error("%s", "Could not read registered target, out of memory");
+		free(temp_string);
+		return NULL;
+	}
+	if (fread(temp_string, string_len, 1, file) != 1) {
+		free(temp_string);
+		return NULL;
+	}
+	temp_string[string_len] = '\0';
+
+	return temp_string;
+}
+
+/*
+ * import_devicerequests() - Register the targets saved by dump_devicerequests()
+ *
+ * @file_path:	The registered targets file.
+ *
+ * Targets listening on a Unix domain socket are saved with port 0 followed
+ * by the socket path and the user that registered it, so files of previous
+ * versions are still valid.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
 int import_devicerequests(const char *file_path)
 {
 	int ret = -1;
@@ -396,9 +610,6 @@ int import_devicerequests(const char *file_path)
 	size_t i;
 	FILE *file = fopen(file_path, "r");
 	request_data_t temp;
-	char *temp_string;
-	size_t string_len;
-	long fpos, flen;
 
 	if (!file) {
 		log_dr_error("Could not read registered targets from %s: %s", file_path, strerror(errno));
@@ -411,51 +622,29 @@ int import_devicerequests(const char *file_path)
 	}
 
 	for (i = 0; i < n; i++) {
+		temp.path = NULL;
+		temp.uid = 0;
 		if (fread(&temp.port, sizeof temp.port, 1, file) != 1
-			|| fread(&string_len, sizeof string_len, 1, file) != 1) {
+			|| (temp.target = read_saved_string(file)) == NULL) {
 			log_dr_error("Could not read registered target %zu", i);
 			goto out;
 		}
 
-		/* Verify that the str_len is at less than the EOF */
-		fpos = ftell(file);
-		if (fseek(file, 0, SEEK_END) != 0)
-			goto out;
-
-		flen = ftell(file);
-		if (fpos < 0 || flen < 0 || flen < fpos || string_len <= 0 || (long)string_len > (flen - fpos))
-			goto out;
-
-		if (fseek(file, fpos, SEEK_SET) != 0)
-			goto out;
-
-		temp_string = malloc(string_len + 1);
-		/*
-		 * We need to check for overflow (as this data can be exposed to an
-		 * attacker). If there is an overflow it will be caused by string_len
-		 * equalling the maximum memory and then the +1 causing the overflow.
-		 * We can't just check that its equal in size as this will just check
-		 * that 0 is equal to 0, we need to check that the allocated memory
-		 * is greater than string_len as this means that it hasn't wrapped
-		 * around e.g. 0 < 0xfffffffffff
-		 */
-		if (!temp_string || malloc_usable_size(temp_string) < (size_t) (string_len)) {
-			log_dr_error("%s", "Could not read registered target, out of memory");
-			free(temp_string);
-			goto out;
-		}
-		if (fread(temp_string, string_len, 1, file) != 1) {
+		if (temp.port == 0 && ((temp.path = read_saved_string(file)) == NULL
+			|| fread(&temp.uid, sizeof temp.uid, 1, file) != 1)) {
 			log_dr_error("Could not read registered target %zu", i);
-			free(temp_string);
+			free(temp.target);
+			free(temp.path);
 			goto out;
 		}
-		temp_string[string_len] = '\0';
-		temp.target = temp_string;
 
-		if (register_device_request(-1, &temp))
-			free(temp_string);
+		pthread_mutex_lock(&active_requests_lock);
+		register_device_request(NULL, &temp);
+		pthread_mutex_unlock(&active_requests_lock);
 	}
 
+	ret = 0;
+
 out:
 	fclose(file);
 
@@ -465,16 +654,21 @@ out:
 int dump_devicerequests(const char *file_path)
 {
 	int ret = -1;
-	size_t n = active_requests.size;
+	size_t n;
 	size_t i;
 	FILE *file;
 
-	if (active_requests.size == 0)
-		return 0;
+	pthread_mutex_lock(&active_requests_lock);
+
+	n = active_requests.size;
+	if (n == 0) {
+		ret = 0;
+		goto unlock;
+	}
 
 	if (!(file = fopen(file_path, "w"))) {
 		log_dr_error("Could not dump registered targets to %s: %s", file_path, strerror(errno));
-		return -1;
+		goto unlock;
 	}
 
 	if (fwrite(&n, sizeof n, 1, file) != 1) {
@@ -484,11 +678,16 @@ int dump_devicerequests(const char *file_path)
 
 	for (i = 0; i < n; i++) {
 		const request_data_t *dr = &active_requests.array[i];
+		uint16_t port = dr->path ? 0 : dr->port;
 		size_t target_len = strlen(dr->target);
+		size_t path_len = dr->path ? strlen(dr->path) : 0;
 
-		if (fwrite(&dr->port, sizeof dr->port, 1, file) != 1
+		if (fwrite(&port, sizeof port, 1, file) != 1
 			|| fwrite(&target_len, sizeof target_len, 1, file) != 1
-			|| fwrite(dr->target, target_len, 1, file) != 1) {
+			|| fwrite(dr->target, target_len, 1, file) != 1
+			|| (dr->path && (fwrite(&path_len, sizeof path_len, 1, file) != 1
+				|| fwrite(dr->path, path_len, 1, file) != 1
+				|| fwrite(&dr->uid, sizeof dr->uid, 1, file) != 1))) {
 			log_dr_error("Could not write registered targets: %s", strerror(errno));
 			goto out;
 		}
@@ -499,6 +698,9 @@ int dump_devicerequests(const char *file_path)
 out:
 	fclose(file);
 
+unlock:
+	pthread_mutex_unlock(&active_requests_lock);
+
 	return ret;
 }
 
@@ -20,11 +20,18 @@
 #ifndef SERVICE_DEVICE_REQUEST_H
 #define SERVICE_DEVICE_REQUEST_H
 
+#include "services_util.h"
+
 #define REQ_TAG_REGISTER_DR	"register_devicerequest"
 #define REQ_TAG_UNREGISTER_DR	"unregister_devicerequest"
 
-int handle_register_device_request(int fd);
-int handle_unregister_device_request(int fd);
+/* Types of the messages forwarded to the application of a target */
+#define DR_TYPE_REQUEST		"request"
+#define DR_TYPE_STATUS		"status"
+
+request_status_t parse_device_request(const request_values_t *request, const char **error);
+int handle_register_device_request(service_client_t *client, const request_values_t *request);
+int handle_unregister_device_request(service_client_t *client, const request_values_t *request);
 
 int import_devicerequests(const char *file_path);
 int dump_devicerequests(const char *file_path);
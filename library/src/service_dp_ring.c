@@ -0,0 +1,1280 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ccapi/ccapi.h"
+#include "cc_logging.h"
+#include "cc_spool.h"
+#include "service_dp_ring.h"
+#include "services_util.h"
+
+/* Milliseconds between drains while samples keep arriving */
+#define RING_DRAIN_PERIOD_MS	10
+
+/* Milliseconds between checks of the rings of finished processes */
+#define RING_IDLE_TICK_MS		1000
+
+/* Records drained from a ring before moving to the next one */
+#define RING_DRAIN_BATCH		1024
+
+/* Drains of every ring on stop, enough to empty full rings once */
+#define RING_STOP_PASSES		(DP_RING_MAX_SLOTS / RING_DRAIN_BATCH)
+
+/* An upload is sent once it has this number of samples or this age */
+#define RING_FLUSH_POINTS		10000
+#define RING_FLUSH_AGE_MS		1000
+
+/* Rings are not drained while the upload being built has this number of samples */
+#define RING_MAX_POINTS			(4 * RING_FLUSH_POINTS)
+
+/* Seconds to wait for Remote Manager to acknowledge an upload */
+#define RING_SEND_TIMEOUT		60
+
+#define RING_STREAM_NAME_MAX	255
+
+/* Not defined by older C libraries, the number is the same on every architecture */
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open			434
+#endif
+
+#define RING_EPOLL_EVENTS		16
+
+/* Initial number of samples of the copy of an upload for the data spool */
+#define RING_COPY_POINTS		1024
+
+/**
+ * ring_stream_t - Data stream of one or more rings
+ *
+ * @path:		Name of the data stream.
+ * @send_id:	Identifier of the last upload the stream was added to.
+ * @copy_index:	Index of the stream in the copy of that upload, if any.
+ * @refs:		Number of rings using the stream.
+ * @next:		Next stream of the list.
+ */
+typedef struct ring_stream {
+	char *path;
+	unsigned long send_id;
+	uint32_t copy_index;
+	unsigned int refs;
+	struct ring_stream *next;
+} ring_stream_t;
+
+/**
+ * ring_t - Data point ring of a local application
+ *
+ * @header:		Mapped shared memory.
+ * @records:	Slots of the ring, right after the header.
+ * @size:		Size of the shared memory.
+ * @n_slots:	Number of slots, not read from the shared memory.
+ * @tail:		Number of records drained.
+ * @dropped:	Number of dropped records already reported.
+ * @mem_fd:		Shared memory file descriptor.
+ * @wake_fd:	Eventfd written by the application when the ring was empty.
+ * @pid_fd:		Process file descriptor of the application, readable once
+ *				it finishes.
+ * @pid:		Process ID of the application, only for logging.
+ * @streams:	Data streams, in the order given by the application.
+ * @n_streams:	Number of data streams.
+ * @next:		Next ring of the list.
+ */
+typedef struct ring {
+	dp_ring_header_t *header;
+	dp_ring_record_t *records;
+	size_t size;
+	uint32_t n_slots;
+	uint64_t tail;
+	uint64_t dropped;
+	int mem_fd;
+	int wake_fd;
+	int pid_fd;
+	pid_t pid;
+	ring_stream_t **streams;
+	uint32_t n_streams;
+	struct ring *next;
+} ring_t;
+
+/**
+ * ring_point_t - Sample of an upload, as stored in its copy
+ *
+ * @stream:		Index of the data stream in the copy.
+ * @timestamp:	Milliseconds since the epoch.
+ * @value:		Value of the sample.
+ */
+typedef struct {
+	uint32_t stream;
+	int64_t timestamp;
+	double value;
+} ring_point_t;
+
+/**
+ * ring_copy_t - Samples of an upload, to store them in the data spool if it fails
+ *
+ * @paths:		Data streams of the upload. They are copied, the streams may
+ *				be released before the upload finishes.
+ * @n_paths:	Number of data streams.
+ * @points:		Samples of the upload.
+ * @n_points:	Number of samples.
+ * @capacity:	Number of samples that fit in 'points'.
+ */
+typedef struct {
+	char **paths;
+	uint32_t n_paths;
+	ring_point_t *points;
+	uint32_t n_points;
+	uint32_t capacity;
+} ring_copy_t;
+
+/**
+ * ring_upload_t - Samples drained from the rings, to be uploaded together
+ *
+ * @collection:	Data point collection, NULL if there are no samples yet.
+ * @copy:		Copy of the samples, NULL if the data spool is disabled.
+ * @send_id:	Identifier of the upload, to add every stream only once.
+ * @n_points:	Number of samples of the collection.
+ * @started:	Monotonic time (ms) of the first sample.
+ */
+typedef struct {
+	ccapi_dp_collection_handle_t collection;
+	ring_copy_t *copy;
+	unsigned long send_id;
+	uint32_t n_points;
+	uint64_t started;
+} ring_upload_t;
+
+/**
+ * ring_service_t - State of the data point rings
+ *
+ * @lock:			Protects the lists of rings and streams and the upload
+ *					handed to the sender.
+ * @send_cond:		Signalled when there is an upload to send or on stop.
+ * @idle_cond:		Signalled when the sender finishes an upload.
+ * @drain_thread:	Thread draining the rings.
+ * @send_thread:	Thread sending the drained uploads.
+ * @running:		Whether the threads are running.
+ * @stop:			Whether the drain thread must finish.
+ * @stop_sender:	Whether the sender must finish, once the drain thread
+ *					handed its last upload.
+ * @epoll_fd:		Watches the eventfds of the rings and 'wake_fd'.
+ * @wake_fd:		Eventfd to wake the drain thread on stop.
+ * @max_rings:		Maximum number of rings.
+ * @n_rings:		Number of rings opened or being opened.
+ * @rings:			List of rings.
+ * @streams:		List of data streams of all the rings.
+ * @sending:		Upload handed to the sender, NULL if it is idle.
+ * @sending_copy:	Copy of the samples of 'sending', NULL if there is none.
+ * @busy:			Whether the sender is sending an upload.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t send_cond;
+	pthread_cond_t idle_cond;
+	pthread_t drain_thread;
+	pthread_t send_thread;
+	bool running;
+	bool stop;
+	bool stop_sender;
+	int epoll_fd;
+	int wake_fd;
+	uint32_t max_rings;
+	uint32_t n_rings;
+	ring_t *rings;
+	ring_stream_t *streams;
+	ccapi_dp_collection_handle_t sending;
+	ring_copy_t *sending_copy;
+	bool busy;
+} ring_service_t;
+
+static ring_service_t service = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.send_cond = PTHREAD_COND_INITIALIZER,
+	.idle_cond = PTHREAD_COND_INITIALIZER,
+	.epoll_fd = -1,
+	.wake_fd = -1
+};
+
+/*
+ * get_clock_ms() - Get the time of a clock in milliseconds
+ *
+ * @clock:	CLOCK_REALTIME or CLOCK_MONOTONIC.
+ *
+ * Return: Milliseconds of the clock.
+ */
+static uint64_t get_clock_ms(clockid_t clock)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+ * get_stream() - Get a data stream, creating it if it does not exist
+ *
+ * @path:	Name of the data stream.
+ *
+ * Must be called with the service lock held.
+ *
+ * Return: The stream with a new reference, NULL if there is not enough memory.
+ */
+static ring_stream_t *get_stream(const char *path)
+{
+	ring_stream_t *stream;
+
+	for (stream = service.streams; stream != NULL; stream = stream->next) {
+		if (!strcmp(stream->path, path)) {
+			stream->refs++;
+			return stream;
+		}
+	}
+
+	stream = calloc(1, sizeof(*stream));
+	if (stream == NULL)
+		return NULL;
+	stream->path = strdup(path);
+	if (stream->path == NULL) {
+		free(stream);
+		return NULL;
+	}
+	stream->refs = 1;
+	stream->next = service.streams;
+	service.streams = stream;
+
+	return stream;
+}
+
+/*
+ * prune_streams() - Free the data streams no ring uses any more
+ *
+ * Unused streams are kept until a new upload starts, so a ring reopened
+ * with the same streams does not add them twice to the same collection.
+ *
+ * Must be called with the service lock held.
+ */
+static void prune_streams(void)
+{
+	ring_stream_t **link = &service.streams;
+
+	while (*link != NULL) {
+		ring_stream_t *stream = *link;
+
+		if (stream->refs > 0) {
+			link = &stream->next;
+			continue;
+		}
+		*link = stream->next;
+		free(stream->path);
+		free(stream);
+	}
+}
+
+/*
+ * free_ring() - Unmap a ring and release its resources
+ *
+ * @ring:	The ring, already removed from the list of rings.
+ *
+ * Must be called with the service lock held.
+ */
+static void free_ring(ring_t *ring)
+{
+	uint32_t i;
+
+	if (ring->header != NULL && ring->header != MAP_FAILED)
+		munmap(ring->header, ring->size);
+	if (ring->mem_fd >= 0)
+		close(ring->mem_fd);
+	/* Closing the eventfd also removes it from the epoll set */
+	if (ring->wake_fd >= 0)
+		close(ring->wake_fd);
+	if (ring->pid_fd >= 0)
+		close(ring->pid_fd);
+	for (i = 0; i < ring->n_streams; i++) {
+		if (ring->streams[i] != NULL)
+			ring->streams[i]->refs--;
+	}
+	free(ring->streams);
+	free(ring);
+
+	service.n_rings--;
+}
+
+/*
+ * create_ring() - Create the shared memory and eventfd of a ring
+ *
+ * @n_slots:	Number of slots, a power of two.
+ * @n_streams:	Number of data streams.
+ *
+ * Return: The new ring, NULL on error.
+ */
+static ring_t *create_ring(uint32_t n_slots, uint32_t n_streams)
+{
+	ring_t *ring = calloc(1, sizeof(*ring));
+
+	if (ring == NULL)
+		return NULL;
+
+	ring->mem_fd = -1;
+	ring->wake_fd = -1;
+	ring->pid_fd = -1;
+	ring->n_slots = n_slots;
+	ring->size = DP_RING_SIZE(n_slots);
+	ring->streams = calloc(n_streams, sizeof(*ring->streams));
+	if (ring->streams == NULL)
+		goto error;
+
+	/*
+	 * The application maps the memory read/write: seal its size so it cannot
+	 * shrink it and make the drain thread fault on the unmapped pages.
+	 */
+	ring->mem_fd = memfd_create("cc_dp_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (ring->mem_fd < 0 || ftruncate(ring->mem_fd, ring->size) != 0
+		|| fcntl(ring->mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+		goto error;
+
+	ring->header = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->mem_fd, 0);
+	if (ring->header == MAP_FAILED)
+		goto error;
+	ring->records = (dp_ring_record_t *) ((char *) ring->header + DP_RING_HEADER_SIZE);
+
+	ring->header->magic = DP_RING_MAGIC;
+	ring->header->version = DP_RING_VERSION;
+	ring->header->n_slots = n_slots;
+	ring->header->n_streams = n_streams;
+	/* The drain thread may be idle, the first record must wake it */
+	ring->header->consumer_sleeping = 1;
+
+	ring->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ring->wake_fd < 0)
+		goto error;
+
+	return ring;
+
+error:
+	log_error("Cannot create data point ring: %s", strerror(errno));
+	pthread_mutex_lock(&service.lock);
+	/* free_ring() releases the slot reserved by the caller */
+	free_ring(ring);
+	pthread_mutex_unlock(&service.lock);
+
+	return NULL;
+}
+
+/*
+ * add_ring_streams() - Resolve the data streams of a ring
+ *
+ * @ring:	The ring.
+ * @names:	Names of the data streams, separated by new lines.
+ *
+ * Must be called with the service lock held.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int add_ring_streams(ring_t *ring, char *names)
+{
+	char *name, *saveptr = NULL;
+
+	for (name = strtok_r(names, "\n", &saveptr); name != NULL;
+			name = strtok_r(NULL, "\n", &saveptr)) {
+		ring->streams[ring->n_streams] = get_stream(name);
+		if (ring->streams[ring->n_streams] == NULL)
+			return -1;
+		ring->n_streams++;
+	}
+
+	return 0;
+}
+
+/*
+ * free_ring_copy() - Release the copy of the samples of an upload
+ *
+ * @copy:	The copy, may be NULL.
+ */
+static void free_ring_copy(ring_copy_t *copy)
+{
+	uint32_t i;
+
+	if (copy == NULL)
+		return;
+
+	for (i = 0; i < copy->n_paths; i++)
+		free(copy->paths[i]);
+	free(copy->paths);
+	free(copy->points);
+	free(copy);
+}
+
+/*
+ * drop_ring_copy() - Stop copying the samples of an upload
+ *
+ * @upload:	The upload.
+ *
+ * The upload is still sent, but it cannot be stored in the data spool if
+ * it fails.
+ */
+static void drop_ring_copy(ring_upload_t *upload)
+{
+	log_error("Cannot keep data point rings samples for the data spool: %s", "Out of memory");
+	free_ring_copy(upload->copy);
+	upload->copy = NULL;
+}
+
+/*
+ * copy_stream() - Add a data stream to the copy of an upload
+ *
+ * @copy:	The copy.
+ * @stream:	The data stream, its index in the copy is stored in it.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int copy_stream(ring_copy_t *copy, ring_stream_t *stream)
+{
+	char **paths = realloc(copy->paths, (copy->n_paths + 1) * sizeof(*paths));
+
+	if (paths == NULL)
+		return -1;
+	copy->paths = paths;
+
+	paths[copy->n_paths] = strdup(stream->path);
+	if (paths[copy->n_paths] == NULL)
+		return -1;
+	stream->copy_index = copy->n_paths++;
+
+	return 0;
+}
+
+/*
+ * copy_point() - Add a sample to the copy of an upload
+ *
+ * @copy:		The copy.
+ * @stream:		Data stream of the sample, already in the copy.
+ * @timestamp:	Milliseconds since the epoch.
+ * @value:		Value of the sample.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int copy_point(ring_copy_t *copy, const ring_stream_t *stream, int64_t timestamp, double value)
+{
+	ring_point_t *point;
+
+	if (copy->n_points == copy->capacity) {
+		uint32_t capacity = copy->capacity > 0 ? 2 * copy->capacity : RING_COPY_POINTS;
+		ring_point_t *points = realloc(copy->points, capacity * sizeof(*points));
+
+		if (points == NULL)
+			return -1;
+		copy->points = points;
+		copy->capacity = capacity;
+	}
+
+	point = &copy->points[copy->n_points++];
+	point->stream = stream->copy_index;
+	point->timestamp = timestamp;
+	point->value = value;
+
+	return 0;
+}
+
+/*
+ * format_point_csv() - Format a sample as a Remote Manager CSV data point
+ *
+ * @buffer:	Buffer to write the data point to, NULL to get its length.
+ * @size:	Size of the buffer.
+ * @copy:	Copy of the upload of the sample.
+ * @point:	The sample.
+ *
+ * Return: Length of the data point, without the null terminator.
+ */
+static int format_point_csv(char *buffer, size_t size, const ring_copy_t *copy, const ring_point_t *point)
+{
+	/* DATA,TIMESTAMP,QUALITY,DESCRIPTION,LOCATION,DATATYPE,UNITS,FORWARDTO,STREAMID */
+	return snprintf(buffer, size, "%.17g,%" PRId64 ",,,,DOUBLE,,,%s\n",
+			point->value, point->timestamp, copy->paths[point->stream]);
+}
+
+/*
+ * spool_ring_copy() - Store the samples of a failed upload in the data spool
+ *
+ * @copy:	Copy of the samples of the upload.
+ *
+ * The samples are stored as Remote Manager data points in CSV format, so they
+ * can be merged with other data points when they are replayed.
+ *
+ * Return: 0 if the samples are stored, -1 otherwise.
+ */
+static int spool_ring_copy(const ring_copy_t *copy)
+{
+	size_t size = 0, len = 0;
+	spool_error_t error;
+	char *csv;
+	uint32_t i;
+
+	for (i = 0; i < copy->n_points; i++)
+		size += format_point_csv(NULL, 0, copy, &copy->points[i]);
+
+	csv = malloc(size + 1);
+	if (csv == NULL) {
+		log_error("Cannot store data point rings samples: %s", "Out of memory");
+		return -1;
+	}
+
+	for (i = 0; i < copy->n_points; i++)
+		len += format_point_csv(csv + len, size + 1 - len, copy, &copy->points[i]);
+
+	error = spool_data(SPOOL_RECORD_DP_CSV, SPOOL_DP_CSV_CLOUD_PATH, csv, len);
+	free(csv);
+
+	if (error != SPOOL_ERROR_NONE) {
+		log_error("Cannot store data point rings samples, %d", error);
+		return -1;
+	}
+
+	log_info("%u data point rings samples stored in the data spool", copy->n_points);
+
+	return 0;
+}
+
+/*
+ * add_point() - Add a drained record to the upload being built
+ *
+ * @upload:	The upload.
+ * @stream:	Data stream of the record.
+ * @record:	The record.
+ * @now:	Current time (ms since the epoch) for records without timestamp.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int add_point(ring_upload_t *upload, ring_stream_t *stream,
+		const dp_ring_record_t *record, int64_t now)
+{
+	ccapi_timestamp_t timestamp = { 0 };
+	ccapi_dp_error_t dp_error;
+
+	if (upload->collection == NULL) {
+		dp_error = ccapi_dp_create_collection(&upload->collection);
+		if (dp_error != CCAPI_DP_ERROR_NONE) {
+			upload->collection = NULL;
+			return -1;
+		}
+		/* Streams are added to the collection only once per upload */
+		upload->send_id++;
+		if (upload->send_id == 0)
+			upload->send_id++;
+		upload->n_points = 0;
+		upload->started = get_clock_ms(CLOCK_MONOTONIC);
+		prune_streams();
+		if (is_spool_enabled()) {
+			upload->copy = calloc(1, sizeof(*upload->copy));
+			if (upload->copy == NULL)
+				drop_ring_copy(upload);
+		}
+	}
+
+	if (stream->send_id != upload->send_id) {
+		dp_error = ccapi_dp_add_data_stream_to_collection_extra(
+					upload->collection, stream->path, "double ts_epoch_ms", NULL, NULL);
+		if (dp_error != CCAPI_DP_ERROR_NONE) {
+			log_error("Cannot add '%s' stream to data point collection, error %d",
+				stream->path, dp_error);
+			return -1;
+		}
+		stream->send_id = upload->send_id;
+		if (upload->copy != NULL && copy_stream(upload->copy, stream) != 0)
+			drop_ring_copy(upload);
+	}
+
+	/* Numeric timestamps ('ts_epoch_ms' streams) need no formatting */
+	timestamp.epoch_msec = record->timestamp > 0 ? record->timestamp : now;
+
+	dp_error = ccapi_dp_add(upload->collection, stream->path, record->value, &timestamp);
+	if (dp_error != CCAPI_DP_ERROR_NONE) {
+		log_error("Cannot add '%s' value, error %d", stream->path, dp_error);
+		return -1;
+	}
+	upload->n_points++;
+	if (upload->copy != NULL
+		&& copy_point(upload->copy, stream, timestamp.epoch_msec, record->value) != 0)
+		drop_ring_copy(upload);
+
+	return 0;
+}
+
+/*
+ * drain_ring() - Move the pending records of a ring to the upload being built
+ *
+ * @ring:	The ring.
+ * @upload:	The upload.
+ * @now:	Current time (ms since the epoch) for records without timestamp.
+ *
+ * At most RING_DRAIN_BATCH records are drained, so every ring gets its turn.
+ *
+ * Return: Number of records drained, -1 if the ring is corrupted.
+ */
+static int drain_ring(ring_t *ring, ring_upload_t *upload, int64_t now)
+{
+	uint64_t head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+	uint64_t pending = head - ring->tail;
+	uint32_t mask = ring->n_slots - 1;
+	int n_drained = 0;
+
+	/* The shared memory is writable by the application, do not trust it */
+	if (pending > ring->n_slots) {
+		log_error("Data point ring of process %d is corrupted", (int) ring->pid);
+		return -1;
+	}
+
+	if (pending > RING_DRAIN_BATCH)
+		pending = RING_DRAIN_BATCH;
+
+	/* Awake, the application does not need to write the eventfd */
+	if (__atomic_load_n(&ring->header->consumer_sleeping, __ATOMIC_RELAXED))
+		__atomic_store_n(&ring->header->consumer_sleeping, 0, __ATOMIC_RELAXED);
+
+	while (pending-- > 0) {
+		dp_ring_record_t record = ring->records[ring->tail & mask];
+
+		ring->tail++;
+		n_drained++;
+		if (record.stream >= ring->n_streams) {
+			log_debug("Data point ring of process %d: invalid stream %u",
+				(int) ring->pid, record.stream);
+			continue;
+		}
+		/* Discard the sample rather than blocking the ring */
+		add_point(upload, ring->streams[record.stream], &record, now);
+	}
+
+	__atomic_store_n(&ring->header->tail, ring->tail, __ATOMIC_RELEASE);
+
+	return n_drained;
+}
+
+/*
+ * is_ring_finished() - Check whether the application of a ring is done with it
+ *
+ * @ring:	The ring, already drained.
+ * @check_pid:	Whether to check that the application is still running.
+ *
+ * Return: true if the ring can be released, false otherwise.
+ */
+static bool is_ring_finished(const ring_t *ring, bool check_pid)
+{
+	struct pollfd pfd = {
+		.fd = ring->pid_fd,
+		.events = POLLIN
+	};
+
+	if (ring->tail != __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE))
+		return false;
+
+	if (__atomic_load_n(&ring->header->closed, __ATOMIC_ACQUIRE))
+		return true;
+
+	/* Unlike the PID, the process file descriptor is never reused */
+	return check_pid && poll(&pfd, 1, 0) > 0;
+}
+
+/*
+ * drain_rings() - Drain every ring once
+ *
+ * @upload:		The upload to add the records to.
+ * @check_pid:	Whether to release the rings of finished applications.
+ *
+ * Rings closed by their application or whose application finished are
+ * released once they are empty.
+ *
+ * Return: true if any ring still has pending records, false otherwise.
+ */
+static bool drain_rings(ring_upload_t *upload, bool check_pid)
+{
+	int64_t now = get_clock_ms(CLOCK_REALTIME);
+	ring_t **link = &service.rings;
+	bool more = false;
+
+	while (*link != NULL) {
+		ring_t *ring = *link;
+		int n_drained = drain_ring(ring, upload, now);
+		uint64_t dropped;
+
+		if (n_drained == RING_DRAIN_BATCH)
+			more = true;
+
+		dropped = __atomic_load_n(&ring->header->dropped, __ATOMIC_RELAXED);
+		if (check_pid && dropped != ring->dropped) {
+			log_warning("Data point ring of process %d full, %llu samples dropped",
+				(int) ring->pid, (unsigned long long) (dropped - ring->dropped));
+			ring->dropped = dropped;
+		}
+
+		if (n_drained < 0 || is_ring_finished(ring, check_pid)) {
+			log_debug("Releasing data point ring of process %d", (int) ring->pid);
+			*link = ring->next;
+			free_ring(ring);
+			continue;
+		}
+
+		link = &ring->next;
+	}
+
+	return more;
+}
+
+/*
+ * sleep_rings() - Ask the applications to wake the drain thread
+ *
+ * Must be called with the service lock held.
+ *
+ * Return: false if any ring got records meanwhile, true if it is safe to
+ *         wait for the eventfds.
+ */
+static bool sleep_rings(void)
+{
+	ring_t *ring;
+
+	for (ring = service.rings; ring != NULL; ring = ring->next)
+		__atomic_store_n(&ring->header->consumer_sleeping, 1, __ATOMIC_RELAXED);
+
+	/* Pairs with the fence of the producers after they publish 'head' */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	for (ring = service.rings; ring != NULL; ring = ring->next) {
+		if (__atomic_load_n(&ring->header->head, __ATOMIC_RELAXED) != ring->tail)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * hand_upload() - Pass the built upload to the sender thread
+ *
+ * @upload:	The upload.
+ * @force:	Whether to hand it regardless of its size and age.
+ *
+ * Must be called with the service lock held. Nothing is done while the
+ * sender is busy with a previous upload.
+ */
+static void hand_upload(ring_upload_t *upload, bool force)
+{
+	uint64_t age;
+
+	if (upload->collection == NULL || service.sending != NULL || service.busy)
+		return;
+
+	age = get_clock_ms(CLOCK_MONOTONIC) - upload->started;
+	if (!force && upload->n_points < RING_FLUSH_POINTS && age < RING_FLUSH_AGE_MS)
+		return;
+
+	service.sending = upload->collection;
+	service.sending_copy = upload->copy;
+	upload->collection = NULL;
+	upload->copy = NULL;
+	upload->n_points = 0;
+	pthread_cond_signal(&service.send_cond);
+}
+
+/*
+ * drain_on_stop() - Hand every pending sample of the rings to the sender
+ *
+ * @upload:	The upload being built.
+ *
+ * The rings are drained into uploads of up to RING_MAX_POINTS samples, each
+ * one handed once the sender finished the previous one. Applications may
+ * keep writing, so at most RING_STOP_PASSES drains are done.
+ *
+ * Must be called with the service lock held.
+ */
+static void drain_on_stop(ring_upload_t *upload)
+{
+	unsigned int n_passes = 0;
+	bool more;
+
+	do {
+		more = drain_rings(upload, false) && ++n_passes < RING_STOP_PASSES;
+		if (more && upload->n_points < RING_MAX_POINTS)
+			continue;
+
+		while (service.sending != NULL || service.busy)
+			pthread_cond_wait(&service.idle_cond, &service.lock);
+		hand_upload(upload, true);
+	} while (more);
+}
+
+/*
+ * get_wait_time() - Get the milliseconds the drain thread may sleep
+ *
+ * @upload:	The upload being built.
+ *
+ * Return: Milliseconds until the upload must be sent, or until the next
+ *         idle check if there is nothing to send.
+ */
+static int get_wait_time(const ring_upload_t *upload)
+{
+	uint64_t age;
+
+	if (upload->collection == NULL)
+		return RING_IDLE_TICK_MS;
+
+	age = get_clock_ms(CLOCK_MONOTONIC) - upload->started;
+	if (age >= RING_FLUSH_AGE_MS)
+		return RING_DRAIN_PERIOD_MS;
+
+	return RING_FLUSH_AGE_MS - age;
+}
+
+/*
+ * drain_threaded() - Drain the rings into data point uploads until stopped
+ *
+ * @unused:	Unused parameter.
+ *
+ * While samples keep arriving the rings are drained every
+ * RING_DRAIN_PERIOD_MS without the applications having to wake this thread.
+ * Only when every ring is empty, the thread sleeps until an application
+ * writes the eventfd of its ring.
+ *
+ * Return: NULL.
+ */
+static void *drain_threaded(void *unused)
+{
+	ring_upload_t upload = { 0 };
+	uint64_t last_check = get_clock_ms(CLOCK_MONOTONIC);
+
+	UNUSED_ARGUMENT(unused);
+
+	for (;;) {
+		struct epoll_event events[RING_EPOLL_EVENTS];
+		uint64_t now = get_clock_ms(CLOCK_MONOTONIC);
+		bool check_pid = now - last_check >= RING_IDLE_TICK_MS;
+		bool more = false, idle = false;
+		int timeout, i, n_events;
+
+		if (check_pid)
+			last_check = now;
+
+		pthread_mutex_lock(&service.lock);
+		if (service.stop) {
+			drain_on_stop(&upload);
+			pthread_mutex_unlock(&service.lock);
+			break;
+		}
+		/* Leave the samples in the rings while the sender cannot keep up */
+		if (upload.n_points < RING_MAX_POINTS)
+			more = drain_rings(&upload, check_pid);
+		hand_upload(&upload, false);
+		if (!more && upload.n_points < RING_MAX_POINTS)
+			idle = sleep_rings();
+		pthread_mutex_unlock(&service.lock);
+
+		if (more)
+			continue;
+
+		timeout = idle ? get_wait_time(&upload) : RING_DRAIN_PERIOD_MS;
+		n_events = epoll_wait(service.epoll_fd, events, RING_EPOLL_EVENTS, timeout);
+		for (i = 0; i < n_events; i++) {
+			uint64_t count;
+
+			if (read(*(int *) events[i].data.ptr, &count, sizeof(count)) < 0 && errno != EAGAIN)
+				log_debug("Cannot read data point ring event: %s", strerror(errno));
+		}
+	}
+
+	if (upload.collection != NULL) {
+		log_warning("Discarding %u samples of data point rings", upload.n_points);
+		ccapi_dp_destroy_collection(upload.collection);
+	}
+	free_ring_copy(upload.copy);
+
+	return NULL;
+}
+
+/*
+ * send_threaded() - Send the uploads handed by the drain thread until stopped
+ *
+ * @unused:	Unused parameter.
+ *
+ * The samples of a failed upload are stored in the data spool, if enabled.
+ *
+ * Return: NULL.
+ */
+static void *send_threaded(void *unused)
+{
+	UNUSED_ARGUMENT(unused);
+
+	pthread_mutex_lock(&service.lock);
+	for (;;) {
+		ccapi_dp_collection_handle_t collection;
+		ring_copy_t *copy;
+		ccapi_dp_error_t dp_error;
+
+		while (service.sending == NULL && !service.stop_sender)
+			pthread_cond_wait(&service.send_cond, &service.lock);
+		if (service.sending == NULL)
+			break;
+
+		collection = service.sending;
+		copy = service.sending_copy;
+		service.sending = NULL;
+		service.sending_copy = NULL;
+		service.busy = true;
+		pthread_mutex_unlock(&service.lock);
+
+		log_debug("%s", "Sending data point rings samples");
+		dp_error = ccapi_dp_send_collection_with_reply(CCAPI_TRANSPORT_TCP, collection,
+				RING_SEND_TIMEOUT, NULL);
+		if (dp_error != CCAPI_DP_ERROR_NONE) {
+			log_error("Cannot upload data point rings samples, error %d", dp_error);
+			if (copy != NULL)
+				spool_ring_copy(copy);
+		}
+		ccapi_dp_destroy_collection(collection);
+		free_ring_copy(copy);
+
+		pthread_mutex_lock(&service.lock);
+		service.busy = false;
+		pthread_cond_signal(&service.idle_cond);
+	}
+	pthread_mutex_unlock(&service.lock);
+
+	return NULL;
+}
+
+/*
+ * get_slots() - Get the number of slots of a new ring
+ *
+ * @requested:	Number of slots requested by the application.
+ *
+ * Return: The requested number of slots rounded up to a power of two,
+ *         between DP_RING_MIN_SLOTS and DP_RING_MAX_SLOTS.
+ */
+static uint32_t get_slots(uint32_t requested)
+{
+	uint32_t n_slots = DP_RING_MIN_SLOTS;
+
+	while (n_slots < requested && n_slots < DP_RING_MAX_SLOTS)
+		n_slots <<= 1;
+
+	return n_slots;
+}
+
+/*
+ * count_streams() - Validate the data stream names of a ring
+ *
+ * @names:	Names of the data streams, separated by new lines.
+ * @error:	Message for the client if the names are not valid.
+ *
+ * Return: Number of data streams, 0 if the names are not valid.
+ */
+static uint32_t count_streams(const char *names, const char **error)
+{
+	uint32_t n_streams = 0;
+	const char *name = names;
+
+	while (*name != '\0') {
+		size_t length = strcspn(name, "\n");
+
+		if (length == 0 || length > RING_STREAM_NAME_MAX) {
+			*error = "Invalid data stream name";
+			return 0;
+		}
+		if (++n_streams > DP_RING_MAX_STREAMS) {
+			*error = "Too many data streams";
+			return 0;
+		}
+		name += length;
+		if (*name == '\n')
+			name++;
+	}
+
+	if (n_streams == 0)
+		*error = "No data streams";
+
+	return n_streams;
+}
+
+/*
+ * parse_datapoint_ring_open() - Check the values received to open a ring
+ *
+ * @request:	Values received so far.
+ * @error:		Message for the client if the values are not valid.
+ *
+ * A ring is opened with the number of slots followed by the names of its
+ * data streams, separated by new lines.
+ *
+ * Return: The status of the received values.
+ */
+request_status_t parse_datapoint_ring_open(const request_values_t *request, const char **error)
+{
+	const service_value_t *value = &request->values[request->n_values - 1];
+
+	if (request->n_values == 1) {
+		if (value->type != DT_INTEGER) {
+			*error = "Failed to read number of slots";
+			return REQUEST_INVALID;
+		}
+		return REQUEST_INCOMPLETE;
+	}
+
+	if (value->type == DT_INTEGER) {
+		*error = "Failed to read data streams";
+		return REQUEST_INVALID;
+	}
+
+	return REQUEST_COMPLETE;
+}
+
+/*
+ * open_pidfd() - Get a process file descriptor of the peer of a connection
+ *
+ * @client:	The client connection.
+ * @pid:	Process ID of the peer, from its credentials.
+ *
+ * The peer is waiting for the response, so its PID has not been reused yet:
+ * this is checked once the process file descriptor is open, in case the
+ * peer gave up meanwhile.
+ *
+ * Return: The process file descriptor, -1 on error.
+ */
+static int open_pidfd(const service_client_t *client, pid_t pid)
+{
+	struct pollfd pfd = {
+		.fd = client->fd,
+		.events = POLLRDHUP
+	};
+	long pid_fd = syscall(SYS_pidfd_open, pid, 0);
+
+	if (pid_fd < 0) {
+		log_error("Cannot watch process %d: %s", (int) pid, strerror(errno));
+		return -1;
+	}
+	if (fcntl((int) pid_fd, F_SETFD, FD_CLOEXEC) != 0 || poll(&pfd, 1, 0) != 0) {
+		close((int) pid_fd);
+		return -1;
+	}
+
+	return (int) pid_fd;
+}
+
+/*
+ * handle_datapoint_ring_open() - Open a data point ring for a local application
+ *
+ * @client:		Client to write the response to.
+ * @request:	Number of slots and data streams, already validated.
+ *
+ * The response is the number of slots of the ring along with its shared
+ * memory and eventfd, so it is only possible over the Unix domain socket.
+ * The ring lives until the application closes it or finishes, which is
+ * watched with a process file descriptor (Linux 5.3 or newer).
+ *
+ * Return: 1 if the client may send more requests, -1 on error.
+ */
+int handle_datapoint_ring_open(service_client_t *client, const request_values_t *request)
+{
+	char *names = request->values[1].data;
+	const char *error = NULL;
+	struct epoll_event event = {
+		.events = EPOLLIN
+	};
+	service_value_t response;
+	struct ucred cred;
+	socklen_t length;
+	int domain = AF_UNSPEC, fds[2];
+	uint32_t n_slots, n_streams;
+	ring_t *ring;
+
+	length = sizeof(domain);
+	if (getsockopt(client->fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) != 0 || domain != AF_UNIX) {
+		send_response_error(client, "Data point rings require the Unix domain socket");
+		return -1;
+	}
+	length = sizeof(cred);
+	if (getsockopt(client->fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+		send_response_error(client, "Cannot get client credentials");
+		return -1;
+	}
+
+	n_streams = count_streams(names, &error);
+	if (n_streams == 0) {
+		send_response_error(client, error);
+		return -1;
+	}
+	n_slots = get_slots(request->values[0].integer);
+
+	/* Reserve the ring so concurrent requests do not exceed the limit */
+	pthread_mutex_lock(&service.lock);
+	if (!service.running || service.n_rings >= service.max_rings) {
+		pthread_mutex_unlock(&service.lock);
+		send_response_error(client, service.max_rings == 0 ?
+				"Data point rings are disabled" : "Too many data point rings");
+		return -1;
+	}
+	service.n_rings++;
+	pthread_mutex_unlock(&service.lock);
+
+	ring = create_ring(n_slots, n_streams);
+	if (ring == NULL) {
+		send_response_error(client, "Cannot create data point ring");
+		return -1;
+	}
+	ring->pid = cred.pid;
+	ring->pid_fd = open_pidfd(client, cred.pid);
+
+	pthread_mutex_lock(&service.lock);
+	event.data.ptr = &ring->wake_fd;
+	if (ring->pid_fd < 0 || add_ring_streams(ring, names) != 0
+		|| epoll_ctl(service.epoll_fd, EPOLL_CTL_ADD, ring->wake_fd, &event) != 0) {
+		free_ring(ring);
+		pthread_mutex_unlock(&service.lock);
+		send_response_error(client, "Cannot create data point ring");
+		return -1;
+	}
+	ring->next = service.rings;
+	service.rings = ring;
+
+	/* The drain thread owns the ring from now on, these copies are only passed */
+	fds[0] = ring->mem_fd;
+	fds[1] = ring->wake_fd;
+	response.type = DT_INTEGER;
+	response.integer = n_slots;
+	if (send_response_fds(client, &response, 1, fds, ARRAY_SIZE(fds)) != 0) {
+		/* Released by the drain thread */
+		ring->header->closed = 1;
+		pthread_mutex_unlock(&service.lock);
+		return -1;
+	}
+	pthread_mutex_unlock(&service.lock);
+
+	log_debug("Opened data point ring of %u slots and %u streams for process %d",
+		n_slots, n_streams, (int) cred.pid);
+
+	return 1;
+}
+
+/*
+ * start_datapoint_rings() - Start draining the data point rings of local applications
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) holding the maximum
+ *			number of rings.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int start_datapoint_rings(const cc_cfg_t *const cc_cfg)
+{
+	struct epoll_event event = {
+		.events = EPOLLIN
+	};
+
+	service.max_rings = cc_cfg->local_max_rings;
+	service.stop = false;
+	service.stop_sender = false;
+	if (service.max_rings == 0)
+		return 0;
+
+	service.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	service.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	event.data.ptr = &service.wake_fd;
+	if (service.epoll_fd < 0 || service.wake_fd < 0
+		|| epoll_ctl(service.epoll_fd, EPOLL_CTL_ADD, service.wake_fd, &event) != 0) {
+		log_error("Unable to start data point rings: %s", strerror(errno));
+		goto error;
+	}
+
+	if (pthread_create(&service.send_thread, NULL, send_threaded, NULL) != 0) {
+		log_error("%s", "Unable to start data point rings sender");
+		goto error;
+	}
+	if (pthread_create(&service.drain_thread, NULL, drain_threaded, NULL) != 0) {
+		log_error("%s", "Unable to start data point rings drain");
+		pthread_mutex_lock(&service.lock);
+		service.stop_sender = true;
+		pthread_cond_signal(&service.send_cond);
+		pthread_mutex_unlock(&service.lock);
+		pthread_join(service.send_thread, NULL);
+		goto error;
+	}
+	service.running = true;
+
+	return 0;
+
+error:
+	if (service.wake_fd >= 0)
+		close(service.wake_fd);
+	service.wake_fd = -1;
+	if (service.epoll_fd >= 0)
+		close(service.epoll_fd);
+	service.epoll_fd = -1;
+
+	return -1;
+}
+
+/*
+ * stop_datapoint_rings() - Upload the pending samples and release the rings
+ */
+void stop_datapoint_rings(void)
+{
+	uint64_t wake = 1;
+
+	if (!service.running)
+		return;
+
+	pthread_mutex_lock(&service.lock);
+	service.stop = true;
+	pthread_mutex_unlock(&service.lock);
+
+	if (write(service.wake_fd, &wake, sizeof(wake)) < 0)
+		log_warning("Cannot stop data point rings: %s", strerror(errno));
+	pthread_join(service.drain_thread, NULL);
+
+	/* The sender uploads the samples handed by the drain thread on stop */
+	pthread_mutex_lock(&service.lock);
+	service.stop_sender = true;
+	pthread_cond_signal(&service.send_cond);
+	pthread_mutex_unlock(&service.lock);
+	pthread_join(service.send_thread, NULL);
+
+	pthread_mutex_lock(&service.lock);
+	service.running = false;
+	while (service.rings != NULL) {
+		ring_t *ring = service.rings;
+
+		service.rings = ring->next;
+		free_ring(ring);
+	}
+	prune_streams();
+	pthread_mutex_unlock(&service.lock);
+
+	close(service.wake_fd);
+	service.wake_fd = -1;
+	close(service.epoll_fd);
+	service.epoll_fd = -1;
+}
@@ -17,19 +17,183 @@
  * ===========================================================================
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "ccapi/ccapi.h"
+#include "cc_init.h"
 #include "cc_logging.h"
+#include "cc_spool.h"
+#include "file_utils.h"
 #include "service_dp_upload.h"
+#include "services.h"
 #include "services_util.h"
 
+#define COALESCE_INITIAL_RECORDS	8
+
+/*
+ * Receipts of asynchronous uploads remembered to answer status queries, new
+ * asynchronous uploads are refused while all of them are pending
+ */
+#define RECEIPTS_MAX				1024
+
+/* Milliseconds between checks of the receipts waited by status queries */
+#define RECEIPTS_POLL_MS			200
+
+/* Fields of a data point CSV line, a line starting with any of them is a header */
+static const char *const csv_fields[] = {
+	"DATA", "TIMESTAMP", "QUALITY", "DESCRIPTION", "LOCATION", "DATATYPE",
+	"UNITS", "FORWARDTO", "STREAMID"
+};
+
+/**
+ * upload_stream_t - Chunked upload being received from a local application
+ *
+ * @type:	Record type of the chunks (metrics or events chunk).
+ * @fd:		Staging file, already removed from the staging directory.
+ * @size:	Number of bytes staged.
+ * @failed:	Whether a chunk failed, the rest are rejected until the empty
+ *			one so a partial upload is never sent.
+ */
+typedef struct {
+	uint32_t type;
+	int fd;
+	size_t size;
+	bool failed;
+} upload_stream_t;
+
+/**
+ * enum upload_status_t - Delivery status of an asynchronous upload
+ *
+ * @upload_status_unknown:		The receipt was never issued or it is too old
+ * @upload_status_spooled:		Stored in the data spool, waiting to be uploaded
+ * @upload_status_uploaded:		Uploaded from the data spool
+ * @upload_status_discarded:	Discarded by the data spool without uploading it,
+ *								because Remote Manager rejected it, it was
+ *								corrupted or the spool was full
+ */
 typedef enum {
-	upload_datapoint_file_terminate,
-	upload_datapoint_file_metrics,
-	upload_datapoint_file_events,
-	upload_datapoint_file_count
-} upload_datapoint_file_t;
+	upload_status_unknown,
+	upload_status_spooled,
+	upload_status_uploaded,
+	upload_status_discarded
+} upload_status_t;
+
+/**
+ * upload_receipt_t - Delivery status of an asynchronous upload
+ *
+ * @id:			Receipt ID returned to the client.
+ * @position:	Position of the upload in the data spool.
+ * @status:		Last known delivery status of the upload.
+ */
+typedef struct {
+	uint32_t id;
+	spool_position_t position;
+	upload_status_t status;
+} upload_receipt_t;
+
+/**
+ * status_watcher_t - Client waiting for an asynchronous upload to leave the spool
+ *
+ * @client:		The waiting client.
+ * @receipt:	Receipt ID of the upload.
+ * @deadline:	Time (CLOCK_REALTIME) to answer even if it is still spooled.
+ * @status:		Status to answer, set when the watcher is removed.
+ * @next:		Next watcher.
+ */
+typedef struct status_watcher {
+	service_client_t *client;
+	uint32_t receipt;
+	struct timespec deadline;
+	upload_status_t status;
+	struct status_watcher *next;
+} status_watcher_t;
+
+/**
+ * batch_record_t - Data points of a client merged in a batch
+ *
+ * @client:		Client waiting for the upload.
+ * @offset:		Position of the data points in the data of the batch.
+ * @length:		Number of bytes of the data points, new line included.
+ */
+typedef struct {
+	service_client_t *client;
+	size_t offset;
+	size_t length;
+} batch_record_t;
+
+/**
+ * upload_batch_t - Data point records of several clients merged in one upload
+ *
+ * @data:		Merged CSV records, one or more lines each.
+ * @length:		Number of bytes in 'data'.
+ * @records:	Records merged in 'data'.
+ * @n_records:	Number of merged records.
+ * @capacity:	Capacity of 'records'.
+ */
+typedef struct {
+	char *data;
+	size_t length;
+	batch_record_t *records;
+	unsigned int n_records;
+	unsigned int capacity;
+} upload_batch_t;
+
+/**
+ * coalescer_t - Stage merging the data point uploads of the local applications
+ *
+ * @lock:		Lock of the coalescer.
+ * @cond:		Signals the flush thread about new records or stopping.
+ * @room_cond:	Signals the clients waiting for an empty batch.
+ * @thread:		Thread uploading the merged batches.
+ * @running:	Whether the flush thread accepts records.
+ * @stop:		Whether the flush thread must finish once the batch is empty.
+ * @flush_now:	Whether the pending batch is full.
+ * @batches:	The batch being filled and the batch being uploaded.
+ * @pending:	The batch being filled.
+ * @deadline:	Time (CLOCK_REALTIME) to upload the pending batch.
+ * @window:		Milliseconds since the first record to upload a batch.
+ * @max_size:	Maximum size of a batch.
+ * @receipts:	Receipts of the last asynchronous uploads.
+ * @last_receipt:	Last issued receipt ID.
+ * @watchers:	Clients waiting for an asynchronous upload to leave the spool.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t room_cond;
+	pthread_t thread;
+	bool running;
+	bool stop;
+	bool flush_now;
+	upload_batch_t batches[2];
+	upload_batch_t *pending;
+	struct timespec deadline;
+	uint32_t window;
+	size_t max_size;
+	upload_receipt_t receipts[RECEIPTS_MAX];
+	uint32_t last_receipt;
+	status_watcher_t *watchers;
+} coalescer_t;
+
+static char *staging_path;
+static size_t max_upload_size = SIZE_MAX;
+static coalescer_t coalescer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.room_cond = PTHREAD_COND_INITIALIZER,
+	.pending = &coalescer.batches[0]
+};
 
 static ccapi_send_error_t upload_datapoint_file(char const * const buff, ccapi_string_info_t * const hint_string_info, size_t size, char const cloud_path[])
 {
@@ -49,78 +213,1094 @@ static ccapi_send_error_t upload_datapoint_file(char const * const buff, ccapi_s
 #undef TIMEOUT
 }
 
-int handle_datapoint_file_upload(int fd)
-{
-	while(1) {
-		ccapi_send_error_t ret;
-		uint32_t type;
-		size_t size;
-		void * blob;
-		struct timeval timeout = {
-			.tv_sec = SOCKET_READ_TIMEOUT_SEC,
-			.tv_usec = 0
-		};
-		char hint[256];
-		ccapi_string_info_t hint_string_info;
-
-		hint[0] = '\0';
-		hint_string_info.length = sizeof hint;
-		hint_string_info.string = hint;
-
-		/* Read the record type from the client message */
-		if (read_uint32(fd, &type, &timeout)) {
-			send_error(fd, "Failed to read data type");
-			return 1;
+/*
+ * upload_datapoint_stream() - Upload a staged chunked upload
+ *
+ * @stream:				The staged upload.
+ * @hint_string_info:	Hint of the error, if any.
+ * @cloud_path:			Remote Manager path to upload to.
+ *
+ * The staging file is sent through its '/proc/self/fd' link: CCAPI reads it
+ * piece by piece with the file system callbacks, so it is never loaded
+ * completely in memory.
+ *
+ * Return: The result of the upload.
+ */
+static ccapi_send_error_t upload_datapoint_stream(const upload_stream_t *stream,
+		ccapi_string_info_t * const hint_string_info, char const cloud_path[])
+{
+#define TIMEOUT 60
+	ccapi_send_error_t send_error;
+	char const file_type[] = "text/plain";
+	char local_path[32];
+
+	snprintf(local_path, sizeof(local_path), "/proc/self/fd/%d", stream->fd);
+	send_error = ccapi_send_file_with_reply(CCAPI_TRANSPORT_TCP,
+											local_path, cloud_path, file_type,
+											CCAPI_SEND_BEHAVIOR_OVERWRITE,
+											TIMEOUT,
+											hint_string_info);
+	if (send_error != CCAPI_SEND_ERROR_NONE)
+		log_error("Send error: %d Hint: %s", send_error, hint_string_info->string);
+
+	return send_error;
+#undef TIMEOUT
+}
+
+/*
+ * is_send_error_transient() - Check if an upload may succeed later
+ *
+ * @error:	Error of the upload.
+ *
+ * Return: True if the upload failed due to the connection, false otherwise.
+ */
+static bool is_send_error_transient(ccapi_send_error_t error)
+{
+	switch (error) {
+		case CCAPI_SEND_ERROR_CCAPI_NOT_RUNNING:
+		case CCAPI_SEND_ERROR_TRANSPORT_NOT_STARTED:
+		case CCAPI_SEND_ERROR_INITIATE_ACTION_FAILED:
+		case CCAPI_SEND_ERROR_STATUS_CANCEL:
+		case CCAPI_SEND_ERROR_STATUS_TIMEOUT:
+		case CCAPI_SEND_ERROR_STATUS_SESSION_ERROR:
+		case CCAPI_SEND_ERROR_RESPONSE_UNAVAILABLE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * get_cloud_path() - Get the Remote Manager path of a record type
+ *
+ * @type:	Record type of the upload.
+ *
+ * Return: The path to upload the record to.
+ */
+static char *get_cloud_path(uint32_t type)
+{
+	switch (type) {
+		case upload_datapoint_file_events:
+		case upload_datapoint_file_events_chunk:
+			return "DeviceLog/EventLog.json";
+		case upload_datapoint_file_metrics:
+		case upload_datapoint_file_metrics_chunk:
+		case upload_datapoint_file_metrics_async:
+		default:
+			return "DataPoint/.csv";
+	}
+}
+
+/*
+ * free_upload_stream() - Discard a chunked upload
+ *
+ * @context:	The upload_stream_t to release.
+ */
+static void free_upload_stream(void *context)
+{
+	upload_stream_t *stream = context;
+
+	if (stream == NULL)
+		return;
+
+	if (stream->fd >= 0 && close(stream->fd) < 0)
+		log_warning("Could not close staged upload: %s", strerror(errno));
+	free(stream);
+}
+
+/*
+ * discard_upload_stream() - Discard the chunked upload of a client
+ *
+ * @client:	The client.
+ */
+static void discard_upload_stream(service_client_t *client)
+{
+	free_upload_stream(client->context);
+	client->context = NULL;
+	client->free_context = NULL;
+}
+
+/*
+ * fail_upload_stream() - Reject the rest of the chunked upload of a client
+ *
+ * @client:	The client.
+ * @type:	Record type of the failed chunk.
+ *
+ * The staged chunks are discarded, but the upload is kept, marked as
+ * failed, until the client sends the empty chunk that completes it.
+ */
+static void fail_upload_stream(service_client_t *client, uint32_t type)
+{
+	upload_stream_t *stream = client->context;
+
+	if (stream == NULL) {
+		stream = calloc(1, sizeof(*stream));
+		if (stream == NULL) {
+			log_error("Cannot reject chunked upload: %s", "Out of memory");
+			return;
 		}
+		stream->type = type;
+		stream->fd = -1;
+		client->context = stream;
+		client->free_context = free_upload_stream;
+	}
 
-		if (type == upload_datapoint_file_terminate)
-			break;
+	if (stream->fd >= 0 && close(stream->fd) < 0)
+		log_warning("Could not close staged upload: %s", strerror(errno));
+	stream->fd = -1;
+	stream->size = 0;
+	stream->failed = true;
+}
 
-		if (type != upload_datapoint_file_metrics && type != upload_datapoint_file_events) {
-			send_error(fd, "Invalid datapoint type");
-			return 1;
+/*
+ * open_upload_stream() - Start a chunked upload
+ *
+ * @type:	Record type of the chunks.
+ *
+ * The staging file is removed right after creating it, so it does not
+ * outlive the upload even if the process is killed.
+ *
+ * Return: The new upload, NULL on error.
+ */
+static upload_stream_t *open_upload_stream(uint32_t type)
+{
+	upload_stream_t *stream = NULL;
+	char *path = NULL;
+
+	if (asprintf(&path, "%s/cc_upload_XXXXXX", staging_path != NULL ? staging_path : "/tmp") < 0) {
+		path = NULL;
+		goto error;
+	}
+
+	stream = calloc(1, sizeof(*stream));
+	if (stream == NULL)
+		goto error;
+
+	stream->type = type;
+	stream->fd = mkostemp(path, O_CLOEXEC);
+	if (stream->fd < 0) {
+		log_error("Cannot stage upload in '%s': %s", path, strerror(errno));
+		goto error;
+	}
+	unlink(path);
+	free(path);
+
+	return stream;
+
+error:
+	free(path);
+	free(stream);
+
+	return NULL;
+}
+
+/*
+ * append_upload_stream() - Stage a chunk of a chunked upload
+ *
+ * @stream:	The upload.
+ * @chunk:	The chunk.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int append_upload_stream(upload_stream_t *stream, const service_value_t *chunk)
+{
+	const char *data = chunk->data;
+	size_t remaining = chunk->length;
+
+	while (remaining > 0) {
+		ssize_t written = write(stream->fd, data, remaining);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("Cannot stage upload: %s", strerror(errno));
+			return -1;
 		}
+		data += written;
+		remaining -= written;
+	}
+	stream->size += chunk->length;
 
-		/* Read the datapoint(s) blob of data from the client process */
-		if (read_blob(fd, &blob, &size, &timeout)) {
-			send_error(fd, "Failed to read datapoint data");
-			return 1;
+	return 0;
+}
+
+/*
+ * upload_or_spool() - Upload data points, or store them while disconnected
+ *
+ * @data:				Data to upload.
+ * @length:				Number of bytes of 'data'.
+ * @cloud_path:			Remote Manager path to upload to.
+ * @spool_type:			Type of the record if it is stored in the data spool.
+ * @hint_string_info:	Hint of the error, if any.
+ * @spooled:			Whether the data was stored in the data spool.
+ *
+ * Return: The result of the upload, CCAPI_SEND_ERROR_NONE if it was spooled.
+ */
+static ccapi_send_error_t upload_or_spool(const char *data, size_t length, char const cloud_path[],
+		spool_record_type_t spool_type, ccapi_string_info_t * const hint_string_info, bool *spooled)
+{
+	ccapi_send_error_t ret;
+
+	if (get_cloud_connection_status() == CC_STATUS_CONNECTED || !is_spool_enabled())
+		ret = upload_datapoint_file(data, hint_string_info, length, cloud_path);
+	else
+		ret = CCAPI_SEND_ERROR_CCAPI_NOT_RUNNING;
+
+	if (is_send_error_transient(ret)
+		&& spool_data(spool_type, cloud_path, data, length) == SPOOL_ERROR_NONE) {
+		log_info("Upload to '%s' stored in the data spool", cloud_path);
+		ret = CCAPI_SEND_ERROR_NONE;
+		*spooled = true;
+	}
+
+	return ret;
+}
+
+/*
+ * send_upload_result() - Send the result of an upload to the client
+ *
+ * @client:	Client to write the response to.
+ * @ret:	Result of the upload.
+ * @hint:	Hint of the error, if any.
+ *
+ * Return: 1 if the upload succeeded, -1 otherwise.
+ */
+static int send_upload_result(service_client_t *client, ccapi_send_error_t ret, const char *hint)
+{
+	if (ret) {
+		char const * const err_msg = to_send_error_msg(ret);
+		char * err_msg_with_hint = NULL;
+
+		if ((hint[0] != '\0') && (asprintf(&err_msg_with_hint, "%s, %s", err_msg, hint) > 0)) {
+			send_response_error(client, err_msg_with_hint);
+			free(err_msg_with_hint);
+		} else {
+			send_response_error(client, err_msg);
+		}
+
+		return -1;
+	}
+
+	send_response_ok(client);
+
+	return 1;
+}
+
+/*
+ * handle_datapoint_file_chunk() - Stage or complete a chunked upload
+ *
+ * @client:	Client to write the response to, it keeps the upload in progress.
+ * @type:	Record type of the chunk.
+ * @chunk:	The chunk, an empty one completes the upload.
+ *
+ * Once a chunk fails, the following ones are rejected and the empty chunk
+ * completes the upload with an error, so the chunks received after the
+ * failure are never uploaded on their own. A chunk that makes the upload
+ * exceed 'local_requests_max_upload_size' fails.
+ *
+ * Return: 1 if the client may send more uploads, -1 on error.
+ */
+static int handle_datapoint_file_chunk(service_client_t *client, uint32_t type, const service_value_t *chunk)
+{
+	upload_stream_t *stream = client->context;
+	ccapi_send_error_t ret;
+	char hint[256];
+	ccapi_string_info_t hint_string_info;
+
+	if (stream != NULL && stream->failed) {
+		if (chunk->length == 0) {
+			discard_upload_stream(client);
+			send_response_error(client, "Chunked upload failed");
+		} else {
+			send_response_error(client, "Chunked upload failed, waiting for its empty chunk");
+		}
+		return -1;
+	}
+
+	if (stream != NULL && stream->type != type) {
+		fail_upload_stream(client, type);
+		send_response_error(client, "Chunk type does not match the upload in progress");
+		return -1;
+	}
+
+	if (chunk->length > 0) {
+		if (chunk->length > max_upload_size - (stream != NULL ? stream->size : 0)) {
+			/* Closing the stage deletes it, it is already unlinked */
+			fail_upload_stream(client, type);
+			send_response_error(client, "Chunked upload exceeds the maximum size");
+			return -1;
+		}
+
+		if (stream == NULL) {
+			stream = open_upload_stream(type);
+			if (stream == NULL) {
+				fail_upload_stream(client, type);
+				send_response_error(client, "Cannot stage upload");
+				return -1;
+			}
+			client->context = stream;
+			client->free_context = free_upload_stream;
+		}
+
+		if (append_upload_stream(stream, chunk) != 0) {
+			fail_upload_stream(client, type);
+			send_response_error(client, "Cannot stage upload");
+			return -1;
 		}
 
-		char* cloud_path;
-		switch(type) {
-			case upload_datapoint_file_events:
-				cloud_path = "DeviceLog/EventLog.json";
+		send_response_ok(client);
+
+		return 1;
+	}
+
+	/* An empty chunk completes the upload */
+	if (stream == NULL) {
+		send_response_error(client, "No chunked upload in progress");
+		return -1;
+	}
+
+	hint[0] = '\0';
+	hint_string_info.length = sizeof hint;
+	hint_string_info.string = hint;
+
+	ret = upload_datapoint_stream(stream, &hint_string_info, get_cloud_path(type));
+	discard_upload_stream(client);
+
+	return send_upload_result(client, ret, hint);
+}
+
+/*
+ * add_ms() - Advance a time by a number of milliseconds
+ *
+ * @time:	The time to advance.
+ * @ms:		Milliseconds to add.
+ */
+static void add_ms(struct timespec *time, uint32_t ms)
+{
+	time->tv_sec += ms / 1000;
+	time->tv_nsec += (long) (ms % 1000) * 1000000L;
+	if (time->tv_nsec >= 1000000000L) {
+		time->tv_sec++;
+		time->tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * is_before() - Check if a time is earlier than another one
+ *
+ * @a:	First time.
+ * @b:	Second time.
+ *
+ * Return: True if 'a' is earlier than 'b', false otherwise.
+ */
+static bool is_before(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * get_next_receipt_id() - Get the ID of the next receipt to issue
+ *
+ * Return: The receipt ID, never 0.
+ */
+static uint32_t get_next_receipt_id(void)
+{
+	uint32_t id = coalescer.last_receipt + 1;
+
+	return id != 0 ? id : 1;
+}
+
+/*
+ * get_receipt_status() - Get the delivery status of an asynchronous upload
+ *
+ * @id:	Receipt ID.
+ *
+ * Must be called with the coalescer lock held.
+ *
+ * Return: The delivery status, upload_status_unknown if the receipt was never
+ *         issued or it is too old.
+ */
+static upload_status_t get_receipt_status(uint32_t id)
+{
+	upload_receipt_t *receipt = &coalescer.receipts[id % RECEIPTS_MAX];
+
+	if (id == 0 || receipt->id != id)
+		return upload_status_unknown;
+
+	if (receipt->status == upload_status_spooled) {
+		switch (get_spool_status(&receipt->position)) {
+			case SPOOL_STATUS_PENDING:
+				break;
+			case SPOOL_STATUS_UPLOADED:
+				receipt->status = upload_status_uploaded;
 				break;
-			case upload_datapoint_file_metrics:
-			default:
-				cloud_path = "DataPoint/.csv";
+			case SPOOL_STATUS_DISCARDED:
+				receipt->status = upload_status_discarded;
 				break;
 		}
+	}
+
+	return receipt->status;
+}
 
-		/* Upload the blob to the cloud */
-		ret = upload_datapoint_file(blob, &hint_string_info, size, cloud_path);
+/*
+ * has_receipt_room() - Check whether a new receipt can be issued
+ *
+ * Receipts are issued in order and the spool is replayed in order, so if the
+ * oldest receipt, the one to replace, is still pending, all of them are.
+ *
+ * Must be called with the coalescer lock held.
+ *
+ * Return: True if the receipt to replace is no longer pending, false otherwise.
+ */
+static bool has_receipt_room(void)
+{
+	uint32_t id = coalescer.receipts[get_next_receipt_id() % RECEIPTS_MAX].id;
 
-		free(blob);
+	return get_receipt_status(id) != upload_status_spooled;
+}
 
-		if (ret) {
-			char const * const err_msg = to_send_error_msg(ret);
-			char * err_msg_with_hint = NULL;
+/*
+ * new_receipt() - Issue the receipt of an asynchronous upload
+ *
+ * @position:	Position of the upload in the data spool.
+ *
+ * Must be called with the coalescer lock held, after checking there is room
+ * with has_receipt_room().
+ *
+ * Return: The receipt ID, never 0.
+ */
+static uint32_t new_receipt(const spool_position_t *position)
+{
+	upload_receipt_t *receipt;
 
-			if ((hint[0] != '\0') && (asprintf(&err_msg_with_hint, "%s, %s", err_msg, hint) > 0)) {
-				send_error(fd, err_msg_with_hint);
-				free(err_msg_with_hint);
-			} else {
-				send_error(fd, err_msg);
-			}
-		} else {
-			send_ok(fd);
+	coalescer.last_receipt = get_next_receipt_id();
+
+	receipt = &coalescer.receipts[coalescer.last_receipt % RECEIPTS_MAX];
+	receipt->id = coalescer.last_receipt;
+	receipt->position = *position;
+	receipt->status = upload_status_spooled;
+
+	return receipt->id;
+}
+
+/*
+ * add_batch_record() - Append the data points of a client to a batch
+ *
+ * @batch:		The batch, it must have room for the record and a new line.
+ * @client:		Client waiting for the result.
+ * @blob:		CSV data points of the client.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int add_batch_record(upload_batch_t *batch, service_client_t *client, const service_value_t *blob)
+{
+	batch_record_t *record;
+
+	if (batch->n_records == batch->capacity) {
+		unsigned int capacity = batch->capacity > 0 ? 2 * batch->capacity : COALESCE_INITIAL_RECORDS;
+		batch_record_t *records = realloc(batch->records, capacity * sizeof(*records));
+
+		if (records == NULL)
+			return -1;
+		batch->records = records;
+		batch->capacity = capacity;
+	}
+
+	record = &batch->records[batch->n_records++];
+	record->client = client;
+	record->offset = batch->length;
+	memcpy(batch->data + batch->length, blob->data, blob->length);
+	batch->length += blob->length;
+	if (blob->length > 0 && blob->data[blob->length - 1] != '\n')
+		batch->data[batch->length++] = '\n';
+	record->length = batch->length - record->offset;
+
+	return 0;
+}
+
+/*
+ * flush_batch() - Upload a batch and report its result to every record
+ *
+ * @batch:	The batch, empty once it is uploaded.
+ *
+ * Every waiting client gets the result of the upload. If Remote Manager
+ * rejects the batch, its records are uploaded one by one so only the clients
+ * whose data points are wrong get the error.
+ */
+static void flush_batch(upload_batch_t *batch)
+{
+	char const *cloud_path = get_cloud_path(upload_datapoint_file_metrics);
+	ccapi_send_error_t ret;
+	char hint[256];
+	ccapi_string_info_t hint_string_info;
+	bool spooled = false, one_by_one;
+	unsigned int i;
+
+	hint[0] = '\0';
+	hint_string_info.length = sizeof hint;
+	hint_string_info.string = hint;
+
+	log_debug("Uploading %zu bytes of %u merged data point uploads", batch->length, batch->n_records);
+	ret = upload_or_spool(batch->data, batch->length, cloud_path, SPOOL_RECORD_DP_CSV,
+			&hint_string_info, &spooled);
+
+	one_by_one = ret != CCAPI_SEND_ERROR_NONE && !is_send_error_transient(ret) && batch->n_records > 1;
+	if (one_by_one)
+		log_info("Merged data point upload rejected, uploading its %u records one by one", batch->n_records);
+
+	for (i = 0; i < batch->n_records; i++) {
+		const batch_record_t *record = &batch->records[i];
+
+		if (one_by_one) {
+			hint[0] = '\0';
+			ret = upload_or_spool(batch->data + record->offset, record->length, cloud_path,
+					SPOOL_RECORD_DP_CSV, &hint_string_info, &spooled);
+		}
+		complete_local_request(record->client, send_upload_result(record->client, ret, hint));
+	}
+
+	batch->length = 0;
+	batch->n_records = 0;
+}
+
+/*
+ * send_receipt_status() - Send the delivery status of an asynchronous upload
+ *
+ * @client:		Client to write the response to.
+ * @status:		Delivery status of the upload.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int send_receipt_status(service_client_t *client, upload_status_t status)
+{
+	service_value_t value = { .type = DT_INTEGER, .integer = status };
+
+	return send_response_values(client, &value, 1);
+}
+
+/*
+ * take_watchers() - Remove the watchers that must be answered
+ *
+ * @now:	Current time (CLOCK_REALTIME), NULL to take all the watchers.
+ *
+ * Watchers are answered once the upload of their receipt left the data
+ * spool or their deadline expires. The status to report is stored in every
+ * returned watcher.
+ *
+ * Must be called with the coalescer lock held.
+ *
+ * Return: List of removed watchers.
+ */
+static status_watcher_t *take_watchers(const struct timespec *now)
+{
+	status_watcher_t *taken = NULL;
+	status_watcher_t **link = &coalescer.watchers;
+
+	while (*link != NULL) {
+		status_watcher_t *watcher = *link;
+
+		watcher->status = get_receipt_status(watcher->receipt);
+		if (now != NULL && watcher->status == upload_status_spooled
+			&& is_before(now, &watcher->deadline)) {
+			link = &watcher->next;
+			continue;
+		}
+
+		*link = watcher->next;
+		watcher->next = taken;
+		taken = watcher;
+	}
+
+	return taken;
+}
+
+/*
+ * notify_watchers() - Answer and release a list of watchers
+ *
+ * @watchers:	Watchers returned by take_watchers().
+ */
+static void notify_watchers(status_watcher_t *watchers)
+{
+	while (watchers != NULL) {
+		status_watcher_t *next = watchers->next;
+
+		send_receipt_status(watchers->client, watchers->status);
+		complete_local_request(watchers->client, 1);
+		free(watchers);
+		watchers = next;
+	}
+}
+
+/*
+ * get_wake_time() - Get the next time the flush thread has something to do
+ *
+ * @now:	Current time (CLOCK_REALTIME).
+ * @wake:	Where to store the time to wake up.
+ *
+ * The spool does not notify when it replays an upload, so the receipts of
+ * the watchers are checked every RECEIPTS_POLL_MS.
+ *
+ * Must be called with the coalescer lock held.
+ *
+ * Return: True if there is a time to wake up, false to wait for a signal.
+ */
+static bool get_wake_time(const struct timespec *now, struct timespec *wake)
+{
+	bool found = coalescer.pending->n_records > 0;
+
+	if (found)
+		*wake = coalescer.deadline;
+
+	if (coalescer.watchers != NULL) {
+		struct timespec poll_time = *now;
+
+		add_ms(&poll_time, RECEIPTS_POLL_MS);
+		if (!found || is_before(&poll_time, wake))
+			*wake = poll_time;
+		found = true;
+	}
+
+	return found;
+}
+
+/*
+ * coalesce_threaded() - Upload the merged data points and answer the status watchers
+ *
+ * @unused:	Unused.
+ *
+ * The pending batch is uploaded when its window finishes or it is full.
+ * When stopping, the pending batch is uploaded and every watcher answered.
+ *
+ * Return: NULL.
+ */
+static void *coalesce_threaded(void *unused)
+{
+	status_watcher_t *watchers;
+
+	UNUSED_ARGUMENT(unused);
+
+	pthread_mutex_lock(&coalescer.lock);
+	for (;;) {
+		upload_batch_t *batch = coalescer.pending;
+		struct timespec now, wake;
+
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		watchers = take_watchers(&now);
+		if (watchers != NULL) {
+			pthread_mutex_unlock(&coalescer.lock);
+			notify_watchers(watchers);
+			pthread_mutex_lock(&coalescer.lock);
+			continue;
+		}
+
+		if (batch->n_records > 0
+			&& (coalescer.stop || coalescer.flush_now || !is_before(&now, &coalescer.deadline))) {
+			/* Keep merging records in the other batch while this one is uploaded */
+			coalescer.pending = batch == &coalescer.batches[0] ? &coalescer.batches[1] : &coalescer.batches[0];
+			coalescer.flush_now = false;
+			pthread_cond_broadcast(&coalescer.room_cond);
+			pthread_mutex_unlock(&coalescer.lock);
+
+			flush_batch(batch);
+
+			pthread_mutex_lock(&coalescer.lock);
+			continue;
+		}
+
+		if (coalescer.stop)
+			break;
+
+		if (get_wake_time(&now, &wake))
+			pthread_cond_timedwait(&coalescer.cond, &coalescer.lock, &wake);
+		else
+			pthread_cond_wait(&coalescer.cond, &coalescer.lock);
+	}
+
+	watchers = take_watchers(NULL);
+	pthread_mutex_unlock(&coalescer.lock);
+	notify_watchers(watchers);
+
+	return NULL;
+}
+
+/*
+ * has_csv_header() - Check if CSV data points have a header line
+ *
+ * @blob:	CSV data points.
+ *
+ * A header line sets the order of the fields of the lines after it, so data
+ * points with a header cannot be merged with those of other clients.
+ *
+ * Return: True if any line starts with the name of a field, false otherwise.
+ */
+static bool has_csv_header(const service_value_t *blob)
+{
+	const char *line = blob->data;
+	const char *end = blob->data + blob->length;
+
+	while (line < end) {
+		const char *eol = memchr(line, '\n', end - line);
+		unsigned int i;
+
+		if (eol == NULL)
+			eol = end;
+		if (*line == '#')
+			line++;
+
+		for (i = 0; i < ARRAY_SIZE(csv_fields); i++) {
+			size_t len = strlen(csv_fields[i]);
+
+			if ((size_t) (eol - line) >= len && !strncasecmp(line, csv_fields[i], len)
+				&& (line + len == eol || line[len] == ',' || line[len] == '\r'))
+				return true;
+		}
+
+		line = eol + 1;
+	}
+
+	return false;
+}
+
+/*
+ * merge_datapoint_file() - Merge the data points of a client in the pending batch
+ *
+ * @client:	Client waiting for the upload.
+ * @blob:	CSV data points, smaller than the maximum size of a batch.
+ *
+ * A full batch makes the client wait until the flush thread takes it.
+ *
+ * Return: 0 if the data points were merged, -1 if they must be uploaded on
+ *         their own.
+ */
+static int merge_datapoint_file(service_client_t *client, const service_value_t *blob)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&coalescer.lock);
+	while (coalescer.running && coalescer.pending->length + blob->length + 1 > coalescer.max_size) {
+		coalescer.flush_now = true;
+		pthread_cond_signal(&coalescer.cond);
+		pthread_cond_wait(&coalescer.room_cond, &coalescer.lock);
+	}
+
+	if (coalescer.running && add_batch_record(coalescer.pending, client, blob) == 0) {
+		if (coalescer.pending->n_records == 1) {
+			clock_gettime(CLOCK_REALTIME, &coalescer.deadline);
+			add_ms(&coalescer.deadline, coalescer.window);
+			pthread_cond_signal(&coalescer.cond);
 		}
+		ret = 0;
+	}
+	pthread_mutex_unlock(&coalescer.lock);
+
+	return ret;
+}
+
+/*
+ * queue_datapoint_file() - Store the data points of an asynchronous upload
+ *
+ * @client:	Client to write the response to.
+ * @blob:	CSV data points.
+ *
+ * The upload is stored in the data spool, which uploads it as soon as it is
+ * connected, so it is not lost if Cloud Connector stops. The client gets the
+ * receipt ID of the upload once it is stored and flushed to disk, and may
+ * query its delivery status later with REQ_TAG_DP_STATUS_REQUEST.
+ *
+ * Return: 1 if the client may send more uploads, -1 on error.
+ */
+static int queue_datapoint_file(service_client_t *client, const service_value_t *blob)
+{
+	service_value_t value = { .type = DT_INTEGER };
+	spool_position_t position;
+	const char *error = NULL;
+
+	if (!is_spool_enabled()) {
+		send_response_error(client, "Asynchronous uploads require the data spool");
+		return -1;
+	}
+
+	/* Hold the lock so the room checked is still there after storing the upload */
+	pthread_mutex_lock(&coalescer.lock);
+	if (!has_receipt_room())
+		error = "Too many pending asynchronous uploads";
+	else if (spool_data_tracked(has_csv_header(blob) ? SPOOL_RECORD_FILE : SPOOL_RECORD_DP_CSV,
+			get_cloud_path(upload_datapoint_file_metrics_async), blob->data, blob->length,
+			&position) != SPOOL_ERROR_NONE)
+		error = "Cannot store upload";
+	else
+		value.integer = new_receipt(&position);
+	pthread_mutex_unlock(&coalescer.lock);
+
+	if (error != NULL) {
+		send_response_error(client, error);
+		return -1;
+	}
+
+	send_response_values(client, &value, 1);
+
+	return 1;
+}
+
+/*
+ * start_coalescer() - Start merging the data point uploads
+ *
+ * @window:		Milliseconds since the first record to upload a batch.
+ * @max_size:	Maximum size of a batch in bytes.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int start_coalescer(uint32_t window, size_t max_size)
+{
+	unsigned int i;
+
+	coalescer.window = window;
+	coalescer.max_size = max_size;
+	coalescer.stop = false;
+	coalescer.flush_now = false;
+	coalescer.pending = &coalescer.batches[0];
+
+	for (i = 0; i < ARRAY_SIZE(coalescer.batches); i++) {
+		coalescer.batches[i].data = malloc(max_size);
+		if (coalescer.batches[i].data == NULL)
+			return -1;
+	}
+
+	if (pthread_create(&coalescer.thread, NULL, coalesce_threaded, NULL) != 0) {
+		log_error("%s", "Unable to start merging local data point uploads");
+		return -1;
+	}
+	coalescer.running = true;
+
+	return 0;
+}
+
+/*
+ * stop_coalescer() - Upload the pending batch and stop merging data point uploads
+ */
+static void stop_coalescer(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&coalescer.lock);
+	if (coalescer.running) {
+		coalescer.running = false;
+		coalescer.stop = true;
+		pthread_cond_signal(&coalescer.cond);
+		pthread_cond_broadcast(&coalescer.room_cond);
+		pthread_mutex_unlock(&coalescer.lock);
+		pthread_join(coalescer.thread, NULL);
+	} else {
+		pthread_mutex_unlock(&coalescer.lock);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(coalescer.batches); i++) {
+		free(coalescer.batches[i].data);
+		free(coalescer.batches[i].records);
+		memset(&coalescer.batches[i], 0, sizeof(coalescer.batches[i]));
+	}
+}
+
+/*
+ * parse_datapoint_upload_status() - Check the values received for a status query
+ *
+ * @request:	Values received so far.
+ * @error:		Message for the client if the values are not valid.
+ *
+ * A status query is the receipt ID followed by the seconds to wait for the
+ * upload to leave the data spool, 0 to get the current status.
+ *
+ * Return: The status of the received values.
+ */
+request_status_t parse_datapoint_upload_status(const request_values_t *request, const char **error)
+{
+	const service_value_t *value = &request->values[request->n_values - 1];
+
+	if (value->type != DT_INTEGER) {
+		*error = request->n_values == 1 ? "Failed to read receipt" : "Failed to read wait time";
+		return REQUEST_INVALID;
+	}
+
+	return request->n_values < 2 ? REQUEST_INCOMPLETE : REQUEST_COMPLETE;
+}
+
+/*
+ * handle_datapoint_upload_status() - Report the delivery status of an asynchronous upload
+ *
+ * @client:		Client to write the response to.
+ * @request:	Receipt ID and seconds to wait, already validated.
+ *
+ * The response is the status (upload_status_t). While the upload is in the
+ * data spool, a client that asked to wait gets the response once it leaves
+ * the spool or the wait expires.
+ *
+ * Return: 1 if the client may send more queries, -1 on error,
+ *         REQUEST_RESPONSE_PENDING if the client is waiting.
+ */
+int handle_datapoint_upload_status(service_client_t *client, const request_values_t *request)
+{
+	uint32_t id = request->values[0].integer;
+	uint32_t wait = request->values[1].integer;
+	upload_status_t status;
+
+	if (wait > SOCKET_READ_TIMEOUT_SEC)
+		wait = SOCKET_READ_TIMEOUT_SEC;
 
-		if (ret != CCAPI_SEND_ERROR_NONE) {
-			return 1;
+	pthread_mutex_lock(&coalescer.lock);
+	status = get_receipt_status(id);
+	if (status == upload_status_spooled && wait > 0 && coalescer.running) {
+		status_watcher_t *watcher = calloc(1, sizeof(*watcher));
+
+		if (watcher != NULL) {
+			watcher->client = client;
+			watcher->receipt = id;
+			clock_gettime(CLOCK_REALTIME, &watcher->deadline);
+			add_ms(&watcher->deadline, wait * 1000);
+			watcher->next = coalescer.watchers;
+			coalescer.watchers = watcher;
+			pthread_cond_signal(&coalescer.cond);
+			pthread_mutex_unlock(&coalescer.lock);
+
+			return REQUEST_RESPONSE_PENDING;
 		}
 	}
+	pthread_mutex_unlock(&coalescer.lock);
+
+	return send_receipt_status(client, status) == 0 ? 1 : -1;
+}
+
+/*
+ * parse_datapoint_file_upload() - Check the values received for an upload
+ *
+ * @request:	Values received so far.
+ * @error:		Message for the client if the values are not valid.
+ *
+ * Every upload is the record type followed by the data points blob, the
+ * terminate type ends the connection. Chunk types carry a piece of an upload
+ * staged until an empty chunk completes it, so its size is not limited by
+ * the memory of the daemon. The asynchronous type is acknowledged with a
+ * receipt ID as soon as it is stored in the data spool.
+ *
+ * Return: The status of the received values.
+ */
+request_status_t parse_datapoint_file_upload(const request_values_t *request, const char **error)
+{
+	const service_value_t *type = &request->values[0];
+
+	if (type->type != DT_INTEGER) {
+		*error = "Failed to read data type";
+		return REQUEST_INVALID;
+	}
+
+	if (type->integer == upload_datapoint_file_terminate)
+		return REQUEST_COMPLETE;
+
+	if (type->integer >= upload_datapoint_file_count) {
+		*error = "Invalid datapoint type";
+		return REQUEST_INVALID;
+	}
+
+	if (request->n_values < 2)
+		return REQUEST_INCOMPLETE;
+
+	if (request->values[1].type != DT_BLOB) {
+		*error = "Failed to read datapoint data";
+		return REQUEST_INVALID;
+	}
+
+	return REQUEST_COMPLETE;
+}
+
+/*
+ * handle_datapoint_file_upload() - Upload the data points of a local application
+ *
+ * @client:		Client to write the response to.
+ * @request:	Values of the upload, already validated.
+ *
+ * Metrics uploads are merged with those of other clients while the coalesce
+ * window is enabled, unless they have a CSV header line. The response is sent
+ * once the merged upload completes.
+ * Asynchronous metrics uploads are stored in the data spool, the response is
+ * their receipt ID and it is sent as soon as they are stored.
+ *
+ * Return: 1 if the client may send more uploads, 0 if it terminated the
+ *         connection, -1 on error, REQUEST_RESPONSE_PENDING if the upload was
+ *         merged.
+ */
+int handle_datapoint_file_upload(service_client_t *client, const request_values_t *request)
+{
+	uint32_t type = request->values[0].integer;
+	const service_value_t *blob = &request->values[1];
+	ccapi_send_error_t ret;
+	char hint[256];
+	ccapi_string_info_t hint_string_info;
+	char *cloud_path;
+	bool spooled = false;
+
+	if (type == upload_datapoint_file_terminate)
+		return 0;
+
+	if (type == upload_datapoint_file_metrics_chunk || type == upload_datapoint_file_events_chunk)
+		return handle_datapoint_file_chunk(client, type, blob);
+
+	if (type == upload_datapoint_file_metrics_async)
+		return queue_datapoint_file(client, blob);
+
+	if (type == upload_datapoint_file_metrics && coalescer.window > 0 && blob->length < coalescer.max_size
+		&& !has_csv_header(blob) && merge_datapoint_file(client, blob) == 0)
+		return REQUEST_RESPONSE_PENDING;
+
+	hint[0] = '\0';
+	hint_string_info.length = sizeof hint;
+	hint_string_info.string = hint;
+
+	cloud_path = get_cloud_path(type);
+
+	/* Upload the blob to the cloud, or store it while disconnected */
+	ret = upload_or_spool(blob->data, blob->length, cloud_path, SPOOL_RECORD_FILE, &hint_string_info, &spooled);
+
+	return send_upload_result(client, ret, hint);
+}
+
+/*
+ * start_datapoint_file_upload() - Configure the uploads of local applications
+ *
+ * @cc_cfg:	Connector configuration struct (cc_cfg_t) holding the staging
+ *			directory, the maximum upload size and the coalesce settings.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int start_datapoint_file_upload(const cc_cfg_t *const cc_cfg)
+{
+	free(staging_path);
+	staging_path = strdup(cc_cfg->local_staging_path != NULL ? cc_cfg->local_staging_path : "/tmp");
+	if (staging_path == NULL)
+		return -1;
+	if (mkpath(staging_path, S_IRWXU) != 0) {
+		log_error("Cannot create staging directory '%s': %s", staging_path, strerror(errno));
+		stop_datapoint_file_upload();
+		return -1;
+	}
+	max_upload_size = cc_cfg->local_max_upload > 0 ? (size_t) cc_cfg->local_max_upload * 1024 : SIZE_MAX;
+
+	/* Also needed with no coalesce window, to answer the status queries */
+	if (start_coalescer(cc_cfg->local_coalesce_window, (size_t) cc_cfg->local_coalesce_size * 1024) != 0) {
+		stop_datapoint_file_upload();
+		return -1;
+	}
 
 	return 0;
 }
+
+/*
+ * stop_datapoint_file_upload() - Upload the merged data points and release the configuration
+ */
+void stop_datapoint_file_upload(void)
+{
+	stop_coalescer();
+
+	free(staging_path);
+	staging_path = NULL;
+}
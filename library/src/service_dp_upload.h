@@ -20,8 +20,30 @@
 #ifndef SERVICE_DP_UPLOAD_H
 #define SERVICE_DP_UPLOAD_H
 
-#define REQ_TAG_DP_FILE_REQUEST	"upload_1_dp"
+#include "cc_config.h"
+#include "services_util.h"
 
-int handle_datapoint_file_upload(int fd);
+#define REQ_TAG_DP_FILE_REQUEST		"upload_1_dp"
+#define REQ_TAG_DP_STATUS_REQUEST	"upload_1_status"
+
+/* Record types of a data point upload */
+typedef enum {
+	upload_datapoint_file_terminate,
+	upload_datapoint_file_metrics,
+	upload_datapoint_file_events,
+	upload_datapoint_file_metrics_chunk,
+	upload_datapoint_file_events_chunk,
+	upload_datapoint_file_metrics_async,
+	upload_datapoint_file_count
+} upload_datapoint_file_t;
+
+request_status_t parse_datapoint_file_upload(const request_values_t *request, const char **error);
+int handle_datapoint_file_upload(service_client_t *client, const request_values_t *request);
+
+request_status_t parse_datapoint_upload_status(const request_values_t *request, const char **error);
+int handle_datapoint_upload_status(service_client_t *client, const request_values_t *request);
+
+int start_datapoint_file_upload(const cc_cfg_t *const cc_cfg);
+void stop_datapoint_file_upload(void);
 
 #endif
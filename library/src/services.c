@@ -19,13 +19,23 @@
 
 #include <errno.h>
 #include <netinet/ip.h>
+#include <stddef.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "ccapi/ccapi.h"
 #include "cc_logging.h"
 #include "service_device_request.h"
+#include "service_dp_ring.h"
 #include "service_dp_upload.h"
 #include "services.h"
 #include "services_util.h"
@@ -33,86 +43,1133 @@
 #define CONNECTOR_REQUEST_PORT	977
 #define REQUEST_TAG_MAX_LENGTH	64
 
-static pthread_t listen_thread;
-static bool listen_thread_valid;
-static volatile bool stop_listening = false;
+/* Seconds to receive the tag of a request */
+#define REQUEST_TAG_TIMEOUT_SEC	20
+
+/* Milliseconds between checks of the connections timeouts */
+#define REACTOR_TICK_MS			1000
 
-typedef int (*request_handler_t)(int socket_fd);
+#define MAX_EVENTS				32
+#define CONN_BUFFER_SIZE		256
+
+/* Size of the pooled buffers, enough for a chunk of UPLOAD_CHUNK_SIZE */
+#define POOL_BUFFER_SIZE		(64 * 1024)
+
+/* Room for the tag and the small values of a request besides its largest value */
+#define REQUEST_OVERHEAD_SIZE	4096
+
+typedef request_status_t (*request_parser_t)(const request_values_t *request, const char **error);
+typedef int (*request_handler_t)(service_client_t *client, const request_values_t *request);
 
 struct handler_t {
 	const char *request_tag;
+	request_parser_t request_parser;
 	request_handler_t request_handler;
 } request_handlers[] = {
 	{
 		REQ_TAG_DP_FILE_REQUEST,
+		parse_datapoint_file_upload,
 		handle_datapoint_file_upload
 	},
+	{
+		REQ_TAG_DP_STATUS_REQUEST,
+		parse_datapoint_upload_status,
+		handle_datapoint_upload_status
+	},
+	{
+		REQ_TAG_DP_RING_OPEN,
+		parse_datapoint_ring_open,
+		handle_datapoint_ring_open
+	},
 	{
 		REQ_TAG_REGISTER_DR,
+		parse_device_request,
 		handle_register_device_request
 	},
 	{
 		REQ_TAG_UNREGISTER_DR,
+		parse_device_request,
 		handle_unregister_device_request
 	}
 };
 
-static void handle_requests(int fd)
+/**
+ * enum conn_state_t - State of a local connection
+ *
+ * @CONN_READ_TAG:		Receiving the tag that selects the handler (or a
+ *						whole protocol v2 message)
+ * @CONN_READ_REQUEST:	Receiving the values of a request
+ * @CONN_BUSY:			A worker is attending the received request
+ * @CONN_WRITE:			Sending the part of the response the socket could
+ *						not take when the worker sent it
+ */
+typedef enum {
+	CONN_READ_TAG,
+	CONN_READ_REQUEST,
+	CONN_BUSY,
+	CONN_WRITE
+} conn_state_t;
+
+/**
+ * struct connection_t - Connection of a local application
+ *
+ * @client:		Non-blocking socket, protocol version and current request id.
+ * @state:		State of the connection.
+ * @handler:	Handler selected by the request tag.
+ * @buffer:		Bytes received and not consumed yet.
+ * @size:		Capacity of 'buffer'.
+ * @length:		Number of received bytes in 'buffer'.
+ * @parsed:		Number of bytes of 'buffer' already decoded.
+ * @needed:		Number of bytes required to decode the next value.
+ * @request:	Values of the request being received, they point to 'buffer'.
+ * @deadline:	Monotonic time (ms) to receive the tag or the request, or to
+ *				send the rest of the response.
+ * @result:		Value returned by the handler of the last request.
+ * @prev:		Previous connection in the list of open connections.
+ * @next:		Next connection in the list of open connections.
+ * @queue_next:	Next connection in the work or done queue.
+ */
+typedef struct connection {
+	service_client_t client;
+	conn_state_t state;
+	const struct handler_t *handler;
+	char *buffer;
+	size_t size;
+	size_t length;
+	size_t parsed;
+	size_t needed;
+	request_values_t request;
+	uint64_t deadline;
+	int result;
+	struct connection *prev;
+	struct connection *next;
+	struct connection *queue_next;
+} connection_t;
+
+/**
+ * struct listener_t - Socket listening for local requests
+ *
+ * @fd:			Non-blocking listening socket, -1 if not open.
+ * @is_unix:	Whether it is the Unix domain socket, whose clients are
+ *				authorized by their user ID.
+ */
+typedef struct {
+	int fd;
+	bool is_unix;
+} listener_t;
+
+/**
+ * struct conn_queue_t - FIFO of connections
+ *
+ * @head:	First connection.
+ * @tail:	Last connection.
+ */
+typedef struct {
+	connection_t *head;
+	connection_t *tail;
+} conn_queue_t;
+
+static pthread_t listen_thread;
+static bool listen_thread_valid;
+static volatile bool stop_listening = false;
+
+static uint32_t listen_backlog;
+static bool listen_tcp;
+static char *socket_path;
+static uint32_t *allowed_uids;
+static unsigned int n_allowed_uids;
+static listener_t listeners[] = {
+	{ .fd = -1, .is_unix = false },
+	{ .fd = -1, .is_unix = true },
+};
+static bool listeners_paused;
+static size_t max_request_size;
+
+/* Bytes of the buffers larger than POOL_BUFFER_SIZE, only used by the listening thread */
+static size_t large_buffered, max_large_buffered;
+static uint32_t n_workers;
+static pthread_t *workers;
+static uint32_t n_workers_running;
+
+/* Free buffers of POOL_BUFFER_SIZE bytes, only used by the listening thread */
+static char **buffer_pool;
+static unsigned int n_pooled, pool_capacity;
+
+static int epoll_fd = -1;
+static int wake_fd = -1;
+static connection_t *connections;
+
+/* Requests ready for a worker and requests attended by one */
+static conn_queue_t work_queue, done_queue;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+
+static void parse_connection(connection_t *conn);
+
+/*
+ * get_monotonic_ms() - Get the current CLOCK_MONOTONIC time
+ *
+ * Return: The current time in milliseconds.
+ */
+static uint64_t get_monotonic_ms(void)
 {
-	int request_sock;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / (1000 * 1000);
+}
+
+/*
+ * queue_push() - Append a connection to a queue
+ *
+ * @queue:	The queue.
+ * @conn:	The connection to append.
+ */
+static void queue_push(conn_queue_t *queue, connection_t *conn)
+{
+	conn->queue_next = NULL;
+	if (queue->tail != NULL)
+		queue->tail->queue_next = conn;
+	else
+		queue->head = conn;
+	queue->tail = conn;
+}
+
+/*
+ * queue_pop() - Remove the first connection of a queue
+ *
+ * @queue:	The queue.
+ *
+ * Return: The removed connection, NULL if the queue is empty.
+ */
+static connection_t *queue_pop(conn_queue_t *queue)
+{
+	connection_t *conn = queue->head;
+
+	if (conn != NULL) {
+		queue->head = conn->queue_next;
+		if (queue->head == NULL)
+			queue->tail = NULL;
+	}
+
+	return conn;
+}
+
+/*
+ * watch_connection() - Start or stop polling a connection
+ *
+ * @conn:	The connection.
+ * @watch:	True to receive its data, or to send the rest of the response
+ *			in CONN_WRITE state, false while a worker attends it.
+ *
+ * Connections attended by a worker are removed from the epoll set, so a
+ * hang up of the client is not reported until the worker finishes.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int watch_connection(connection_t *conn, bool watch)
+{
+	struct epoll_event event = {
+		.events = conn->state == CONN_WRITE ? EPOLLOUT : EPOLLIN,
+		.data.ptr = conn
+	};
+
+	if (!watch)
+		return epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->client.fd, NULL);
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->client.fd, &event);
+}
+
+/*
+ * pause_listeners() - Stop or resume accepting local connections
+ *
+ * @pause:	True when there are no descriptors left for new connections,
+ *			false to try again.
+ *
+ * A listener whose pending connections cannot be accepted would be reported
+ * by epoll over and over, so it is not polled until a connection closes or
+ * the next reactor tick.
+ */
+static void pause_listeners(bool pause)
+{
+	unsigned int i;
+
+	if (pause == listeners_paused)
+		return;
 
-	while (!stop_listening && (request_sock = accept4(fd, NULL, NULL, SOCK_CLOEXEC)) != -1) {
-		char *request_tag = NULL;
-		unsigned long i;
-		bool handled = false;
-		struct timeval timeout = {
-			.tv_sec = 20,
-			.tv_usec = 0
+	for (i = 0; i < ARRAY_SIZE(listeners); i++) {
+		struct epoll_event event = {
+			.events = EPOLLIN,
+			.data.ptr = &listeners[i]
 		};
-		/* Read request tag (to select handler for this request) */
-		if (read_string(request_sock, &request_tag, NULL, &timeout) < 0) {
-			send_error(request_sock, "Failed to read request code");
-			log_error("Error reading request tag, %s", strerror(errno));
-			close(request_sock);
+
+		if (listeners[i].fd < 0)
 			continue;
+
+		if (epoll_ctl(epoll_fd, pause ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, listeners[i].fd, &event) != 0)
+			log_warning("Cannot %s local connections: %s", pause ? "pause" : "resume", strerror(errno));
+	}
+
+	listeners_paused = pause;
+}
+
+/*
+ * get_pool_buffer() - Get a buffer of POOL_BUFFER_SIZE bytes
+ *
+ * Return: A free buffer of the pool or a new one, NULL if there is not
+ *         enough memory.
+ */
+static char *get_pool_buffer(void)
+{
+	if (n_pooled > 0)
+		return buffer_pool[--n_pooled];
+
+	return malloc(POOL_BUFFER_SIZE);
+}
+
+/*
+ * release_buffer() - Release the buffer of a connection
+ *
+ * @buffer:	The buffer.
+ * @size:	Capacity of 'buffer'.
+ *
+ * Buffers of POOL_BUFFER_SIZE bytes return to the pool while it has room.
+ */
+static void release_buffer(char *buffer, size_t size)
+{
+	if (buffer != NULL && size == POOL_BUFFER_SIZE && n_pooled < pool_capacity) {
+		buffer_pool[n_pooled++] = buffer;
+		return;
+	}
+
+	if (buffer != NULL && size > POOL_BUFFER_SIZE)
+		large_buffered -= size;
+	free(buffer);
+}
+
+/*
+ * free_buffer_pool() - Release all the buffers of the pool
+ */
+static void free_buffer_pool(void)
+{
+	while (n_pooled > 0)
+		free(buffer_pool[--n_pooled]);
+	free(buffer_pool);
+	buffer_pool = NULL;
+	pool_capacity = 0;
+}
+
+/*
+ * close_connection() - Close a local connection and release its resources
+ *
+ * @conn:	The connection to close.
+ */
+static void close_connection(connection_t *conn)
+{
+	if (conn->prev != NULL)
+		conn->prev->next = conn->next;
+	else
+		connections = conn->next;
+	if (conn->next != NULL)
+		conn->next->prev = conn->prev;
+
+	if (conn->state != CONN_BUSY)
+		watch_connection(conn, false);
+	if (close(conn->client.fd) < 0)
+		log_warning("Could not close service socket after attending request: %s", strerror(errno));
+	if (conn->client.free_context != NULL)
+		conn->client.free_context(conn->client.context);
+
+	free(conn->client.output);
+	release_buffer(conn->buffer, conn->size);
+	free(conn);
+
+	/* A descriptor is free for the connections that could not be accepted */
+	if (listeners_paused)
+		pause_listeners(false);
+}
+
+/*
+ * fail_connection() - Report an error to the client and close the connection
+ *
+ * @conn:	The connection.
+ * @error:	Message for the client.
+ *
+ * The error is sent without blocking, the part the socket cannot take is
+ * discarded.
+ */
+static void fail_connection(connection_t *conn, const char *error)
+{
+	send_response_error(&conn->client, error);
+	close_connection(conn);
+}
+
+/*
+ * expect_request() - Prepare a connection to receive a new request
+ *
+ * @conn:	The connection.
+ * @state:	CONN_READ_TAG or CONN_READ_REQUEST.
+ * @now:	Current monotonic time (ms).
+ *
+ * The bytes of the previous request are discarded, those already received
+ * for the next one are kept. A buffer enlarged for a big value is replaced
+ * by a pooled one as soon as the remaining bytes fit in it.
+ */
+static void expect_request(connection_t *conn, conn_state_t state, uint64_t now)
+{
+	if (conn->parsed > 0) {
+		conn->length -= conn->parsed;
+		memmove(conn->buffer, conn->buffer + conn->parsed, conn->length);
+		conn->parsed = 0;
+	}
+
+	if (conn->size > POOL_BUFFER_SIZE && conn->length <= POOL_BUFFER_SIZE) {
+		char *buffer = get_pool_buffer();
+
+		if (buffer != NULL) {
+			memcpy(buffer, conn->buffer, conn->length);
+			release_buffer(conn->buffer, conn->size);
+			conn->buffer = buffer;
+			conn->size = POOL_BUFFER_SIZE;
+		}
+	}
+
+	conn->state = state;
+	conn->needed = 0;
+	conn->request.n_values = 0;
+	conn->deadline = now + (state == CONN_READ_TAG && conn->client.version != V2_VERSION ?
+			REQUEST_TAG_TIMEOUT_SEC : SOCKET_READ_TIMEOUT_SEC) * 1000;
+}
+
+/*
+ * grow_buffer() - Make room in the buffer of a connection
+ *
+ * @conn:	The connection.
+ * @size:	Minimum capacity required.
+ *
+ * The values already decoded are relocated to the new buffer. Up to
+ * POOL_BUFFER_SIZE bytes, the buffer is taken from the pool; only bigger
+ * values, up to the maximum request size, take a dedicated allocation.
+ * Dedicated allocations of all the connections together are limited to
+ * 'max_large_buffered' bytes.
+ *
+ * Return: 0 on success, -1 if there is not enough memory (errno is ENOBUFS
+ *         if the limit was reached).
+ */
+static int grow_buffer(connection_t *conn, size_t size)
+{
+	size_t offsets[REQUEST_MAX_VALUES];
+	size_t new_size = conn->size > 0 ? conn->size : CONN_BUFFER_SIZE;
+	size_t large_size = conn->size > POOL_BUFFER_SIZE ? conn->size : 0;
+	char *new_buffer;
+	unsigned int i;
+
+	while (new_size < size) {
+		if (new_size > SIZE_MAX / 2) {
+			new_size = size;
+			break;
+		}
+		new_size *= 2;
+	}
+	if (new_size > max_request_size && size <= max_request_size)
+		new_size = max_request_size;
+
+	if (new_size > POOL_BUFFER_SIZE && large_buffered - large_size + new_size > max_large_buffered) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	for (i = 0; i < conn->request.n_values; i++)
+		offsets[i] = conn->request.values[i].data != NULL ?
+			(size_t) (conn->request.values[i].data - conn->buffer) : 0;
+
+	if (conn->size < POOL_BUFFER_SIZE && new_size > CONN_BUFFER_SIZE && new_size <= POOL_BUFFER_SIZE) {
+		new_size = POOL_BUFFER_SIZE;
+		new_buffer = get_pool_buffer();
+		if (new_buffer != NULL && conn->buffer != NULL) {
+			memcpy(new_buffer, conn->buffer, conn->length);
+			free(conn->buffer);
 		}
+	} else {
+		new_buffer = realloc(conn->buffer, new_size);
+	}
+	if (new_buffer == NULL)
+		return -1;
+
+	for (i = 0; i < conn->request.n_values; i++) {
+		if (conn->request.values[i].data != NULL)
+			conn->request.values[i].data = new_buffer + offsets[i];
+	}
 
-		/* Invoke the corresponding handler (only one handler per request */
-		for (i = 0; i < ARRAY_SIZE(request_handlers); i++) {
-			const struct handler_t *handler = &request_handlers[i];
+	if (new_size > POOL_BUFFER_SIZE)
+		large_buffered += new_size - large_size;
+	conn->buffer = new_buffer;
+	conn->size = new_size;
 
-			if (!strcmp(request_tag, handler->request_tag)) {
-				if (handler->request_handler(request_sock))
-					log_error("Error handling request tagged with: '%s'", request_tag);
+	return 0;
+}
 
-				handled = true;
+/*
+ * dispatch_request() - Queue a received request for the workers
+ *
+ * @conn:	The connection with the complete request.
+ *
+ * The connection stops being polled until the worker finishes, so the buffer
+ * the request values point to does not change meanwhile.
+ */
+static void dispatch_request(connection_t *conn)
+{
+	conn->state = CONN_BUSY;
+	if (watch_connection(conn, false) != 0) {
+		log_error("Cannot attend local request: %s", strerror(errno));
+		close_connection(conn);
+		return;
+	}
 
+	pthread_mutex_lock(&queue_lock);
+	queue_push(&work_queue, conn);
+	pthread_cond_signal(&work_cond);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+/*
+ * parse_tag() - Select the handler of a request from its tag
+ *
+ * @conn:	The connection.
+ * @value:	The decoded tag.
+ *
+ * Return: 0 on success, -1 if the connection was closed.
+ */
+static int parse_tag(connection_t *conn, const service_value_t *value)
+{
+	unsigned long i;
+
+	if (value->type != DT_STRING || value->length > REQUEST_TAG_MAX_LENGTH) {
+		log_error("%s", "Error reading request tag");
+		fail_connection(conn, "Failed to read request code");
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(request_handlers); i++) {
+		if (!strcmp(value->data, request_handlers[i].request_tag)) {
+			conn->handler = &request_handlers[i];
+			conn->state = CONN_READ_REQUEST;
+			conn->request.n_values = 0;
+			conn->deadline = get_monotonic_ms() + SOCKET_READ_TIMEOUT_SEC * 1000;
+			return 0;
+		}
+	}
+
+	fail_connection(conn, "Invalid request type");
+
+	return -1;
+}
+
+/*
+ * add_request_value() - Add a decoded value to the request of a connection
+ *
+ * @conn:	The connection.
+ * @value:	The decoded value.
+ *
+ * Return: The status of the request. The connection is closed if the
+ *         request is invalid.
+ */
+static request_status_t add_request_value(connection_t *conn, const service_value_t *value)
+{
+	const char *error = "Invalid request";
+	request_status_t status = REQUEST_INVALID;
+
+	if (conn->request.n_values < REQUEST_MAX_VALUES) {
+		conn->request.values[conn->request.n_values++] = *value;
+		status = conn->handler->request_parser(&conn->request, &error);
+	}
+
+	if (status != REQUEST_INCOMPLETE && status != REQUEST_COMPLETE) {
+		fail_connection(conn, error);
+		status = REQUEST_INVALID;
+	}
+
+	return status;
+}
+
+/*
+ * parse_v1_connection() - Decode the received values of a protocol v1 connection
+ *
+ * @conn:	The connection.
+ *
+ * Advances the state machine of the connection with every complete value
+ * and dispatches the request once its handler has all the values it needs.
+ */
+static void parse_v1_connection(connection_t *conn)
+{
+	while (conn->state != CONN_BUSY && conn->length >= conn->needed) {
+		service_value_t value;
+		size_t needed;
+		ssize_t consumed;
+
+		consumed = decode_value(conn->buffer + conn->parsed,
+				conn->length - conn->parsed, &value, &needed);
+		if (consumed == 0) {
+			conn->needed = conn->parsed + needed;
+			if (conn->needed > max_request_size)
+				fail_connection(conn, "Request too large");
+			return;
+		}
+		if (consumed < 0) {
+			if (conn->state == CONN_READ_TAG) {
+				log_error("%s", "Error reading request tag");
+				fail_connection(conn, "Failed to read request code");
+			} else {
+				fail_connection(conn, "Invalid request");
+			}
+			return;
+		}
+		conn->parsed += consumed;
+		conn->needed = 0;
+
+		if (conn->state == CONN_READ_TAG) {
+			if (parse_tag(conn, &value) != 0)
+				return;
+			continue;
+		}
+
+		switch (add_request_value(conn, &value)) {
+			case REQUEST_INCOMPLETE:
+				break;
+			case REQUEST_COMPLETE:
+				dispatch_request(conn);
+				return;
+			case REQUEST_INVALID:
+			default:
+				return;
+		}
+	}
+}
+
+/*
+ * parse_v2_connection() - Decode the received message of a protocol v2 connection
+ *
+ * @conn:	The connection.
+ *
+ * The message is decoded once it is completely received. Its payload must
+ * be exactly the tag and the values of one request.
+ */
+static void parse_v2_connection(connection_t *conn)
+{
+	v2_header_t header;
+	char *payload;
+	size_t offset = 0;
+
+	if (conn->length - conn->parsed < V2_HEADER_SIZE) {
+		conn->needed = conn->parsed + V2_HEADER_SIZE;
+		return;
+	}
+
+	if (decode_v2_header(conn->buffer + conn->parsed, &header) != 0
+		|| header.type != V2_MSG_REQUEST
+		|| header.length > SIZE_MAX - V2_HEADER_SIZE - conn->parsed) {
+		fail_connection(conn, "Invalid message header");
+		return;
+	}
+	if (V2_HEADER_SIZE + header.length > max_request_size) {
+		fail_connection(conn, "Request too large");
+		return;
+	}
+	conn->client.request_id = header.request_id;
+
+	if (conn->length - conn->parsed - V2_HEADER_SIZE < header.length) {
+		conn->needed = conn->parsed + V2_HEADER_SIZE + header.length;
+		return;
+	}
+
+	payload = conn->buffer + conn->parsed + V2_HEADER_SIZE;
+	conn->parsed += V2_HEADER_SIZE + header.length;
+	conn->needed = 0;
+
+	while (offset < header.length) {
+		service_value_t value;
+		ssize_t consumed;
+
+		consumed = decode_v2_value(payload + offset, header.length - offset, &value);
+		if (consumed < 0) {
+			fail_connection(conn, conn->state == CONN_READ_TAG ?
+					"Failed to read request code" : "Invalid request");
+			return;
+		}
+		offset += consumed;
+
+		if (conn->state == CONN_READ_TAG) {
+			if (parse_tag(conn, &value) != 0)
+				return;
+			continue;
+		}
+
+		switch (add_request_value(conn, &value)) {
+			case REQUEST_INCOMPLETE:
 				break;
+			case REQUEST_COMPLETE:
+				if (offset != header.length) {
+					fail_connection(conn, "Invalid request");
+					return;
+				}
+				dispatch_request(conn);
+				return;
+			case REQUEST_INVALID:
+			default:
+				return;
+		}
+	}
+
+	fail_connection(conn, "Invalid request");
+}
+
+/*
+ * parse_connection() - Decode the received data of a connection
+ *
+ * @conn:	The connection.
+ *
+ * The protocol version of the connection is selected by its first byte.
+ */
+static void parse_connection(connection_t *conn)
+{
+	if (conn->length < conn->needed || conn->length == 0)
+		return;
+
+	if (conn->client.version == 0)
+		conn->client.version = (uint8_t) conn->buffer[0] == V2_MAGIC ? V2_VERSION : 1;
+
+	if (conn->client.version == V2_VERSION)
+		parse_v2_connection(conn);
+	else
+		parse_v1_connection(conn);
+}
+
+/*
+ * read_connection() - Receive the available data of a connection
+ *
+ * @conn:	The connection.
+ *
+ * The buffer only grows when the value being received does not fit, the
+ * rest of the data is read once the buffered values are decoded.
+ */
+static void read_connection(connection_t *conn)
+{
+	for (;;) {
+		ssize_t n_read;
+
+		if (conn->length == conn->size) {
+			if (conn->length >= conn->needed)
+				break;
+			if (grow_buffer(conn, conn->needed) != 0) {
+				if (errno == ENOBUFS) {
+					log_warning("%s", "Cannot receive local request, too many large requests in progress");
+					fail_connection(conn, "Too many large requests in progress");
+				} else {
+					log_error("%s", "Cannot receive local request, out of memory");
+					fail_connection(conn, "Out of memory");
+				}
+				return;
 			}
 		}
 
-		/* Error on requets that cannot be handled, and clean up */
-		if (!handled)
-			send_error(request_sock, "Invalid request type");
+		n_read = read(conn->client.fd, conn->buffer + conn->length, conn->size - conn->length);
+		if (n_read > 0) {
+			conn->length += n_read;
+			continue;
+		}
+		if (n_read < 0 && errno == EINTR)
+			continue;
+		if (n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+
+		/* Closed by the client or error */
+		close_connection(conn);
+		return;
+	}
+
+	parse_connection(conn);
+}
+
+/*
+ * is_peer_allowed() - Check if the client of the Unix domain socket is authorized
+ *
+ * @fd:	Accepted socket.
+ *
+ * Return: True if the user ID of the client process is allowed, false otherwise.
+ */
+static bool is_peer_allowed(int fd)
+{
+	struct ucred cred;
+	socklen_t length = sizeof(cred);
+	unsigned int i;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+		log_error("Cannot get local client credentials: %s", strerror(errno));
+		return false;
+	}
 
-		if (close(request_sock) < 0)
-			log_warning("Could not close service socket after attending request: %s", strerror(errno));
+	if (n_allowed_uids == 0)
+		return true;
 
-		free(request_tag);
+	for (i = 0; i < n_allowed_uids; i++) {
+		if (allowed_uids[i] == cred.uid)
+			return true;
 	}
+
+	log_warning("Local request of user %u (pid %d) not allowed", (unsigned int) cred.uid, (int) cred.pid);
+
+	return false;
 }
 
-static void *listen_threaded(void *unused)
+/*
+ * accept_connections() - Accept the pending connections of local applications
+ *
+ * @listener:	Listening socket with pending connections.
+ */
+static void accept_connections(const listener_t *listener)
+{
+	int request_sock;
+
+	while ((request_sock = accept4(listener->fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) != -1) {
+		connection_t *conn;
+
+		if (listener->is_unix && !is_peer_allowed(request_sock)) {
+			service_client_t client = { .fd = request_sock };
+
+			send_response_error(&client, "Permission denied");
+			free(client.output);
+			close(request_sock);
+			continue;
+		}
+
+		conn = calloc(1, sizeof(*conn));
+
+		if (conn == NULL) {
+			log_error("%s", "Cannot accept local request, out of memory");
+			close(request_sock);
+			continue;
+		}
+
+		conn->client.fd = request_sock;
+		if (grow_buffer(conn, CONN_BUFFER_SIZE) != 0) {
+			log_error("%s", "Cannot accept local request, out of memory");
+			close(request_sock);
+			free(conn);
+			continue;
+		}
+		expect_request(conn, CONN_READ_TAG, get_monotonic_ms());
+
+		if (watch_connection(conn, true) != 0) {
+			log_error("Cannot accept local request: %s", strerror(errno));
+			close(request_sock);
+			free(conn->buffer);
+			free(conn);
+			continue;
+		}
+
+		conn->next = connections;
+		if (connections != NULL)
+			connections->prev = conn;
+		connections = conn;
+	}
+
+	if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+		log_warning("Cannot accept local request: %s, waiting for a connection to close",
+			strerror(errno));
+		pause_listeners(true);
+	} else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		log_error("Error accepting local request: %s", strerror(errno));
+	}
+}
+
+/*
+ * is_last_request() - Check if a connection ends with its attended request
+ *
+ * @conn:	The connection, its result is already set.
+ *
+ * Return: True if the connection must be closed once the response is sent.
+ */
+static bool is_last_request(const connection_t *conn)
+{
+	/* v1 requests end the connection unless the handler expects more */
+	return conn->client.version != V2_VERSION && conn->result <= 0;
+}
+
+/*
+ * resume_connection() - Wait for the next request of a connection
+ *
+ * @conn:	The connection, whose response is completely sent. It must not
+ *			be polled.
+ */
+static void resume_connection(connection_t *conn)
+{
+	expect_request(conn, conn->client.version == V2_VERSION ? CONN_READ_TAG : CONN_READ_REQUEST,
+		get_monotonic_ms());
+	if (watch_connection(conn, true) != 0) {
+		close_connection(conn);
+		return;
+	}
+
+	/* The client may have sent the next request already */
+	parse_connection(conn);
+}
+
+/*
+ * write_connection() - Send the rest of the response of a connection
+ *
+ * @conn:	The connection, in CONN_WRITE state.
+ *
+ * Once the whole response is sent the connection waits for the next request.
+ */
+static void write_connection(connection_t *conn)
+{
+	int result = flush_response(&conn->client);
+
+	if (result > 0)
+		return;
+
+	if (result < 0 || is_last_request(conn) || watch_connection(conn, false) != 0) {
+		close_connection(conn);
+		return;
+	}
+
+	resume_connection(conn);
+}
+
+/*
+ * complete_requests() - Resume the connections whose request was attended
+ *
+ * A response the socket could not completely take is sent before reading
+ * the next request of the connection.
+ */
+static void complete_requests(void)
+{
+	conn_queue_t done;
+	connection_t *conn;
+	uint64_t value;
+
+	if (read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		log_warning("Cannot read local requests event: %s", strerror(errno));
+
+	pthread_mutex_lock(&queue_lock);
+	done = done_queue;
+	done_queue.head = done_queue.tail = NULL;
+	pthread_mutex_unlock(&queue_lock);
+
+	while ((conn = queue_pop(&done)) != NULL) {
+		if (conn->result < 0)
+			log_error("Error handling request tagged with: '%s'", conn->handler->request_tag);
+
+		if (conn->client.output_length > 0) {
+			conn->state = CONN_WRITE;
+			conn->deadline = get_monotonic_ms() + SOCKET_READ_TIMEOUT_SEC * 1000;
+			if (watch_connection(conn, true) != 0)
+				close_connection(conn);
+			continue;
+		}
+
+		if (is_last_request(conn))
+			close_connection(conn);
+		else
+			resume_connection(conn);
+	}
+}
+
+/*
+ * expire_connections() - Close the connections that are too slow to send a
+ *			   request or to receive its response
+ *
+ * @now:	Current monotonic time (ms).
+ */
+static void expire_connections(uint64_t now)
+{
+	connection_t *conn = connections;
+
+	while (conn != NULL) {
+		connection_t *next = conn->next;
+
+		if (conn->state != CONN_BUSY && now >= conn->deadline) {
+			if (conn->state == CONN_WRITE) {
+				log_error("Error sending local response, %s", strerror(ETIMEDOUT));
+				close_connection(conn);
+			} else if (conn->state == CONN_READ_TAG) {
+				log_error("Error reading request tag, %s", strerror(ETIMEDOUT));
+				fail_connection(conn, "Failed to read request code");
+			} else {
+				fail_connection(conn, "Timeout");
+			}
+		}
+
+		conn = next;
+	}
+}
+
+/*
+ * handle_requests() - Attend the local connections until stopped
+ *
+ * Connections are accepted and read without blocking. Once a request is
+ * completely received it is attended by a worker, so a slow upload does not
+ * delay the requests of other applications.
+ */
+static void handle_requests(void)
+{
+	struct epoll_event events[MAX_EVENTS];
+	uint64_t last_check = get_monotonic_ms();
+
+	while (!stop_listening) {
+		uint64_t now;
+		int i, n_events;
+
+		n_events = epoll_wait(epoll_fd, events, MAX_EVENTS, REACTOR_TICK_MS);
+		if (n_events < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("Error waiting for local requests: %s", strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < n_events && !stop_listening; i++) {
+			void *ptr = events[i].data.ptr;
+
+			if (ptr == &listeners[0] || ptr == &listeners[1])
+				accept_connections(ptr);
+			else if (ptr == &wake_fd)
+				complete_requests();
+			else if (((connection_t *) ptr)->state == CONN_WRITE)
+				write_connection(ptr);
+			else
+				read_connection(ptr);
+		}
+
+		now = get_monotonic_ms();
+		if (now - last_check >= REACTOR_TICK_MS) {
+			expire_connections(now);
+			pause_listeners(false);
+			last_check = now;
+		}
+	}
+}
+
+/*
+ * finish_request() - Return an attended request to the listening thread
+ *
+ * @conn:	The connection, its result is already set.
+ */
+static void finish_request(connection_t *conn)
+{
+	uint64_t wake = 1;
+
+	pthread_mutex_lock(&queue_lock);
+	queue_push(&done_queue, conn);
+	pthread_mutex_unlock(&queue_lock);
+
+	if (write(wake_fd, &wake, sizeof(wake)) < 0)
+		log_warning("Cannot notify attended local request: %s", strerror(errno));
+}
+
+/*
+ * worker_threaded() - Attend the received requests
+ *
+ * @unused:	Unused parameter.
+ *
+ * Return: NULL.
+ */
+static void *worker_threaded(void *unused)
+{
+	UNUSED_ARGUMENT(unused);
+
+	for (;;) {
+		connection_t *conn;
+
+		pthread_mutex_lock(&queue_lock);
+		while (!stop_listening && work_queue.head == NULL)
+			pthread_cond_wait(&work_cond, &queue_lock);
+		if (stop_listening) {
+			pthread_mutex_unlock(&queue_lock);
+			break;
+		}
+		conn = queue_pop(&work_queue);
+		pthread_mutex_unlock(&queue_lock);
+
+		conn->result = conn->handler->request_handler(&conn->client, &conn->request);
+
+		/* The handler completes the request later */
+		if (conn->result == REQUEST_RESPONSE_PENDING)
+			continue;
+
+		finish_request(conn);
+	}
+
+	return NULL;
+}
+
+/*
+ * start_workers() - Start the threads attending the local requests
+ *
+ * Return: 0 if at least one worker started, -1 otherwise.
+ */
+static int start_workers(void)
+{
+	pthread_attr_t attr;
+	uint32_t i;
+
+	workers = calloc(n_workers, sizeof(*workers));
+	if (workers == NULL)
+		return -1;
+
+	if (pthread_attr_init(&attr) != 0)
+		return -1;
+
+	for (i = 0; i < n_workers; i++) {
+		if (pthread_create(&workers[n_workers_running], &attr, worker_threaded, NULL) != 0) {
+			log_error("Unable to start local requests worker %u", i);
+			continue;
+		}
+		n_workers_running++;
+	}
+
+	pthread_attr_destroy(&attr);
+
+	return n_workers_running > 0 ? 0 : -1;
+}
+
+/*
+ * stop_workers() - Stop the threads attending the local requests
+ *
+ * Workers finish the request they are attending, queued requests are
+ * discarded when the connections are closed.
+ */
+static void stop_workers(void)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&queue_lock);
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&queue_lock);
+
+	for (i = 0; i < n_workers_running; i++)
+		pthread_join(workers[i], NULL);
+
+	n_workers_running = 0;
+	free(workers);
+	workers = NULL;
+}
+
+/*
+ * open_tcp_listener() - Listen for local requests on the TCP loopback port
+ *
+ * Return: The listening socket, -1 on error.
+ */
+static int open_tcp_listener(void)
 {
 	struct sockaddr_in addr;
 	int fd;
 	int n_options = 1;
 
-	UNUSED_ARGUMENT(unused);
-
-	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
 	if (fd == -1)
-		return NULL;
+		return -1;
 
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &n_options, sizeof(n_options)) < 0)
 		log_warning("Failed to set SO_REUSE* on request serversocket: %s", strerror(errno));
@@ -121,29 +1178,180 @@ static void *listen_threaded(void *unused)
 	addr.sin_port = htons(CONNECTOR_REQUEST_PORT);
 	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
-	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) || listen(fd, 3)) {
+	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) || listen(fd, listen_backlog)) {
 		log_error("%s", "Failed to bind to local socket");
-		goto done;
+		close(fd);
+		return -1;
 	}
 
-	handle_requests(fd);
+	return fd;
+}
 
-done:
-	close(fd);
+/*
+ * open_unix_listener() - Listen for local requests on a Unix domain socket
+ *
+ * @path:	Path of the socket.
+ *
+ * A stale socket left by a previous run is replaced. Any user may connect
+ * to the socket, clients are authorized once accepted.
+ *
+ * Return: The listening socket, -1 on error.
+ */
+static int open_unix_listener(const char *path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX
+	};
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		log_error("Local requests socket path too long: %s", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
 
-	pthread_exit(NULL);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd == -1)
+		return -1;
+
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) || listen(fd, listen_backlog)) {
+		log_error("Failed to bind to local socket '%s': %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if (chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) != 0)
+		log_warning("Cannot set permissions of local socket '%s': %s", path, strerror(errno));
+
+	return fd;
+}
+
+/*
+ * close_listeners() - Close the sockets listening for local requests
+ */
+static void close_listeners(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(listeners); i++) {
+		if (listeners[i].fd < 0)
+			continue;
+
+		close(listeners[i].fd);
+		listeners[i].fd = -1;
+		if (listeners[i].is_unix)
+			unlink(socket_path);
+	}
+}
+
+static void *listen_threaded(void *unused)
+{
+	unsigned int i, n_listeners = 0;
+
+	UNUSED_ARGUMENT(unused);
+
+	if (listen_tcp)
+		listeners[0].fd = open_tcp_listener();
+	if (socket_path[0] != '\0')
+		listeners[1].fd = open_unix_listener(socket_path);
+
+	for (i = 0; i < ARRAY_SIZE(listeners); i++) {
+		struct epoll_event event = {
+			.events = EPOLLIN,
+			.data.ptr = &listeners[i]
+		};
+
+		if (listeners[i].fd < 0)
+			continue;
+
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listeners[i].fd, &event) != 0) {
+			log_error("Failed to poll local socket: %s", strerror(errno));
+			continue;
+		}
+		n_listeners++;
+	}
+
+	if (n_listeners > 0)
+		handle_requests();
+	else
+		log_error("%s", "Not listening for local requests");
+
+	close_listeners();
 
 	return NULL;
 }
 
-void start_listening_for_local_requests(void)
+/*
+ * free_listen_settings() - Release the copy of the listening settings
+ */
+static void free_listen_settings(void)
+{
+	free(socket_path);
+	socket_path = NULL;
+	free(allowed_uids);
+	allowed_uids = NULL;
+	n_allowed_uids = 0;
+}
+
+void start_listening_for_local_requests(const cc_cfg_t *const cc_cfg)
 {
+	struct epoll_event event = {
+		.events = EPOLLIN
+	};
 	pthread_attr_t attr;
 
+	listen_backlog = cc_cfg->local_backlog;
+	listen_tcp = cc_cfg->local_tcp == CCAPI_TRUE;
+	n_workers = cc_cfg->local_workers;
+	max_request_size = (size_t) cc_cfg->local_max_value * 1024 + REQUEST_OVERHEAD_SIZE;
+	max_large_buffered = (size_t) cc_cfg->local_max_memory * 1024;
+	listeners_paused = false;
+	stop_listening = false;
+
+	/* Keep a pooled buffer for every request being received or attended */
+	pool_capacity = 2 * n_workers;
+	buffer_pool = calloc(pool_capacity, sizeof(*buffer_pool));
+	if (buffer_pool == NULL || start_datapoint_file_upload(cc_cfg) != 0
+		|| start_datapoint_rings(cc_cfg) != 0) {
+		log_error("%s", "Unable to start listening for requests, out of memory");
+		goto error;
+	}
+
+	socket_path = strdup(cc_cfg->local_socket != NULL ? cc_cfg->local_socket : "");
+	if (cc_cfg->n_local_uids > 0) {
+		allowed_uids = calloc(cc_cfg->n_local_uids, sizeof(*allowed_uids));
+		if (allowed_uids != NULL) {
+			memcpy(allowed_uids, cc_cfg->local_uids, cc_cfg->n_local_uids * sizeof(*allowed_uids));
+			n_allowed_uids = cc_cfg->n_local_uids;
+		}
+	}
+	if (socket_path == NULL || (cc_cfg->n_local_uids > 0 && allowed_uids == NULL)) {
+		log_error("%s", "Unable to start listening for requests, out of memory");
+		goto error;
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	event.data.ptr = &wake_fd;
+	if (epoll_fd < 0 || wake_fd < 0
+		|| epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) != 0) {
+		log_error("Unable to start listening for requests: %s", strerror(errno));
+		goto error;
+	}
+
+	if (start_workers() != 0) {
+		log_error("%s", "Unable to start local requests workers");
+		goto error;
+	}
+
 	listen_thread_valid = (pthread_attr_init(&attr) == 0);
 	if (!listen_thread_valid) {
 		log_error("Unable to start listening for requests (%d)", listen_thread_valid);
-		return;
+		goto error;
 	}
 
 	listen_thread_valid = (pthread_create(&listen_thread, &attr, listen_threaded, NULL) == 0);
@@ -151,17 +1359,73 @@ void start_listening_for_local_requests(void)
 		log_error("Unable to start sending response (%d)", listen_thread_valid);
 
 	pthread_attr_destroy(&attr);
+
+	if (listen_thread_valid)
+		return;
+
+error:
+	stop_listening = true;
+	stop_workers();
+	free_listen_settings();
+	free_buffer_pool();
+	stop_datapoint_rings();
+	stop_datapoint_file_upload();
+	if (wake_fd >= 0)
+		close(wake_fd);
+	wake_fd = -1;
+	if (epoll_fd >= 0)
+		close(epoll_fd);
+	epoll_fd = -1;
 }
 
 void stop_listening_for_local_requests(void)
 {
+	uint64_t wake = 1;
+
 	if (stop_listening)
 		return;
 
 	stop_listening = true;
 
 	if (listen_thread_valid) {
-		pthread_cancel(listen_thread);
+		if (write(wake_fd, &wake, sizeof(wake)) < 0)
+			log_warning("Cannot stop listening for requests: %s", strerror(errno));
 		pthread_join(listen_thread, NULL);
+		listen_thread_valid = false;
 	}
+
+	stop_workers();
+	/* Complete the uploads still waiting to be merged */
+	stop_datapoint_file_upload();
+	stop_datapoint_rings();
+
+	work_queue.head = work_queue.tail = NULL;
+	done_queue.head = done_queue.tail = NULL;
+	while (connections != NULL)
+		close_connection(connections);
+
+	close(wake_fd);
+	wake_fd = -1;
+	close(epoll_fd);
+	epoll_fd = -1;
+
+	free_listen_settings();
+	free_buffer_pool();
+}
+
+/*
+ * complete_local_request() - Finish a request whose response was pending
+ *
+ * @client:	Client of the request, as received by its handler.
+ * @result:	Result of the request, as if returned by its handler.
+ *
+ * Handlers returning REQUEST_RESPONSE_PENDING must call this function once
+ * they have sent the response. The connection is not touched meanwhile.
+ */
+void complete_local_request(service_client_t *client, int result)
+{
+	connection_t *conn = (connection_t *) ((char *) client - offsetof(connection_t, client));
+
+	conn->result = result;
+	finish_request(conn);
 }
@@ -20,7 +20,14 @@
 #ifndef SERVICES_H
 #define SERVICES_H
 
-void start_listening_for_local_requests(void);
+#include "cc_config.h"
+#include "services_util.h"
+
+/* Result of a handler that sends the response later, see complete_local_request() */
+#define REQUEST_RESPONSE_PENDING	2
+
+void start_listening_for_local_requests(const cc_cfg_t *const cc_cfg);
 void stop_listening_for_local_requests(void);
+void complete_local_request(service_client_t *client, int result);
 
 #endif
@@ -21,12 +21,15 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -96,6 +99,32 @@
  *
  * All the functions required to read/write values from/to socket streams are
  * provided by this module.
+ *
+ * Protocol v2
+ * -----------
+ *
+ * Clients sending many small messages may use a binary framing instead. A
+ * connection uses v2 if its first byte is V2_MAGIC, that cannot start a v1
+ * message, so both versions are accepted on the same socket. A connector
+ * without v2 support answers a v1 error and closes the connection, so the
+ * client can fall back to v1.
+ *
+ * Every v2 message is a fixed header followed by its payload, integers are
+ * little-endian:
+ *
+ * 	<header>	<=	<magic:u8><version:u8><type:u8><flags:u8>
+ * 				<request id:u32><payload length:u32>
+ * 	<payload>	<=	{<value>}
+ * 	<value>		<=	'i'<u32>
+ * 				|	's'<length:u32><'length' bytes>'\0'
+ * 				|	'b'<length:u32><'length' bytes>'\0'
+ *
+ * A request payload is the request tag (a string) followed by the same values
+ * the v1 request has. The response, with the request id of the request, has
+ * the same values as its v1 counterpart. Requests are self-contained, so a
+ * client may send several without waiting for their responses.
+ *
+ * The trailing '\0' of strings and blobs lets the receiver use them in place.
  */
 
 /* Serialisation Protocol constants */
@@ -103,16 +132,14 @@
 #define	TERMINATOR	'\n'
 #define SEPARATOR	':'
 
-/* Data types ... */
-
-#define	DT_INTEGER	'i'
-#define	DT_STRING	's'
-#define	DT_BLOB		'b'
+/* Longest serialised integer accepted, type and separator included */
+#define INTEGER_MAX_LENGTH	48
 
-/* Upper protocol constants */
+/* Milliseconds to wait for a non-blocking socket to accept more data */
+#define SOCKET_WRITE_TIMEOUT_MS	(SOCKET_READ_TIMEOUT_SEC * 1000)
 
-#define RESP_END_OF_MESSAGE	0
-#define RESP_ERROR			1
+/* Size of a v2 value without its payload: type and integer or length */
+#define V2_VALUE_HEADER_SIZE	5
 
 #define concat_va_list(arg) __extension__({		\
 	__typeof__(arg) *_l;				\
@@ -290,11 +317,22 @@ static int send_amt(int sock_fd, const void *buffer, size_t length)
 	ssize_t chunk_sent;
 
 	while (length > 0) {
-		chunk_sent = send(sock_fd, p, length, 0);
+		chunk_sent = send(sock_fd, p, length, MSG_NOSIGNAL);
 		if (chunk_sent <= 0) {
 			if (errno == EINTR)
 				continue;
 
+			/* Local requests sockets do not block, wait for room */
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				struct pollfd pfd = {
+					.fd = sock_fd,
+					.events = POLLOUT
+				};
+
+				if (poll(&pfd, 1, SOCKET_WRITE_TIMEOUT_MS) > 0)
+					continue;
+			}
+
 			return -1;
 		}
 
@@ -305,6 +343,237 @@ static int send_amt(int sock_fd, const void *buffer, size_t length)
 	return 0;
 }
 
+/**
+ * fd_control_t - Ancillary data to pass up to SEND_MAX_FDS file descriptors
+ */
+typedef union {
+	char buffer[CMSG_SPACE(SEND_MAX_FDS * sizeof(int))];
+	struct cmsghdr align;
+} fd_control_t;
+
+/*
+ * attach_fds() - Add file descriptors to a message
+ *
+ * @msg:		Message to send.
+ * @control:	Storage of the ancillary data of the message.
+ * @fds:		File descriptors to pass, NULL for none.
+ * @n_fds:		Number of file descriptors, up to SEND_MAX_FDS.
+ */
+static void attach_fds(struct msghdr *msg, fd_control_t *control, const int *fds,
+		unsigned int n_fds)
+{
+	struct cmsghdr *cmsg;
+
+	if (n_fds == 0)
+		return;
+
+	memset(control, 0, sizeof(*control));
+	msg->msg_control = control->buffer;
+	msg->msg_controllen = CMSG_SPACE(n_fds * sizeof(int));
+	cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(n_fds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, n_fds * sizeof(int));
+}
+
+/*
+ * skip_sent() - Advance a set of buffers past the bytes already sent
+ *
+ * @iov:	Buffers being sent, updated to the first one with pending bytes.
+ * @iovcnt:	Number of buffers, updated to the ones with pending bytes.
+ * @sent:	Number of bytes sent.
+ */
+static void skip_sent(struct iovec **iov, int *iovcnt, size_t sent)
+{
+	while (*iovcnt > 0 && sent >= (*iov)->iov_len) {
+		sent -= (*iov)->iov_len;
+		(*iov)++;
+		(*iovcnt)--;
+	}
+	if (*iovcnt > 0) {
+		(*iov)->iov_base = (char *) (*iov)->iov_base + sent;
+		(*iov)->iov_len -= sent;
+	}
+}
+
+/*
+ * send_iov() - Send a set of buffers
+ *
+ * @sock_fd:	Socket to write to.
+ * @iov:		Buffers to send, modified while sending them.
+ * @iovcnt:		Number of buffers.
+ * @fds:		File descriptors to pass along with the first byte, NULL for none.
+ * @n_fds:		Number of file descriptors, up to SEND_MAX_FDS.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int send_iov(int sock_fd, struct iovec *iov, int iovcnt, const int *fds,
+		unsigned int n_fds)
+{
+	fd_control_t control;
+
+	if (n_fds > SEND_MAX_FDS)
+		return -1;
+
+	while (iovcnt > 0) {
+		struct msghdr msg = {
+			.msg_iov = iov,
+			.msg_iovlen = iovcnt
+		};
+		ssize_t chunk_sent;
+
+		attach_fds(&msg, &control, fds, n_fds);
+		chunk_sent = sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
+		if (chunk_sent < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* Local requests sockets do not block, wait for room */
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				struct pollfd pfd = {
+					.fd = sock_fd,
+					.events = POLLOUT
+				};
+
+				if (poll(&pfd, 1, SOCKET_WRITE_TIMEOUT_MS) > 0)
+					continue;
+			}
+
+			return -1;
+		}
+
+		/* The descriptors travel with the first byte sent */
+		n_fds = 0;
+
+		skip_sent(&iov, &iovcnt, chunk_sent);
+	}
+
+	return 0;
+}
+
+/*
+ * queue_output() - Keep the bytes of a response the socket could not take
+ *
+ * @client:	The application the response is for.
+ * @iov:	Buffers not sent yet.
+ * @iovcnt:	Number of buffers.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int queue_output(service_client_t *client, const struct iovec *iov, int iovcnt)
+{
+	size_t length = client->output_length;
+	char *output;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		length += iov[i].iov_len;
+
+	output = realloc(client->output, length);
+	if (output == NULL)
+		return -1;
+
+	length = client->output_length;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(output + length, iov[i].iov_base, iov[i].iov_len);
+		length += iov[i].iov_len;
+	}
+	client->output = output;
+	client->output_length = length;
+
+	return 0;
+}
+
+/*
+ * send_client_iov() - Send a set of buffers to a local application without blocking
+ *
+ * @client:	The application.
+ * @iov:	Buffers to send, modified while sending them.
+ * @iovcnt:	Number of buffers.
+ * @fds:	File descriptors to pass along with the first byte, NULL for none.
+ * @n_fds:	Number of file descriptors, up to SEND_MAX_FDS.
+ *
+ * What the socket cannot take is queued in the client, the listening thread
+ * sends it with flush_response() once the socket has room. File descriptors
+ * travel with the first byte of their message, so they are only sent if
+ * nothing is queued before and the socket takes at least that byte.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int send_client_iov(service_client_t *client, struct iovec *iov, int iovcnt,
+		const int *fds, unsigned int n_fds)
+{
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = iovcnt
+	};
+	fd_control_t control;
+	ssize_t chunk_sent;
+
+	if (n_fds > SEND_MAX_FDS)
+		return -1;
+
+	/* Keep the order of the responses */
+	if (client->output_length > 0)
+		return n_fds > 0 ? -1 : queue_output(client, iov, iovcnt);
+
+	attach_fds(&msg, &control, fds, n_fds);
+	do {
+		chunk_sent = sendmsg(client->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	} while (chunk_sent < 0 && errno == EINTR);
+
+	if (chunk_sent < 0) {
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) || n_fds > 0)
+			return -1;
+		chunk_sent = 0;
+	}
+
+	skip_sent(&iov, &iovcnt, chunk_sent);
+	if (iovcnt == 0)
+		return 0;
+
+	return queue_output(client, iov, iovcnt);
+}
+
+/*
+ * flush_response() - Send the queued bytes of the responses to a local application
+ *
+ * @client:	The application.
+ *
+ * Return: 0 if nothing remains queued, 1 if the socket has no room for the
+ *         rest of the bytes, -1 on error.
+ */
+int flush_response(service_client_t *client)
+{
+	size_t sent = 0;
+
+	while (sent < client->output_length) {
+		ssize_t chunk_sent = send(client->fd, client->output + sent,
+				client->output_length - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (chunk_sent < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		sent += chunk_sent;
+	}
+
+	client->output_length -= sent;
+	if (client->output_length > 0) {
+		memmove(client->output, client->output + sent, client->output_length);
+		return 1;
+	}
+
+	free(client->output);
+	client->output = NULL;
+
+	return 0;
+}
+
 static int send_end_of_response(int fd)
 {
 	return write_uint32(fd, RESP_END_OF_MESSAGE);
@@ -316,11 +585,27 @@ int send_ok(int fd)
 }
 
 int send_error(int fd, const char *msg) {
+	char header[48], trailer[16];
+	struct iovec iov[3];
+	int length;
 
-	if (write_uint32(fd, RESP_ERROR) == 0 && write_blob(fd, msg, strlen(msg)) == 0) {
-		return send_end_of_response(fd);
-	}
-	return -1;
+	/* The whole error in a single write */
+	length = snprintf(header, sizeof header, "i:%u%cb:i:%zu%c",
+			RESP_ERROR, TERMINATOR, strlen(msg), TERMINATOR);
+	if (length < 0)
+		return -1;
+	iov[0].iov_base = header;
+	iov[0].iov_len = length;
+	iov[1].iov_base = (void *) msg;
+	iov[1].iov_len = strlen(msg);
+	length = snprintf(trailer, sizeof trailer, "%ci:%u%c",
+			TERMINATOR, RESP_END_OF_MESSAGE, TERMINATOR);
+	if (length < 0)
+		return -1;
+	iov[2].iov_base = trailer;
+	iov[2].iov_len = length;
+
+	return send_iov(fd, iov, ARRAY_SIZE(iov), NULL, 0);
 }
 
 int read_uint32(int fd, uint32_t * const result, struct timeval *timeout)
@@ -358,7 +643,7 @@ static int send_blob(int fd, const char *type, const void *data, size_t data_len
 	if (send_amt(fd, type, strlen(type)) > -1			/* Send the blob type */
 		&& write_uint32(fd, data_length) > -1			/* & length */
 		&& send_amt(fd, data, data_length) > -1 ) {		/* then the data */
-		return write(fd, &terminator, 1) == 1 ? 0 : -1;	/* and terminator */
+		return send_amt(fd, &terminator, 1);			/* and terminator */
 	}
 
 	return -1;
@@ -399,6 +684,102 @@ static int recv_blob(int fd, char type, void **data, size_t *data_length, struct
 	return -1;
 }
 
+/*
+ * decode_integer() - Decode a serialised integer from a buffer
+ *
+ * @buffer:	Received bytes.
+ * @length:	Number of bytes in 'buffer'.
+ * @value:	Decoded integer.
+ *
+ * Return: Number of bytes of the serialised integer, 0 if it is not complete,
+ *         -1 if the bytes are not an integer.
+ */
+static ssize_t decode_integer(const char *buffer, size_t length, uint32_t *value)
+{
+	const char *terminator;
+	char *end;
+
+	if (length >= 1 && buffer[0] != DT_INTEGER)
+		return -1;
+	if (length >= 2 && buffer[1] != SEPARATOR)
+		return -1;
+
+	terminator = length > 2 ? memchr(buffer + 2, TERMINATOR, length - 2) : NULL;
+	if (terminator == NULL)
+		return length < INTEGER_MAX_LENGTH ? 0 : -1;
+	if (terminator == buffer + 2 || terminator - buffer >= INTEGER_MAX_LENGTH)
+		return -1;
+
+	*value = (uint32_t) strtoul(buffer + 2, &end, 10);
+	if (end != terminator)
+		return -1;
+
+	return terminator - buffer + 1;
+}
+
+/*
+ * decode_value() - Decode a serialised value from the received bytes
+ *
+ * @buffer:	Received bytes, starting at the beginning of the value.
+ * @length:	Number of bytes in 'buffer'.
+ * @value:	Decoded value. The payload of strings and blobs points to
+ *			'buffer', where their terminator is replaced by a '\0'.
+ * @needed:	Number of bytes the complete value requires, if known, or
+ *			'length' + 1 otherwise. Only set if the value is not complete.
+ *
+ * This is the non-blocking counterpart of read_uint32(), read_string() and
+ * read_blob(): the caller accumulates the bytes of the socket and retries
+ * once at least 'needed' bytes are available.
+ *
+ * Return: Number of bytes of the value, 0 if it is not complete, -1 if the
+ *         bytes are not a valid serialised value.
+ */
+ssize_t decode_value(char *buffer, size_t length, service_value_t *value, size_t *needed)
+{
+	ssize_t header;
+	uint32_t data_length;
+	size_t total;
+
+	memset(value, 0, sizeof(*value));
+	*needed = length + 1;
+
+	if (length == 0)
+		return 0;
+
+	value->type = buffer[0];
+	if (value->type == DT_INTEGER)
+		return decode_integer(buffer, length, &value->integer);
+
+	if (value->type != DT_STRING && value->type != DT_BLOB)
+		return -1;
+	if (length < 2)
+		return 0;
+	if (buffer[1] != SEPARATOR)
+		return -1;
+
+	header = decode_integer(buffer + 2, length - 2, &data_length);
+	if (header <= 0)
+		return header;
+
+	/* Type and separator, length, payload and terminator */
+	total = 2 + (size_t) header + data_length + 1;
+	if (total < data_length)
+		return -1;
+	if (length < total) {
+		*needed = total;
+
+		return 0;
+	}
+	if (buffer[total - 1] != TERMINATOR)
+		return -1;
+
+	buffer[total - 1] = '\0';
+	value->data = buffer + 2 + header;
+	value->length = data_length;
+
+	return total;
+}
+
 int write_string(int fd, const char *string )
 {
 	return send_blob(fd,"s:",string,strlen(string));
@@ -418,3 +799,382 @@ int write_blob(int fd, const void *data, size_t data_length)
 {
 	return send_blob(fd, "b:", data, data_length );
 }
+
+/*
+ * put_le32() - Store a 32-bit integer in little-endian order
+ *
+ * @buffer:	Destination, at least 4 bytes.
+ * @value:	Integer to store.
+ */
+static void put_le32(uint8_t *buffer, uint32_t value)
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = (value >> 8) & 0xFF;
+	buffer[2] = (value >> 16) & 0xFF;
+	buffer[3] = (value >> 24) & 0xFF;
+}
+
+/*
+ * get_le32() - Load a 32-bit integer stored in little-endian order
+ *
+ * @buffer:	Source, at least 4 bytes.
+ *
+ * Return: The integer.
+ */
+static uint32_t get_le32(const uint8_t *buffer)
+{
+	return (uint32_t) buffer[0] | (uint32_t) buffer[1] << 8
+		| (uint32_t) buffer[2] << 16 | (uint32_t) buffer[3] << 24;
+}
+
+/*
+ * decode_v2_header() - Decode the header of a protocol v2 message
+ *
+ * @buffer:	At least V2_HEADER_SIZE received bytes.
+ * @header:	Decoded header.
+ *
+ * Return: 0 on success, -1 if the bytes are not a valid v2 header.
+ */
+int decode_v2_header(const char *buffer, v2_header_t *header)
+{
+	const uint8_t *p = (const uint8_t *) buffer;
+
+	if (p[0] != V2_MAGIC || p[1] != V2_VERSION)
+		return -1;
+
+	header->type = p[2];
+	header->request_id = get_le32(p + 4);
+	header->length = get_le32(p + 8);
+
+	return 0;
+}
+
+/*
+ * decode_v2_value() - Decode a value of the payload of a protocol v2 message
+ *
+ * @buffer:	Remaining bytes of the payload.
+ * @length:	Number of bytes in 'buffer'.
+ * @value:	Decoded value. The payload of strings and blobs points to 'buffer'.
+ *
+ * Return: Number of bytes of the value, -1 if the bytes are not a valid value.
+ */
+ssize_t decode_v2_value(char *buffer, size_t length, service_value_t *value)
+{
+	uint32_t data_length;
+
+	memset(value, 0, sizeof(*value));
+	if (length < V2_VALUE_HEADER_SIZE)
+		return -1;
+
+	value->type = buffer[0];
+	data_length = get_le32((const uint8_t *) buffer + 1);
+	if (value->type == DT_INTEGER) {
+		value->integer = data_length;
+
+		return V2_VALUE_HEADER_SIZE;
+	}
+
+	if (value->type != DT_STRING && value->type != DT_BLOB)
+		return -1;
+	if (length - V2_VALUE_HEADER_SIZE <= data_length
+		|| buffer[V2_VALUE_HEADER_SIZE + data_length] != '\0')
+		return -1;
+
+	value->data = buffer + V2_VALUE_HEADER_SIZE;
+	value->length = data_length;
+
+	return V2_VALUE_HEADER_SIZE + data_length + 1;
+}
+
+/*
+ * read_v2_message() - Receive a protocol v2 message
+ *
+ * @fd:			Socket to read from.
+ * @header:		Decoded header.
+ * @payload:	Allocated buffer with the payload, the values point to it. The
+ *				caller must free it, even on error.
+ * @message:	Decoded values.
+ * @max_length:	Largest payload accepted.
+ * @timeout:	Time to wait for the whole message, NULL to wait forever.
+ *
+ * This is the blocking counterpart of decode_v2_header() and decode_v2_value(),
+ * for clients waiting for the response of a request.
+ *
+ * Return: 0 on success, -ETIMEDOUT if the message did not arrive on time,
+ *         -1 on any other error.
+ */
+int read_v2_message(int fd, v2_header_t *header, char **payload, request_values_t *message,
+		size_t max_length, struct timeval *timeout)
+{
+	char head[V2_HEADER_SIZE];
+	size_t offset = 0;
+	int ret;
+
+	*payload = NULL;
+	message->n_values = 0;
+
+	ret = read_amt(fd, head, sizeof(head), timeout);
+	if (ret != 0)
+		return ret;
+	if (decode_v2_header(head, header) != 0 || header->length > max_length)
+		return -1;
+
+	*payload = malloc(header->length + 1);
+	if (*payload == NULL)
+		return -1;
+	ret = read_amt(fd, *payload, header->length, timeout);
+	if (ret != 0)
+		return ret;
+
+	while (offset < header->length) {
+		ssize_t length;
+
+		if (message->n_values == REQUEST_MAX_VALUES)
+			return -1;
+		length = decode_v2_value(*payload + offset, header->length - offset,
+				&message->values[message->n_values]);
+		if (length < 0)
+			return -1;
+		offset += length;
+		message->n_values++;
+	}
+
+	return 0;
+}
+
+/*
+ * write_v2_message_fds() - Send a protocol v2 message
+ *
+ * @fd:			Socket to write to.
+ * @client:		Local application whose unsent bytes are queued, NULL to wait
+ *				for room in 'fd' instead.
+ * @header:		Type and request id of the message, its length is computed.
+ * @values:		Values of the payload.
+ * @n_values:	Number of values, up to REQUEST_MAX_VALUES.
+ * @fds:		File descriptors to pass with the message, NULL for none.
+ * @n_fds:		Number of file descriptors, up to SEND_MAX_FDS.
+ *
+ * The header and the whole payload are sent with a single sendmsg().
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int write_v2_message_fds(int fd, service_client_t *client, const v2_header_t *header,
+		const service_value_t *values, unsigned int n_values, const int *fds, unsigned int n_fds)
+{
+	static const char nul = '\0';
+	uint8_t head[V2_HEADER_SIZE];
+	uint8_t value_heads[REQUEST_MAX_VALUES][V2_VALUE_HEADER_SIZE];
+	struct iovec iov[1 + 3 * REQUEST_MAX_VALUES];
+	uint32_t length = 0;
+	unsigned int i;
+	int iovcnt = 1;
+
+	if (n_values > REQUEST_MAX_VALUES)
+		return -1;
+
+	for (i = 0; i < n_values; i++) {
+		const service_value_t *value = &values[i];
+		bool is_integer = value->type == DT_INTEGER;
+
+		value_heads[i][0] = value->type;
+		put_le32(value_heads[i] + 1, is_integer ? value->integer : value->length);
+		iov[iovcnt].iov_base = value_heads[i];
+		iov[iovcnt++].iov_len = V2_VALUE_HEADER_SIZE;
+		length += V2_VALUE_HEADER_SIZE;
+		if (is_integer)
+			continue;
+
+		iov[iovcnt].iov_base = value->data;
+		iov[iovcnt++].iov_len = value->length;
+		iov[iovcnt].iov_base = (void *) &nul;
+		iov[iovcnt++].iov_len = 1;
+		length += value->length + 1;
+	}
+
+	head[0] = V2_MAGIC;
+	head[1] = V2_VERSION;
+	head[2] = header->type;
+	head[3] = 0;
+	put_le32(head + 4, header->request_id);
+	put_le32(head + 8, length);
+	iov[0].iov_base = head;
+	iov[0].iov_len = sizeof(head);
+
+	if (client != NULL)
+		return send_client_iov(client, iov, iovcnt, fds, n_fds);
+
+	return send_iov(fd, iov, iovcnt, fds, n_fds);
+}
+
+/*
+ * write_v2_message() - Send a protocol v2 message
+ *
+ * @fd:			Socket to write to.
+ * @header:		Type and request id of the message, its length is computed.
+ * @values:		Values of the payload.
+ * @n_values:	Number of values, up to REQUEST_MAX_VALUES.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int write_v2_message(int fd, const v2_header_t *header, const service_value_t *values,
+		unsigned int n_values)
+{
+	return write_v2_message_fds(fd, NULL, header, values, n_values, NULL, 0);
+}
+
+/*
+ * send_v1_values() - Send a sequence of serialised values to a local application
+ *
+ * @client:		The application.
+ * @values:		Values to send.
+ * @n_values:	Number of values, up to REQUEST_MAX_VALUES.
+ * @fds:		File descriptors to pass with the values, NULL for none.
+ * @n_fds:		Number of file descriptors, up to SEND_MAX_FDS.
+ *
+ * All the values are sent with a single sendmsg().
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+static int send_v1_values(service_client_t *client, const service_value_t *values,
+		unsigned int n_values, const int *fds, unsigned int n_fds)
+{
+	static const char terminator = TERMINATOR;
+	char heads[REQUEST_MAX_VALUES][INTEGER_MAX_LENGTH];
+	struct iovec iov[3 * REQUEST_MAX_VALUES];
+	unsigned int i;
+	int iovcnt = 0;
+
+	if (n_values > REQUEST_MAX_VALUES)
+		return -1;
+
+	for (i = 0; i < n_values; i++) {
+		const service_value_t *value = &values[i];
+		int length;
+
+		if (value->type == DT_INTEGER)
+			length = snprintf(heads[i], sizeof(heads[i]), "i:%u%c", value->integer, TERMINATOR);
+		else
+			length = snprintf(heads[i], sizeof(heads[i]), "%c:i:%zu%c", value->type, value->length, TERMINATOR);
+		if (length < 0)
+			return -1;
+
+		iov[iovcnt].iov_base = heads[i];
+		iov[iovcnt++].iov_len = length;
+		if (value->type == DT_INTEGER)
+			continue;
+
+		iov[iovcnt].iov_base = value->data;
+		iov[iovcnt++].iov_len = value->length;
+		iov[iovcnt].iov_base = (void *) &terminator;
+		iov[iovcnt++].iov_len = 1;
+	}
+
+	return send_client_iov(client, iov, iovcnt, fds, n_fds);
+}
+
+/*
+ * send_response_ok() - Report to a local application its request succeeded
+ *
+ * @client:	The application, in the protocol version it uses.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int send_response_ok(service_client_t *client)
+{
+	v2_header_t header = {
+		.type = V2_MSG_RESPONSE,
+		.request_id = client->request_id
+	};
+	service_value_t end = {
+		.type = DT_INTEGER,
+		.integer = RESP_END_OF_MESSAGE
+	};
+
+	if (client->version != V2_VERSION)
+		return send_v1_values(client, &end, 1, NULL, 0);
+
+	return write_v2_message_fds(client->fd, client, &header, &end, 1, NULL, 0);
+}
+
+/*
+ * send_response_error() - Report to a local application its request failed
+ *
+ * @client:	The application, in the protocol version it uses.
+ * @msg:	Description of the error.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int send_response_error(service_client_t *client, const char *msg)
+{
+	v2_header_t header = {
+		.type = V2_MSG_RESPONSE,
+		.request_id = client->request_id
+	};
+	service_value_t values[] = {
+		{ .type = DT_INTEGER, .integer = RESP_ERROR },
+		{ .type = DT_BLOB, .data = (char *) msg, .length = strlen(msg) },
+		{ .type = DT_INTEGER, .integer = RESP_END_OF_MESSAGE },
+	};
+
+	if (client->version != V2_VERSION)
+		return send_v1_values(client, values, ARRAY_SIZE(values), NULL, 0);
+
+	return write_v2_message_fds(client->fd, client, &header, values, ARRAY_SIZE(values), NULL, 0);
+}
+
+/*
+ * send_response_fds() - Send to a local application the result of its request
+ *			 along with some file descriptors
+ *
+ * @client:		The application, in the protocol version it uses.
+ * @values:		Values of the result.
+ * @n_values:	Number of values, up to REQUEST_MAX_VALUES - 2.
+ * @fds:		File descriptors to pass, NULL for none. They are duplicated in
+ *				the application, the caller keeps its copies.
+ * @n_fds:		Number of file descriptors, up to SEND_MAX_FDS.
+ *
+ * The values are preceded by RESP_DATA and followed by the end of message.
+ * File descriptors can only be passed over a Unix domain socket.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int send_response_fds(service_client_t *client, const service_value_t *values,
+		unsigned int n_values, const int *fds, unsigned int n_fds)
+{
+	v2_header_t header = {
+		.type = V2_MSG_RESPONSE,
+		.request_id = client->request_id
+	};
+	service_value_t message[REQUEST_MAX_VALUES];
+
+	if (n_values > REQUEST_MAX_VALUES - 2)
+		return -1;
+
+	message[0].type = DT_INTEGER;
+	message[0].integer = RESP_DATA;
+	memcpy(message + 1, values, n_values * sizeof(*values));
+	message[n_values + 1].type = DT_INTEGER;
+	message[n_values + 1].integer = RESP_END_OF_MESSAGE;
+
+	if (client->version != V2_VERSION)
+		return send_v1_values(client, message, n_values + 2, fds, n_fds);
+
+	return write_v2_message_fds(client->fd, client, &header, message, n_values + 2, fds, n_fds);
+}
+
+/*
+ * send_response_values() - Send to a local application the result of its request
+ *
+ * @client:		The application, in the protocol version it uses.
+ * @values:		Values of the result.
+ * @n_values:	Number of values, up to REQUEST_MAX_VALUES - 2.
+ *
+ * The values are preceded by RESP_DATA and followed by the end of message.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int send_response_values(service_client_t *client, const service_value_t *values,
+		unsigned int n_values)
+{
+	return send_response_fds(client, values, n_values, NULL, 0);
+}
@@ -20,6 +20,8 @@
 #ifndef SERVICES_UTIL_H
 #define SERVICES_UTIL_H
 
+#include <sys/types.h>
+
 #include "ccapi/ccapi.h"
 
 /*
@@ -31,6 +33,107 @@
 /* TODO: Move to a DAL configuration option */
 #define SOCKET_READ_TIMEOUT_SEC		75
 
+/* Data types of the serialised values */
+#define DT_INTEGER	'i'
+#define DT_STRING	's'
+#define DT_BLOB		'b'
+
+/* Response codes, the first value of every response */
+#define RESP_END_OF_MESSAGE	0
+#define RESP_ERROR			1
+#define RESP_DATA			2
+
+/* Maximum number of values of a single request */
+#define REQUEST_MAX_VALUES	8
+
+/* Maximum number of file descriptors passed in a single response */
+#define SEND_MAX_FDS		4
+
+/* Recommended size of the chunks of a chunked upload, they fit in a pooled buffer */
+#define UPLOAD_CHUNK_SIZE	(32 * 1024)
+
+/* Protocol v2 framing */
+#define V2_MAGIC			0xCC
+#define V2_VERSION			2
+#define V2_HEADER_SIZE		12
+#define V2_MSG_REQUEST		1
+#define V2_MSG_RESPONSE		2
+
+/**
+ * service_value_t - Value decoded from the stream of a local application
+ *
+ * @type:		Data type of the value (DT_INTEGER, DT_STRING or DT_BLOB).
+ * @integer:	Value of an integer.
+ * @data:		Payload of a string or a blob, always NUL-terminated. It points
+ *				to the buffer the value was decoded from.
+ * @length:		Length of the payload of a string or a blob.
+ */
+typedef struct {
+	char type;
+	uint32_t integer;
+	char *data;
+	size_t length;
+} service_value_t;
+
+/**
+ * request_values_t - Values of a request received from a local application
+ *
+ * @values:		Decoded values, in the order they were received.
+ * @n_values:	Number of decoded values.
+ */
+typedef struct {
+	service_value_t values[REQUEST_MAX_VALUES];
+	unsigned int n_values;
+} request_values_t;
+
+/**
+ * v2_header_t - Header of a protocol v2 message
+ *
+ * @type:		Message type (V2_MSG_REQUEST or V2_MSG_RESPONSE).
+ * @request_id:	Identifier of the request, chosen by the client and copied
+ *				to its response.
+ * @length:		Length of the payload following the header.
+ */
+typedef struct {
+	uint8_t type;
+	uint32_t request_id;
+	uint32_t length;
+} v2_header_t;
+
+/**
+ * service_client_t - Local application to send a response to
+ *
+ * @fd:			Socket of the application.
+ * @version:	Protocol version used by the application (1 or 2).
+ * @request_id:	Identifier of the request being attended (protocol v2).
+ * @context:		State kept by a handler between requests of the connection.
+ * @free_context:	Function to release 'context' when the connection closes.
+ * @output:		Bytes of the responses the socket could not take yet.
+ * @output_length:	Number of bytes in 'output'.
+ */
+typedef struct {
+	int fd;
+	uint8_t version;
+	uint32_t request_id;
+	void *context;
+	void (*free_context)(void *context);
+	char *output;
+	size_t output_length;
+} service_client_t;
+
+/**
+ * enum request_status_t - Status of the values received for a request
+ *
+ * @REQUEST_INCOMPLETE:	More values are required
+ * @REQUEST_COMPLETE:	The request can be attended
+ * @REQUEST_INVALID:	A value does not match the request
+ */
+typedef enum {
+	REQUEST_INCOMPLETE,
+	REQUEST_COMPLETE,
+	REQUEST_INVALID
+} request_status_t;
+
 const char *to_send_error_msg(ccapi_send_error_t error);
 
 int read_uint32(int fd, uint32_t * const ret, struct timeval *timeout);
@@ -42,7 +145,24 @@ int write_string(int fd, const char *string );
 int read_blob(int fd, void **buffer, size_t *length, struct timeval *timeout);
 int write_blob(int fd, const void *data, size_t data_length);
 
+ssize_t decode_value(char *buffer, size_t length, service_value_t *value, size_t *needed);
+
+int decode_v2_header(const char *buffer, v2_header_t *header);
+ssize_t decode_v2_value(char *buffer, size_t length, service_value_t *value);
+int write_v2_message(int fd, const v2_header_t *header, const service_value_t *values,
+		unsigned int n_values);
+int read_v2_message(int fd, v2_header_t *header, char **payload, request_values_t *message,
+		size_t max_length, struct timeval *timeout);
+
 int send_ok(int fd);
 int send_error(int fd, const char *msg);
 
+int send_response_ok(service_client_t *client);
+int send_response_error(service_client_t *client, const char *msg);
+int send_response_values(service_client_t *client, const service_value_t *values,
+		unsigned int n_values);
+int send_response_fds(service_client_t *client, const service_value_t *values,
+		unsigned int n_values, const int *fds, unsigned int n_fds);
+int flush_response(service_client_t *client);
+
 #endif
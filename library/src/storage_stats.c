@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "file_utils.h"
+#include "storage_stats.h"
+#include "string_utils.h"
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+#define FILE_DISKSTATS				"/proc/diskstats"
+
+#define DISKSTATS_BUFFER_SIZE		4096
+#define DISKSTATS_MAX_BUFFER_SIZE	(1024 * 1024)
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * disk_stats_reader - Persistent state of the reads of '/proc/diskstats'
+ *
+ * @fd:			Descriptor of '/proc/diskstats', re-read on every read.
+ * @buffer:		Buffer for the contents of the file.
+ * @size:		Size of 'buffer', it grows when the file does not fit in it.
+ * @stats:		Statistics of the block devices in the last read.
+ * @n_stats:	Number of devices in 'stats'.
+ * @capacity:	Number of elements allocated for 'stats'.
+ */
+struct disk_stats_reader {
+	int fd;
+	char *buffer;
+	long size;
+	disk_stats_t *stats;
+	int n_stats;
+	int capacity;
+};
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+static int add_disk_stats(disk_stats_reader_t *reader, const char *line);
+static uint64_t get_monotonic_ms(void);
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * disk_stats_create() - Allocate the state of the block device reads
+ *
+ * '/proc/diskstats' is opened once. If it cannot be opened, the reader is
+ * still created and every read fails.
+ *
+ * Return: The new reader, NULL if there is not enough memory.
+ */
+disk_stats_reader_t *disk_stats_create(void)
+{
+	disk_stats_reader_t *reader = calloc(1, sizeof(*reader));
+
+	if (reader == NULL)
+		return NULL;
+
+	reader->size = DISKSTATS_BUFFER_SIZE;
+	reader->buffer = malloc(reader->size);
+	if (reader->buffer == NULL) {
+		free(reader);
+		return NULL;
+	}
+
+	reader->fd = open(FILE_DISKSTATS, O_RDONLY | O_CLOEXEC);
+
+	return reader;
+}
+
+/*
+ * disk_stats_free() - Release the state of the block device reads
+ *
+ * @reader:	The reader to free.
+ */
+void disk_stats_free(disk_stats_reader_t *reader)
+{
+	if (reader == NULL)
+		return;
+
+	if (reader->fd >= 0)
+		close(reader->fd);
+	free(reader->buffer);
+	free(reader->stats);
+	free(reader);
+}
+
+/*
+ * disk_stats_read() - Read the statistics of every block device
+ *
+ * @reader:		The reader.
+ * @stats:		The statistics of the devices, valid until the next read.
+ * @n_stats:	Number of devices in 'stats'.
+ * @time_ms:	CLOCK_MONOTONIC time of the read, in milliseconds.
+ *
+ * The file is re-read into the same buffer, which doubles up to
+ * DISKSTATS_MAX_BUFFER_SIZE while the file does not fit in it.
+ *
+ * Return: 0 on success, -1 otherwise.
+ */
+int disk_stats_read(disk_stats_reader_t *reader, const disk_stats_t **stats,
+		int *n_stats, uint64_t *time_ms)
+{
+	const char *line;
+	long len;
+
+	for (;;) {
+		char *tmp;
+
+		len = pread_file(reader->fd, reader->buffer, reader->size);
+		if (len < 0)
+			return -1;
+		if (len < reader->size - 1 || reader->size >= DISKSTATS_MAX_BUFFER_SIZE)
+			break;
+
+		tmp = realloc(reader->buffer, reader->size * 2);
+		if (tmp == NULL)
+			break;
+		reader->buffer = tmp;
+		reader->size *= 2;
+	}
+	*time_ms = get_monotonic_ms();
+
+	reader->n_stats = 0;
+	for (line = reader->buffer; *line != '\0'; line = skip_line(line)) {
+		if (add_disk_stats(reader, line) != 0)
+			break;
+	}
+
+	*stats = reader->stats;
+	*n_stats = reader->n_stats;
+
+	return 0;
+}
+
+/*
+ * fs_usage_read() - Read the space of a filesystem
+ *
+ * @path:	A path in the filesystem.
+ * @usage:	The used and available space.
+ *
+ * Same as 'df', the space reserved for root is neither used nor available.
+ *
+ * Return: 0 on success, -1 otherwise with errno set.
+ */
+int fs_usage_read(const char *path, fs_usage_t *usage)
+{
+	struct statvfs st;
+
+	if (statvfs(path, &st) != 0)
+		return -1;
+
+	usage->used = (uint64_t) (st.f_blocks - st.f_bfree) * st.f_frsize / 1024;
+	usage->available = (uint64_t) st.f_bavail * st.f_frsize / 1024;
+
+	return 0;
+}
+
+/*
+ * add_disk_stats() - Parse a line of '/proc/diskstats' into the reader
+ *
+ * @reader:	The reader.
+ * @line:	The line to parse.
+ *
+ * Malformed lines and devices with a too long name are skipped.
+ *
+ * Return: 0 on success, -1 if there is not enough memory.
+ */
+static int add_disk_stats(disk_stats_reader_t *reader, const char *line)
+{
+	/*
+	 * major minor name reads reads_merged read_sectors read_ms writes
+	 * writes_merged write_sectors write_ms ios_in_progress io_ms ...
+	 */
+	uint64_t fields[11];
+	disk_stats_t *stats;
+	const char *p, *name;
+	size_t name_len;
+	int i;
+
+	p = scan_uint64(line, &fields[0]);
+	if (p != NULL)
+		p = scan_uint64(p, &fields[1]);
+	if (p == NULL)
+		return 0;
+	name = skip_blanks(p);
+	name_len = strcspn(name, " \t\n");
+	if (name_len == 0 || name_len >= DISK_NAME_SIZE)
+		return 0;
+	p = name + name_len;
+	for (i = 0; i < 11 && p != NULL; i++)
+		p = scan_uint64(p, &fields[i]);
+	if (p == NULL)
+		return 0;
+
+	if (reader->n_stats == reader->capacity) {
+		int capacity = reader->capacity > 0 ? reader->capacity * 2 : 8;
+		disk_stats_t *tmp = realloc(reader->stats, capacity * sizeof(disk_stats_t));
+
+		if (tmp == NULL)
+			return -1;
+		reader->stats = tmp;
+		reader->capacity = capacity;
+	}
+
+	stats = &reader->stats[reader->n_stats++];
+	memcpy(stats->name, name, name_len);
+	stats->name[name_len] = '\0';
+	stats->ios = fields[0] + fields[4];
+	stats->read_sectors = fields[2];
+	stats->write_sectors = fields[6];
+	stats->io_ticks = fields[9];
+
+	return 0;
+}
+
+/*
+ * get_monotonic_ms() - Get the CLOCK_MONOTONIC time in milliseconds
+ *
+ * Return: The time in milliseconds.
+ */
+static uint64_t get_monotonic_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / (1000 * 1000);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef STORAGE_STATS_H_
+#define STORAGE_STATS_H_
+
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+                             D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/* Maximum length of a block device name, including the null character. */
+#define DISK_NAME_SIZE			32
+
+/* Size of the sectors counted in '/proc/diskstats', whatever the device. */
+#define DISK_SECTOR_SIZE		512
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * disk_stats_t - Statistics of a block device read from '/proc/diskstats'
+ *
+ * @name:			Device name.
+ * @ios:			Completed reads and writes.
+ * @read_sectors:	Read sectors.
+ * @write_sectors:	Written sectors.
+ * @io_ticks:		Milliseconds spent doing I/O.
+ */
+typedef struct {
+	char name[DISK_NAME_SIZE];
+	uint64_t ios;
+	uint64_t read_sectors;
+	uint64_t write_sectors;
+	uint64_t io_ticks;
+} disk_stats_t;
+
+/**
+ * fs_usage_t - Space of a filesystem, in kB
+ *
+ * @used:		Used space.
+ * @available:	Space available to unprivileged users.
+ */
+typedef struct {
+	uint64_t used;
+	uint64_t available;
+} fs_usage_t;
+
+typedef struct disk_stats_reader disk_stats_reader_t;
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+disk_stats_reader_t *disk_stats_create(void);
+void disk_stats_free(disk_stats_reader_t *reader);
+int disk_stats_read(disk_stats_reader_t *reader, const disk_stats_t **stats,
+		int *n_stats, uint64_t *time_ms);
+int fs_usage_read(const char *path, fs_usage_t *usage);
+
+#endif /* STORAGE_STATS_H_ */
@@ -18,6 +18,7 @@
  */
 
 #include <ctype.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -149,3 +150,91 @@ char *delete_newline_character(char *str)
 
 	return str;
 }
+
+/*
+ * skip_blanks() - Skip the spaces and tabs at the beginning of a string.
+ *
+ * @str:	String to skip blanks from.
+ *
+ * Return: Pointer to the first character that is not a space nor a tab.
+ */
+const char *skip_blanks(const char *str)
+{
+	while (*str == ' ' || *str == '\t')
+		str++;
+
+	return str;
+}
+
+/*
+ * skip_line() - Skip the current line of a string.
+ *
+ * @str:	String to skip the line from.
+ *
+ * Return: Pointer to the beginning of the next line, or to the null
+ *         terminator if there are no more lines.
+ */
+const char *skip_line(const char *str)
+{
+	while (*str != '\0' && *str != '\n')
+		str++;
+
+	return *str == '\n' ? str + 1 : str;
+}
+
+/*
+ * scan_uint64() - Parse an unsigned decimal number from a string.
+ *
+ * @str:	String to parse, leading spaces and tabs are skipped.
+ * @value:	The parsed value.
+ *
+ * This is a lightweight replacement of sscanf() for the hot paths parsing
+ * '/proc' and '/sys' files: it neither allocates nor handles locales.
+ *
+ * Return: Pointer to the first character after the number, NULL if the
+ *         string does not start with a number.
+ */
+const char *scan_uint64(const char *str, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	str = skip_blanks(str);
+	if (*str < '0' || *str > '9')
+		return NULL;
+
+	while (*str >= '0' && *str <= '9')
+		result = result * 10 + (uint64_t) (*str++ - '0');
+
+	*value = result;
+
+	return str;
+}
+
+/*
+ * scan_int64() - Parse a signed decimal number from a string.
+ *
+ * @str:	String to parse, leading spaces and tabs are skipped.
+ * @value:	The parsed value.
+ *
+ * Return: Pointer to the first character after the number, NULL if the
+ *         string does not start with a number.
+ */
+const char *scan_int64(const char *str, int64_t *value)
+{
+	bool negative = false;
+	uint64_t result;
+
+	str = skip_blanks(str);
+	if (*str == '-' || *str == '+') {
+		negative = *str == '-';
+		str++;
+	}
+
+	str = scan_uint64(str, &result);
+	if (str == NULL)
+		return NULL;
+
+	*value = negative ? -(int64_t) result : (int64_t) result;
+
+	return str;
+}
@@ -20,10 +20,16 @@
 #ifndef STRING_UTILS_H
 #define STRING_UTILS_H
 
+#include <stdint.h>
+
 char *delete_quotes(char *str);
 char *delete_leading_spaces(char *str);
 char *delete_trailing_spaces(char *str);
 char *trim(char *str);
 char *delete_newline_character(char *str);
+const char *skip_blanks(const char *str);
+const char *skip_line(const char *str);
+const char *scan_uint64(const char *str, uint64_t *value);
+const char *scan_int64(const char *str, int64_t *value);
 
 #endif
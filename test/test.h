@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+/*------------------------------------------------------------------------------
+                                  M A C R O S
+------------------------------------------------------------------------------*/
+/**
+ * check() - Report a failed condition of a test
+ *
+ * @cond:	Condition that must be true.
+ * @msg:	Description of the condition.
+ *
+ * The failures are counted in 'test_failures', the test program returns it.
+ */
+#define check(cond, msg)											\
+	do {															\
+		if (!(cond)) {												\
+			fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, msg);	\
+			test_failures++;										\
+		}															\
+	} while (0)
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static unsigned int test_failures = 0;
+
+#endif /* TEST_H_ */
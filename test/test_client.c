@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cc_client.h"
+#include "service_dp_upload.h"
+#include "services_util.h"
+#include "test.h"
+
+/*------------------------------------------------------------------------------
+                                  M A C R O S
+------------------------------------------------------------------------------*/
+/* Large enough to fill the socket buffers with unread responses */
+#define TEST_UPLOAD_SIZE	(16 * 1024 * 1024)
+#define TEST_TIMEOUT		30
+
+/*------------------------------------------------------------------------------
+                 D A T A    T Y P E S    D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/**
+ * fake_server_t - Cloud Connector answering the uploads of the test
+ *
+ * @listen_fd:		Listening Unix domain socket.
+ * @idle_timeout:	Close the next connection as if it was idle too long.
+ * @n_requests:		Requests received.
+ * @received:		Bytes of the chunks received.
+ * @completed:		Whether the empty chunk completing the upload was received.
+ */
+typedef struct {
+	int listen_fd;
+	bool idle_timeout;
+	unsigned int n_requests;
+	size_t received;
+	bool completed;
+} fake_server_t;
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * time_out_connection() - Close a connection as Cloud Connector does when it is idle
+ *
+ * @fd:	The connection.
+ *
+ * The unsolicited "Timeout" response is sent once the client wrote its
+ * request, which is never read.
+ */
+static void time_out_connection(int fd)
+{
+	service_value_t error[2] = {
+		{ .type = DT_INTEGER, .integer = RESP_ERROR },
+		{ .type = DT_STRING, .data = "Timeout", .length = strlen("Timeout") }
+	};
+	v2_header_t header = { .type = V2_MSG_RESPONSE };
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	if (poll(&pfd, 1, TEST_TIMEOUT * 1000) == 1)
+		write_v2_message(fd, &header, error, 2);
+	close(fd);
+}
+
+/*
+ * serve_connection() - Answer the requests of a connection, in order
+ *
+ * @server:	The fake server.
+ * @fd:		The connection.
+ *
+ * As Cloud Connector does, the next request is not read until the response
+ * of the previous one is written.
+ */
+static void serve_connection(fake_server_t *server, int fd)
+{
+	for (;;) {
+		struct timeval timeout = { .tv_sec = TEST_TIMEOUT };
+		service_value_t ok = { .type = DT_INTEGER, .integer = RESP_END_OF_MESSAGE };
+		request_values_t request;
+		v2_header_t header;
+		char *payload;
+
+		if (read_v2_message(fd, &header, &payload, &request, 2 * UPLOAD_CHUNK_SIZE, &timeout) != 0) {
+			free(payload);
+			break;
+		}
+		server->n_requests++;
+		if (request.n_values == 3) {
+			server->received += request.values[2].length;
+			if (request.values[2].length == 0)
+				server->completed = true;
+		}
+		free(payload);
+
+		header.type = V2_MSG_RESPONSE;
+		if (write_v2_message(fd, &header, &ok, 1) != 0)
+			break;
+	}
+
+	close(fd);
+}
+
+/*
+ * serve_threaded() - Attend the connections of the fake server until it is shut down
+ *
+ * @arg:	The fake_server_t.
+ *
+ * Return: NULL.
+ */
+static void *serve_threaded(void *arg)
+{
+	fake_server_t *server = arg;
+	int fd;
+
+	while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0) {
+		if (server->idle_timeout) {
+			server->idle_timeout = false;
+			time_out_connection(fd);
+		} else {
+			serve_connection(server, fd);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * reset_server() - Clear the counters of the fake server
+ *
+ * @server:	The fake server.
+ */
+static void reset_server(fake_server_t *server)
+{
+	server->n_requests = 0;
+	server->received = 0;
+	server->completed = false;
+}
+
+/*
+ * test_large_upload() - Check a large upload completes through the client library
+ *
+ * @socket_path:	Socket of the fake server.
+ * @server:			The fake server.
+ *
+ * Each chunk of the upload gets a response, so a client that sends all of
+ * them before reading any response blocks with the server.
+ */
+static void test_large_upload(const char *socket_path, fake_server_t *server)
+{
+	cc_client_t *client = cc_client_open(socket_path);
+	char *data = malloc(TEST_UPLOAD_SIZE);
+
+	reset_server(server);
+	check(client != NULL && data != NULL, "client created");
+	if (client == NULL || data == NULL)
+		goto done;
+
+	memset(data, 'x', TEST_UPLOAD_SIZE);
+	cc_client_set_timeout(client, TEST_TIMEOUT);
+	check(cc_client_upload_datapoints(client, CC_CLIENT_DP_METRICS, data, TEST_UPLOAD_SIZE) == 0,
+			"large upload succeeded");
+
+done:
+	cc_client_close(client);
+	free(data);
+
+	check(server->completed, "upload completed");
+	check(server->received == TEST_UPLOAD_SIZE, "every chunk received");
+	check(server->n_requests == TEST_UPLOAD_SIZE / UPLOAD_CHUNK_SIZE + 1, "one request per chunk");
+}
+
+/*
+ * test_idle_timeout() - Check a request is sent again if the idle connection times out
+ *
+ * @socket_path:	Socket of the fake server.
+ * @server:			The fake server.
+ *
+ * Cloud Connector may close an idle connection right after the client sent
+ * a request, answering an unsolicited "Timeout" response instead.
+ */
+static void test_idle_timeout(const char *socket_path, fake_server_t *server)
+{
+	cc_client_t *client = cc_client_open(socket_path);
+	static const char data[] = "sensor,1.5\n";
+
+	reset_server(server);
+	server->idle_timeout = true;
+	check(client != NULL, "client created");
+	if (client == NULL)
+		return;
+
+	cc_client_set_timeout(client, TEST_TIMEOUT);
+	check(cc_client_upload_datapoints(client, CC_CLIENT_DP_METRICS, data, strlen(data)) == 0,
+			"upload sent again after the idle timeout");
+	cc_client_close(client);
+
+	check(server->n_requests == 1, "upload received once");
+	check(server->received == strlen(data), "upload data received");
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/test_client.XXXXXX";
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	fake_server_t server = { .listen_fd = -1 };
+	pthread_t thread;
+
+	/* A blocked client fails the test instead of hanging it */
+	alarm(2 * TEST_TIMEOUT);
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/sock", dir);
+
+	server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (server.listen_fd < 0
+		|| bind(server.listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+		|| listen(server.listen_fd, 1) != 0
+		|| pthread_create(&thread, NULL, serve_threaded, &server) != 0) {
+		perror("fake server");
+		return EXIT_FAILURE;
+	}
+
+	test_large_upload(addr.sun_path, &server);
+	test_idle_timeout(addr.sun_path, &server);
+
+	shutdown(server.listen_fd, SHUT_RDWR);
+	pthread_join(thread, NULL);
+	close(server.listen_fd);
+	unlink(addr.sun_path);
+	rmdir(dir);
+
+	printf("%s: %s\n", "test_client", test_failures ? "FAIL" : "PASS");
+
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2022 Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Digi International Inc., 9350 Excelsior Blvd., Suite 700, Hopkins, MN 55343
+ * ===========================================================================
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ccapi/ccapi.h"
+#include "cc_init.h"
+#include "cc_logging.h"
+#include "cc_spool.h"
+#include "test.h"
+
+/*------------------------------------------------------------------------------
+                                  M A C R O S
+------------------------------------------------------------------------------*/
+#define TEST_CLOUD_PATH		"DataPoint/test.csv"
+#define TEST_DATA			"sensor,1.5\n"
+
+#define TEST_MAX_SIZE		64
+#define TEST_SEGMENT_SIZE	16
+#define TEST_SYNC_RECORDS	16
+#define TEST_WAIT_MS		15000
+
+/*------------------------------------------------------------------------------
+                    F U N C T I O N  D E C L A R A T I O N S
+------------------------------------------------------------------------------*/
+int __real_fdatasync(int fd);
+int __wrap_fdatasync(int fd);
+
+/*------------------------------------------------------------------------------
+                         G L O B A L  V A R I A B L E S
+------------------------------------------------------------------------------*/
+static unsigned int n_syncs = 0;
+static bool connected = false;
+static ccapi_send_error_t send_result = CCAPI_SEND_ERROR_NONE;
+
+/*------------------------------------------------------------------------------
+                     F U N C T I O N  D E F I N I T I O N S
+------------------------------------------------------------------------------*/
+/*
+ * __wrap_fdatasync() - Count the flushes of the spool segments
+ */
+int __wrap_fdatasync(int fd)
+{
+	__atomic_add_fetch(&n_syncs, 1, __ATOMIC_SEQ_CST);
+
+	return __real_fdatasync(fd);
+}
+
+/*
+ * get_cloud_connection_status() - Report the connection set by the test
+ *
+ * While disconnected nothing is replayed, so the records stay in the spool.
+ */
+cc_status_t get_cloud_connection_status(void)
+{
+	return __atomic_load_n(&connected, __ATOMIC_SEQ_CST) ? CC_STATUS_CONNECTED : CC_STATUS_DISCONNECTED;
+}
+
+/*
+ * ccapi_send_data_with_reply() - Answer the replayed uploads with the result set by the test
+ */
+
+ccapi_send_error_t ccapi_send_data_with_reply(ccapi_transport_t const transport,
+		char const * const cloud_path, char const * const content_type,
+		void const * const data, size_t const bytes,
+		ccapi_send_behavior_t const behavior, unsigned long const timeout,
+		ccapi_string_info_t * const hint)
+{
+	UNUSED_ARGUMENT(transport);
+	UNUSED_ARGUMENT(cloud_path);
+	UNUSED_ARGUMENT(content_type);
+	UNUSED_ARGUMENT(data);
+	UNUSED_ARGUMENT(bytes);
+	UNUSED_ARGUMENT(behavior);
+	UNUSED_ARGUMENT(timeout);
+	UNUSED_ARGUMENT(hint);
+
+	if (!__atomic_load_n(&connected, __ATOMIC_SEQ_CST))
+		return CCAPI_SEND_ERROR_CCAPI_NOT_RUNNING;
+
+	return __atomic_load_n(&send_result, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * wait_status() - Wait for a stored record to leave the spool
+ *
+ * @position:	Position after the record.
+ *
+ * Return: The status of the record, SPOOL_STATUS_PENDING if it is still
+ *         stored after TEST_WAIT_MS.
+ */
+static spool_status_t wait_status(const spool_position_t *position)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+	spool_status_t status;
+	int i;
+
+	for (i = 0; i < TEST_WAIT_MS / 10; i++) {
+		status = get_spool_status(position);
+		if (status != SPOOL_STATUS_PENDING)
+			break;
+		nanosleep(&delay, NULL);
+	}
+
+	return status;
+}
+
+/*
+ * test_tracked_sync() - Check tracked records are flushed before returning
+ *
+ * The position of a tracked record is the receipt acknowledged to the
+ * application, so the record must be on disk when spool_data_tracked()
+ * returns. Untracked records are flushed in batches.
+ */
+static void test_tracked_sync(void)
+{
+	spool_position_t position;
+	unsigned int syncs;
+
+	syncs = __atomic_load_n(&n_syncs, __ATOMIC_SEQ_CST);
+	check(spool_data(SPOOL_RECORD_DP_CSV, TEST_CLOUD_PATH, TEST_DATA, strlen(TEST_DATA)) == SPOOL_ERROR_NONE,
+			"untracked record stored");
+	check(__atomic_load_n(&n_syncs, __ATOMIC_SEQ_CST) == syncs,
+			"untracked record waits for the batched flush");
+
+	syncs = __atomic_load_n(&n_syncs, __ATOMIC_SEQ_CST);
+	check(spool_data_tracked(SPOOL_RECORD_DP_CSV, TEST_CLOUD_PATH, TEST_DATA, strlen(TEST_DATA),
+			&position) == SPOOL_ERROR_NONE, "tracked record stored");
+	check(__atomic_load_n(&n_syncs, __ATOMIC_SEQ_CST) > syncs,
+			"tracked record flushed before its position is returned");
+	check(get_spool_status(&position) == SPOOL_STATUS_PENDING, "tracked record pending while disconnected");
+}
+
+/*
+ * test_discarded_status() - Check discarded records are not reported as uploaded
+ *
+ * Records rejected by Remote Manager leave the spool, but their status must
+ * tell they were lost.
+ */
+static void test_discarded_status(void)
+{
+	spool_position_t rejected, uploaded;
+
+	__atomic_store_n(&send_result, CCAPI_SEND_ERROR_RESPONSE_BAD_REQUEST, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&connected, true, __ATOMIC_SEQ_CST);
+	check(spool_data_tracked(SPOOL_RECORD_DP_CSV, TEST_CLOUD_PATH, TEST_DATA, strlen(TEST_DATA),
+			&rejected) == SPOOL_ERROR_NONE, "rejected record stored");
+	check(wait_status(&rejected) == SPOOL_STATUS_DISCARDED, "rejected record reported as discarded");
+
+	__atomic_store_n(&send_result, CCAPI_SEND_ERROR_NONE, __ATOMIC_SEQ_CST);
+	check(spool_data_tracked(SPOOL_RECORD_DP_CSV, TEST_CLOUD_PATH, TEST_DATA, strlen(TEST_DATA),
+			&uploaded) == SPOOL_ERROR_NONE, "uploaded record stored");
+	check(wait_status(&uploaded) == SPOOL_STATUS_UPLOADED, "uploaded record reported as uploaded");
+	check(get_spool_status(&rejected) == SPOOL_STATUS_DISCARDED, "rejected record still reported as discarded");
+}
+
+/*
+ * test_full_status() - Check records dropped when the spool is full are discarded
+ */
+static void test_full_status(void)
+{
+	spool_position_t dropped, kept;
+	char data[1024];
+	int i;
+
+	__atomic_store_n(&connected, false, __ATOMIC_SEQ_CST);
+	memset(data, 'x', sizeof(data));
+
+	check(spool_data_tracked(SPOOL_RECORD_FILE, TEST_CLOUD_PATH, data, sizeof(data),
+			&dropped) == SPOOL_ERROR_NONE, "dropped record stored");
+	for (i = 0; i < 2 * TEST_MAX_SIZE; i++)
+		spool_data(SPOOL_RECORD_FILE, TEST_CLOUD_PATH, data, sizeof(data));
+	check(spool_data_tracked(SPOOL_RECORD_FILE, TEST_CLOUD_PATH, data, sizeof(data),
+			&kept) == SPOOL_ERROR_NONE, "kept record stored");
+
+	check(get_spool_status(&dropped) == SPOOL_STATUS_DISCARDED, "dropped record reported as discarded");
+	check(get_spool_status(&kept) == SPOOL_STATUS_PENDING, "kept record pending");
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/test_spool.XXXXXX";
+	char cmd[64];
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	if (start_spool(dir, TEST_MAX_SIZE, TEST_SEGMENT_SIZE, TEST_SYNC_RECORDS) != 0) {
+		fprintf(stderr, "Cannot start the spool in '%s'\n", dir);
+		return EXIT_FAILURE;
+	}
+
+	test_tracked_sync();
+	test_discarded_status();
+	test_full_status();
+
+	stop_spool();
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	if (system(cmd) != 0)
+		fprintf(stderr, "Cannot remove '%s'\n", dir);
+
+	printf("%s: %s\n", "test_spool", test_failures ? "FAIL" : "PASS");
+
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}